@@ -1,6 +1,7 @@
 #include "DdsFile.h"
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 using namespace dds;
@@ -113,34 +114,165 @@ struct DdsHeader
     std::uint32_t reserved2;// unused
 };
 
+struct DdsHeaderDx10
+{
+    std::uint32_t dxgiFormat;       // DXGI_FORMAT
+    std::uint32_t resourceDimension;// D3D10_RESOURCE_DIMENSION, 3 for a 2D texture
+    std::uint32_t miscFlag;         // 0x4 for a cube map
+    std::uint32_t arraySize;
+    std::uint32_t miscFlags2;
+};
 
-#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
-#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
-#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
-#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+enum DXGI_FORMAT
+{
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+    DXGI_FORMAT_R8G8_UNORM = 49,
+    DXGI_FORMAT_R8_UNORM = 61,
+    DXGI_FORMAT_A8_UNORM = 65,
+    DXGI_FORMAT_BC1_UNORM = 71,
+    DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+    DXGI_FORMAT_BC2_UNORM = 74,
+    DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+    DXGI_FORMAT_BC3_UNORM = 77,
+    DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+    DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+    DXGI_FORMAT_B8G8R8X8_UNORM = 88,
+    DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+    DXGI_FORMAT_B8G8R8X8_UNORM_SRGB = 93
+};
 
-DdsFile::DdsFile(void *data, std::size_t dataSize):
-    m_dataSize(dataSize),
-    m_dataFormat(0u),
-    m_dataType(0u),
-    m_bytesPerPixel(0u)
+
+struct FormatInfo
+{
+    Format format;
+    const char *name;
+    GLenum glDataFormat;
+    GLenum glDataType;
+    std::uint16_t blockDim;
+    std::uint16_t blockBytes;
+};
+
+static const FormatInfo formatInfos[] =
+{
+    { FORMAT_UNKNOWN, "unknown", 0u, 0u, 1u, 0u },
+    { FORMAT_DXT1, "DXT1", GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0u, 4u, 8u },
+    { FORMAT_DXT3, "DXT3", GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0u, 4u, 16u },
+    { FORMAT_DXT5, "DXT5", GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0u, 4u, 16u },
+    { FORMAT_BGRA8, "BGRA8", GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 1u, 4u },
+    { FORMAT_BGRX8, "BGRX8", GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 1u, 4u },
+    { FORMAT_RGBA8, "RGBA8", GL_RGBA, GL_UNSIGNED_BYTE, 1u, 4u },
+    { FORMAT_BGR8, "BGR8", GL_BGR, GL_UNSIGNED_BYTE, 1u, 3u },
+    { FORMAT_RG8, "RG8", GL_RG, GL_UNSIGNED_BYTE, 1u, 2u },
+    { FORMAT_R8, "R8", GL_RED, GL_UNSIGNED_BYTE, 1u, 1u },
+    { FORMAT_A8, "A8", GL_ALPHA, GL_UNSIGNED_BYTE, 1u, 1u }
+};
+
+
+static Format fourCCFormat(std::uint32_t fourCC)
 {
-    init(data, dataSize);
-    m_mutableData = const_cast<void*>(m_data);
+    const char *cc = (const char*)&fourCC;
+    if (!strncmp(cc, "DXT1", 4))
+    {
+        return FORMAT_DXT1;
+    }
+    else if (!strncmp(cc, "DXT2", 4) || !strncmp(cc, "DXT3", 4))
+    {
+        return FORMAT_DXT3;
+    }
+    else if (!strncmp(cc, "DXT4", 4) || !strncmp(cc, "DXT5", 4))
+    {
+        return FORMAT_DXT5;
+    }
+    return FORMAT_UNKNOWN;
 }
 
-DdsFile::DdsFile(const void *data, std::size_t dataSize) :
-m_dataSize(dataSize),
-m_dataFormat(0u),
-m_dataType(0u),
-m_bytesPerPixel(0u)
+
+static Format dxgiFormat(std::uint32_t dxgi)
 {
-    init(data, dataSize);
-    m_mutableData = NULL;
+    switch (dxgi)
+    {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+        return FORMAT_DXT1;
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+        return FORMAT_DXT3;
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+        return FORMAT_DXT5;
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+        return FORMAT_BGRA8;
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        return FORMAT_BGRX8;
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+        return FORMAT_RGBA8;
+    case DXGI_FORMAT_R8G8_UNORM:
+        return FORMAT_RG8;
+    case DXGI_FORMAT_R8_UNORM:
+        return FORMAT_R8;
+    case DXGI_FORMAT_A8_UNORM:
+        return FORMAT_A8;
+    default:
+        return FORMAT_UNKNOWN;
+    }
 }
 
 
-void DdsFile::init(const void *data, std::size_t dataSize)
+// uncompressed formats are identified by bit count and channel masks
+static Format maskFormat(const DdsPixelFormat &fmt)
+{
+    bool alpha = (fmt.flags & (DDPF_ALPHAPIXELS | DDPF_ALPHA)) != 0u;
+    switch (fmt.rgbBitCount)
+    {
+    case 32:
+        if (fmt.rBitMask == 0xff0000 && fmt.gBitMask == 0xff00 && fmt.bBitMask == 0xff)
+        {
+            return alpha && fmt.aBitMask == 0xff000000 ? FORMAT_BGRA8 : FORMAT_BGRX8;
+        }
+        if (fmt.rBitMask == 0xff && fmt.gBitMask == 0xff00 && fmt.bBitMask == 0xff0000)
+        {
+            return FORMAT_RGBA8;
+        }
+        break;
+    case 24:
+        if (fmt.rBitMask == 0xff0000 && fmt.gBitMask == 0xff00 && fmt.bBitMask == 0xff)
+        {
+            return FORMAT_BGR8;
+        }
+        break;
+    case 16:
+        // RG8, or luminance + alpha which is stored the same way
+        if (fmt.rBitMask == 0xff && (fmt.gBitMask == 0xff00 || (alpha && fmt.aBitMask == 0xff00)))
+        {
+            return FORMAT_RG8;
+        }
+        break;
+    case 8:
+        if ((fmt.flags & DDPF_ALPHA) && fmt.aBitMask == 0xff)
+        {
+            return FORMAT_A8;
+        }
+        if (fmt.rBitMask == 0xff)
+        {
+            return FORMAT_R8;
+        }
+        break;
+    }
+    return FORMAT_UNKNOWN;
+}
+
+
+const char *dds::formatName(Format format)
+{
+    return formatInfos[format].name;
+}
+
+
+DdsTexture DdsTexture::parse(const void *data, std::size_t dataSize)
 {
     if (dataSize < 4u + sizeof(DdsHeader))
     {
@@ -151,97 +283,160 @@ void DdsFile::init(const void *data, std::size_t dataSize)
     {
         throw std::runtime_error("DdsFile: not a dds file!");
     }
-    m_data = (const void*)((const char*)data + 4u);
 
-    const DdsHeader *header = (const DdsHeader*)m_data;
+    const DdsHeader *header = (const DdsHeader*)((const char*)data + 4u);
     if (header->size != sizeof(DdsHeader))
     {
         throw std::runtime_error("DdsFile: unexpected DdsHeader.size!");
     }
-
-    if(header->format.size != sizeof(DdsPixelFormat))
+    if (header->format.size != sizeof(DdsPixelFormat))
     {
         throw std::runtime_error("DdsFile: unexpected DdsPixelFormat.size!");
     }
-    else
+    if (header->caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))
     {
-        const DdsPixelFormat &fmt = header->format;
-        if (header->flags & DDPF_FOURCC && header->format.fourCC)
-        {
-            if (!strncmp((const char*)&fmt.fourCC, "DXT1", 4))
-            {
-                m_dataFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
-            }
-            else if (!strncmp((const char*)&fmt.fourCC, "DXT3", 4))
-            {
-                m_dataFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-            }
-            else if (!strncmp((const char*)&fmt.fourCC, "DXT5", 5))
-            {
-                m_dataFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-            }
-            else
-            {
-                throw std::runtime_error("DdsFile: unsupported FOURCC dds format!");
-            }
-
-            m_bytesPerPixel = (dataSize - header->size - 4) / header->width / header->height;
-            if (m_bytesPerPixel * header->width * header->height + header->size + 4 != dataSize)
-            {
-                throw std::runtime_error("DdsFile: unable to ascertain pixel format");
-            }
-        }
-        else if (fmt.rgbBitCount == 32 && fmt.aBitMask == 0xff000000 && fmt.rBitMask == 0xff0000 && fmt.gBitMask == 0xff00 && fmt.bBitMask == 0xff)
+        throw std::runtime_error("DdsFile: cube maps and volume textures are not supported!");
+    }
+
+    DdsTexture result;
+    result.headerBytes = 4u + sizeof(DdsHeader);
+
+    const DdsPixelFormat &fmt = header->format;
+    if ((fmt.flags & DDPF_FOURCC) && !strncmp((const char*)&fmt.fourCC, "DX10", 4))
+    {
+        if (dataSize < 4u + sizeof(DdsHeader) + sizeof(DdsHeaderDx10))
         {
-            m_bytesPerPixel = 4;
-            m_dataFormat = GL_BGRA;
-            m_dataType = GL_UNSIGNED_INT_8_8_8_8_REV;
+            throw std::runtime_error("DdsFile: data file not large enough to container a DX10 header!");
         }
-        else if (fmt.rgbBitCount == 24 && fmt.rBitMask == 0xff0000 && fmt.gBitMask == 0xff00 && fmt.bBitMask == 0xff)
+        const DdsHeaderDx10 *dx10 = (const DdsHeaderDx10*)(header + 1);
+        if (dx10->arraySize > 1u || (dx10->miscFlag & 0x4))
         {
-            m_bytesPerPixel = 3;
-            m_dataFormat = GL_BGR;
-            m_dataType = GL_UNSIGNED_BYTE;
+            throw std::runtime_error("DdsFile: texture arrays and cube maps are not supported!");
         }
-        else
+        result.format = dxgiFormat(dx10->dxgiFormat);
+        result.headerBytes += sizeof(DdsHeaderDx10);
+    }
+    else if ((fmt.flags & DDPF_FOURCC) && fmt.fourCC)
+    {
+        result.format = fourCCFormat(fmt.fourCC);
+    }
+    else
+    {
+        result.format = maskFormat(fmt);
+    }
+
+    if (result.format == FORMAT_UNKNOWN)
+    {
+        throw std::runtime_error("DdsFile: unsupported dds format!");
+    }
+
+    const FormatInfo &info = formatInfos[result.format];
+    result.glDataFormat = info.glDataFormat;
+    result.glDataType = info.glDataType;
+    result.blockDim = info.blockDim;
+    result.blockBytes = info.blockBytes;
+    result.width = header->width;
+    result.height = header->height;
+    if (result.width == 0u || result.height == 0u)
+    {
+        throw std::runtime_error("DdsFile: zero sized image!");
+    }
+
+    // some writers leave mipMapCount set without the flag, or the flag set with a count of 0: trust the count.
+    // never more levels than it takes to get to 1x1
+    unsigned maxLevels = 1u;
+    while (maxLevels < MAX_MIP_LEVELS && (std::max(result.width, result.height) >> maxLevels) > 0u)
+    {
+        ++maxLevels;
+    }
+    result.mipMapCount = std::min(std::max(header->mipMapCount, 1u), maxLevels);
+
+    std::size_t offset = result.headerBytes;
+    for (unsigned level = 0u; level < MAX_MIP_LEVELS; ++level)
+    {
+        result.mipOffset[level] = std::uint32_t(offset);
+        if (level < result.mipMapCount)
         {
-            throw std::runtime_error("DdsFile: unsupported dds format!");
+            offset += result.mipBytes(level);
         }
     }
+
+    if (offset > dataSize)
+    {
+        throw std::runtime_error("DdsFile: data file too small for the image it describes!");
+    }
+    return result;
+}
+
+
+unsigned DdsTexture::mipWidth(unsigned level) const
+{
+    return std::max(width >> level, 1u);
+}
+
+unsigned DdsTexture::mipHeight(unsigned level) const
+{
+    return std::max(height >> level, 1u);
+}
+
+std::size_t DdsTexture::mipBytes(unsigned level) const
+{
+    std::size_t blocksWide = (mipWidth(level) + blockDim - 1u) / blockDim;
+    std::size_t blocksHigh = (mipHeight(level) + blockDim - 1u) / blockDim;
+    return blocksWide * blocksHigh * blockBytes;
+}
+
+std::size_t DdsTexture::totalBytes() const
+{
+    return mipOffset[mipMapCount - 1u] + mipBytes(mipMapCount - 1u);
+}
+
+
+DdsFile::DdsFile(void *data, std::size_t dataSize) :
+    m_data((const std::uint8_t*)data),
+    m_mutableData((std::uint8_t*)data),
+    m_dataSize(dataSize),
+    m_texture(DdsTexture::parse(data, dataSize))
+{
+}
+
+DdsFile::DdsFile(const void *data, std::size_t dataSize) :
+    m_data((const std::uint8_t*)data),
+    m_mutableData(NULL),
+    m_dataSize(dataSize),
+    m_texture(DdsTexture::parse(data, dataSize))
+{
 }
 
 
 GLenum DdsFile::glDataFormat() const
 {
-    return m_dataFormat;
+    return m_texture.glDataFormat;
 }
 
 GLenum DdsFile::glDataType() const
 {
-    return m_dataType;
+    return m_texture.glDataType;
 }
 
 unsigned DdsFile::width() const
 {
-    const DdsHeader *header = (DdsHeader*)m_data;
-    return header->width;
+    return m_texture.width;
 }
 
 unsigned DdsFile::height() const
 {
-    const DdsHeader *header = (DdsHeader*)m_data;
-    return header->height;
+    return m_texture.height;
 }
 
 unsigned DdsFile::mipMapCount() const
 {
-    const DdsHeader *header = (DdsHeader*)m_data;
-    return std::max(header->mipMapCount, 1u);
+    return m_texture.mipMapCount;
 }
 
 std::size_t DdsFile::bytesPerPixel() const
 {
-    return m_bytesPerPixel;
+    return std::size_t(m_texture.blockBytes) / (std::size_t(m_texture.blockDim) * m_texture.blockDim);
 }
 
 char *DdsFile::getMutable(std::size_t &bytes)
@@ -251,16 +446,34 @@ char *DdsFile::getMutable(std::size_t &bytes)
         throw std::runtime_error("Attempt to get mutable data from const DdsFile");
     }
 
-    const DdsHeader *header = (const DdsHeader*) m_mutableData;
-    bytes = m_dataSize - header->size;
-    char *image = (char*)m_mutableData + header->size;
-    return image;
+    bytes = m_texture.mipBytes(0u);
+    return (char*)m_mutableData + m_texture.mipOffset[0];
 }
 
 const char *DdsFile::get(std::size_t &bytes) const
 {
-    const DdsHeader *header = (DdsHeader*)m_data;
-    bytes = m_dataSize - header->size;
-    const char *image = (const char*)m_data + header->size;
-    return image;
+    bytes = m_texture.mipBytes(0u);
+    return (const char*)m_data + m_texture.mipOffset[0];
+}
+
+
+std::vector<std::uint8_t> DdsFile::createBlank(unsigned width, unsigned height) const
+{
+    DdsTexture texture = m_texture;
+    texture.width = width;
+    texture.height = height;
+    std::size_t imageBytes = texture.mipBytes(0u);
+
+    std::vector<std::uint8_t> result(m_texture.headerBytes + imageBytes, 0u);
+    std::memcpy(result.data(), m_data, m_texture.headerBytes);
+
+    DdsHeader *newHeader = (DdsHeader*)(result.data() + 4u);
+    newHeader->width = width;
+    newHeader->height = height;
+    newHeader->mipMapCount = 0u;
+    newHeader->flags &= ~DDSD_MIPMAPCOUNT;
+    newHeader->caps1 &= ~(DDSCAPS_COMPLEX | DDSCAPS_MIPMAP);
+    newHeader->pitchOrLinearSize = (newHeader->flags & DDSD_LINEARSIZE) ?
+        std::uint32_t(imageBytes) : std::uint32_t(width * m_texture.blockBytes);
+    return result;
 }
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 #define NOMINMAX
 
 typedef unsigned long GLenum;
@@ -13,6 +14,10 @@ typedef unsigned long GLenum;
 #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
 #define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
 #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_RED 0x1903
+#define GL_RG 0x8227
+#define GL_RGBA 0x1908
+#define GL_ALPHA 0x1906
 
 // glDataTypes
 #define GL_UNSIGNED_BYTE 0x1401
@@ -20,31 +25,79 @@ typedef unsigned long GLenum;
 
 namespace dds
 {
+    enum Format
+    {
+        FORMAT_UNKNOWN,
+        FORMAT_DXT1,
+        FORMAT_DXT3,
+        FORMAT_DXT5,
+        FORMAT_BGRA8,
+        FORMAT_BGRX8,
+        FORMAT_RGBA8,
+        FORMAT_BGR8,
+        FORMAT_RG8,
+        FORMAT_R8,
+        FORMAT_A8
+    };
+
+    const char *formatName(Format format);
+
+
+    // Everything needed to address the pixels of a dds file, parsed once from its header.
+    // It holds no pointer to the data, so one descriptor describes the file wherever its bytes live:
+    // a std::vector, a section of a memory mapped .scmap, or a network buffer.
+    struct DdsTexture
+    {
+        enum { MAX_MIP_LEVELS = 16 };
+
+        // throws std::runtime_error if the header is malformed, the format unsupported or the data too short
+        static DdsTexture parse(const void *data, std::size_t dataSize);
+
+        bool isCompressed() const { return blockDim > 1u; }
+        unsigned mipWidth(unsigned level) const;
+        unsigned mipHeight(unsigned level) const;
+        std::size_t mipBytes(unsigned level) const;
+        std::size_t totalBytes() const;     // header and every mip level
+
+        Format format;
+        GLenum glDataFormat;
+        GLenum glDataType;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t mipMapCount;          // at least 1
+        std::uint32_t headerBytes;          // "DDS " magic, header and DX10 header if present
+        std::uint16_t blockDim;             // 4 for block compressed formats, 1 for uncompressed
+        std::uint16_t blockBytes;           // bytes per block, or per pixel when uncompressed
+        std::uint32_t mipOffset[MAX_MIP_LEVELS];    // from the start of the file
+    };
+
+
+    // A DdsTexture bound to the bytes it describes.  The data is never copied.
     class DdsFile
     {
     public:
         DdsFile(void *data, std::size_t dataSize);
         DdsFile(const void *data, std::size_t dataSize);
 
+        const DdsTexture &texture() const { return m_texture; }
         GLenum glDataFormat() const;
         GLenum glDataType() const;
         unsigned width() const;
         unsigned height() const;
         unsigned mipMapCount() const;
-        std::size_t bytesPerPixel() const;
+        std::size_t bytesPerPixel() const;      // rounded down for block compressed formats: DXT3/5 => 1, DXT1 => 0
+
+        // top level image
         const char *get(std::size_t &bytes) const;
         char *getMutable(std::size_t &bytes);
 
-    private:
-        void init(const void *data, std::size_t dataSize);
+        // a new dds file with this file's pixel format, the given dimensions, no mipmaps and zeroed image data
+        std::vector<std::uint8_t> createBlank(unsigned width, unsigned height) const;
 
-        const void *m_data;
-        void *m_mutableData;
+    private:
+        const std::uint8_t *m_data;
+        std::uint8_t *m_mutableData;
         std::size_t m_dataSize;
-
-        GLenum m_dataFormat;
-        GLenum m_dataType;
-        std::size_t m_bytesPerPixel;
-
+        DdsTexture m_texture;
     };
 }
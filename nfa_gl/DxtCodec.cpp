@@ -0,0 +1,232 @@
+#include "DxtCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace dds;
+
+
+static void unpack565(std::uint16_t c, std::uint8_t *rgb)
+{
+    std::uint8_t r = (c >> 11) & 0x1f;
+    std::uint8_t g = (c >> 5) & 0x3f;
+    std::uint8_t b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static std::uint16_t pack565(const std::uint8_t *rgb)
+{
+    unsigned r = (rgb[0] * 31u + 127u) / 255u;
+    unsigned g = (rgb[1] * 63u + 127u) / 255u;
+    unsigned b = (rgb[2] * 31u + 127u) / 255u;
+    return std::uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void alphaPalette(std::uint8_t a0, std::uint8_t a1, std::uint8_t *palette)
+{
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int i = 2; i < 8; ++i)
+        {
+            palette[i] = std::uint8_t(((8 - i) * a0 + (i - 1) * a1) / 7);
+        }
+    }
+    else
+    {
+        for (int i = 2; i < 6; ++i)
+        {
+            palette[i] = std::uint8_t(((6 - i) * a0 + (i - 1) * a1) / 5);
+        }
+        palette[6] = 0u;
+        palette[7] = 255u;
+    }
+}
+
+static void colourPalette(std::uint16_t c0, std::uint16_t c1, std::uint8_t *palette)
+{
+    unpack565(c0, palette + 0);
+    unpack565(c1, palette + 3);
+    for (int ch = 0; ch < 3; ++ch)
+    {
+        palette[6 + ch] = std::uint8_t((2 * palette[ch] + palette[3 + ch]) / 3);
+        palette[9 + ch] = std::uint8_t((palette[ch] + 2 * palette[3 + ch]) / 3);
+    }
+}
+
+
+void dds::decodeDxt5Block(const std::uint8_t *block, std::uint8_t *rgba)
+{
+    std::uint8_t alphas[8];
+    alphaPalette(block[0], block[1], alphas);
+
+    std::uint64_t alphaBits = 0u;
+    for (int i = 0; i < 6; ++i)
+    {
+        alphaBits |= std::uint64_t(block[2 + i]) << (8 * i);
+    }
+
+    std::uint16_t c0 = std::uint16_t(block[8] | (block[9] << 8));
+    std::uint16_t c1 = std::uint16_t(block[10] | (block[11] << 8));
+    std::uint8_t colours[12];
+    colourPalette(c0, c1, colours);
+
+    std::uint32_t colourBits = std::uint32_t(block[12]) | (std::uint32_t(block[13]) << 8) |
+        (std::uint32_t(block[14]) << 16) | (std::uint32_t(block[15]) << 24);
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const std::uint8_t *c = colours + 3 * ((colourBits >> (2 * i)) & 0x3);
+        rgba[4 * i + 0] = c[0];
+        rgba[4 * i + 1] = c[1];
+        rgba[4 * i + 2] = c[2];
+        rgba[4 * i + 3] = alphas[(alphaBits >> (3 * i)) & 0x7];
+    }
+}
+
+
+void dds::encodeDxt5Block(const std::uint8_t *rgba, std::uint8_t *block)
+{
+    // alpha: endpoints at the extremes, 8-value ramp
+    std::uint8_t amin = 255u, amax = 0u;
+    for (int i = 0; i < 16; ++i)
+    {
+        amin = std::min(amin, rgba[4 * i + 3]);
+        amax = std::max(amax, rgba[4 * i + 3]);
+    }
+
+    std::uint64_t alphaBits = 0u;
+    if (amax > amin)
+    {
+        int range = amax - amin;
+        for (int i = 0; i < 16; ++i)
+        {
+            // position along the ramp from amin (0) to amax (7), mapped onto the palette order
+            int k = ((rgba[4 * i + 3] - amin) * 7 + range / 2) / range;
+            std::uint64_t index = k == 7 ? 0u : k == 0 ? 1u : std::uint64_t(8 - k);
+            alphaBits |= index << (3 * i);
+        }
+    }
+    block[0] = amax;
+    block[1] = amin;
+    for (int i = 0; i < 6; ++i)
+    {
+        block[2 + i] = std::uint8_t(alphaBits >> (8 * i));
+    }
+
+    // colour: bounding box diagonal, nearest of the 4 palette entries
+    std::uint8_t cmin[3] = { 255u, 255u, 255u }, cmax[3] = { 0u, 0u, 0u };
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            cmin[ch] = std::min(cmin[ch], rgba[4 * i + ch]);
+            cmax[ch] = std::max(cmax[ch], rgba[4 * i + ch]);
+        }
+    }
+
+    std::uint16_t c0 = pack565(cmax);
+    std::uint16_t c1 = pack565(cmin);
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+    }
+
+    std::uint32_t colourBits = 0u;
+    if (c0 != c1)
+    {
+        std::uint8_t colours[12];
+        colourPalette(c0, c1, colours);
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (int ch = 0; ch < 3; ++ch)
+                {
+                    int d = int(rgba[4 * i + ch]) - int(colours[3 * p + ch]);
+                    distance += d*d;
+                }
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            colourBits |= std::uint32_t(best) << (2 * i);
+        }
+    }
+    block[8] = std::uint8_t(c0);
+    block[9] = std::uint8_t(c0 >> 8);
+    block[10] = std::uint8_t(c1);
+    block[11] = std::uint8_t(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+    {
+        block[12 + i] = std::uint8_t(colourBits >> (8 * i));
+    }
+}
+
+
+void dds::decodeDxt5(const std::uint8_t *blocks, unsigned width, unsigned height, std::uint8_t *rgba)
+{
+    unsigned blocksWide = (width + 3u) / 4u;
+    unsigned blocksHigh = (height + 3u) / 4u;
+    std::uint8_t texels[64];
+
+    for (unsigned by = 0u; by < blocksHigh; ++by)
+    {
+        for (unsigned bx = 0u; bx < blocksWide; ++bx)
+        {
+            decodeDxt5Block(blocks + DXT5_BLOCK_BYTES * (by*blocksWide + bx), texels);
+            for (unsigned ty = 0u; ty < 4u && 4u*by + ty < height; ++ty)
+            {
+                unsigned columns = std::min(4u, width - 4u*bx);
+                std::memcpy(rgba + 4u * (width*(4u*by + ty) + 4u*bx), texels + 16u * ty, 4u * columns);
+            }
+        }
+    }
+}
+
+
+void dds::encodeDxt5Region(const std::uint8_t *rgba, unsigned width, unsigned height, std::uint8_t *blocks,
+    unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    unsigned blocksWide = (width + 3u) / 4u;
+    unsigned bx1 = std::min((std::min(x1, width) + 3u) / 4u, blocksWide);
+    unsigned by1 = std::min((std::min(y1, height) + 3u) / 4u, (height + 3u) / 4u);
+    std::uint8_t texels[64];
+
+    for (unsigned by = y0 / 4u; by < by1; ++by)
+    {
+        for (unsigned bx = x0 / 4u; bx < bx1; ++bx)
+        {
+            // edge blocks of odd sized images replicate their last row/column
+            for (unsigned ty = 0u; ty < 4u; ++ty)
+            {
+                unsigned y = std::min(4u*by + ty, height - 1u);
+                for (unsigned tx = 0u; tx < 4u; ++tx)
+                {
+                    unsigned x = std::min(4u*bx + tx, width - 1u);
+                    std::memcpy(texels + 4u * (4u*ty + tx), rgba + 4u * (width*y + x), 4u);
+                }
+            }
+            encodeDxt5Block(texels, blocks + DXT5_BLOCK_BYTES * (by*blocksWide + bx));
+        }
+    }
+}
+
+
+void dds::encodeDxt5(const std::uint8_t *rgba, unsigned width, unsigned height, std::uint8_t *blocks)
+{
+    encodeDxt5Region(rgba, width, height, blocks, 0u, 0u, width, height);
+}
+
+
+std::size_t dds::dxt5ImageBytes(unsigned width, unsigned height)
+{
+    return DXT5_BLOCK_BYTES * ((width + 3u) / 4u) * ((height + 3u) / 4u);
+}
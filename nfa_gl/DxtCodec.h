@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace dds
+{
+    // DXT5 (BC3) block codec.  decoded texels are 8-bit RGBA, row major, 4 bytes per texel.
+    // DXT5 always uses the 4-colour palette for the colour block, and the 8-value alpha ramp
+    // is used whenever the alpha endpoints differ.
+
+    const std::size_t DXT5_BLOCK_BYTES = 16u;
+
+    // rgba[16*4] <- block[16]
+    void decodeDxt5Block(const std::uint8_t *block, std::uint8_t *rgba);
+
+    // block[16] <- rgba[16*4].  bounding box endpoint fit, nearest palette entry per texel
+    void encodeDxt5Block(const std::uint8_t *rgba, std::uint8_t *block);
+
+    // decode/encode whole images.  width and height are in texels and need not be multiples of 4;
+    // the rgba buffer is width*height*4 bytes
+    void decodeDxt5(const std::uint8_t *blocks, unsigned width, unsigned height, std::uint8_t *rgba);
+    void encodeDxt5(const std::uint8_t *rgba, unsigned width, unsigned height, std::uint8_t *blocks);
+
+    // re-encode only the blocks overlapping texel rectangle [x0,x1) x [y0,y1)
+    void encodeDxt5Region(const std::uint8_t *rgba, unsigned width, unsigned height, std::uint8_t *blocks,
+        unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+
+    std::size_t dxt5ImageBytes(unsigned width, unsigned height);
+}
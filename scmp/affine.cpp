@@ -0,0 +1,474 @@
+#include "image.h"
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+#include "taskgraph.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        namespace {
+
+            // where the samples of a layer lie on its map: sample i, j at offsetX + i spacingX, offsetZ + j spacingZ, in cells
+            struct Lattice
+            {
+                int width;
+                int height;
+                float spacingX;
+                float spacingZ;
+                float offsetX;
+                float offsetZ;
+            };
+        }
+
+        // the heightmap's samples are the corners of the cells
+        static Lattice VertexLattice(int W, int H)
+        {
+            Lattice l = { W + 1, H + 1, 1.0f, 1.0f, 0.0f, 0.0f };
+            return l;
+        }
+
+        // those of the other layers fill it, each at the centre of its square of cells
+        static Lattice TexelLattice(int W, int H, int columns, int rows)
+        {
+            float sx = float(W) / float(columns), sz = float(H) / float(rows);
+            Lattice l = { columns, rows, sx, sz, 0.5f * sx, 0.5f * sz };
+            return l;
+        }
+
+
+        namespace {
+
+            // the placed source, and the box of this map it covers
+            struct SourcePlacement
+            {
+                Affine toSource;
+                float sourceWidth;
+                float sourceHeight;
+                float x0;
+                float z0;
+                float x1;
+                float z1;
+            };
+        }
+
+        // how far outside the source a sample may land, in cells, and still be on it: enough for the rounding in a turn
+        // by a multiple of 90 degrees, whose sin and cos aren't quite 0
+        static const float EDGE = 1e-3f;
+
+        namespace {
+
+            // the samples [i0,i1) x [j0,j1) of a lattice inside the placement's box
+            struct Window
+            {
+                int i0;
+                int j0;
+                int i1;
+                int j1;
+                bool empty() const { return i0 >= i1 || j0 >= j1; }
+            };
+        }
+
+        static Window PlacedWindow(const Lattice &dst, const SourcePlacement &p)
+        {
+            Window w;
+            w.i0 = std::max(0, int(std::ceil((p.x0 - EDGE - dst.offsetX) / dst.spacingX)));
+            w.j0 = std::max(0, int(std::ceil((p.z0 - EDGE - dst.offsetZ) / dst.spacingZ)));
+            w.i1 = std::min(dst.width, int(std::floor((p.x1 + EDGE - dst.offsetX) / dst.spacingX)) + 1);
+            w.j1 = std::min(dst.height, int(std::floor((p.z1 + EDGE - dst.offsetZ) / dst.spacingZ)) + 1);
+            return w;
+        }
+
+
+        // the side of the squares of samples ForEachPlacedSample visits together
+        static const int TILE = 64;
+
+        // f(index, sx, sz) for each sample of dst that lands on the placed source, with sx, sz where it lands in src's
+        // samples, in row bands on every core.  A turned source is read along a slant, so each band is visited a square
+        // at a time, keeping the source rows it reads in cache.  Along a row the positions in the source step by a
+        // constant, so they are accumulated rather than transformed one by one
+        template<typename F>
+        static void ForEachPlacedSample(const Lattice &dst, const Lattice &src, const SourcePlacement &p, const F &f)
+        {
+            Window w = PlacedWindow(dst, p);
+            if (w.empty())
+            {
+                return;
+            }
+            const Affine &t = p.toSource;
+            float du = t.xx * dst.spacingX, dv = t.zx * dst.spacingX;
+            ParallelForRows(w.j1 - w.j0, [&](int row0, int row1)
+            {
+                for (int tileRow = w.j0 + row0; tileRow < w.j0 + row1; tileRow += TILE)
+                {
+                    for (int tileColumn = w.i0; tileColumn < w.i1; tileColumn += TILE)
+                    {
+                        int i1 = std::min(tileColumn + TILE, w.i1);
+                        for (int j = tileRow; j < std::min(tileRow + TILE, w.j0 + row1); ++j)
+                        {
+                            float u = dst.offsetX + float(tileColumn) * dst.spacingX, v = dst.offsetZ + float(j) * dst.spacingZ;
+                            t.Apply(u, v);
+                            std::size_t index = std::size_t(dst.width) * j + tileColumn;
+                            for (int i = tileColumn; i < i1; ++i, ++index)
+                            {
+                                float su = u + float(i - tileColumn) * du, sv = v + float(i - tileColumn) * dv;
+                                if (su >= -EDGE && su <= p.sourceWidth + EDGE && sv >= -EDGE && sv <= p.sourceHeight + EDGE)
+                                {
+                                    f(index, (su - src.offsetX) / src.spacingX, (sv - src.offsetZ) / src.spacingZ);
+                                }
+                            }
+                        }
+                    }
+                }
+            }, TILE);
+        }
+
+
+        namespace {
+
+            // the four samples of a w x h image around sx, sz and their weights, for bilinear filtering; off the image its edge
+            // repeats.  Found once per position, then shared by every channel read there
+            struct Taps
+            {
+                Taps(int w, int h, float sx, float sz)
+                {
+                    sx = std::min(std::max(sx, 0.0f), float(w - 1));
+                    sz = std::min(std::max(sz, 0.0f), float(h - 1));
+                    int x0 = int(sx), z0 = int(sz);
+                    int x1 = std::min(x0 + 1, w - 1), z1 = std::min(z0 + 1, h - 1);
+                    fx = sx - float(x0);
+                    fz = sz - float(z0);
+                    i00 = std::size_t(w) * z0 + x0;
+                    i10 = std::size_t(w) * z0 + x1;
+                    i01 = std::size_t(w) * z1 + x0;
+                    i11 = std::size_t(w) * z1 + x1;
+                }
+
+                // channel c of an image of n channels
+                template<typename T>
+                float operator()(const T *im, int n, int c) const
+                {
+                    float top = float(im[i00 * n + c]) + (float(im[i10 * n + c]) - float(im[i00 * n + c])) * fx;
+                    float bottom = float(im[i01 * n + c]) + (float(im[i11 * n + c]) - float(im[i01 * n + c])) * fx;
+                    return top + (bottom - top) * fz;
+                }
+
+                std::size_t i00, i10, i01, i11;
+                float fx, fz;
+            };
+        }
+
+        // the nearest sample
+        template<typename T>
+        static T Nearest(const T *im, int w, int h, float sx, float sz)
+        {
+            int x = std::min(std::max(int(std::floor(sx + 0.5f)), 0), w - 1);
+            int z = std::min(std::max(int(std::floor(sz + 0.5f)), 0), h - 1);
+            return im[std::size_t(w) * z + x];
+        }
+
+        static std::uint8_t RoundToByte(float v)
+        {
+            return std::uint8_t(std::min(std::max(std::floor(v + 0.5f), 0.0f), 255.0f));
+        }
+
+
+        template<typename T>
+        static void ImportGridAffine(const CowVector<T> &src, const Lattice &srcLattice, CowVector<T> &dst, const Lattice &dstLattice,
+            const SourcePlacement &p, bool nearest)
+        {
+            if (src.size() != std::size_t(srcLattice.width) * srcLattice.height || dst.size() != std::size_t(dstLattice.width) * dstLattice.height ||
+                src.empty() || dst.empty())
+            {
+                return;
+            }
+            const T *in = src.Get().data();
+            T *out = dst.data();
+            int w = srcLattice.width, h = srcLattice.height;
+            ForEachPlacedSample(dstLattice, srcLattice, p, [&](std::size_t index, float sx, float sz)
+            {
+                out[index] = nearest ? Nearest(in, w, h, sx, sz) : RoundToByte(Taps(w, h, sx, sz)(in, 1, 0));
+            });
+        }
+
+
+        // the dds texture's top level image as 3 or 4 byte texels (BGR or BGRA), decoded to rgba if DXT5
+        static std::vector<std::uint8_t> DdsTexels(const dds::DdsFile &dds, int &channels)
+        {
+            std::size_t imageBytes;
+            const std::uint8_t *image = (const std::uint8_t*)dds.get(imageBytes);
+            if (dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            {
+                channels = 4;
+                std::vector<std::uint8_t> rgba(4u * dds.width() * dds.height());
+                dds::decodeDxt5(image, dds.width(), dds.height(), rgba.data());
+                return rgba;
+            }
+            if ((dds.glDataFormat() != GL_BGRA && dds.glDataFormat() != GL_BGR) || dds.bytesPerPixel() < 3u)
+            {
+                throw std::runtime_error("unsupported dds format");
+            }
+            channels = int(dds.bytesPerPixel());
+            return std::vector<std::uint8_t>(image, image + std::size_t(channels) * dds.width() * dds.height());
+        }
+
+
+        // Import a dds layer: texels resampled channel by channel or, for a DXT5 normal map, as normals turned and their
+        // slopes changed by the placement.  Compressed textures re-encode only the blocks under the placement
+        static void ImportDdsAffine(const CowVector<std::uint8_t> &srcData, int srcW, int srcH, CowVector<std::uint8_t> &dstData,
+            int W, int H, const SourcePlacement &p, const std::string &debugName, bool normals)
+        {
+            if (srcData.empty() || dstData.empty())
+            {
+                return;
+            }
+            dds::DdsFile srcDds((std::uint8_t*)srcData.Get().data(), srcData.size());
+            dds::DdsFile dstDds(dstData.data(), dstData.size());
+            if (srcDds.bytesPerPixel() != dstDds.bytesPerPixel() || srcDds.glDataFormat() != dstDds.glDataFormat() ||
+                srcDds.glDataType() != dstDds.glDataType())
+            {
+                throw std::runtime_error(debugName + ": dds data aren't in the same pixel format. cannot import");
+            }
+
+            int TW = dstDds.width(), TH = dstDds.height();
+            Lattice dst = TexelLattice(W, H, TW, TH);
+            Lattice src = TexelLattice(srcW, srcH, srcDds.width(), srcDds.height());
+            Window window = PlacedWindow(dst, p);
+            if (window.empty())
+            {
+                return;
+            }
+
+            bool dxt5 = dstDds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            int channels;
+            std::vector<std::uint8_t> in, out;
+            try
+            {
+                in = DdsTexels(srcDds, channels);
+                out = DdsTexels(dstDds, channels);
+            }
+            catch (const std::runtime_error &)
+            {
+                throw std::runtime_error(debugName + ": unsupported dds format, cannot import");
+            }
+
+            if (normals && dxt5)
+            {
+                // x and y are filtered as packed, and z found from them after
+                const Affine &t = p.toSource;
+                ForEachPlacedSample(dst, src, p, [&](std::size_t index, float sx, float sz)
+                {
+                    Taps taps(src.width, src.height, sx, sz);
+                    float nx = taps(in.data(), 4, 3) * (2.0f / 255.0f) - 1.0f;
+                    float ny = taps(in.data(), 4, 1) * (2.0f / 255.0f) - 1.0f;
+                    float nz = std::sqrt(std::max(1e-6f, 1.0f - nx * nx - ny * ny));
+                    // a slope hx, hz of the source is hx * dx/dx' + hz * dz/dx', hx * dx/dz' + hz * dz/dz' here
+                    float hx = -nx / nz, hz = -ny / nz;
+                    float gx = hx * t.xx + hz * t.zx, gz = hx * t.xz + hz * t.zz;
+                    float inv = 1.0f / std::sqrt(gx * gx + gz * gz + 1.0f);
+                    // packed as PackNormalRows does, but only where the source lands
+                    out[4u * index + 0u] = 255u;
+                    out[4u * index + 1u] = RoundToByte((1.0f - gz * inv) * 127.5f);
+                    out[4u * index + 2u] = 0u;
+                    out[4u * index + 3u] = RoundToByte((1.0f - gx * inv) * 127.5f);
+                });
+            }
+            else
+            {
+                ForEachPlacedSample(dst, src, p, [&](std::size_t index, float sx, float sz)
+                {
+                    Taps taps(src.width, src.height, sx, sz);
+                    for (int c = 0; c < channels; ++c)
+                    {
+                        out[index * channels + c] = RoundToByte(taps(in.data(), channels, c));
+                    }
+                });
+            }
+
+            std::size_t imageBytes;
+            std::uint8_t *image = (std::uint8_t*)dstDds.getMutable(imageBytes);
+            if (dxt5)
+            {
+                // bands of whole block rows under the placement, each encoded independently
+                int blockRow0 = window.j0 / 4, blockRow1 = (window.j1 + 3) / 4;
+                ParallelForRows(blockRow1 - blockRow0, [&](int b0, int b1)
+                {
+                    int row0 = std::max(4 * (blockRow0 + b0), window.j0);
+                    int row1 = std::min(4 * (blockRow0 + b1), window.j1);
+                    dds::encodeDxt5Region(out.data(), TW, TH, image, window.i0, row0, window.i1, row1);
+                }, 4);
+            }
+            else
+            {
+                std::copy(out.begin(), out.end(), image);
+            }
+        }
+
+
+        // this map's items under the placed source, then copies of the source's carried onto this map by the transform,
+        // their heights set to heightAt(x, z)
+        template<typename T, typename HeightAt>
+        static std::vector< std::shared_ptr<T> > ImportItemsAffine(
+            const std::vector< std::shared_ptr<T> > &items, const SpatialGrid &itemsGrid,
+            const std::vector< std::shared_ptr<T> > &otherItems, const Affine &transform, const SourcePlacement &p,
+            int W, int H, const HeightAt &heightAt)
+        {
+            auto onSource = [&p](float x, float z)
+            {
+                return x >= 0.0f && x < p.sourceWidth && z >= 0.0f && z < p.sourceHeight;
+            };
+
+            std::vector<std::uint32_t> under;
+            itemsGrid.QueryRectangle(p.x0, p.z0, std::nextafter(p.x1, HUGE_VALF), std::nextafter(p.z1, HUGE_VALF), under);
+            std::vector<bool> replaced(items.size(), false);
+            for (std::uint32_t i : under)
+            {
+                float x = items[i]->position[0], z = items[i]->position[2];
+                p.toSource.Apply(x, z);
+                replaced[i] = onSource(x, z);
+            }
+
+            std::vector< std::shared_ptr<T> > newItems;
+            newItems.reserve(items.size() + otherItems.size());
+            for (std::size_t i = 0u; i < items.size(); ++i)
+            {
+                if (!replaced[i])
+                {
+                    newItems.push_back(items[i]);
+                }
+            }
+            for (const std::shared_ptr<T> &item : otherItems)
+            {
+                if (!onSource(item->position[0], item->position[2]))
+                {
+                    continue;
+                }
+                std::shared_ptr<T> itemPtr(new T(*item));
+                TransformItem(*itemPtr, transform);
+                float x = itemPtr->position[0], z = itemPtr->position[2];
+                if (x >= 0.0f && x <= float(W) && z >= 0.0f && z <= float(H))
+                {
+                    itemPtr->position[1] = heightAt(x, z);
+                    newItems.push_back(itemPtr);
+                }
+            }
+            return newItems;
+        }
+
+
+        void Scmp::ImportAffine(const Scmp &other, const Affine &transform, bool additiveTerrain, const ProgressCallback &progress)
+        {
+            float determinant = transform.Determinant();
+            if (!std::isfinite(determinant) || std::fabs(determinant) < 1e-6f)
+            {
+                throw std::runtime_error("ImportAffine: the transform is singular");
+            }
+
+            SourcePlacement p;
+            p.toSource = transform.Inverse();
+            p.sourceWidth = float(other.width);
+            p.sourceHeight = float(other.height);
+            p.x0 = p.z0 = HUGE_VALF;
+            p.x1 = p.z1 = -HUGE_VALF;
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                float x = (corner & 1) ? p.sourceWidth : 0.0f, z = (corner & 2) ? p.sourceHeight : 0.0f;
+                transform.Apply(x, z);
+                p.x0 = std::min(p.x0, x);
+                p.z0 = std::min(p.z0, z);
+                p.x1 = std::max(p.x1, x);
+                p.z1 = std::max(p.z1, z);
+            }
+
+            EditScope edit(*this, "ImportAffine");
+            int W = width, H = height;
+            int srcW = other.width, srcH = other.height;
+
+            // as Import: each layer is its own task, and the items wait for the heights they are snapped to.  the
+            // preview is left for RenderPreview
+            TaskGraph tasks;
+
+            TaskGraph::TaskId heightMapTask = tasks.Add("heightMapData", [&]()
+            {
+                Lattice src = VertexLattice(srcW, srcH), dst = VertexLattice(W, H);
+                if (other.heightMapData.size() != std::size_t(src.width) * src.height ||
+                    heightMapData.size() != std::size_t(dst.width) * dst.height)
+                {
+                    return;
+                }
+                const std::int16_t *in = other.heightMapData.Get().data();
+                std::int16_t *out = heightMapData.data();
+                ForEachPlacedSample(dst, src, p, [&](std::size_t index, float sx, float sz)
+                {
+                    float h = Taps(src.width, src.height, sx, sz)(in, 1, 0) + (additiveTerrain ? float(out[index]) : 0.0f);
+                    out[index] = std::int16_t(std::min(std::max(std::floor(h + 0.5f), -32768.0f), 32767.0f));
+                });
+            });
+
+            tasks.Add("terrainTypeData", [&]()
+            {
+                ImportGridAffine(other.terrainTypeData, TexelLattice(srcW, srcH, srcW, srcH),
+                    terrainTypeData, TexelLattice(W, H, W, H), p, true);
+            });
+            tasks.Add("masks", [&]()
+            {
+                for (auto masks : { std::make_pair(&other.waterFoamMask, &waterFoamMask),
+                    std::make_pair(&other.waterFlatnessMask, &waterFlatnessMask), std::make_pair(&other.waterDepthBiasMask, &waterDepthBiasMask) })
+                {
+                    int srcDivisor, divisor;
+                    if (MaskDivisor(masks.first->size(), srcW, srcH, srcDivisor) && MaskDivisor(masks.second->size(), W, H, divisor))
+                    {
+                        ImportGridAffine(*masks.first, TexelLattice(srcW, srcH, srcW / srcDivisor, srcH / srcDivisor),
+                            *masks.second, TexelLattice(W, H, W / divisor, H / divisor), p, false);
+                    }
+                }
+            });
+
+            for (auto layers : { std::make_pair(&normalMapData, &other.normalMapData), std::make_pair(&strataLerpData, &other.strataLerpData),
+                std::make_pair(&waterLerpData, &other.waterLerpData) })
+            {
+                const char *name = layers.first == &normalMapData ? "normalMapData" : layers.first == &strataLerpData ? "strataLerpData" : "waterLerpData";
+                for (std::size_t n = 0u; n < layers.first->size() && n < layers.second->size(); ++n)
+                {
+                    tasks.Add(name, [&, layers, name, n]()
+                    {
+                        ImportDdsAffine((*layers.second)[n], srcW, srcH, (*layers.first)[n], W, H, p, name, layers.first == &normalMapData);
+                    });
+                }
+            }
+
+            auto heightAt = [this](float x, float z) { return heightScale * HeightMapAt(int(x), int(z)); };
+            tasks.Add("waveGenerators", [&]()
+            {
+                // taken before Mutable() moves the generation on: a copy it makes holds the same items in order
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_WAVE_GENERATORS);
+                const auto &items = waveGenerators.Mutable();
+                waveGenerators = ImportItemsAffine(items, *grid, other.waveGenerators.Get(), transform, p, W, H, heightAt);
+            }, { heightMapTask });
+            tasks.Add("decals", [&]()
+            {
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_DECALS);
+                const auto &items = decals.Mutable();
+                decals = ImportItemsAffine(items, *grid, other.decals.Get(), transform, p, W, H, heightAt);
+            }, { heightMapTask });
+            tasks.Add("props", [&]()
+            {
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_PROPS);
+                const auto &items = props.Mutable();
+                props = ImportItemsAffine(items, *grid, other.props.Get(), transform, p, W, H, heightAt);
+            }, { heightMapTask });
+
+            tasks.Run(progress);
+            InvalidateItemIndices();
+        }
+
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        // The copy a CowVector takes before its first write.  Vectors of items copy the items too, so the items of one
+        // buffer are never reachable from another and editing an item in place can't show through in a snapshot
+        template<typename T>
+        std::vector<T> CowCopy(const std::vector<T> &v)
+        {
+            return v;
+        }
+
+        template<typename T>
+        std::vector< std::shared_ptr<T> > CowCopy(const std::vector< std::shared_ptr<T> > &v)
+        {
+            std::vector< std::shared_ptr<T> > copy;
+            copy.reserve(v.size());
+            for (const auto &item : v)
+            {
+                copy.push_back(item ? std::make_shared<T>(*item) : item);
+            }
+            return copy;
+        }
+
+
+        // What the const accessors of a CowVector<T> give: const T &, but for a vector of items, shared_ptr<const T>, so
+        // an item shared with another map's vector can't be edited through a const map.  Get() still gives the vector
+        // itself, to pass to functions of vectors: don't write items through it
+        template<typename T>
+        struct CowConstAccess
+        {
+            typedef const T &reference;
+            typedef typename std::vector<T>::const_iterator iterator;
+
+            static iterator Wrap(typename std::vector<T>::const_iterator i) { return i; }
+        };
+
+        template<typename T>
+        struct CowConstAccess< std::shared_ptr<T> >
+        {
+            typedef std::shared_ptr<const T> reference;
+
+            class iterator
+            {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef std::shared_ptr<const T> value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const std::shared_ptr<const T> *pointer;
+                typedef std::shared_ptr<const T> reference;
+
+                iterator() { }
+                explicit iterator(typename std::vector< std::shared_ptr<T> >::const_iterator i) : m_i(i) { }
+
+                reference operator*() const { return *m_i; }
+                iterator &operator++() { ++m_i; return *this; }
+                iterator operator++(int) { iterator before = *this; ++m_i; return before; }
+                bool operator==(const iterator &other) const { return m_i == other.m_i; }
+                bool operator!=(const iterator &other) const { return m_i != other.m_i; }
+
+            private:
+                typename std::vector< std::shared_ptr<T> >::const_iterator m_i;
+            };
+
+            static iterator Wrap(typename std::vector< std::shared_ptr<T> >::const_iterator i) { return iterator(i); }
+        };
+
+
+        // A std::vector whose buffer is shared by copies until one of them writes, so copying a Scmp costs a reference
+        // count per buffer rather than a copy of every byte.
+        //
+        // As with Qt's implicit sharing, every non-const access (data(), [], begin(), resize(), Mutable() ...) first
+        // gives this copy a buffer of its own, copying it if it is shared, and invalidates pointers taken before.  Read
+        // through a const reference, or Get(), to share.  Copies may be read and written from different threads, but
+        // one CowVector must not be accessed non-const from several threads at once: take data() before fanning out.
+        //
+        // Generation() changes on every non-const access and assignment and never returns to an earlier value, so a
+        // cache built from the contents (eg ItemIndex) can tell whether they may have changed since.  Writes through a
+        // reference kept from before the cache was built aren't seen: take a fresh one for each edit
+        template<typename T>
+        class CowVector
+        {
+        public:
+            typedef T value_type;
+            typedef typename std::vector<T>::size_type size_type;
+            typedef typename std::vector<T>::iterator iterator;
+            typedef typename CowConstAccess<T>::iterator const_iterator;
+            typedef typename CowConstAccess<T>::reference const_reference;
+
+            CowVector() : m_data(std::make_shared< std::vector<T> >()), m_generation(0u) { }
+            CowVector(std::vector<T> v) : m_data(std::make_shared< std::vector<T> >(std::move(v))), m_generation(0u) { }
+            CowVector(const CowVector &other) : m_data(other.m_data), m_generation(other.m_generation) { }
+            CowVector &operator=(const CowVector &other)
+            {
+                m_data = other.m_data;
+                m_generation = std::max(m_generation, other.m_generation) + 1u;
+                return *this;
+            }
+            CowVector &operator=(std::vector<T> v)
+            {
+                m_data = std::make_shared< std::vector<T> >(std::move(v));
+                ++m_generation;
+                return *this;
+            }
+
+            const std::vector<T> &Get() const { return *m_data; }
+            operator const std::vector<T> &() const { return *m_data; }
+
+            // the buffer, unshared, for writing
+            std::vector<T> &Mutable()
+            {
+                ++m_generation;
+                if (m_data.use_count() != 1)
+                {
+                    m_data = std::make_shared< std::vector<T> >(CowCopy(*m_data));
+                }
+                else
+                {
+                    // whoever dropped the last other reference is done reading it
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                }
+                return *m_data;
+            }
+            bool IsShared() const { return m_data.use_count() != 1; }
+            std::uint64_t Generation() const { return m_generation; }
+
+            size_type size() const { return m_data->size(); }
+            bool empty() const { return m_data->empty(); }
+
+            const T *data() const { return m_data->data(); }
+            const_reference operator[](size_type i) const { return (*m_data)[i]; }
+            const_reference front() const { return m_data->front(); }
+            const_reference back() const { return m_data->back(); }
+            const_iterator begin() const { return CowConstAccess<T>::Wrap(m_data->cbegin()); }
+            const_iterator end() const { return CowConstAccess<T>::Wrap(m_data->cend()); }
+
+            T *data() { return Mutable().data(); }
+            T &operator[](size_type i) { return Mutable()[i]; }
+            T &front() { return Mutable().front(); }
+            T &back() { return Mutable().back(); }
+            iterator begin() { return Mutable().begin(); }
+            iterator end() { return Mutable().end(); }
+
+            void resize(size_type n) { Mutable().resize(n); }
+            void reserve(size_type n) { Mutable().reserve(n); }
+            void push_back(const T &value) { Mutable().push_back(value); }
+            void push_back(T &&value) { Mutable().push_back(std::move(value)); }
+            void clear() { m_data = std::make_shared< std::vector<T> >(); ++m_generation; }
+
+        private:
+            std::shared_ptr< std::vector<T> > m_data;
+            std::uint64_t m_generation;
+        };
+    }
+}
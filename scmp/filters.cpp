@@ -0,0 +1,582 @@
+#include "filters.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+
+namespace nfa {
+    namespace scmp {
+
+        namespace {
+
+            // an area clipped to the map's vertices: [x0,x1) x [z0,z1)
+            struct Window
+            {
+                int x0;
+                int z0;
+                int x1;
+                int z1;
+            };
+
+            // the map's heights from row z0 on, eg a copy of the rows an edit reads as they were before it
+            struct HeightRows
+            {
+                const std::int16_t *data;
+                int z0;
+            };
+        }
+
+
+        // what an edit of the window's heights records for undo
+        static EditRegion WindowRegion(const Window &window)
+        {
+            return EditRegion(window.x0, window.z0, window.x1 - window.x0, window.z1 - window.z0);
+        }
+
+
+        static bool ClipArea(const Scmp &scmp, const HeightmapArea &area, const std::string &what, Window &window)
+        {
+            if (!area.mask.empty() && (area.width <= 0 || area.height <= 0 || area.mask.size() != std::size_t(area.width) * area.height))
+            {
+                throw std::runtime_error(what + ": the mask isn't width x height");
+            }
+            int VW = scmp.width + 1, VH = scmp.height + 1;
+            if (scmp.width <= 0 || scmp.height <= 0 || scmp.heightMapData.size() != std::size_t(VW) * VH)
+            {
+                return false;
+            }
+            window.x0 = std::max(area.column0, 0);
+            window.z0 = std::max(area.row0, 0);
+            window.x1 = int(std::min<long long>((long long)area.column0 + area.width, VW));
+            window.z1 = int(std::min<long long>((long long)area.row0 + area.height, VH));
+            return window.x0 < window.x1 && window.z0 < window.z1;
+        }
+
+
+        // count heights of row z from column x on; off the map the edge repeats
+        template<typename T>
+        static void ReadRow(const HeightRows &heights, int VW, int VH, int x, int z, int count, T *row)
+        {
+            const std::int16_t *src = heights.data + std::size_t(VW) * (std::min(std::max(z, 0), VH - 1) - heights.z0);
+            int left = std::min(std::max(-x, 0), count);
+            int right = std::max(std::min(VW - x, count), left);
+            std::fill(row, row + left, T(src[0]));
+            for (int i = left; i < right; ++i)
+            {
+                row[i] = T(src[x + i]);
+            }
+            std::fill(row + right, row + count, T(src[VW - 1]));
+        }
+
+
+        // row z of the window, filtered, rounded and blended into the heights by the area's mask.  Rounds by truncating
+        // a positive offset copy, as std::floor is a library call where the target lacks a rounding instruction
+        static void WriteRow(std::int16_t *heights, int VW, const Window &window, const HeightmapArea &area, int z, float *filtered)
+        {
+            std::int16_t *dst = heights + std::size_t(VW) * z + window.x0;
+            int count = window.x1 - window.x0;
+            if (!area.mask.empty())
+            {
+                const std::uint8_t *mask = area.mask.data() + std::size_t(area.width) * (z - area.row0) + (window.x0 - area.column0);
+                for (int i = 0; i < count; ++i)
+                {
+                    filtered[i] = float(dst[i]) + (filtered[i] - float(dst[i])) * float(mask[i]) * (1.0f / 255.0f);
+                }
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                float h = filtered[i] + 32768.5f;
+                h = h > 0.0f ? h : 0.0f;
+                h = h < 65535.0f ? h : 65535.0f;
+                dst[i] = std::int16_t(int(h) - 32768);
+            }
+        }
+
+
+        // One edit of the window's heights: band(source, heights, window, row0, row1) writes rows [row0,row1) of the
+        // window, counted from its top, reading the heights as they were before the edit from source, which holds the
+        // window's rows and margin rows either side.  Only those are copied, so a small window is a small edit
+        template<typename Band>
+        static void FilterHeights(Scmp &scmp, const HeightmapArea &area, const std::string &name, int margin, const Band &band)
+        {
+            Window window;
+            if (!ClipArea(scmp, area, name, window))
+            {
+                return;
+            }
+
+            EditScope edit(scmp, name, WindowRegion(window));
+            int VW = scmp.width + 1, VH = scmp.height + 1;
+            int z0 = std::max(window.z0 - margin, 0), z1 = std::min(window.z1 + margin, VH);
+            const std::int16_t *all = scmp.heightMapData.Get().data();
+            std::vector<std::int16_t> original(all + std::size_t(VW) * z0, all + std::size_t(VW) * z1);
+            HeightRows source = { original.data(), z0 };
+            std::int16_t *heights = scmp.heightMapData.Mutable().data();
+            ParallelForRows(window.z1 - window.z0, [&](int row0, int row1)
+            {
+                band(source, heights, window, row0, row1);
+            });
+        }
+
+
+        // h + amount (h - gaussian blurred h): amount -1 is the blur itself.  Each band blurs across the rows it needs,
+        // into a ring of the 2 radius + 1 rows the next row down reads, so the passes work in cache.  Both add pairs of
+        // taps that share a weight, as whole rows of multiply-adds
+        static void Convolve(Scmp &scmp, float sigma, float amount, const HeightmapArea &area, const std::string &name)
+        {
+            if (!(sigma > 0.0f))
+            {
+                throw std::runtime_error(name + ": sigma must be positive");
+            }
+            int radius = std::max(1, int(std::ceil(3.0f * sigma)));
+            std::vector<float> kernel(radius + 1);
+            float total = 0.0f;
+            for (int k = 0; k <= radius; ++k)
+            {
+                kernel[k] = std::exp(-0.5f * float(k * k) / (sigma * sigma));
+                total += k == 0 ? kernel[k] : 2.0f * kernel[k];
+            }
+            for (float &weight : kernel)
+            {
+                weight /= total;
+            }
+
+            int VW = scmp.width + 1, VH = scmp.height + 1;
+            int taps = 2 * radius + 1;
+            FilterHeights(scmp, area, name, radius, [&](const HeightRows &source, std::int16_t *heights, const Window &window, int row0, int row1)
+            {
+                int w = window.x1 - window.x0;
+                std::vector<float> padded(w + 2 * radius), ring(std::size_t(taps) * w), out(w), centre(w);
+
+                // ring row (z mod taps) <- row z blurred across
+                auto across = [&](int z)
+                {
+                    ReadRow(source, VW, VH, window.x0 - radius, z, w + 2 * radius, padded.data());
+                    float *dst = ring.data() + std::size_t(w) * (unsigned(z + taps) % unsigned(taps));
+                    const float *mid = padded.data() + radius;
+                    float weight = kernel[0];
+                    for (int x = 0; x < w; ++x)
+                    {
+                        dst[x] = weight * mid[x];
+                    }
+                    for (int k = 1; k <= radius; ++k)
+                    {
+                        const float *left = mid - k, *right = mid + k;
+                        weight = kernel[k];
+                        for (int x = 0; x < w; ++x)
+                        {
+                            dst[x] += weight * (left[x] + right[x]);
+                        }
+                    }
+                };
+
+                int first = window.z0 + row0, last = window.z0 + row1;
+                for (int z = first - radius; z < first + radius; ++z)
+                {
+                    across(z);
+                }
+                for (int z = first; z < last; ++z)
+                {
+                    across(z + radius);
+                    auto row = [&](int dz)
+                    {
+                        return ring.data() + std::size_t(w) * (unsigned(z + dz + taps) % unsigned(taps));
+                    };
+                    const float *mid = row(0);
+                    float weight = kernel[0];
+                    for (int x = 0; x < w; ++x)
+                    {
+                        out[x] = weight * mid[x];
+                    }
+                    for (int k = 1; k <= radius; ++k)
+                    {
+                        const float *above = row(-k), *below = row(k);
+                        weight = kernel[k];
+                        for (int x = 0; x < w; ++x)
+                        {
+                            out[x] += weight * (above[x] + below[x]);
+                        }
+                    }
+                    ReadRow(source, VW, VH, window.x0, z, w, centre.data());
+                    for (int x = 0; x < w; ++x)
+                    {
+                        out[x] = centre[x] + amount * (centre[x] - out[x]);
+                    }
+                    WriteRow(heights, VW, window, area, z, out.data());
+                }
+            });
+        }
+
+
+        void GaussianBlurHeights(Scmp &scmp, float sigma, const HeightmapArea &area)
+        {
+            Convolve(scmp, sigma, -1.0f, area, "GaussianBlurHeights");
+        }
+
+
+        void UnsharpMaskHeights(Scmp &scmp, float sigma, float amount, const HeightmapArea &area)
+        {
+            Convolve(scmp, sigma, amount, area, "UnsharpMaskHeights");
+        }
+
+
+        // sort a, b into ascending order
+        static inline void SortPair(std::int16_t &a, std::int16_t &b)
+        {
+            std::int16_t lo = std::min(a, b), hi = std::max(a, b);
+            a = lo;
+            b = hi;
+        }
+
+
+        void MedianFilterHeights(Scmp &scmp, int radius, const HeightmapArea &area)
+        {
+            if (radius < 1)
+            {
+                throw std::runtime_error("MedianFilterHeights: radius must be at least 1");
+            }
+
+            int VW = scmp.width + 1, VH = scmp.height + 1;
+            int side = 2 * radius + 1;
+            FilterHeights(scmp, area, "MedianFilterHeights", radius, [&](const HeightRows &source, std::int16_t *heights, const Window &window, int row0, int row1)
+            {
+                // a ring of the side rows, each with radius columns either side, that the next row down reads
+                int w = window.x1 - window.x0, pw = w + 2 * radius;
+                std::vector<std::int16_t> ring(std::size_t(side) * pw);
+                auto ringRow = [&](int z)
+                {
+                    return ring.data() + std::size_t(pw) * (unsigned(z + side) % unsigned(side));
+                };
+                int first = window.z0 + row0, last = window.z0 + row1;
+                for (int z = first - radius; z < first + radius; ++z)
+                {
+                    ReadRow(source, VW, VH, window.x0 - radius, z, pw, ringRow(z));
+                }
+
+                std::vector<float> out(w);
+                std::vector<std::int16_t> neighbourhood(side * side);
+                for (int z = first; z < last; ++z)
+                {
+                    ReadRow(source, VW, VH, window.x0 - radius, z + radius, pw, ringRow(z + radius));
+                    if (radius == 1)
+                    {
+                        // the 19 exchange median of 9 network: min and max only, so the compiler runs it across x
+                        const std::int16_t *r0 = ringRow(z - 1), *r1 = ringRow(z), *r2 = ringRow(z + 1);
+                        for (int x = 0; x < w; ++x)
+                        {
+                            std::int16_t p0 = r0[x], p1 = r0[x + 1], p2 = r0[x + 2];
+                            std::int16_t p3 = r1[x], p4 = r1[x + 1], p5 = r1[x + 2];
+                            std::int16_t p6 = r2[x], p7 = r2[x + 1], p8 = r2[x + 2];
+                            SortPair(p1, p2); SortPair(p4, p5); SortPair(p7, p8);
+                            SortPair(p0, p1); SortPair(p3, p4); SortPair(p6, p7);
+                            SortPair(p1, p2); SortPair(p4, p5); SortPair(p7, p8);
+                            SortPair(p0, p3); SortPair(p5, p8); SortPair(p4, p7);
+                            SortPair(p3, p6); SortPair(p1, p4); SortPair(p2, p5);
+                            SortPair(p4, p7); SortPair(p4, p2); SortPair(p6, p4);
+                            SortPair(p4, p2);
+                            out[x] = float(p4);
+                        }
+                    }
+                    else
+                    {
+                        for (int x = 0; x < w; ++x)
+                        {
+                            for (int dz = 0; dz < side; ++dz)
+                            {
+                                const std::int16_t *src = ringRow(z - radius + dz) + x;
+                                std::copy(src, src + side, neighbourhood.begin() + side * dz);
+                            }
+                            std::nth_element(neighbourhood.begin(), neighbourhood.begin() + side * side / 2, neighbourhood.end());
+                            out[x] = float(neighbourhood[side * side / 2]);
+                        }
+                    }
+                    WriteRow(heights, VW, window, area, z, out.data());
+                }
+            });
+        }
+
+
+        void ThermalErosionHeights(Scmp &scmp, float talusSlope, int iterations, float rate, const HeightmapArea &area)
+        {
+            Window window;
+            if (iterations <= 0 || !ClipArea(scmp, area, "ThermalErosionHeights", window))
+            {
+                return;
+            }
+            if (!(rate > 0.0f && rate <= 1.0f))
+            {
+                throw std::runtime_error("ThermalErosionHeights: rate must be in (0, 1]");
+            }
+            if (!(scmp.heightScale > 0.0f))
+            {
+                throw std::runtime_error("ThermalErosionHeights: the map's heightScale isn't positive");
+            }
+
+            EditScope edit(scmp, "ThermalErosionHeights", WindowRegion(window));
+            int VW = scmp.width + 1, VH = scmp.height + 1;
+            int w = window.x1 - window.x0, h = window.z1 - window.z0, pw = w + 2;
+
+            // the window and a ring of vertices around it, which stay as they are.  a vertex exchanges with four
+            // neighbours at once, so each exchange moves at most an eighth of the excess to stay stable
+            std::vector<float> current(std::size_t(pw) * (h + 2));
+            HeightRows all = { scmp.heightMapData.Get().data(), 0 };
+            for (int j = 0; j < h + 2; ++j)
+            {
+                ReadRow(all, VW, VH, window.x0 - 1, window.z0 - 1 + j, pw, current.data() + std::size_t(pw) * j);
+            }
+            std::vector<float> next(current);
+            float talus = talusSlope / scmp.heightScale;
+            float step = rate * 0.125f;
+
+            for (int iteration = 0; iteration < iterations; ++iteration)
+            {
+                ParallelForRows(h, [&](int row0, int row1)
+                {
+                    for (int z = row0 + 1; z < row1 + 1; ++z)
+                    {
+                        const float *above = current.data() + std::size_t(pw) * (z - 1);
+                        const float *row = above + pw;
+                        const float *below = row + pw;
+                        float *dst = next.data() + std::size_t(pw) * z;
+                        for (int x = 1; x <= w; ++x)
+                        {
+                            float centre = row[x];
+                            float dn = above[x] - centre, ds = below[x] - centre, dw = row[x - 1] - centre, de = row[x + 1] - centre;
+                            float excess = dn - std::max(-talus, std::min(dn, talus));
+                            excess += ds - std::max(-talus, std::min(ds, talus));
+                            excess += dw - std::max(-talus, std::min(dw, talus));
+                            excess += de - std::max(-talus, std::min(de, talus));
+                            dst[x] = centre + step * excess;
+                        }
+                    }
+                });
+                current.swap(next);
+            }
+
+            std::int16_t *heights = scmp.heightMapData.Mutable().data();
+            ParallelForRows(h, [&](int row0, int row1)
+            {
+                for (int z = row0; z < row1; ++z)
+                {
+                    WriteRow(heights, VW, window, area, window.z0 + z, current.data() + std::size_t(pw) * (z + 1) + 1);
+                }
+            });
+        }
+
+
+        namespace {
+
+            // splitmix64: a random sequence that is the same on every platform and standard library
+            struct Random
+            {
+                explicit Random(std::uint64_t seed) : state(seed) { }
+
+                std::uint64_t Next()
+                {
+                    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+                    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                    return z ^ (z >> 31);
+                }
+
+                // in [0, 1)
+                float Uniform()
+                {
+                    return float(Next() >> 40) * (1.0f / 16777216.0f);
+                }
+
+                std::uint64_t state;
+            };
+        }
+
+
+        // count droplets started at random in cells [x0,x1) x [z0,z1) of a w x h grid of heights.  A droplet stops when
+        // it runs off the grid, comes to rest or its lifetime ends
+        static void RunDroplets(const HydraulicErosion &settings, Random &random, std::uint64_t count,
+            float *heights, int w, int h, int x0, int z0, int x1, int z1)
+        {
+            auto at = [heights, w](int x, int z) -> float & { return heights[std::size_t(w) * z + x]; };
+            // add amount to the corners of the cell at x,z, weighted by how near they are
+            auto spread = [&at](float x, float z, float amount)
+            {
+                int ix = int(x), iz = int(z);
+                float fx = x - float(ix), fz = z - float(iz);
+                at(ix, iz) += amount * (1.0f - fx) * (1.0f - fz);
+                at(ix + 1, iz) += amount * fx * (1.0f - fz);
+                at(ix, iz + 1) += amount * (1.0f - fx) * fz;
+                at(ix + 1, iz + 1) += amount * fx * fz;
+            };
+
+            for (std::uint64_t droplet = 0u; droplet < count; ++droplet)
+            {
+                float x = float(x0) + random.Uniform() * float(x1 - x0);
+                float z = float(z0) + random.Uniform() * float(z1 - z0);
+                float dx = 0.0f, dz = 0.0f, speed = 1.0f, water = 1.0f, sediment = 0.0f;
+
+                for (int step = 0; step < settings.lifetime; ++step)
+                {
+                    int ix = int(x), iz = int(z);
+                    float fx = x - float(ix), fz = z - float(iz);
+                    float h00 = at(ix, iz), h10 = at(ix + 1, iz), h01 = at(ix, iz + 1), h11 = at(ix + 1, iz + 1);
+                    float height = h00 * (1.0f - fx) * (1.0f - fz) + h10 * fx * (1.0f - fz) + h01 * (1.0f - fx) * fz + h11 * fx * fz;
+                    float gx = (h10 - h00) * (1.0f - fz) + (h11 - h01) * fz;
+                    float gz = (h01 - h00) * (1.0f - fx) + (h11 - h10) * fx;
+
+                    dx = dx * settings.inertia - gx * (1.0f - settings.inertia);
+                    dz = dz * settings.inertia - gz * (1.0f - settings.inertia);
+                    float length = std::sqrt(dx * dx + dz * dz);
+                    if (length < 1e-6f)
+                    {
+                        break;
+                    }
+                    dx /= length;
+                    dz /= length;
+                    float leftX = x, leftZ = z;
+                    x += dx;
+                    z += dz;
+                    if (!(x >= 0.0f && z >= 0.0f && x < float(w - 1) && z < float(h - 1)))
+                    {
+                        break;
+                    }
+
+                    int nx = int(x), nz = int(z);
+                    float gfx = x - float(nx), gfz = z - float(nz);
+                    float newHeight = at(nx, nz) * (1.0f - gfx) * (1.0f - gfz) + at(nx + 1, nz) * gfx * (1.0f - gfz)
+                        + at(nx, nz + 1) * (1.0f - gfx) * gfz + at(nx + 1, nz + 1) * gfx * gfz;
+                    float dh = newHeight - height;
+
+                    // deposit or erode where the droplet left
+                    float capacity = std::max(-dh, settings.minSlope) * speed * water * settings.capacity;
+                    float amount;
+                    if (dh > 0.0f)
+                    {
+                        amount = std::min(dh, sediment);        // uphill: fill the hollow it climbs out of
+                    }
+                    else if (sediment > capacity)
+                    {
+                        amount = (sediment - capacity) * settings.deposition;
+                    }
+                    else
+                    {
+                        amount = -std::min((capacity - sediment) * settings.strength, -dh);
+                    }
+                    sediment -= amount;
+                    spread(leftX, leftZ, amount);
+
+                    speed = std::sqrt(std::max(0.0f, speed * speed - dh * settings.gravity));
+                    water *= 1.0f - settings.evaporation;
+                }
+
+                // what it still carries settles where it stops, unless it ran off the grid
+                if (x >= 0.0f && z >= 0.0f && x < float(w - 1) && z < float(h - 1))
+                {
+                    spread(x, z, sediment);
+                }
+            }
+        }
+
+
+        void HydraulicErosionHeights(Scmp &scmp, const HydraulicErosion &settings, const HeightmapArea &area,
+            const ProgressCallback &progress)
+        {
+            Window window;
+            if (settings.droplets == 0u || settings.iterations <= 0 || settings.lifetime <= 0
+                || !ClipArea(scmp, area, "HydraulicErosionHeights", window))
+            {
+                return;
+            }
+            if (!(scmp.heightScale > 0.0f))
+            {
+                throw std::runtime_error("HydraulicErosionHeights: the map's heightScale isn't positive");
+            }
+            // droplets start in the area's cells, between its vertices
+            int cellsWide = window.x1 - 1 - window.x0, cellsHigh = window.z1 - 1 - window.z0;
+            if (cellsWide <= 0 || cellsHigh <= 0)
+            {
+                return;
+            }
+
+            EditScope edit(scmp, "HydraulicErosionHeights", WindowRegion(window));
+            int VW = scmp.width + 1;
+            std::int16_t *heights = scmp.heightMapData.Mutable().data();
+
+            // a droplet runs at most lifetime cells and touches the vertices of one cell more, so tiles of the same
+            // colour, a tile apart, keep their droplets' reach apart if a tile is over twice that
+            int reach = settings.lifetime + 1;
+            int tile = std::max(64, 2 * reach + 2);
+            int tilesWide = (cellsWide + tile - 1) / tile, tilesHigh = (cellsHigh + tile - 1) / tile;
+            double dropletsPerCell = double(settings.droplets) / (double(cellsWide) * double(cellsHigh));
+            float scale = scmp.heightScale, inverseScale = 1.0f / scmp.heightScale;
+
+            for (int iteration = 0; iteration < settings.iterations; ++iteration)
+            {
+                for (int colour = 0; colour < 4; ++colour)
+                {
+                    std::vector< std::pair<int, int> > tiles;
+                    for (int tz = colour / 2; tz < tilesHigh; tz += 2)
+                    {
+                        for (int tx = colour % 2; tx < tilesWide; tx += 2)
+                        {
+                            tiles.push_back(std::make_pair(tx, tz));
+                        }
+                    }
+
+                    ParallelForRows(int(tiles.size()), [&](int first, int last)
+                    {
+                        std::vector<float> buffer;
+                        for (int t = first; t < last; ++t)
+                        {
+                            int tx = tiles[t].first, tz = tiles[t].second;
+                            int cx0 = window.x0 + tx * tile, cz0 = window.z0 + tz * tile;
+                            int cx1 = std::min(cx0 + tile, window.x0 + cellsWide), cz1 = std::min(cz0 + tile, window.z0 + cellsHigh);
+
+                            // the tile's vertices and its droplets' reach, in world units
+                            int bx0 = std::max(cx0 - reach, window.x0), bz0 = std::max(cz0 - reach, window.z0);
+                            int bx1 = std::min(cx1 + reach + 1, window.x1), bz1 = std::min(cz1 + reach + 1, window.z1);
+                            int bw = bx1 - bx0, bh = bz1 - bz0;
+                            buffer.resize(std::size_t(bw) * bh);
+                            for (int z = 0; z < bh; ++z)
+                            {
+                                const std::int16_t *src = heights + std::size_t(VW) * (bz0 + z) + bx0;
+                                float *dst = buffer.data() + std::size_t(bw) * z;
+                                for (int x = 0; x < bw; ++x)
+                                {
+                                    dst[x] = float(src[x]) * scale;
+                                }
+                            }
+
+                            Random random((std::uint64_t(settings.seed) << 32) ^ (std::uint64_t(iteration) << 40)
+                                ^ (std::uint64_t(tz) << 20) ^ std::uint64_t(tx));
+                            random.Next();
+                            double expected = dropletsPerCell * double(cx1 - cx0) * double(cz1 - cz0);
+                            std::uint64_t count = std::uint64_t(expected);
+                            count += random.Uniform() < float(expected - double(count)) ? 1u : 0u;
+                            RunDroplets(settings, random, count, buffer.data(), bw, bh, cx0 - bx0, cz0 - bz0, cx1 - bx0, cz1 - bz0);
+
+                            Window reached = { bx0, bz0, bx1, bz1 };
+                            for (int z = 0; z < bh; ++z)
+                            {
+                                float *row = buffer.data() + std::size_t(bw) * z;
+                                for (int x = 0; x < bw; ++x)
+                                {
+                                    row[x] *= inverseScale;
+                                }
+                                WriteRow(heights, VW, reached, area, bz0 + z, row);
+                            }
+                        }
+                    }, 1);
+
+                    if (progress && !progress("HydraulicErosionHeights", float(iteration * 4 + colour + 1) / float(settings.iterations * 4)))
+                    {
+                        throw Cancelled("HydraulicErosionHeights cancelled");
+                    }
+                }
+            }
+        }
+
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "progress.h"
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // The part of the heightmap a filter changes: vertices column0 <= x < column0 + width, row0 <= z < row0 + height,
+        // clipped to the map.  The default is the whole map.  mask is empty, for all of it, or width x height weights:
+        // 255 takes the filtered height, 0 keeps the old one and those between blend the two.  Filters read the
+        // vertices around the area too, so its edges filter as they would in a filter of the whole map
+        struct HeightmapArea
+        {
+            HeightmapArea() : column0(0), row0(0), width(INT_MAX), height(INT_MAX) { }
+            HeightmapArea(int c0, int r0, int w, int h) : column0(c0), row0(r0), width(w), height(h) { }
+
+            int column0;
+            int row0;
+            int width;
+            int height;
+            std::vector<std::uint8_t> mask;
+        };
+
+        // Heightmap filters, eg for the stair steps an upscaling Resize leaves.  Each is one edit of the map, computed in
+        // row bands on every core with straight-line float loops the compiler vectorises.  The edge of the map repeats
+        // outwards.  Items keep their heights
+
+        // Separable gaussian blur, sigma in cells.  The kernel reaches 3 sigma
+        void GaussianBlurHeights(Scmp &scmp, float sigma, const HeightmapArea &area = HeightmapArea());
+
+        // Sharpen: each height moves away from its gaussian blurred neighbourhood by amount times the difference
+        void UnsharpMaskHeights(Scmp &scmp, float sigma, float amount, const HeightmapArea &area = HeightmapArea());
+
+        // The median of the (2 radius + 1)^2 heights around each vertex: removes spikes and pits, keeps ridges sharp
+        void MedianFilterHeights(Scmp &scmp, int radius, const HeightmapArea &area = HeightmapArea());
+
+        // Slopes steeper than talusSlope (height per cell, in the units of heightScale * raw heights) slump: each
+        // iteration moves rate (0 to 1) of the excess height towards each lower neighbour, keeping the total volume.
+        // Vertices just outside the area don't move
+        void ThermalErosionHeights(Scmp &scmp, float talusSlope, int iterations, float rate = 0.5f,
+            const HeightmapArea &area = HeightmapArea());
+
+
+        // Settings of HydraulicErosionHeights.  Droplets carve in the units of heightScale * raw heights, over a grid of
+        // one unit per cell
+        struct HydraulicErosion
+        {
+            HydraulicErosion() : droplets(200000u), iterations(1), lifetime(30), strength(0.3f), deposition(0.3f),
+                evaporation(0.02f), inertia(0.05f), capacity(4.0f), minSlope(0.01f), gravity(4.0f), seed(0u) { }
+
+            std::uint64_t droplets;     // per iteration, spread evenly over the area
+            int iterations;             // passes over the area, each with droplets of its own
+            int lifetime;               // steps a droplet runs, at most a cell each
+            float strength;             // the fraction of a droplet's spare capacity it picks up per step
+            float deposition;           // the fraction of its sediment beyond its capacity it drops per step
+            float evaporation;          // the fraction of its water it loses per step
+            float inertia;              // 0 runs straight downhill, 1 keeps going the way it was
+            float capacity;             // sediment carried per unit of slope, speed and water
+            float minSlope;             // the slope capacity never falls below, so droplets on the flat still carry
+            float gravity;
+            std::uint32_t seed;
+        };
+
+        // Particle hydraulic erosion: droplets start at random in the area and run downhill, picking up sediment where
+        // they speed up and dropping it where they slow, cutting gullies into smooth slopes.  Droplets that leave the
+        // area stop.  The area is split into tiles wider than twice a droplet's run, so droplets of one tile can't meet
+        // those of the tiles beside its neighbours, and the tiles of each of the four colours of a 2 x 2 checkerboard
+        // are eroded at once on every core.  Each tile has a random sequence seeded from the seed, the iteration and
+        // its place, so the result doesn't depend on the thread count.  Memory is a float copy of one tile and its
+        // margin per thread.  progress (optional) is called after each colour of each iteration; cancelling throws
+        // Cancelled and leaves the heights part eroded
+        void HydraulicErosionHeights(Scmp &scmp, const HydraulicErosion &settings, const HeightmapArea &area = HeightmapArea(),
+            const ProgressCallback &progress = ProgressCallback());
+    }
+}
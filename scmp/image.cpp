@@ -0,0 +1,177 @@
+#include "image.h"
+
+#include <cmath>
+
+
+// tent filter taps for resampling n0 samples onto n samples.  tap i covers source samples [first[i], first[i]+count[i])
+// with weights stored contiguously from weights[offset[i]]
+struct FilterTaps
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<int> offset;
+    std::vector<float> weights;
+};
+
+
+static FilterTaps BuildTentTaps(int n0, int n)
+{
+    FilterTaps taps;
+    float scale = float(n0) / float(n);
+    float support = std::max(1.0f, scale);
+
+    for (int i = 0; i < n; ++i)
+    {
+        float centre = (float(i) + 0.5f) * scale - 0.5f;
+        int lo = int(std::floor(centre - support)) + 1;
+        int hi = int(std::ceil(centre + support)) - 1;
+        lo = std::max(lo, 0);
+        hi = std::min(hi, n0 - 1);
+        if (hi < lo)
+        {
+            lo = hi = std::min(std::max(int(centre + 0.5f), 0), n0 - 1);
+        }
+
+        taps.first.push_back(lo);
+        taps.count.push_back(hi - lo + 1);
+        taps.offset.push_back(int(taps.weights.size()));
+
+        float sum = 0.0f;
+        for (int j = lo; j <= hi; ++j)
+        {
+            float w = std::max(0.0f, 1.0f - std::fabs(float(j) - centre) / support);
+            taps.weights.push_back(w);
+            sum += w;
+        }
+        for (int j = lo; j <= hi; ++j)
+        {
+            float &w = taps.weights[taps.offset.back() + j - lo];
+            w = sum > 0.0f ? w / sum : 1.0f / float(hi - lo + 1);
+        }
+    }
+    return taps;
+}
+
+
+static inline std::uint8_t ToUnorm8(float v)
+{
+    float f = (v + 1.0f) * 127.5f + 0.5f;
+    return std::uint8_t(std::min(std::max(f, 0.0f), 255.0f));
+}
+
+
+namespace nfa {
+    namespace scmp {
+
+        void UnpackNormals(const std::uint8_t *rgba, NormalMap &nm)
+        {
+            std::size_t count = std::size_t(nm.width) * std::size_t(nm.height);
+            float *x = nm.x.data();
+            float *y = nm.y.data();
+            float *z = nm.z.data();
+            for (std::size_t i = 0u; i < count; ++i)
+            {
+                x[i] = float(rgba[4 * i + 3]) * (2.0f / 255.0f) - 1.0f;
+                y[i] = float(rgba[4 * i + 1]) * (2.0f / 255.0f) - 1.0f;
+            }
+            for (std::size_t i = 0u; i < count; ++i)
+            {
+                z[i] = std::sqrt(std::max(0.0f, 1.0f - x[i] * x[i] - y[i] * y[i]));
+            }
+        }
+
+
+        void PackNormalRows(const NormalMap &nm, int row0, int row1, std::uint8_t *rgba)
+        {
+            std::size_t begin = std::size_t(row0) * std::size_t(nm.width);
+            std::size_t end = std::size_t(row1) * std::size_t(nm.width);
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                rgba[4 * i + 0] = 255u;
+                rgba[4 * i + 1] = ToUnorm8(nm.y[i]);
+                rgba[4 * i + 2] = 0u;
+                rgba[4 * i + 3] = ToUnorm8(nm.x[i]);
+            }
+        }
+
+
+        void PackNormals(const NormalMap &nm, std::uint8_t *rgba)
+        {
+            PackNormalRows(nm, 0, nm.height, rgba);
+        }
+
+
+        NormalMap ResampleNormals(const NormalMap &nm, int W, int H, float gainX, float gainY)
+        {
+            int W0 = nm.width;
+            int H0 = nm.height;
+            FilterTaps colTaps = BuildTentTaps(W0, W);
+            FilterTaps rowTaps = BuildTentTaps(H0, H);
+
+            // horizontal pass: H0 rows of W
+            NormalMap tmp(W, H0);
+            const float *src[3] = { nm.x.data(), nm.y.data(), nm.z.data() };
+            float *dst[3] = { tmp.x.data(), tmp.y.data(), tmp.z.data() };
+            for (int ch = 0; ch < 3; ++ch)
+            {
+                for (int row = 0; row < H0; ++row)
+                {
+                    const float *in = src[ch] + std::size_t(row) * W0;
+                    float *out = dst[ch] + std::size_t(row) * W;
+                    for (int col = 0; col < W; ++col)
+                    {
+                        const float *w = colTaps.weights.data() + colTaps.offset[col];
+                        const float *s = in + colTaps.first[col];
+                        float sum = 0.0f;
+                        for (int k = 0; k < colTaps.count[col]; ++k)
+                        {
+                            sum += w[k] * s[k];
+                        }
+                        out[col] = sum;
+                    }
+                }
+            }
+
+            // vertical pass: whole rows accumulated at once
+            NormalMap result(W, H);
+            const float *tsrc[3] = { tmp.x.data(), tmp.y.data(), tmp.z.data() };
+            float *rdst[3] = { result.x.data(), result.y.data(), result.z.data() };
+            for (int ch = 0; ch < 3; ++ch)
+            {
+                for (int row = 0; row < H; ++row)
+                {
+                    float *out = rdst[ch] + std::size_t(row) * W;
+                    std::fill(out, out + W, 0.0f);
+                    for (int k = 0; k < rowTaps.count[row]; ++k)
+                    {
+                        float w = rowTaps.weights[rowTaps.offset[row] + k];
+                        const float *in = tsrc[ch] + std::size_t(rowTaps.first[row] + k) * W;
+                        for (int col = 0; col < W; ++col)
+                        {
+                            out[col] += w * in[col];
+                        }
+                    }
+                }
+            }
+
+            // slope gain and renormalize
+            float *x = result.x.data();
+            float *y = result.y.data();
+            float *z = result.z.data();
+            std::size_t count = std::size_t(W) * std::size_t(H);
+            for (std::size_t i = 0u; i < count; ++i)
+            {
+                float nx = x[i] * gainX;
+                float ny = y[i] * gainY;
+                float nz = std::max(z[i], 0.0f);
+                float len2 = nx*nx + ny*ny + nz*nz;
+                float inv = len2 > 1e-12f ? 1.0f / std::sqrt(len2) : 0.0f;
+                x[i] = nx * inv;
+                y[i] = ny * inv;
+                z[i] = len2 > 1e-12f ? nz * inv : 1.0f;
+            }
+            return result;
+        }
+
+    }
+}
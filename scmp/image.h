@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        // one pixel of ResizeImage: the inverse distance weighted mean of the 4x4 source pixels around it, or the
+        // nearest one if !lerp.  wscale, hscale = W/W0, H/H0
+        template<typename DataT>
+        inline DataT ResizeSample(const DataT *im, int W0, int H0, float wscale, float hscale, int col, int row, bool lerp)
+        {
+            if (lerp)
+            {
+                float sourceCol(float(col) / wscale);
+                float sourceRow(float(row) / hscale);
+                double sum = 0.0, sumWeights = 0.0;
+                for (int c = int(sourceCol) -1; c<int(sourceCol) + 3; ++c)
+                {
+                    for (int r = int(sourceRow) -1; r<int(sourceRow) + 3; ++r)
+                    {
+                        if (c >= 0 && c < W0 && r >= 0 && r < H0)
+                        {
+                            double dc = sourceCol - double(c), dr = sourceRow - double(r);
+                            double d = dc*dc + dr*dr;
+                            d = std::max(0.1, d);
+                            sum += double(im[W0*r + c]) / d;
+                            sumWeights += 1.0 / d;
+                        }
+                    }
+                }
+                return sumWeights > 0.0 ? DataT(sum / sumWeights) : DataT(0.0);
+            }
+            else
+            {
+                int sourceCol(float(col) / wscale);
+                int sourceRow(float(row) / hscale);
+                return im[W0*sourceRow + sourceCol];
+            }
+        }
+
+
+        template<typename DataT>
+        inline void ResizeImage(const DataT *im, DataT *om, int W0, int H0, int W, int H, bool lerp)
+        {
+            float wscale = float(W) / float(W0);
+            float hscale = float(H) / float(H0);
+
+            for (int row = 0; row < H; ++row)
+            {
+                for (int col = 0; col < W; ++col)
+                {
+                    om[W*row + col] = ResizeSample(im, W0, H0, wscale, hscale, col, row, lerp);
+                }
+            }
+        }
+
+
+        template<typename DataT>
+        inline void ImportImage(
+            const DataT *im1, int W1, int H1,
+            DataT *im2, int W2, int H2,
+            int W0, int H0, bool additive)
+        {
+            for (int col = 0u; col < W1; ++col)
+            {
+                for (int row = 0u; row < H1; ++row)
+                {
+                    int destCol = col + W0;
+                    int destRow = row + H0;
+                    if (destCol < 0 || destCol >= W2 || destRow < 0 || destRow >= H2)
+                    {
+                        continue;
+                    }
+                    if (additive)
+                    {
+                        im2[W2*destRow + destCol] += im1[W1*row + col];
+                    }
+                    else
+                    {
+                        im2[W2*destRow + destCol] = im1[W1*row + col];
+                    }
+                }
+            }
+        }
+
+
+        template<typename DataT>
+        inline void GainImage(std::vector<DataT> &im, float gain)
+        {
+            for (auto &pix : im)
+            {
+                pix *= gain;
+            }
+        }
+
+
+        // The eight ways a rectangle can be laid back onto the grid.  Bit 0 mirrors the source's x axis, bit 1 its z axis
+        // and bit 2 then swaps the axes, so a W x H image becomes H x W.  The rotations are clockwise seen from above,
+        // with x east and z south: ROTATE_90 turns the north edge into the east edge
+        enum Orientation
+        {
+            ORIENT_IDENTITY = 0,
+            ORIENT_FLIP_X = 1,
+            ORIENT_FLIP_Z = 2,
+            ORIENT_ROTATE_180 = 3,
+            ORIENT_TRANSPOSE = 4,
+            ORIENT_ROTATE_270 = 5,
+            ORIENT_ROTATE_90 = 6,
+            ORIENT_ANTI_TRANSPOSE = 7
+        };
+
+        inline bool OrientFlipsX(Orientation o) { return (o & 1) != 0; }
+        inline bool OrientFlipsZ(Orientation o) { return (o & 2) != 0; }
+        inline bool OrientSwapsAxes(Orientation o) { return (o & 4) != 0; }
+        // a mirror image rather than a rotation
+        inline bool OrientMirrors(Orientation o) { return (OrientFlipsX(o) != OrientFlipsZ(o)) != OrientSwapsAxes(o); }
+
+        // where point x,z of a W x H map lands.  Works for vectors too, with W = H = 0
+        inline void OrientPoint(Orientation o, float W, float H, float &x, float &z)
+        {
+            float u = OrientFlipsX(o) ? W - x : x;
+            float v = OrientFlipsZ(o) ? H - z : z;
+            x = OrientSwapsAxes(o) ? v : u;
+            z = OrientSwapsAxes(o) ? u : v;
+        }
+
+
+        // A 2D affine transform of map positions, in cells: x' = xx x + xz z + tx, z' = zx x + zz z + tz.  Build one from
+        // the factories, right to left as they apply, eg Translation(cx, cz) * Rotation(a) * Scale(2, 2) * Translation(-w/2,
+        // -h/2) doubles a w x h map about its centre, turns it and centres it on cx, cz
+        struct Affine
+        {
+            Affine() : xx(1.0f), xz(0.0f), zx(0.0f), zz(1.0f), tx(0.0f), tz(0.0f) { }
+            Affine(float a, float b, float c, float d, float x, float z) : xx(a), xz(b), zx(c), zz(d), tx(x), tz(z) { }
+
+            static Affine Translation(float x, float z) { return Affine(1.0f, 0.0f, 0.0f, 1.0f, x, z); }
+            static Affine Scale(float x, float z) { return Affine(x, 0.0f, 0.0f, z, 0.0f, 0.0f); }
+            // clockwise seen from above, as ORIENT_ROTATE_90 is a quarter turn
+            static Affine Rotation(float radians)
+            {
+                float c = std::cos(radians), s = std::sin(radians);
+                return Affine(c, -s, s, c, 0.0f, 0.0f);
+            }
+
+            // this after b
+            Affine operator*(const Affine &b) const
+            {
+                return Affine(xx * b.xx + xz * b.zx, xx * b.xz + xz * b.zz, zx * b.xx + zz * b.zx, zx * b.xz + zz * b.zz,
+                    xx * b.tx + xz * b.tz + tx, zx * b.tx + zz * b.tz + tz);
+            }
+
+            float Determinant() const { return xx * zz - xz * zx; }
+            Affine Inverse() const
+            {
+                float d = 1.0f / Determinant();
+                Affine i(zz * d, -xz * d, -zx * d, xx * d, 0.0f, 0.0f);
+                i.tx = -(i.xx * tx + i.xz * tz);
+                i.tz = -(i.zx * tx + i.zz * tz);
+                return i;
+            }
+
+            void Apply(float &x, float &z) const
+            {
+                float u = xx * x + xz * z + tx;
+                z = zx * x + zz * z + tz;
+                x = u;
+            }
+            // a direction or velocity: the transform without its translation
+            void ApplyVector(float &x, float &z) const
+            {
+                float u = xx * x + xz * z;
+                z = zx * x + zz * z;
+                x = u;
+            }
+
+            float xx, xz, zx, zz;
+            float tx, tz;
+        };
+
+
+        // Rows [row0,row1) of W x H image im laid onto om as o says.  When the axes swap, a destination row is a source
+        // column, so it is copied in tiles small enough that the source rows a tile reads stay in cache
+        template<typename DataT>
+        inline void OrientImage(const DataT *im, DataT *om, int W, int H, Orientation o, int row0, int row1)
+        {
+            int OW = OrientSwapsAxes(o) ? H : W;
+            if (!OrientSwapsAxes(o))
+            {
+                for (int row = row0; row < row1; ++row)
+                {
+                    const DataT *src = im + std::size_t(W) * (OrientFlipsZ(o) ? H - 1 - row : row);
+                    DataT *dst = om + std::size_t(OW) * row;
+                    if (OrientFlipsX(o))
+                    {
+                        std::reverse_copy(src, src + W, dst);
+                    }
+                    else
+                    {
+                        std::copy(src, src + W, dst);
+                    }
+                }
+                return;
+            }
+
+            // om(col, row) = im(xs(row), zs(col)): down a source column as col increases
+            const int TILE = sizeof(DataT) >= 8u ? 16 : 64;
+            std::ptrdiff_t step = OrientFlipsZ(o) ? -std::ptrdiff_t(W) : std::ptrdiff_t(W);
+            std::ptrdiff_t first = OrientFlipsZ(o) ? std::ptrdiff_t(W) * (H - 1) : 0;
+            for (int tileRow = row0; tileRow < row1; tileRow += TILE)
+            {
+                int tileRowEnd = std::min(tileRow + TILE, row1);
+                for (int tileCol = 0; tileCol < OW; tileCol += TILE)
+                {
+                    int tileColEnd = std::min(tileCol + TILE, OW);
+                    for (int row = tileRow; row < tileRowEnd; ++row)
+                    {
+                        const DataT *src = im + first + (OrientFlipsX(o) ? W - 1 - row : row) + step * tileCol;
+                        DataT *dst = om + std::size_t(OW) * row;
+                        for (int col = tileCol; col < tileColEnd; ++col, src += step)
+                        {
+                            dst[col] = *src;
+                        }
+                    }
+                }
+            }
+        }
+
+
+        // Rows [row0,row1) of the OW x OH window of W x H image im whose top left is x0,z0.  The window may hang off the
+        // image, where it repeats the image's edge
+        template<typename DataT>
+        inline void CropImage(const DataT *im, int W, int H, DataT *om, int x0, int z0, int OW, int row0, int row1)
+        {
+            int left = std::min(std::max(-x0, 0), OW);
+            int right = std::max(std::min(W - x0, OW), left);
+            for (int row = row0; row < row1; ++row)
+            {
+                const DataT *src = im + std::size_t(W) * std::min(std::max(z0 + row, 0), H - 1);
+                DataT *dst = om + std::size_t(OW) * row;
+                std::fill(dst, dst + left, src[0]);
+                if (right > left)
+                {
+                    std::copy(src + x0 + left, src + x0 + right, dst + left);
+                }
+                std::fill(dst + right, dst + OW, src[W - 1]);
+            }
+        }
+
+
+        // The mirror symmetries of competitive maps, each the orientation SymmetryOrientation that lays the map onto
+        // itself.  HORIZONTAL mirrors across the north-south centre line (x -> W - x), VERTICAL across the east-west one,
+        // DIAGONAL across the line from the north west corner (x <-> z) and ANTI_DIAGONAL across the one from the north
+        // east corner.  The diagonals need square maps
+        enum Symmetry
+        {
+            SYMMETRY_HORIZONTAL,
+            SYMMETRY_VERTICAL,
+            SYMMETRY_DIAGONAL,
+            SYMMETRY_ANTI_DIAGONAL,
+            SYMMETRY_ROTATE_180
+        };
+
+        inline Orientation SymmetryOrientation(Symmetry s)
+        {
+            switch (s)
+            {
+            case SYMMETRY_HORIZONTAL: return ORIENT_FLIP_X;
+            case SYMMETRY_VERTICAL: return ORIENT_FLIP_Z;
+            case SYMMETRY_DIAGONAL: return ORIENT_TRANSPOSE;
+            case SYMMETRY_ANTI_DIAGONAL: return ORIENT_ANTI_TRANSPOSE;
+            default: return ORIENT_ROTATE_180;
+            }
+        }
+
+        // Whether point (or pixel) x,z is in the half of the map a symmetry overwrites, given its mirror image mx,mz.  The
+        // first half, kept by default, is the west, north, north east, north west or north one (for ROTATE_180, with the
+        // west of the centre line); fromSecondHalf keeps the other.  Points on the mirror line are kept
+        template<typename T>
+        inline bool SymmetryOverwrites(Symmetry s, bool fromSecondHalf, T x, T z, T mx, T mz)
+        {
+            if (fromSecondHalf)
+            {
+                std::swap(x, mx);
+                std::swap(z, mz);
+            }
+            switch (s)
+            {
+            case SYMMETRY_HORIZONTAL: return mx < x;
+            case SYMMETRY_VERTICAL: return mz < z;
+            case SYMMETRY_DIAGONAL: return mz - mx < z - x;
+            case SYMMETRY_ANTI_DIAGONAL: return mx + mz < x + z;
+            default: return mz < z || (mz == z && mx < x);
+            }
+        }
+
+        // Rows [row0,row1) of W x H image im made symmetric.  mirrored holds im laid out by SymmetryOrientation(s), which is
+        // already right for the overwritten half; the pixels of the half that is kept are copied back into it from im
+        template<typename DataT>
+        inline void SymmetrizeImage(const DataT *im, DataT *mirrored, int W, int H, Symmetry s, bool fromSecondHalf, int row0, int row1)
+        {
+            Orientation o = SymmetryOrientation(s);
+            for (int z = row0; z < row1; ++z)
+            {
+                std::size_t offset = std::size_t(W) * z;
+                for (int x = 0; x < W; ++x)
+                {
+                    int u = OrientFlipsX(o) ? W - 1 - x : x, v = OrientFlipsZ(o) ? H - 1 - z : z;
+                    int mx = OrientSwapsAxes(o) ? v : u, mz = OrientSwapsAxes(o) ? u : v;
+                    if (!SymmetryOverwrites(s, fromSecondHalf, x, z, mx, mz))
+                    {
+                        mirrored[offset + x] = im[offset + x];
+                    }
+                }
+            }
+        }
+
+        // Absolute differences between count values of a and b: their sum, the largest and how many aren't zero.  A
+        // straight-line loop the compiler turns into vector instructions, over spans short enough (a row) that the
+        // 32 bit sum can't overflow
+        template<typename DataT>
+        inline void AccumulateDifferences(const DataT *a, const DataT *b, int count,
+            std::int64_t &sum, int &largest, std::size_t &differing)
+        {
+            std::int32_t rowSum = 0, rowLargest = largest, rowDiffering = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                std::int32_t d = std::int32_t(a[i]) - std::int32_t(b[i]);
+                d = d < 0 ? -d : d;
+                rowSum += d;
+                rowLargest = rowLargest > d ? rowLargest : d;
+                rowDiffering += d != 0 ? 1 : 0;
+            }
+            sum += rowSum;
+            largest = rowLargest;
+            differing += std::size_t(rowDiffering);
+        }
+
+        // AccumulateDifferences over rows [row0,row1) of W x H image im and its mirror image under s, compared as Element
+        // values (eg the bytes of a pixel).  mirrored has room for the mirror image: all of it when the symmetry swaps the
+        // axes, so OrientImage can fill the rows in tiles, otherwise one row, rebuilt for each row
+        template<typename Element, typename DataT>
+        inline void AccumulateAsymmetry(const DataT *im, DataT *mirrored, int W, int H, Symmetry s, int row0, int row1,
+            std::int64_t &sum, int &largest, std::size_t &differing)
+        {
+            Orientation o = SymmetryOrientation(s);
+            int count = int(W * sizeof(DataT) / sizeof(Element));
+            if (OrientSwapsAxes(o))
+            {
+                OrientImage(im, mirrored, W, H, o, row0, row1);
+            }
+            for (int z = row0; z < row1; ++z)
+            {
+                const DataT *row = im + std::size_t(W) * z;
+                const DataT *mirror = mirrored + std::size_t(W) * z;
+                if (!OrientSwapsAxes(o))
+                {
+                    const DataT *src = im + std::size_t(W) * (OrientFlipsZ(o) ? H - 1 - z : z);
+                    if (OrientFlipsX(o))
+                    {
+                        std::reverse_copy(src, src + W, mirrored);
+                        mirror = mirrored;
+                    }
+                    else
+                    {
+                        mirror = src;
+                    }
+                }
+                AccumulateDifferences((const Element*)row, (const Element*)mirror, count, sum, largest, differing);
+            }
+        }
+
+
+        // Tangent-space normal maps are stored DXT5nm style: x in alpha, y in green.
+        // Red and blue carry no information (written as 255 and 0 so the colour endpoints spend all their precision on green)
+        // and z is reconstructed from x and y.  The kernels below work on planar unit vectors so that whole rows can be
+        // processed with straight-line, vectorisable loops.
+
+        struct NormalMap
+        {
+            NormalMap() : width(0), height(0) { }
+            NormalMap(int w, int h) : width(w), height(h), x(w*h), y(w*h), z(w*h) { }
+
+            int width;
+            int height;
+            std::vector<float> x;
+            std::vector<float> y;
+            std::vector<float> z;
+        };
+
+        // rgba (4 bytes per texel, as decoded from DXT5) <-> unit normals
+        void UnpackNormals(const std::uint8_t *rgba, NormalMap &nm);
+        void PackNormals(const NormalMap &nm, std::uint8_t *rgba);
+        void PackNormalRows(const NormalMap &nm, int row0, int row1, std::uint8_t *rgba);
+
+        // Resamples to W x H with a tent filter whose footprint widens when minifying, so that no source texel is skipped.
+        // Full 3D vectors are filtered, then x and y are multiplied by gainX and gainY (slope change of a non-uniform
+        // resize) and the result is renormalized.  Filtering the packed bytes instead would shorten the vectors and
+        // flatten the lighting.
+        NormalMap ResampleNormals(const NormalMap &nm, int W, int H, float gainX, float gainY);
+    }
+}
@@ -0,0 +1,160 @@
+#include "import_session.h"
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace nfa {
+    namespace scmp {
+
+        // copy rows [z0,z1) x columns [x0,x1) of a W wide image, clipped to it, from one buffer to another
+        template<typename T>
+        static void CopyRectangle(const T *from, T *to, int W, int H, int x0, int z0, int x1, int z1)
+        {
+            x0 = std::max(x0, 0);
+            z0 = std::max(z0, 0);
+            x1 = std::min(x1, W);
+            z1 = std::min(z1, H);
+            for (int z = z0; z < z1 && x0 < x1; ++z)
+            {
+                std::copy(from + std::size_t(W) * z + x0, from + std::size_t(W) * z + x1, to + std::size_t(W) * z + x0);
+            }
+        }
+
+
+        // copy the top level blocks (or pixels) of a dds that cover the map rectangle [x0,x1) x [z0,z1), for a map of
+        // W x H cells.  generous by a texel on each side, to cover ImportDds' rounding; the extra texels are unchanged anyway
+        static void CopyDdsRectangle(const CowVector<std::uint8_t> &from, CowVector<std::uint8_t> &to, int W, int H,
+            int x0, int z0, int x1, int z1)
+        {
+            if (from.size() != to.size() || from.empty())
+            {
+                return;
+            }
+            dds::DdsTexture texture = dds::DdsTexture::parse(from.data(), from.size());
+            int tw = int(texture.width), th = int(texture.height);
+            int tx0 = int(std::floor(double(x0) * tw / W)) - 1, tx1 = int(std::ceil(double(x1) * tw / W)) + 1;
+            int tz0 = int(std::floor(double(z0) * th / H)) - 1, tz1 = int(std::ceil(double(z1) * th / H)) + 1;
+
+            int dim = texture.blockDim;
+            int blocksWide = (tw + dim - 1) / dim, blocksHigh = (th + dim - 1) / dim;
+            int bx0 = std::max(tx0, 0) / dim, bx1 = std::min((std::max(tx1, 0) + dim - 1) / dim, blocksWide);
+            int bz0 = std::max(tz0, 0) / dim, bz1 = std::min((std::max(tz1, 0) + dim - 1) / dim, blocksHigh);
+            if (bx0 >= bx1 || bz0 >= bz1)
+            {
+                return;
+            }
+
+            const std::uint8_t *src = from.data() + texture.mipOffset[0];
+            std::uint8_t *dst = to.data() + texture.mipOffset[0];
+            std::size_t rowBytes = std::size_t(blocksWide) * texture.blockBytes;
+            for (int bz = bz0; bz < bz1; ++bz)
+            {
+                std::size_t offset = rowBytes * bz + std::size_t(bx0) * texture.blockBytes;
+                std::memcpy(dst + offset, src + offset, std::size_t(bx1 - bx0) * texture.blockBytes);
+            }
+        }
+
+
+        // the base's items outside [x0,x1) x [z0,z1), in order, then the imported ones: the vector Import makes from
+        // them.  The base's are shared by pointer, not copied: neither the base nor the result is edited in place, and a
+        // clone of the result copies its items before its first write
+        template<typename T>
+        static std::vector< std::shared_ptr<T> > WithBaseItems(const std::vector< std::shared_ptr<T> > &base,
+            const SpatialGrid &baseGrid, const std::vector< std::shared_ptr<T> > &imported, int x0, int z0, int x1, int z1)
+        {
+            std::vector<std::uint32_t> covered;
+            baseGrid.QueryRectangle(float(x0), float(z0), float(x1), float(z1), covered);
+
+            std::vector< std::shared_ptr<T> > items;
+            items.reserve(base.size() - covered.size() + imported.size());
+            auto nextCovered = covered.begin();
+            for (std::uint32_t i = 0u; i < base.size(); ++i)
+            {
+                if (nextCovered != covered.end() && *nextCovered == i)
+                {
+                    ++nextCovered;
+                    continue;
+                }
+                items.push_back(base[i]);
+            }
+            items.insert(items.end(), imported.begin(), imported.end());
+            return items;
+        }
+
+
+        ImportSession::ImportSession(const Scmp &base, const Scmp &source, bool additiveTerrain) :
+            m_base(base.Clone()),
+            m_source(source.Clone()),
+            m_result(base.Clone()),
+            m_additive(additiveTerrain),
+            m_placed(false),
+            m_column0(0),
+            m_row0(0)
+        {
+        }
+
+
+        void ImportSession::Place(int column0, int row0, const ProgressCallback &progress)
+        {
+            if (m_placed)
+            {
+                Restore(m_column0, m_row0);
+            }
+            // if the import throws, the result is part imported: treat it as covering the whole placement
+            m_placed = true;
+            m_column0 = column0;
+            m_row0 = row0;
+
+            // Import is left only the source's items to place, and the base's are added back around them, so no item
+            // of the map is copied or re-indexed for a move
+            const Scmp &base = *m_base;
+            Scmp &result = *m_result;
+            result.waveGenerators.clear();
+            result.decals.clear();
+            result.props.clear();
+            result.Import(*m_source, column0, row0, m_additive, progress);
+
+            int x1 = column0 + m_source->width, z1 = row0 + m_source->height;
+            result.waveGenerators = WithBaseItems(base.waveGenerators.Get(), *base.ItemGrid(Scmp::LAYER_WAVE_GENERATORS),
+                result.waveGenerators.Get(), column0, row0, x1, z1);
+            result.decals = WithBaseItems(base.decals.Get(), *base.ItemGrid(Scmp::LAYER_DECALS),
+                result.decals.Get(), column0, row0, x1, z1);
+            result.props = WithBaseItems(base.props.Get(), *base.ItemGrid(Scmp::LAYER_PROPS),
+                result.props.Get(), column0, row0, x1, z1);
+        }
+
+
+        // put back the layers importing at column0,row0 changed (Place recomposes the items).  the result's buffers were
+        // made its own by the first import, so these are in place copies of the rectangle only
+        void ImportSession::Restore(int column0, int row0)
+        {
+            const Scmp &base = *m_base;
+            Scmp &result = *m_result;
+            int W = base.width, H = base.height;
+            int x1 = column0 + m_source->width, z1 = row0 + m_source->height;
+
+            CopyRectangle(base.heightMapData.data(), result.heightMapData.data(), W + 1, H + 1, column0, row0, x1 + 1, z1 + 1);
+            if (base.terrainTypeData.size() == std::size_t(W) * H && result.terrainTypeData.size() == base.terrainTypeData.size())
+            {
+                CopyRectangle(base.terrainTypeData.data(), result.terrainTypeData.data(), W, H, column0, row0, x1, z1);
+            }
+
+            for (auto layers : {
+                std::make_pair(&base.normalMapData, &result.normalMapData),
+                std::make_pair(&base.strataLerpData, &result.strataLerpData),
+                std::make_pair(&base.waterLerpData, &result.waterLerpData) })
+            {
+                for (std::size_t n = 0u; n < layers.first->size() && n < layers.second->size(); ++n)
+                {
+                    CopyDdsRectangle((*layers.first)[n], (*layers.second)[n], W, H, column0, row0, x1, z1);
+                }
+            }
+        }
+
+    }
+}
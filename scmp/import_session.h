@@ -0,0 +1,41 @@
+#pragma once
+
+#include "progress.h"
+
+#include <memory>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // Scmp::Import of one map into another at a placement that changes many times, eg while the user drags it.  Place
+        // first puts back, from the base map, only the rectangle the previous placement covered in each layer, then
+        // imports into the new one, so moving a tile costs about as much as the tile rather than the map.  The items
+        // are the base's, shared rather than copied, around copies of the source's.  The result is the same as
+        // importing into a fresh copy of the base
+        class ImportSession
+        {
+        public:
+            // source is imported as it is, so Resize it first.  Both maps are kept as clones, which share their buffers
+            ImportSession(const Scmp &base, const Scmp &source, bool additiveTerrain);
+
+            void Place(int column0, int row0, const ProgressCallback &progress = ProgressCallback());
+            bool Placed() const { return m_placed; }
+
+            // the base map with the source imported at the last placement.  Clone it to keep or edit it
+            const Scmp &Result() const { return *m_result; }
+
+        private:
+            void Restore(int column0, int row0);
+
+            std::shared_ptr<const Scmp> m_base;
+            std::shared_ptr<const Scmp> m_source;
+            std::shared_ptr<Scmp> m_result;
+            bool m_additive;
+            bool m_placed;
+            int m_column0;
+            int m_row0;
+        };
+    }
+}
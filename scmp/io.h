@@ -2,6 +2,9 @@
 
 #include <istream>
 #include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
 #include <string>
 #include <type_traits>
 
@@ -10,6 +13,35 @@ namespace nfa {
 
         std::size_t BytesRemaining(std::istream &is);
 
+        // A read only streambuf over bytes held elsewhere, so a map already read into memory can be parsed by
+        // Scmp(std::istream &) without first being copied into a stringstream.  Supports the seeks BytesRemaining makes
+        class MemoryStreamBuf : public std::streambuf
+        {
+        public:
+            MemoryStreamBuf(const char *begin, const char *end)
+            {
+                setg(const_cast<char*>(begin), const_cast<char*>(begin), const_cast<char*>(end));
+            }
+
+        protected:
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+            {
+                char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+                if (!(which & std::ios_base::in) || off < eback() - base || off > egptr() - base)
+                {
+                    return pos_type(off_type(-1));
+                }
+                setg(eback(), base + off, egptr());
+                return pos_type(off_type(gptr() - eback()));
+            }
+
+            pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+            {
+                return seekoff(off_type(pos), std::ios_base::beg, which);
+            }
+        };
+
+
         template<typename T>
         inline void Read(std::istream &is, T &result)
         {
@@ -49,10 +81,10 @@ namespace nfa {
                 return;
             }
 
-            if (BytesRemaining(is) / sizeof(ContainerT::value_type) < itemCount)
+            if (BytesRemaining(is) / sizeof(typename ContainerT::value_type) < itemCount)
             {
                 std::ostringstream ss;
-                ss << "Not enough bytes remaining to read " << itemCount << " items of size " << sizeof(ContainerT::value_type);
+                ss << "Not enough bytes remaining to read " << itemCount << " items of size " << sizeof(typename ContainerT::value_type);
                 throw std::runtime_error(ss.str());
             }
 
@@ -0,0 +1,607 @@
+#include "journal.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        namespace {
+
+            enum BufferGroup
+            {
+                BUFFER_PREVIEW,
+                BUFFER_HEIGHTMAP,
+                BUFFER_NORMALMAP,
+                BUFFER_STRATA_LERP,
+                BUFFER_WATER_LERP,
+                BUFFER_WATER_FOAM,
+                BUFFER_WATER_FLATNESS,
+                BUFFER_WATER_DEPTH_BIAS,
+                BUFFER_TERRAIN_TYPE
+            };
+
+
+            // one buffer's change: XOR runs if its size held, otherwise its whole contents before and after
+            struct BufferDelta
+            {
+                struct Run
+                {
+                    std::size_t offset;
+                    std::size_t length;
+                    std::vector<std::uint8_t> xorRle;
+                };
+
+                int group;
+                std::size_t index;
+                bool resized;
+                std::size_t beforeBytes;
+                std::size_t afterBytes;
+                std::vector<Run> runs;
+                std::vector<std::uint8_t> beforeRle;
+                std::vector<std::uint8_t> afterRle;
+            };
+        }
+
+
+        struct EditJournal::Entry
+        {
+            std::string name;
+            std::shared_ptr<Scmp> before;       // without buffers
+            std::shared_ptr<Scmp> after;
+            std::vector<BufferDelta> deltas;
+            std::uint64_t bytes;
+        };
+
+
+        // PackBits: a header byte n < 128 is followed by n + 1 literal bytes, n > 128 by one byte repeated 257 - n times
+        static void RleEncode(const std::uint8_t *p, std::size_t n, std::vector<std::uint8_t> &out)
+        {
+            std::size_t i = 0u;
+            while (i < n)
+            {
+                std::size_t repeat = 1u;
+                while (i + repeat < n && repeat < 128u && p[i + repeat] == p[i])
+                {
+                    ++repeat;
+                }
+                if (repeat >= 3u)
+                {
+                    out.push_back(std::uint8_t(257u - repeat));
+                    out.push_back(p[i]);
+                    i += repeat;
+                    continue;
+                }
+
+                std::size_t start = i;
+                while (i < n && i - start < 128u && !(i + 2u < n && p[i] == p[i + 1u] && p[i] == p[i + 2u]))
+                {
+                    ++i;
+                }
+                out.push_back(std::uint8_t(i - start - 1u));
+                out.insert(out.end(), p + start, p + i);
+            }
+        }
+
+
+        // decodes n bytes into out, or XORs them into it
+        static void RleDecode(const std::vector<std::uint8_t> &rle, std::uint8_t *out, std::size_t n, bool xorInto)
+        {
+            std::size_t i = 0u, o = 0u;
+            while (i < rle.size() && o < n)
+            {
+                std::uint8_t header = rle[i++];
+                if (header < 128u)
+                {
+                    std::size_t count = std::min<std::size_t>(header + 1u, n - o);
+                    for (std::size_t k = 0u; k < count; ++k)
+                    {
+                        out[o + k] = xorInto ? std::uint8_t(out[o + k] ^ rle[i + k]) : rle[i + k];
+                    }
+                    i += header + 1u;
+                    o += count;
+                }
+                else if (header > 128u)
+                {
+                    std::size_t count = std::min<std::size_t>(257u - header, n - o);
+                    std::uint8_t value = rle[i++];
+                    if (xorInto)
+                    {
+                        if (value != 0u)
+                        {
+                            for (std::size_t k = 0u; k < count; ++k)
+                            {
+                                out[o + k] ^= value;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        std::memset(out + o, value, count);
+                    }
+                    o += count;
+                }
+            }
+            if (o != n)
+            {
+                throw std::runtime_error("edit journal: corrupt delta");
+            }
+        }
+
+
+        // the ranges where a and b differ.  ranges are found a chunk at a time, so differences less than a chunk apart
+        // share a range and the XOR's zeros between them compress away
+        static void DiffRuns(const std::uint8_t *a, const std::uint8_t *b, std::size_t n, std::vector<BufferDelta::Run> &runs)
+        {
+            const std::size_t chunk = 64u;
+            std::size_t i = 0u;
+            std::vector<std::uint8_t> x;
+            while (i < n)
+            {
+                std::size_t length = std::min(chunk, n - i);
+                if (std::memcmp(a + i, b + i, length) == 0)
+                {
+                    i += length;
+                    continue;
+                }
+
+                std::size_t begin = i;
+                while (a[begin] == b[begin])
+                {
+                    ++begin;
+                }
+                std::size_t end = i;
+                while (end < n)
+                {
+                    length = std::min(chunk, n - end);
+                    if (std::memcmp(a + end, b + end, length) == 0)
+                    {
+                        break;
+                    }
+                    end += length;
+                }
+                while (a[end - 1u] == b[end - 1u])
+                {
+                    --end;
+                }
+
+                x.resize(end - begin);
+                for (std::size_t k = begin; k < end; ++k)
+                {
+                    x[k - begin] = a[k] ^ b[k];
+                }
+                BufferDelta::Run run;
+                run.offset = begin;
+                run.length = end - begin;
+                RleEncode(x.data(), x.size(), run.xorRle);
+                runs.push_back(std::move(run));
+                i = end;
+            }
+        }
+
+
+        // calls f(group, index, first's buffer, second's buffer) for every buffer either map has; a buffer only one of
+        // them has comes with a null pointer for the other
+        template<typename V1, typename V2, typename F>
+        static void ForEachBufferPair(int group, V1 &first, V2 &second, F f)
+        {
+            for (std::size_t i = 0u; i < std::max(first.size(), second.size()); ++i)
+            {
+                f(group, i, i < first.size() ? &first[i] : nullptr, i < second.size() ? &second[i] : nullptr);
+            }
+        }
+
+        template<typename ScmpA, typename ScmpB, typename F>
+        static void ForEachBufferPair(ScmpA &first, ScmpB &second, F f)
+        {
+            f(BUFFER_PREVIEW, 0u, &first.previewImageData, &second.previewImageData);
+            f(BUFFER_HEIGHTMAP, 0u, &first.heightMapData, &second.heightMapData);
+            ForEachBufferPair(BUFFER_NORMALMAP, first.normalMapData, second.normalMapData, f);
+            ForEachBufferPair(BUFFER_STRATA_LERP, first.strataLerpData, second.strataLerpData, f);
+            ForEachBufferPair(BUFFER_WATER_LERP, first.waterLerpData, second.waterLerpData, f);
+            f(BUFFER_WATER_FOAM, 0u, &first.waterFoamMask, &second.waterFoamMask);
+            f(BUFFER_WATER_FLATNESS, 0u, &first.waterFlatnessMask, &second.waterFlatnessMask);
+            f(BUFFER_WATER_DEPTH_BIAS, 0u, &first.waterDepthBiasMask, &second.waterDepthBiasMask);
+            f(BUFFER_TERRAIN_TYPE, 0u, &first.terrainTypeData, &second.terrainTypeData);
+        }
+
+
+        // f(offset, length) for the bytes of each row of the region in a w x h image of elementBytes per pixel
+        template<typename F>
+        static void ForEachRegionRow(const EditRegion &region, int w, int h, std::size_t elementBytes, F f)
+        {
+            int x0 = std::max(region.column0, 0), z0 = std::max(region.row0, 0);
+            int x1 = int(std::min<long long>((long long)region.column0 + region.width, w));
+            int z1 = int(std::min<long long>((long long)region.row0 + region.height, h));
+            for (int z = z0; z < z1 && x0 < x1; ++z)
+            {
+                f((std::size_t(w) * z + x0) * elementBytes, std::size_t(x1 - x0) * elementBytes);
+            }
+        }
+
+
+        template<typename T>
+        static void CopyRegion(const CowVector<T> &buffer, const EditRegion &region, int w, int h, std::vector<std::uint8_t> &out)
+        {
+            const std::uint8_t *data = (const std::uint8_t*)buffer.Get().data();
+            out.clear();
+            ForEachRegionRow(region, w, h, sizeof(T), [&](std::size_t offset, std::size_t length)
+            {
+                out.insert(out.end(), data + offset, data + offset + length);
+            });
+        }
+
+
+        // the runs where the region's rows differ from their copy as the edit began
+        template<typename T>
+        static void DiffRegion(const std::vector<std::uint8_t> &before, const CowVector<T> &after, const EditRegion &region,
+            int w, int h, std::vector<BufferDelta::Run> &runs)
+        {
+            const std::uint8_t *data = (const std::uint8_t*)after.Get().data();
+            std::size_t copied = 0u;
+            ForEachRegionRow(region, w, h, sizeof(T), [&](std::size_t offset, std::size_t length)
+            {
+                std::size_t first = runs.size();
+                DiffRuns(before.data() + copied, data + offset, length, runs);
+                for (std::size_t r = first; r < runs.size(); ++r)
+                {
+                    runs[r].offset += offset;
+                }
+                copied += length;
+            });
+        }
+
+
+        // the map without its buffers
+        static std::shared_ptr<Scmp> Header(const Scmp &scmp)
+        {
+            std::shared_ptr<Scmp> header = scmp.Clone();
+            ForEachBufferPair(*header, *header, [](int, std::size_t, auto *buffer, auto *)
+            {
+                buffer->clear();
+            });
+            return header;
+        }
+
+
+        template<typename T>
+        static void ApplyDelta(CowVector<T> &buffer, const BufferDelta &delta, bool undo)
+        {
+            if (delta.resized)
+            {
+                std::size_t bytes = undo ? delta.beforeBytes : delta.afterBytes;
+                std::vector<T> contents(bytes / sizeof(T));
+                RleDecode(undo ? delta.beforeRle : delta.afterRle, (std::uint8_t*)contents.data(), bytes, false);
+                buffer = std::move(contents);
+            }
+            else
+            {
+                std::uint8_t *data = (std::uint8_t*)buffer.data();
+                for (const BufferDelta::Run &run : delta.runs)
+                {
+                    RleDecode(run.xorRle, data + run.offset, run.length, true);
+                }
+            }
+        }
+
+
+        // make scmp the header's map, keeping its buffers, then undo or redo the deltas on them
+        static void Restore(Scmp &scmp, const Scmp &header, const std::vector<BufferDelta> &deltas, bool undo)
+        {
+            {
+                std::shared_ptr<const Scmp> buffers = scmp.Clone();
+                scmp = *header.Clone();
+                ForEachBufferPair(*buffers, scmp, [](int, std::size_t, const auto *live, auto *restored)
+                {
+                    if (live && restored)
+                    {
+                        *restored = *live;
+                    }
+                });
+            }
+
+            // buffers is gone, so the deltas write in place unless the journal's neighbours still share a buffer
+            ForEachBufferPair(scmp, scmp, [&](int group, std::size_t index, auto *buffer, auto *)
+            {
+                for (const BufferDelta &delta : deltas)
+                {
+                    if (delta.group == group && delta.index == index)
+                    {
+                        ApplyDelta(*buffer, delta, undo);
+                    }
+                }
+            });
+            scmp.InvalidateItemIndices();
+        }
+
+
+        EditJournal::EditJournal() :
+            m_enabled(false),
+            m_memoryBudget(0u),
+            m_bytes(0u),
+            m_position(0u),
+            m_depth(0)
+        {
+            m_regional[0] = m_regional[1] = false;
+        }
+
+
+        EditJournal::EditJournal(const EditJournal &) :
+            m_enabled(false),
+            m_memoryBudget(0u),
+            m_bytes(0u),
+            m_position(0u),
+            m_depth(0)
+        {
+            m_regional[0] = m_regional[1] = false;
+        }
+
+
+        EditJournal &EditJournal::operator=(const EditJournal &)
+        {
+            return *this;
+        }
+
+
+        EditJournal::~EditJournal()
+        {
+        }
+
+
+        void EditJournal::Enable(bool enable, std::uint64_t memoryBudget)
+        {
+            m_enabled = enable;
+            m_memoryBudget = memoryBudget;
+            if (!enable)
+            {
+                Clear();
+            }
+            Trim();
+        }
+
+
+        void EditJournal::Begin(const Scmp &scmp, const std::string &name, const EditRegion &region)
+        {
+            if (!m_enabled)
+            {
+                return;
+            }
+            if (m_depth++ == 0)
+            {
+                m_name = name;
+                m_before = scmp.Clone();
+                m_region = region;
+
+                // a region less than the map is copied out rather than shared, so the edit writes it in place
+                int W = scmp.width, H = scmp.height;
+                bool whole = region.column0 <= 0 && region.row0 <= 0 &&
+                    (long long)region.column0 + region.width > W && (long long)region.row0 + region.height > H;
+                m_regional[0] = !whole && W > 0 && H > 0 && scmp.heightMapData.size() == std::size_t(W + 1) * (H + 1);
+                m_regional[1] = !whole && W > 0 && H > 0 && scmp.terrainTypeData.size() == std::size_t(W) * H;
+                if (m_regional[0])
+                {
+                    CopyRegion(scmp.heightMapData, region, W + 1, H + 1, m_regionBefore[0]);
+                    m_before->heightMapData.clear();
+                }
+                if (m_regional[1])
+                {
+                    CopyRegion(scmp.terrainTypeData, region, W, H, m_regionBefore[1]);
+                    m_before->terrainTypeData.clear();
+                }
+            }
+        }
+
+
+        void EditJournal::End(Scmp &scmp)
+        {
+            if (m_depth == 0 || --m_depth > 0)
+            {
+                return;
+            }
+
+            std::shared_ptr<Scmp> before = m_before;
+            m_before.reset();
+            std::vector<std::uint8_t> regionBefore[2];
+            regionBefore[0].swap(m_regionBefore[0]);
+            regionBefore[1].swap(m_regionBefore[1]);
+            bool regional[2] = { m_regional[0], m_regional[1] };
+            m_regional[0] = m_regional[1] = false;
+
+            int W = before->width, H = before->height;
+            if ((regional[0] || regional[1]) && (scmp.width != W || scmp.height != H ||
+                (regional[0] && scmp.heightMapData.size() != std::size_t(W + 1) * (H + 1)) ||
+                (regional[1] && scmp.terrainTypeData.size() != std::size_t(W) * H)))
+            {
+                // resized: what lay outside the region wasn't kept, so this edit can't be undone, nor those before it
+                Clear();
+                return;
+            }
+
+            std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+            entry->name = m_name;
+            entry->bytes = sizeof(Entry);
+            auto addRegionDelta = [&](int group, std::vector<BufferDelta::Run> runs)
+            {
+                if (runs.empty())
+                {
+                    return;
+                }
+                BufferDelta delta;
+                delta.group = group;
+                delta.index = 0u;
+                delta.resized = false;
+                delta.beforeBytes = delta.afterBytes = 0u;
+                delta.runs = std::move(runs);
+                for (const BufferDelta::Run &run : delta.runs)
+                {
+                    entry->bytes += sizeof(run) + run.xorRle.size();
+                }
+                entry->deltas.push_back(std::move(delta));
+            };
+            if (regional[0])
+            {
+                std::vector<BufferDelta::Run> runs;
+                DiffRegion(regionBefore[0], scmp.heightMapData, m_region, W + 1, H + 1, runs);
+                addRegionDelta(BUFFER_HEIGHTMAP, std::move(runs));
+            }
+            if (regional[1])
+            {
+                std::vector<BufferDelta::Run> runs;
+                DiffRegion(regionBefore[1], scmp.terrainTypeData, m_region, W, H, runs);
+                addRegionDelta(BUFFER_TERRAIN_TYPE, std::move(runs));
+            }
+
+            ForEachBufferPair(*before, scmp, [&](int group, std::size_t index, const auto *b, const auto *a)
+            {
+                if ((group == BUFFER_HEIGHTMAP && regional[0]) || (group == BUFFER_TERRAIN_TYPE && regional[1]))
+                {
+                    return;     // recorded above
+                }
+                std::size_t beforeBytes = b ? b->size() * sizeof(b->Get()[0]) : 0u;
+                std::size_t afterBytes = a ? a->size() * sizeof(a->Get()[0]) : 0u;
+                const std::uint8_t *beforeData = b ? (const std::uint8_t*)b->data() : nullptr;
+                const std::uint8_t *afterData = a ? (const std::uint8_t*)a->data() : nullptr;
+                if (beforeData == afterData && beforeBytes == afterBytes)
+                {
+                    return;     // still shared, so untouched
+                }
+
+                BufferDelta delta;
+                delta.group = group;
+                delta.index = index;
+                delta.beforeBytes = beforeBytes;
+                delta.afterBytes = afterBytes;
+                delta.resized = beforeBytes != afterBytes;
+                if (delta.resized)
+                {
+                    RleEncode(beforeData, beforeBytes, delta.beforeRle);
+                    RleEncode(afterData, afterBytes, delta.afterRle);
+                    entry->bytes += delta.beforeRle.size() + delta.afterRle.size();
+                }
+                else
+                {
+                    DiffRuns(beforeData, afterData, beforeBytes, delta.runs);
+                    if (delta.runs.empty())
+                    {
+                        return;
+                    }
+                    for (const BufferDelta::Run &run : delta.runs)
+                    {
+                        entry->bytes += sizeof(run) + run.xorRle.size();
+                    }
+                }
+                entry->deltas.push_back(std::move(delta));
+            });
+
+            before = Header(*before);
+            entry->before = before;
+            entry->after = Header(scmp);
+
+            for (std::size_t i = m_position; i < m_entries.size(); ++i)
+            {
+                m_bytes -= m_entries[i]->bytes;
+            }
+            m_entries.resize(m_position);
+            m_entries.push_back(entry);
+            m_bytes += entry->bytes;
+            m_position = m_entries.size();
+            Trim();
+        }
+
+
+        bool EditJournal::Undo(Scmp &scmp)
+        {
+            if (m_depth > 0)
+            {
+                throw std::runtime_error("can't undo during an edit");
+            }
+            if (!CanUndo())
+            {
+                return false;
+            }
+            const Entry &entry = *m_entries[--m_position];
+            Restore(scmp, *entry.before, entry.deltas, true);
+            return true;
+        }
+
+
+        bool EditJournal::Redo(Scmp &scmp)
+        {
+            if (m_depth > 0)
+            {
+                throw std::runtime_error("can't redo during an edit");
+            }
+            if (!CanRedo())
+            {
+                return false;
+            }
+            const Entry &entry = *m_entries[m_position++];
+            Restore(scmp, *entry.after, entry.deltas, false);
+            return true;
+        }
+
+
+        std::string EditJournal::UndoName() const
+        {
+            return CanUndo() ? m_entries[m_position - 1u]->name : std::string();
+        }
+
+
+        std::string EditJournal::RedoName() const
+        {
+            return CanRedo() ? m_entries[m_position]->name : std::string();
+        }
+
+
+        void EditJournal::Clear()
+        {
+            m_entries.clear();
+            m_position = 0u;
+            m_bytes = 0u;
+        }
+
+
+        void EditJournal::Trim()
+        {
+            // always keep the newest edit, however big
+            std::size_t drop = 0u;
+            while (m_bytes > m_memoryBudget && drop + 1u < m_entries.size())
+            {
+                m_bytes -= m_entries[drop++]->bytes;
+            }
+            if (drop > m_position)
+            {
+                // the map's state is among those dropped, so what is left can't be reached from it
+                Clear();
+                return;
+            }
+            m_entries.erase(m_entries.begin(), m_entries.begin() + drop);
+            m_position -= drop;
+        }
+
+
+        EditScope::EditScope(Scmp &scmp, const std::string &name, const EditRegion &region) :
+            m_scmp(scmp)
+        {
+            m_scmp.BeginEdit(name, region);
+        }
+
+
+        EditScope::~EditScope()
+        {
+            try
+            {
+                m_scmp.EndEdit();
+            }
+            catch (...)
+            {
+                // out of memory recording the edit: the history no longer matches the map
+                m_scmp.journal.Clear();
+            }
+        }
+
+    }
+}
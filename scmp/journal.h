@@ -0,0 +1,102 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // The part of the heightmap and terrain types an edit may change: heightmap vertices [column0, column0 + width) x
+        // [row0, row0 + height), and the same cells of the terrain types, clipped to each.  The default is all of them.
+        // With less, the journal copies and compares only those rows of the two buffers rather than the whole of each,
+        // so a brush stroke costs about its own size.  The edit must not change them outside the region or resize them
+        // (which clears the history).  Other buffers are compared whole, if the edit wrote to them
+        struct EditRegion
+        {
+            EditRegion() : column0(0), row0(0), width(INT_MAX), height(INT_MAX) { }
+            EditRegion(int c0, int r0, int w, int h) : column0(c0), row0(r0), width(w), height(h) { }
+
+            int column0;
+            int row0;
+            int width;
+            int height;
+        };
+
+
+        // Undo/redo history of one map.  An edit records, for each buffer it changed in place, the XOR of the old and new
+        // contents over the byte ranges that differ, run length encoded: one record serves both undo and redo, and the
+        // unchanged bytes inside a range cost next to nothing.  Buffers an edit resized are recorded whole, run length
+        // encoded.  Everything else (sizes, settings and the item vectors, whose unchanged layers are shared rather than
+        // copied) is kept as a map without its buffers.  Undo and redo take time proportional to what the edit changed.
+        //
+        // Copies of a map start with an empty, disabled journal; assigning a map keeps the journal it had.  While enabled,
+        // every change must be made between BeginEdit and EndEdit (Resize, Import, RegenerateNormalMap, RenderPreview and
+        // Recipe::Apply do that themselves): a change made outside one is not recorded and breaks undoing the edits before it
+        class EditJournal
+        {
+        public:
+            EditJournal();
+            EditJournal(const EditJournal &);
+            EditJournal &operator=(const EditJournal &);
+            ~EditJournal();
+
+            // the oldest edits are dropped once the history takes more than memoryBudget bytes.  disabling clears it
+            void Enable(bool enable, std::uint64_t memoryBudget);
+            bool Enabled() const { return m_enabled; }
+
+            // edits nest; only the outermost is recorded, as one step, within its region
+            void Begin(const Scmp &scmp, const std::string &name, const EditRegion &region = EditRegion());
+            void End(Scmp &scmp);
+
+            // false if there is nothing to undo/redo.  Throws std::runtime_error during an edit
+            bool Undo(Scmp &scmp);
+            bool Redo(Scmp &scmp);
+
+            bool CanUndo() const { return m_position > 0u; }
+            bool CanRedo() const { return m_position < m_entries.size(); }
+            std::string UndoName() const;
+            std::string RedoName() const;
+            std::uint64_t Bytes() const { return m_bytes; }
+            void Clear();
+
+        private:
+            struct Entry;
+
+            void Trim();
+
+            bool m_enabled;
+            std::uint64_t m_memoryBudget;
+            std::uint64_t m_bytes;
+            std::vector< std::shared_ptr<Entry> > m_entries;
+            std::size_t m_position;         // entries before it are undoable, those from it redoable
+            int m_depth;
+            std::string m_name;
+            std::shared_ptr<Scmp> m_before; // the map as the outermost edit began
+            EditRegion m_region;
+            // when the region is less than the map, the bytes in it of the heightmap [0] and the terrain types [1] as the
+            // outermost edit began.  m_before holds neither of these buffers
+            bool m_regional[2];
+            std::vector<std::uint8_t> m_regionBefore[2];
+        };
+
+
+        // BeginEdit/EndEdit for the lifetime of a scope, so an edit that throws (eg is cancelled) is still recorded and
+        // can be undone
+        class EditScope
+        {
+        public:
+            EditScope(Scmp &scmp, const std::string &name, const EditRegion &region = EditRegion());
+            ~EditScope();
+            EditScope(const EditScope &) = delete;
+            EditScope &operator=(const EditScope &) = delete;
+
+        private:
+            Scmp &m_scmp;
+        };
+    }
+}
@@ -0,0 +1,802 @@
+#include "layers.h"
+#include "image.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        namespace {
+
+            // a pixel, or block, of a dds texture as an opaque value
+            template<std::size_t N>
+            struct PixelBytes
+            {
+                std::uint8_t bytes[N];
+            };
+        }
+
+        // f(PixelBytes<bytes>())
+        template<typename F>
+        static void WithPixelType(std::size_t bytes, const F &f)
+        {
+            switch (bytes)
+            {
+            case 1: f(PixelBytes<1>()); break;
+            case 2: f(PixelBytes<2>()); break;
+            case 3: f(PixelBytes<3>()); break;
+            case 4: f(PixelBytes<4>()); break;
+            case 8: f(PixelBytes<8>()); break;
+            case 16: f(PixelBytes<16>()); break;
+            default: throw std::runtime_error("dds: unexpected bytes per pixel");
+            }
+        }
+
+
+        // little endian bit fields of a block
+        static std::uint64_t LoadBits(const std::uint8_t *bytes, int count)
+        {
+            std::uint64_t bits = 0u;
+            for (int i = count - 1; i >= 0; --i)
+            {
+                bits = (bits << 8) | bytes[i];
+            }
+            return bits;
+        }
+
+        static void StoreBits(std::uint64_t bits, std::uint8_t *bytes, int count)
+        {
+            for (int i = 0; i < count; ++i, bits >>= 8)
+            {
+                bytes[i] = std::uint8_t(bits);
+            }
+        }
+
+        // the fieldBits wide fields of texels 0..15 of a block, reordered so that texel t takes texel from[t]'s
+        static std::uint64_t PermuteFields(std::uint64_t fields, int fieldBits, const int from[16])
+        {
+            std::uint64_t mask = (std::uint64_t(1) << fieldBits) - 1u, result = 0u;
+            for (int t = 0; t < 16; ++t)
+            {
+                result |= ((fields >> (fieldBits * from[t])) & mask) << (fieldBits * t);
+            }
+            return result;
+        }
+
+        // the endpoints of a DXT block don't depend on where its texels are, so moving texels only moves their indices:
+        // 2 bits each in the colour block, and 3 (DXT5) or 4 (DXT3) in the alpha block before it
+        static void PermuteBlock(std::uint8_t *block, dds::Format format, const int from[16])
+        {
+            std::uint8_t *colour = block + (format == dds::FORMAT_DXT1 ? 0 : 8);
+            StoreBits(PermuteFields(LoadBits(colour + 4, 4), 2, from), colour + 4, 4);
+            if (format == dds::FORMAT_DXT5)
+            {
+                StoreBits(PermuteFields(LoadBits(block + 2, 6), 3, from), block + 2, 6);
+            }
+            else if (format == dds::FORMAT_DXT3)
+            {
+                StoreBits(PermuteFields(LoadBits(block, 8), 4, from), block, 8);
+            }
+        }
+
+
+        void ImportDds(
+            const std::uint8_t *_srcDdsData, std::size_t srcBytes,
+            std::uint8_t *_dstDdsData, std::size_t dstBytes,
+            int srcW, int srcH, int destW, int destH,
+            int column0, int row0, std::string debugName, bool lerp)
+        {
+            dds::DdsFile srcDds(_srcDdsData, srcBytes);
+            dds::DdsFile dstDds(_dstDdsData, dstBytes);
+
+            if (srcDds.bytesPerPixel() != dstDds.bytesPerPixel() || srcDds.glDataFormat() != dstDds.glDataFormat() || srcDds.glDataType() != dstDds.glDataType())
+            {
+                throw std::runtime_error(debugName + ": dds data aren't in the same pixel format. cannot import");
+            }
+
+            // adjust column0,row0 to texture coordinates
+            column0 = 0.5 + float(column0) / float(destW) * dstDds.width();
+            row0 = 0.5 + float(row0) / float(destH) * dstDds.height();
+
+            // scale source texture to fit into dst texture coordinates assuming src texture maps to srcW/H world coordinates and dst texture maps to destW/H world coordinates
+            int srcWScaled = 0.5 + float(srcW) / float(destW) * float(dstDds.width());
+            int srcHScaled = 0.5 + float(srcH) / float(destH) * float(dstDds.height());
+            // actually just set up the buffer here, we'll do the resize in the coming switch statement
+            std::vector<std::uint8_t> srcScaled(srcWScaled*srcHScaled*srcDds.bytesPerPixel());
+
+            std::size_t imageBytes;
+            switch (srcDds.bytesPerPixel())
+            {
+            case 1:
+                ResizeImage<std::uint8_t>((const std::uint8_t*)srcDds.get(imageBytes), (std::uint8_t*)srcScaled.data(),
+                    srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
+                ImportImage<std::uint8_t>(
+                    (std::uint8_t*)srcScaled.data(), srcWScaled, srcHScaled,
+                    (std::uint8_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
+                    column0, row0, false);
+                break;
+
+            case 2:
+                ResizeImage<std::uint16_t>((const std::uint16_t*)srcDds.get(imageBytes), (std::uint16_t*)srcScaled.data(),
+                    srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
+                ImportImage<std::uint16_t>(
+                    (std::uint16_t*)srcScaled.data(), srcWScaled, srcHScaled,
+                    (std::uint16_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
+                    column0, row0, false);
+                break;
+
+            case 4:
+                ResizeImage<std::uint32_t>((const std::uint32_t*)srcDds.get(imageBytes), (std::uint32_t*)srcScaled.data(),
+                    srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
+                ImportImage<std::uint32_t>(
+                    (std::uint32_t*)srcScaled.data(), srcWScaled, srcHScaled,
+                    (std::uint32_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
+                    column0, row0, false);
+                break;
+
+            case 8:
+                ResizeImage<std::uint64_t>((const std::uint64_t*)srcDds.get(imageBytes), (std::uint64_t*)srcScaled.data(),
+                    srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
+                ImportImage<std::uint64_t>(
+                    (std::uint64_t*)srcScaled.data(), srcWScaled, srcHScaled,
+                    (std::uint64_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
+                    column0, row0, false);
+                break;
+
+            default:
+                throw std::runtime_error(debugName + ": dds data unexpected bytes per pixel");
+            }
+        }
+
+
+        static NormalMap DecodeNormalDds(const dds::DdsFile &dds)
+        {
+            std::size_t imageBytes;
+            const std::uint8_t *blocks = (const std::uint8_t*)dds.get(imageBytes);
+
+            std::vector<std::uint8_t> rgba(4u * dds.width() * dds.height());
+            dds::decodeDxt5(blocks, dds.width(), dds.height(), rgba.data());
+
+            NormalMap nm(dds.width(), dds.height());
+            UnpackNormals(rgba.data(), nm);
+            return nm;
+        }
+
+
+        void ImportNormalDds(
+            const std::uint8_t *_srcDdsData, std::size_t srcBytes,
+            std::uint8_t *_dstDdsData, std::size_t dstBytes,
+            int srcW, int srcH, int destW, int destH,
+            int column0, int row0, std::string debugName)
+        {
+            dds::DdsFile srcDds(_srcDdsData, srcBytes);
+            dds::DdsFile dstDds(_dstDdsData, dstBytes);
+
+            if (srcDds.glDataFormat() != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || dstDds.glDataFormat() != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            {
+                ImportDds(_srcDdsData, srcBytes, _dstDdsData, dstBytes, srcW, srcH, destW, destH, column0, row0, debugName, false);
+                return;
+            }
+
+            // adjust column0,row0 to texture coordinates
+            column0 = std::floor(0.5 + float(column0) / float(destW) * dstDds.width());
+            row0 = std::floor(0.5 + float(row0) / float(destH) * dstDds.height());
+
+            int srcWScaled = 0.5 + float(srcW) / float(destW) * float(dstDds.width());
+            int srcHScaled = 0.5 + float(srcH) / float(destH) * float(dstDds.height());
+            if (srcWScaled <= 0 || srcHScaled <= 0)
+            {
+                return;
+            }
+
+            NormalMap srcScaled = ResampleNormals(DecodeNormalDds(srcDds), srcWScaled, srcHScaled, 1.0f, 1.0f);
+            std::vector<std::uint8_t> srcRgba(4u * srcWScaled * srcHScaled);
+            PackNormals(srcScaled, srcRgba.data());
+
+            std::size_t imageBytes;
+            std::uint8_t *dstBlocks = (std::uint8_t*)dstDds.getMutable(imageBytes);
+            int dstW = dstDds.width();
+            int dstH = dstDds.height();
+            int x0 = std::max(column0, 0), y0 = std::max(row0, 0);
+            int x1 = std::min(column0 + srcWScaled, dstW), y1 = std::min(row0 + srcHScaled, dstH);
+            if (x0 >= x1 || y0 >= y1)
+            {
+                return;
+            }
+
+            // the whole blocks under the import, as a texel region of their own
+            int blocksPerRow = (dstW + 3) / 4;
+            int bx0 = x0 / 4, by0 = y0 / 4, bx1 = (x1 + 3) / 4, by1 = (y1 + 3) / 4;
+            int regionW = 4 * (bx1 - bx0), regionH = 4 * (by1 - by0);
+            std::vector<std::uint8_t> regionRgba(4u * regionW * regionH);
+            for (int by = by0; by < by1; ++by)
+            {
+                for (int bx = bx0; bx < bx1; ++bx)
+                {
+                    std::uint8_t texels[64];
+                    dds::decodeDxt5Block(dstBlocks + dds::DXT5_BLOCK_BYTES * (std::size_t(blocksPerRow) * by + bx), texels);
+                    for (int row = 0; row < 4; ++row)
+                    {
+                        std::copy(texels + 16 * row, texels + 16 * row + 16,
+                            regionRgba.begin() + 4u * (std::size_t(regionW) * (4 * (by - by0) + row) + 4 * (bx - bx0)));
+                    }
+                }
+            }
+
+            ImportImage<std::uint32_t>(
+                (const std::uint32_t*)srcRgba.data(), srcWScaled, srcHScaled,
+                (std::uint32_t*)regionRgba.data(), regionW, regionH,
+                column0 - 4 * bx0, row0 - 4 * by0, false);
+
+            for (int by = by0; by < by1; ++by)
+            {
+                for (int bx = bx0; bx < bx1; ++bx)
+                {
+                    // as encodeDxt5Region, edge blocks of odd sized textures replicate their last row/column
+                    std::uint8_t texels[64];
+                    for (int ty = 0; ty < 4; ++ty)
+                    {
+                        int y = std::min(4 * by + ty, dstH - 1) - 4 * by0;
+                        for (int tx = 0; tx < 4; ++tx)
+                        {
+                            int x = std::min(4 * bx + tx, dstW - 1) - 4 * bx0;
+                            std::copy_n(regionRgba.begin() + 4u * (std::size_t(regionW) * y + x), 4, texels + 4 * (4 * ty + tx));
+                        }
+                    }
+                    dds::encodeDxt5Block(texels, dstBlocks + dds::DXT5_BLOCK_BYTES * (std::size_t(blocksPerRow) * by + bx));
+                }
+            }
+        }
+
+
+        void ResizeNormalDds(std::vector<std::uint8_t> &ddsData, int newW, int newH, float gainX, float gainY)
+        {
+            dds::DdsFile srcDds(ddsData.data(), ddsData.size());
+            if (srcDds.glDataFormat() != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            {
+                return;
+            }
+
+            NormalMap nm = ResampleNormals(DecodeNormalDds(srcDds), newW, newH, gainX, gainY);
+            std::vector<std::uint8_t> rgba(4u * newW * newH);
+            PackNormals(nm, rgba.data());
+
+            std::vector<std::uint8_t> newData = srcDds.createBlank(newW, newH);
+            dds::DdsFile dstDds(newData.data(), newData.size());
+            std::size_t imageBytes;
+            dds::encodeDxt5(rgba.data(), newW, newH, (std::uint8_t*)dstDds.getMutable(imageBytes));
+            ddsData.swap(newData);
+        }
+
+
+        void DropMipmaps(CowVector<std::uint8_t> &ddsData)
+        {
+            if (ddsData.empty())
+            {
+                return;
+            }
+            dds::DdsFile srcDds(ddsData.Get().data(), ddsData.size());
+            if (srcDds.mipMapCount() <= 1u)
+            {
+                return;
+            }
+
+            std::vector<std::uint8_t> newData = srcDds.createBlank(srcDds.width(), srcDds.height());
+            dds::DdsFile dstDds(newData.data(), newData.size());
+            std::size_t srcBytes, dstBytes;
+            const char *src = srcDds.get(srcBytes);
+            char *dst = dstDds.getMutable(dstBytes);
+            std::copy(src, src + std::min(srcBytes, dstBytes), dst);
+            ddsData = std::move(newData);
+        }
+
+
+        // how far a DXT5 block can have moved its normals' packed x (alpha) and y (green) in encoding them: half a step of
+        // the block's ramp, plus the rounding of its endpoints (none for alpha, up to 2 for green's 6 bits)
+        static void NormalEncodingError(const std::uint8_t *block, int &errorX, int &errorY)
+        {
+            int a0 = block[0], a1 = block[1];
+            errorX = (std::abs(a0 - a1) + (a0 > a1 ? 13 : 9)) / (a0 > a1 ? 14 : 10);
+            int g0 = ((block[8] | (block[9] << 8)) >> 5) & 63, g1 = ((block[10] | (block[11] << 8)) >> 5) & 63;
+            g0 = (g0 << 2) | (g0 >> 4);
+            g1 = (g1 << 2) | (g1 >> 4);
+            errorY = (std::abs(g0 - g1) + 5) / 6 + 2;
+        }
+
+
+        // DXT5nm normals (decoded rgba texels, x in alpha, y in green) turned as o turns the map: a flipped axis negates
+        // that component, which packed is 255 - b, and swapping the axes swaps the components
+        static void OrientNormals(std::uint8_t *rgba, std::size_t count, Orientation o)
+        {
+            for (std::size_t i = 0u; i < count; ++i)
+            {
+                std::uint8_t *texel = rgba + 4u * i;
+                std::uint8_t x = OrientFlipsX(o) ? 255u - texel[3] : texel[3];
+                std::uint8_t y = OrientFlipsZ(o) ? 255u - texel[1] : texel[1];
+                texel[3] = OrientSwapsAxes(o) ? y : x;
+                texel[1] = OrientSwapsAxes(o) ? x : y;
+            }
+        }
+
+
+        std::vector<std::uint8_t> OrientDds(const std::vector<std::uint8_t> &ddsData, Orientation o, bool normals)
+        {
+            dds::DdsFile srcDds(ddsData.data(), ddsData.size());
+            const dds::DdsTexture &texture = srcDds.texture();
+            int W = int(texture.width), H = int(texture.height);
+            int OW = OrientSwapsAxes(o) ? H : W, OH = OrientSwapsAxes(o) ? W : H;
+
+            std::vector<std::uint8_t> result = srcDds.createBlank(OW, OH);
+            dds::DdsFile dstDds(result.data(), result.size());
+            std::size_t imageBytes;
+            const std::uint8_t *src = (const std::uint8_t*)srcDds.get(imageBytes);
+            std::uint8_t *dst = (std::uint8_t*)dstDds.getMutable(imageBytes);
+
+            if (normals && texture.format == dds::FORMAT_DXT5)
+            {
+                std::vector<std::uint32_t> rgba(std::size_t(W) * H), oriented(rgba.size());
+                dds::decodeDxt5(src, W, H, (std::uint8_t*)rgba.data());
+                ParallelForRows(OH, [&](int row0, int row1)
+                {
+                    OrientImage(rgba.data(), oriented.data(), W, H, o, row0, row1);
+                    OrientNormals((std::uint8_t*)(oriented.data() + std::size_t(OW) * row0), std::size_t(OW) * (row1 - row0), o);
+                });
+                dds::encodeDxt5((const std::uint8_t*)oriented.data(), OW, OH, dst);
+            }
+            else if (!texture.isCompressed())
+            {
+                WithPixelType(texture.blockBytes, [&](auto pixel)
+                {
+                    typedef decltype(pixel) Pixel;
+                    ParallelForRows(OH, [&](int row0, int row1)
+                    {
+                        OrientImage((const Pixel*)src, (Pixel*)dst, W, H, o, row0, row1);
+                    });
+                });
+            }
+            else if (W % 4 == 0 && H % 4 == 0)
+            {
+                int from[16];
+                for (int t = 0; t < 16; ++t)
+                {
+                    float x = float(t % 4) + 0.5f, z = float(t / 4) + 0.5f;
+                    OrientPoint(o, 4.0f, 4.0f, x, z);
+                    from[4 * int(z) + int(x)] = t;
+                }
+                WithPixelType(texture.blockBytes, [&](auto block)
+                {
+                    typedef decltype(block) Block;
+                    ParallelForRows(OH / 4, [&](int row0, int row1)
+                    {
+                        OrientImage((const Block*)src, (Block*)dst, W / 4, H / 4, o, row0, row1);
+                        for (std::size_t b = std::size_t(OW / 4) * row0; b < std::size_t(OW / 4) * row1; ++b)
+                        {
+                            PermuteBlock(dst + texture.blockBytes * b, texture.format, from);
+                        }
+                    }, 4);
+                });
+            }
+            else if (texture.format == dds::FORMAT_DXT5)
+            {
+                std::vector<std::uint32_t> rgba(std::size_t(W) * H), oriented(rgba.size());
+                dds::decodeDxt5(src, W, H, (std::uint8_t*)rgba.data());
+                OrientImage(rgba.data(), oriented.data(), W, H, o, 0, OH);
+                dds::encodeDxt5((const std::uint8_t*)oriented.data(), OW, OH, dst);
+            }
+            else
+            {
+                throw std::runtime_error(std::string("dds: cannot reorient ") + dds::formatName(texture.format) + " whose sides aren't multiples of 4");
+            }
+            return result;
+        }
+
+
+        std::vector<std::uint8_t> CropDds(const std::vector<std::uint8_t> &ddsData, int x0, int z0, int width, int height)
+        {
+            dds::DdsFile srcDds(ddsData.data(), ddsData.size());
+            const dds::DdsTexture &texture = srcDds.texture();
+            int W = int(texture.width), H = int(texture.height);
+
+            std::vector<std::uint8_t> result = srcDds.createBlank(width, height);
+            dds::DdsFile dstDds(result.data(), result.size());
+            std::size_t imageBytes;
+            const std::uint8_t *src = (const std::uint8_t*)srcDds.get(imageBytes);
+            std::uint8_t *dst = (std::uint8_t*)dstDds.getMutable(imageBytes);
+            if (W <= 0 || H <= 0 || width <= 0 || height <= 0)
+            {
+                return result;
+            }
+
+            if (!texture.isCompressed())
+            {
+                WithPixelType(texture.blockBytes, [&](auto pixel)
+                {
+                    typedef decltype(pixel) Pixel;
+                    ParallelForRows(height, [&](int row0, int row1)
+                    {
+                        CropImage((const Pixel*)src, W, H, (Pixel*)dst, x0, z0, width, row0, row1);
+                    });
+                });
+            }
+            else if (W % 4 == 0 && H % 4 == 0 && x0 % 4 == 0 && z0 % 4 == 0 && width % 4 == 0 && height % 4 == 0)
+            {
+                WithPixelType(texture.blockBytes, [&](auto block)
+                {
+                    typedef decltype(block) Block;
+                    ParallelForRows(height / 4, [&](int row0, int row1)
+                    {
+                        CropImage((const Block*)src, W / 4, H / 4, (Block*)dst, x0 / 4, z0 / 4, width / 4, row0, row1);
+                    }, 4);
+                });
+            }
+            else if (texture.format == dds::FORMAT_DXT5)
+            {
+                std::vector<std::uint32_t> rgba(std::size_t(W) * H), cropped(std::size_t(width) * height);
+                dds::decodeDxt5(src, W, H, (std::uint8_t*)rgba.data());
+                CropImage(rgba.data(), W, H, cropped.data(), x0, z0, width, 0, height);
+                dds::encodeDxt5((const std::uint8_t*)cropped.data(), width, height, dst);
+            }
+            else
+            {
+                throw std::runtime_error(std::string("dds: cannot crop ") + dds::formatName(texture.format) + " off its 4x4 blocks");
+            }
+            return result;
+        }
+
+
+        // a normal on the mirror line is its own mirror image, so the symmetric map's is halfway between it and turned
+        static void MeetNormals(const std::uint8_t *kept, std::uint8_t *mirrored)
+        {
+            mirrored[1] = std::uint8_t((kept[1] + mirrored[1] + 1) / 2);
+            mirrored[3] = std::uint8_t((kept[3] + mirrored[3] + 1) / 2);
+            mirrored[0] = kept[0];
+            mirrored[2] = kept[2];
+        }
+
+
+        std::vector<std::uint8_t> SymmetrizeDds(const std::vector<std::uint8_t> &ddsData, Symmetry s, bool fromSecondHalf, bool normals)
+        {
+            dds::DdsFile srcDds(ddsData.data(), ddsData.size());
+            const dds::DdsTexture &texture = srcDds.texture();
+            int W = int(texture.width), H = int(texture.height);
+            if (OrientSwapsAxes(SymmetryOrientation(s)) && W != H)
+            {
+                throw std::runtime_error("dds: diagonal symmetry needs a square texture");
+            }
+
+            std::vector<std::uint8_t> result = OrientDds(ddsData, SymmetryOrientation(s), normals);
+            dds::DdsFile dstDds(result.data(), result.size());
+            std::size_t imageBytes;
+            const std::uint8_t *src = (const std::uint8_t*)srcDds.get(imageBytes);
+            std::uint8_t *dst = (std::uint8_t*)dstDds.getMutable(imageBytes);
+
+            // what becomes of texel x,z: overwritten by its mirror image, kept, or for a normal on the mirror line, met
+            // halfway (see MeetNormals)
+            Orientation o = SymmetryOrientation(s);
+            normals = normals && texture.format == dds::FORMAT_DXT5;
+            enum Fate { KEPT, OVERWRITTEN, MET };
+            auto fate = [&](int x, int z)
+            {
+                int u = OrientFlipsX(o) ? W - 1 - x : x, v = OrientFlipsZ(o) ? H - 1 - z : z;
+                int mx = OrientSwapsAxes(o) ? v : u, mz = OrientSwapsAxes(o) ? u : v;
+                return SymmetryOverwrites(s, fromSecondHalf, x, z, mx, mz) ? OVERWRITTEN : normals && mx == x && mz == z ? MET : KEPT;
+            };
+
+            if (!texture.isCompressed())
+            {
+                WithPixelType(texture.blockBytes, [&](auto pixel)
+                {
+                    typedef decltype(pixel) Pixel;
+                    ParallelForRows(H, [&](int row0, int row1)
+                    {
+                        SymmetrizeImage((const Pixel*)src, (Pixel*)dst, W, H, s, fromSecondHalf, row0, row1);
+                    });
+                });
+            }
+            else if (W % 4 == 0 && H % 4 == 0)
+            {
+                // blocks wholly in the overwritten half are already right, and those wholly in the kept half are copied
+                // back.  the few the mirror line crosses hold texels of both
+                std::size_t blockBytes = texture.blockBytes;
+                ParallelForRows(H / 4, [&](int row0, int row1)
+                {
+                    for (int bz = row0; bz < row1; ++bz)
+                    {
+                        for (int bx = 0; bx < W / 4; ++bx)
+                        {
+                            int overwritten = 0, kept = 0;
+                            for (int t = 0; t < 16; ++t)
+                            {
+                                Fate f = fate(4 * bx + t % 4, 4 * bz + t / 4);
+                                overwritten += f == OVERWRITTEN ? 1 : 0;
+                                kept += f == KEPT ? 1 : 0;
+                            }
+
+                            std::size_t offset = blockBytes * (std::size_t(W / 4) * bz + bx);
+                            if (kept == 16 || (overwritten < 16 && texture.format != dds::FORMAT_DXT5))
+                            {
+                                std::memcpy(dst + offset, src + offset, blockBytes);
+                            }
+                            else if (overwritten < 16)
+                            {
+                                std::uint8_t texels[16 * 4], mirrored[16 * 4];
+                                dds::decodeDxt5Block(src + offset, texels);
+                                dds::decodeDxt5Block(dst + offset, mirrored);
+                                for (int t = 0; t < 16; ++t)
+                                {
+                                    Fate f = fate(4 * bx + t % 4, 4 * bz + t / 4);
+                                    if (f == KEPT)
+                                    {
+                                        std::memcpy(mirrored + 4 * t, texels + 4 * t, 4u);
+                                    }
+                                    else if (f == MET)
+                                    {
+                                        MeetNormals(texels + 4 * t, mirrored + 4 * t);
+                                    }
+                                }
+                                dds::encodeDxt5Block(mirrored, dst + offset);
+                            }
+                        }
+                    }
+                }, 4);
+            }
+            else if (texture.format == dds::FORMAT_DXT5)
+            {
+                std::vector<std::uint8_t> rgba(4u * W * H), mirrored(rgba.size());
+                dds::decodeDxt5(src, W, H, rgba.data());
+                dds::decodeDxt5(dst, W, H, mirrored.data());
+                for (int z = 0; z < H; ++z)
+                {
+                    for (int x = 0; x < W; ++x)
+                    {
+                        std::size_t offset = 4u * (std::size_t(W) * z + x);
+                        Fate f = fate(x, z);
+                        if (f == KEPT)
+                        {
+                            std::memcpy(mirrored.data() + offset, rgba.data() + offset, 4u);
+                        }
+                        else if (f == MET)
+                        {
+                            MeetNormals(rgba.data() + offset, mirrored.data() + offset);
+                        }
+                    }
+                }
+                dds::encodeDxt5(mirrored.data(), W, H, dst);
+            }
+            else
+            {
+                throw std::runtime_error(std::string("dds: cannot make symmetric ") + dds::formatName(texture.format) + " whose sides aren't multiples of 4");
+            }
+            return result;
+        }
+
+
+        void MeasureDdsAsymmetry(const std::vector<std::uint8_t> &ddsData, Symmetry s, LayerAsymmetry &asymmetry, bool normals)
+        {
+            dds::DdsFile srcDds(ddsData.data(), ddsData.size());
+            const dds::DdsTexture &texture = srcDds.texture();
+            int W = int(texture.width), H = int(texture.height);
+            std::size_t imageBytes;
+            const std::uint8_t *src = (const std::uint8_t*)srcDds.get(imageBytes);
+
+            std::int64_t sum = 0;
+            int largest = 0;
+            std::size_t differing = 0u, samples;
+            if (normals && texture.format == dds::FORMAT_DXT5)
+            {
+                // x and y of each texel against its mirror texel's, turned.  The two were encoded apart, and when the
+                // axes swap one's x was encoded as the other's y, so they differ only if encoding can't account for it
+                Orientation o = SymmetryOrientation(s);
+                std::vector<std::uint8_t> rgba(4u * W * H);
+                dds::decodeDxt5(src, W, H, rgba.data());
+                std::size_t blocksPerRow = std::size_t(W + 3) / 4u;
+                auto encodingError = [&](int x, int z, int &errorX, int &errorY)
+                {
+                    NormalEncodingError(src + dds::DXT5_BLOCK_BYTES * (blocksPerRow * (z / 4) + x / 4), errorX, errorY);
+                };
+                samples = 2u * W * H;
+                std::mutex lock;
+                ParallelForRows(H, [&](int row0, int row1)
+                {
+                    std::int64_t bandSum = 0;
+                    int bandLargest = 0;
+                    std::size_t bandDiffering = 0u;
+                    for (int z = row0; z < row1; ++z)
+                    {
+                        for (int x = 0; x < W; ++x)
+                        {
+                            int u = OrientFlipsX(o) ? W - 1 - x : x, v = OrientFlipsZ(o) ? H - 1 - z : z;
+                            int mx = OrientSwapsAxes(o) ? v : u, mz = OrientSwapsAxes(o) ? u : v;
+                            const std::uint8_t *texel = rgba.data() + 4u * (std::size_t(W) * z + x);
+                            std::uint8_t turned[4];
+                            std::memcpy(turned, rgba.data() + 4u * (std::size_t(W) * mz + mx), 4u);
+                            OrientNormals(turned, 1u, o);
+
+                            int errorX, errorY, mirrorErrorX, mirrorErrorY;
+                            encodingError(x, z, errorX, errorY);
+                            encodingError(mx, mz, mirrorErrorX, mirrorErrorY);
+                            if (OrientSwapsAxes(o))
+                            {
+                                std::swap(mirrorErrorX, mirrorErrorY);
+                            }
+                            int dx = std::abs(int(texel[3]) - int(turned[3])), dy = std::abs(int(texel[1]) - int(turned[1]));
+                            bandSum += dx + dy;
+                            bandLargest = std::max(bandLargest, std::max(dx, dy));
+                            bandDiffering += dx > errorX + mirrorErrorX || dy > errorY + mirrorErrorY ? 1u : 0u;
+                        }
+                    }
+                    std::lock_guard<std::mutex> guard(lock);
+                    sum += bandSum;
+                    largest = std::max(largest, bandLargest);
+                    differing += bandDiffering;
+                });
+            }
+            else if (!texture.isCompressed())
+            {
+                // per byte rather than per pixel, so a row is one span of the vectorised loop
+                samples = std::size_t(W) * H * texture.blockBytes;
+                WithPixelType(texture.blockBytes, [&](auto pixel)
+                {
+                    typedef decltype(pixel) Pixel;
+                    bool swaps = OrientSwapsAxes(SymmetryOrientation(s));
+                    std::vector<Pixel> mirrored(swaps ? std::size_t(W) * H : 0u);
+                    std::mutex lock;
+                    ParallelForRows(H, [&](int row0, int row1)
+                    {
+                        std::vector<Pixel> row(swaps ? 0u : std::size_t(W));
+                        std::int64_t bandSum = 0;
+                        int bandLargest = 0;
+                        std::size_t bandDiffering = 0u;
+                        AccumulateAsymmetry<std::uint8_t>((const Pixel*)src, swaps ? mirrored.data() : row.data(), W, H, s, row0, row1,
+                            bandSum, bandLargest, bandDiffering);
+                        std::lock_guard<std::mutex> guard(lock);
+                        sum += bandSum;
+                        largest = std::max(largest, bandLargest);
+                        differing += bandDiffering;
+                    });
+                });
+            }
+            else
+            {
+                std::vector<std::uint8_t> mirrored = OrientDds(ddsData, SymmetryOrientation(s), false);
+                dds::DdsFile mirroredDds(mirrored.data(), mirrored.size());
+                std::size_t mirroredBytes;
+                const std::uint8_t *mirror = (const std::uint8_t*)mirroredDds.get(mirroredBytes);
+                samples = std::min(imageBytes, mirroredBytes) / texture.blockBytes;
+                for (std::size_t block = 0u; block < samples; ++block)
+                {
+                    std::size_t offset = block * texture.blockBytes;
+                    differing += std::memcmp(src + offset, mirror + offset, texture.blockBytes) != 0 ? 1u : 0u;
+                }
+                sum = std::int64_t(differing);
+                largest = differing > 0u ? 1 : 0;
+            }
+
+            if (samples > 0u)
+            {
+                asymmetry.meanDifference = (asymmetry.meanDifference * double(asymmetry.samples) + double(sum)) / double(asymmetry.samples + samples);
+            }
+            asymmetry.samples += samples;
+            asymmetry.asymmetric += differing;
+            asymmetry.maxDifference = std::max(asymmetry.maxDifference, double(largest));
+        }
+
+
+        bool MaskDivisor(std::size_t size, int W, int H, int &divisor)
+        {
+            if (size == 0u || W <= 0 || H <= 0)
+            {
+                return false;
+            }
+            divisor = std::max(1, int(0.5 + std::sqrt(double(std::size_t(W) * H / size))));
+            return std::size_t(W / divisor) * std::size_t(H / divisor) == size;
+        }
+
+
+        // the heading (yaw about y) of an item after the map is reoriented: where its z axis, (sin yaw, cos yaw), now points
+        static float OrientYaw(Orientation o, float yaw)
+        {
+            float x = std::sin(yaw), z = std::cos(yaw);
+            OrientPoint(o, 0.0f, 0.0f, x, z);
+            return std::atan2(x, z);
+        }
+
+
+        void OrientItem(WaveGenerator &wg, Orientation o, int W, int H)
+        {
+            OrientPoint(o, float(W), float(H), wg.position[0], wg.position[2]);
+            OrientPoint(o, 0.0f, 0.0f, wg.velocity[0], wg.velocity[2]);
+            wg.rotation = OrientYaw(o, wg.rotation);
+        }
+
+
+        void OrientItem(Decal &d, Orientation o, int W, int H)
+        {
+            OrientPoint(o, float(W), float(H), d.position[0], d.position[2]);
+            d.rotation[1] = OrientYaw(o, d.rotation[1]);
+        }
+
+
+        void OrientItem(Prop &p, Orientation o, int W, int H)
+        {
+            OrientPoint(o, float(W), float(H), p.position[0], p.position[2]);
+            for (float *axis : { p.rotationX, p.rotationY, p.rotationZ })
+            {
+                OrientPoint(o, 0.0f, 0.0f, axis[0], axis[2]);
+            }
+            if (OrientMirrors(o))
+            {
+                for (float &c : p.rotationX)
+                {
+                    c = -c;
+                }
+            }
+        }
+
+
+
+        static float TransformYaw(const Affine &t, float yaw)
+        {
+            float x = std::sin(yaw), z = std::cos(yaw);
+            t.ApplyVector(x, z);
+            return std::atan2(x, z);
+        }
+
+
+        void TransformItem(WaveGenerator &wg, const Affine &t)
+        {
+            t.Apply(wg.position[0], wg.position[2]);
+            t.ApplyVector(wg.velocity[0], wg.velocity[2]);
+            wg.rotation = TransformYaw(t, wg.rotation);
+        }
+
+
+        void TransformItem(Decal &d, const Affine &t)
+        {
+            // the decal's own x and z axes, as its yaw turns them
+            float yaw = d.rotation[1];
+            float ax = std::cos(yaw), az = -std::sin(yaw);
+            float bx = std::sin(yaw), bz = std::cos(yaw);
+            t.ApplyVector(ax, az);
+            t.ApplyVector(bx, bz);
+            t.Apply(d.position[0], d.position[2]);
+            d.scale[0] *= std::sqrt(ax * ax + az * az);
+            d.scale[2] *= std::sqrt(bx * bx + bz * bz);
+            d.rotation[1] = std::atan2(bx, bz);
+        }
+
+
+        void TransformItem(Prop &p, const Affine &t)
+        {
+            // the rotation of the polar decomposition of t, after mirroring x first if t mirrors
+            bool mirrors = t.Determinant() < 0.0f;
+            float xx = mirrors ? -t.xx : t.xx, zx = mirrors ? -t.zx : t.zx;
+            float angle = std::atan2(zx - t.xz, xx + t.zz);
+            Affine r = Affine::Rotation(angle) * Affine::Scale(mirrors ? -1.0f : 1.0f, 1.0f);
+
+            t.Apply(p.position[0], p.position[2]);
+            for (float *axis : { p.rotationX, p.rotationY, p.rotationZ })
+            {
+                r.ApplyVector(axis[0], axis[2]);
+            }
+            if (mirrors)
+            {
+                for (float &c : p.rotationX)
+                {
+                    c = -c;
+                }
+            }
+        }
+    }
+}
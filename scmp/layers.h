@@ -0,0 +1,142 @@
+#pragma once
+
+#include "cow.h"
+#include "image.h"
+#include "spatial_index.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct WaveGenerator;
+        struct Decal;
+        struct Prop;
+        struct LayerAsymmetry;
+        struct Scmp;
+
+        // The per layer steps of Scmp::Resize and Scmp::Import, for the other edits that apply them one layer at a time
+
+        // Import a srcW x srcH map's dds layer into a destW x destH map's at column0,row0 (in heightmap cells), scaling
+        // the source to the destination's texel density.  Both must have the same pixel format
+        void ImportDds(
+            const std::uint8_t *srcDdsData, std::size_t srcBytes,
+            std::uint8_t *dstDdsData, std::size_t dstBytes,
+            int srcW, int srcH, int destW, int destH,
+            int column0, int row0, std::string debugName, bool lerp);
+
+        // The normal map counterpart of ImportDds: decodes the source, resamples it as unit vectors and decodes, merges
+        // and re-encodes only the destination blocks it touches.  Textures that aren't DXT5 are imported as plain pixels
+        void ImportNormalDds(
+            const std::uint8_t *srcDdsData, std::size_t srcBytes,
+            std::uint8_t *dstDdsData, std::size_t dstBytes,
+            int srcW, int srcH, int destW, int destH,
+            int column0, int row0, std::string debugName);
+
+        // Resample a DXT5 normal map to newW x newH texels, applying the slope gain of a non-uniform resize.  Other
+        // formats are left alone
+        void ResizeNormalDds(std::vector<std::uint8_t> &ddsData, int newW, int newH, float gainX, float gainY);
+
+        // A dds texture cut to its top level image, for the edits that redraw only that: mipmaps kept from before would
+        // show the old image wherever the game samples them.  A texture without mipmaps is left as it is, unshared
+        void DropMipmaps(CowVector<std::uint8_t> &ddsData);
+
+        // A dds texture's top level image laid out as o says, as a new texture without mipmaps.  Block compressed textures
+        // whose sides are multiples of 4 are rearranged a block at a time, permuting the texel indices inside each block,
+        // so nothing is re-encoded.  Others are decoded and re-encoded if DXT5, and throw std::runtime_error if not.  A
+        // DXT5 normal map (normals) is always decoded, its normals turned with the map and re-encoded
+        std::vector<std::uint8_t> OrientDds(const std::vector<std::uint8_t> &ddsData, Orientation o, bool normals);
+
+        // The width x height texel window of a dds texture whose top left is x0,z0, as a new texture without mipmaps.  The
+        // window may hang off the texture, where it repeats the edge texels (or, if block compressed, the edge blocks).
+        // Compressed textures are cut on block boundaries when the window allows it, otherwise as OrientDds
+        std::vector<std::uint8_t> CropDds(const std::vector<std::uint8_t> &ddsData, int x0, int z0, int width, int height);
+
+        // A dds texture's top level image made symmetric (see SymmetrizeImage), as a new texture without mipmaps.  The
+        // mirror image comes from OrientDds, so compressed textures are only re-encoded in the blocks the mirror line
+        // crosses, and only if DXT5: other formats keep those blocks as they are.  A DXT5 normal map's mirror image has its
+        // normals turned, and a normal on the mirror line is met halfway by its turned self
+        std::vector<std::uint8_t> SymmetrizeDds(const std::vector<std::uint8_t> &ddsData, Symmetry s, bool fromSecondHalf, bool normals);
+
+        // Add how far a dds texture's top level image is from symmetric to asymmetry: per byte of its pixels, or for
+        // compressed textures per block, where a block differs by 1 if it isn't its mirror block's texels rearranged.  A
+        // DXT5 normal map is compared per normal x and y against its mirror texel's turned, and a texel differs if either
+        // is further off than encoding the two texels' blocks could have moved them
+        void MeasureDdsAsymmetry(const std::vector<std::uint8_t> &ddsData, Symmetry s, LayerAsymmetry &asymmetry, bool normals);
+
+
+        // Box filter the (W+1)x(H+1) heightmap down to PW x PH world heights, for layers drawn at their own resolution
+        // from the heights (the preview, the water masks)
+        std::vector<float> DownsampleHeights(const Scmp &scmp, int PW, int PH);
+
+
+        // The masks are a fraction of the map's size.  divisor is the side of the square of cells each byte covers;
+        // false if size isn't W x H shrunk by a whole divisor
+        bool MaskDivisor(std::size_t size, int W, int H, int &divisor);
+
+        // Carry an item through Scmp::Orient of a W x H map: its position, heading and (wave generators) velocity.  A
+        // prop's rotation vectors are its axes: a mirrored map would mirror the prop too, so its x axis is turned back
+        // round to keep the axes a rotation, with the prop facing (z) where its mirror image would
+        void OrientItem(WaveGenerator &wg, Orientation o, int W, int H);
+        void OrientItem(Decal &d, Orientation o, int W, int H);
+        void OrientItem(Prop &p, Orientation o, int W, int H);
+
+        // Carry a source item through Scmp::ImportAffine: its position, and its heading and (wave generators) velocity,
+        // by t.  A decal stretches with t along its own axes.  Props can't stretch, so they turn by the rotation nearest
+        // t, and a mirroring t mirrors them as OrientItem does
+        void TransformItem(WaveGenerator &wg, const Affine &t);
+        void TransformItem(Decal &d, const Affine &t);
+        void TransformItem(Prop &p, const Affine &t);
+
+
+        // Items outside [xlow,xhigh)x[zlow,zhigh), then copies of the other map's items that land inside it when offset
+        // by (xlow, zlow), their heights set to heightAt(x, z).  Only the items the grids find in the rectangle are
+        // visited or copied
+        template<typename T, typename HeightAt>
+        std::vector< std::shared_ptr<T> > ImportItemsInRectangle(
+            const std::vector<std::shared_ptr<T> > &items, const SpatialGrid &itemsGrid,
+            const std::vector<std::shared_ptr<T> > &otherItems, const SpatialGrid &otherGrid,
+            int xlow, int zlow, int xhigh, int zhigh, const HeightAt &heightAt)
+        {
+            auto isInBounds = [xlow, zlow, xhigh, zhigh](float *pos)
+            {
+                return (pos[0] >= xlow && pos[0] < xhigh && pos[2] >= zlow && pos[2] < zhigh);
+            };
+
+            std::vector<std::uint32_t> replaced, imported;
+            itemsGrid.QueryRectangle(float(xlow), float(zlow), float(xhigh), float(zhigh), replaced);
+            // a unit wider than needed, so rounding in the offset can't lose an item; isInBounds has the final say
+            otherGrid.QueryRectangle(-1.0f, -1.0f, float(xhigh - xlow) + 1.0f, float(zhigh - zlow) + 1.0f, imported);
+
+            std::vector<std::shared_ptr<T> > newItems;
+            newItems.reserve(items.size() - replaced.size() + imported.size());
+            auto nextReplaced = replaced.begin();
+            for (std::uint32_t i = 0u; i < items.size(); ++i)
+            {
+                if (nextReplaced != replaced.end() && *nextReplaced == i)
+                {
+                    ++nextReplaced;
+                    continue;
+                }
+                newItems.push_back(items[i]);
+            }
+            for (std::uint32_t i : imported)
+            {
+                std::shared_ptr<T> itemPtr(new T(*otherItems[i]));
+                itemPtr->position[0] += xlow;
+                itemPtr->position[2] += zlow;
+
+                if (isInBounds(itemPtr->position))
+                {
+                    itemPtr->position[1] = heightAt(itemPtr->position[0], itemPtr->position[2]);
+                    newItems.push_back(itemPtr);
+                }
+            }
+            return newItems;
+        }
+    }
+}
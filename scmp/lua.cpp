@@ -0,0 +1,524 @@
+#include "lua.h"
+
+#include "mapped_file.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool IsNameStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline bool IsNameChar(char c)
+{
+    return IsNameStart(c) || IsDigit(c);
+}
+
+
+namespace nfa {
+    namespace scmp {
+
+        bool LuaToken::Is(Type t, const char *text) const
+        {
+            std::size_t n = std::strlen(text);
+            return type == t && std::size_t(end - begin) == n && !std::memcmp(begin, text, n);
+        }
+
+
+        void LuaToken::Unquoted(const char *&b, const char *&e) const
+        {
+            b = begin;
+            e = end;
+            if (type != STRING || b == e)
+            {
+                return;
+            }
+
+            if (*b == '[')
+            {
+                // [==[ ... ]==]
+                int level = 0;
+                for (++b; b < e && *b == '='; ++b, ++level);
+                b = std::min(b + 1, e);
+                e = std::max(b, e - (level + 2));
+            }
+            else
+            {
+                ++b;
+                if (e > b && e[-1] == *begin)
+                {
+                    --e;
+                }
+            }
+        }
+
+
+        // p points at '['.  returns the end of the long bracket string starting there, the end of the buffer if it is
+        // unterminated, or NULL if p doesn't start a long bracket
+        const char *LuaLexer::LongBracketEnd(const char *p) const
+        {
+            const char *q = p + 1;
+            int level = 0;
+            for (; q < m_end && *q == '='; ++q, ++level);
+            if (q >= m_end || *q != '[')
+            {
+                return NULL;
+            }
+
+            for (++q; q < m_end; ++q)
+            {
+                if (*q != ']')
+                {
+                    continue;
+                }
+                const char *r = q + 1;
+                int closeLevel = 0;
+                for (; r < m_end && *r == '='; ++r, ++closeLevel);
+                if (closeLevel == level && r < m_end && *r == ']')
+                {
+                    return r + 1;
+                }
+            }
+            return m_end;
+        }
+
+
+        LuaToken LuaLexer::Next()
+        {
+            while (m_pos < m_end && IsSpace(*m_pos))
+            {
+                ++m_pos;
+            }
+
+            LuaToken token;
+            token.begin = m_pos;
+            if (m_pos == m_end)
+            {
+                token.type = LuaToken::END;
+                token.end = m_end;
+                return token;
+            }
+
+            const char *p = m_pos;
+            char c = *p;
+            char c1 = p + 1 < m_end ? p[1] : '\0';
+
+            if (c == '-' && c1 == '-')
+            {
+                token.type = LuaToken::COMMENT;
+                p += 2;
+                const char *longEnd = p < m_end && *p == '[' ? LongBracketEnd(p) : NULL;
+                if (longEnd)
+                {
+                    p = longEnd;
+                }
+                else
+                {
+                    for (; p < m_end && *p != '\n'; ++p);
+                }
+            }
+            else if (c == '[' && (c1 == '[' || c1 == '=') && LongBracketEnd(p))
+            {
+                token.type = LuaToken::STRING;
+                p = LongBracketEnd(p);
+            }
+            else if (c == '"' || c == '\'')
+            {
+                token.type = LuaToken::STRING;
+                for (++p; p < m_end && *p != c && *p != '\n'; ++p)
+                {
+                    if (*p == '\\' && p + 1 < m_end)
+                    {
+                        ++p;
+                    }
+                }
+                p = std::min(p + 1, m_end);
+            }
+            else if (IsNameStart(c))
+            {
+                token.type = LuaToken::NAME;
+                for (++p; p < m_end && IsNameChar(*p); ++p);
+            }
+            else if (IsDigit(c) || (c == '.' && IsDigit(c1)))
+            {
+                // digits, points, exponents and hex all together; the grammar is checked when the number is parsed
+                token.type = LuaToken::NUMBER;
+                bool hex = c == '0' && (c1 == 'x' || c1 == 'X');
+                char exponent = hex ? 'p' : 'e';
+                for (p += hex ? 2 : 1; p < m_end; ++p)
+                {
+                    char d = *p;
+                    if ((d | 0x20) == exponent && p + 1 < m_end && (p[1] == '+' || p[1] == '-'))
+                    {
+                        ++p;
+                    }
+                    else if (!IsNameChar(d) && d != '.')
+                    {
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                token.type = LuaToken::SYMBOL;
+                static const char *multi[] = { "...", "..", "==", "~=", "<=", ">=", "::", "//", "<<", ">>" };
+                std::size_t n = 1u;
+                for (const char *m : multi)
+                {
+                    std::size_t len = std::strlen(m);
+                    if (std::size_t(m_end - p) >= len && !std::memcmp(p, m, len))
+                    {
+                        n = len;
+                        break;
+                    }
+                }
+                p += n;
+            }
+
+            m_pos = p;
+            token.end = p;
+            return token;
+        }
+
+
+        LuaToken LuaLexer::NextSignificant()
+        {
+            LuaToken token = Next();
+            while (token.type == LuaToken::COMMENT)
+            {
+                token = Next();
+            }
+            return token;
+        }
+
+
+        bool ParseLuaNumber(const char *begin, const char *end, double &value)
+        {
+            // exact powers of ten; any integer mantissa below 2^53 times one of these is correctly rounded
+            static const double powers[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+            const char *p = begin;
+            std::uint64_t mantissa = 0u;
+            int digits = 0;
+            int exponent = 0;
+            bool any = false;
+            for (; p < end && IsDigit(*p); ++p, any = true)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10u + std::uint64_t(*p - '0');
+                    digits += mantissa != 0u;
+                }
+                else
+                {
+                    ++exponent;
+                    digits = 20;
+                }
+            }
+            if (p < end && *p == '.')
+            {
+                for (++p; p < end && IsDigit(*p); ++p, any = true)
+                {
+                    if (digits < 19)
+                    {
+                        mantissa = mantissa * 10u + std::uint64_t(*p - '0');
+                        digits += mantissa != 0u;
+                        --exponent;
+                    }
+                    else
+                    {
+                        digits = 20;
+                    }
+                }
+            }
+            if (!any)
+            {
+                return false;
+            }
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                ++p;
+                bool negative = p < end && *p == '-';
+                if (p < end && (*p == '-' || *p == '+'))
+                {
+                    ++p;
+                }
+                if (p == end || !IsDigit(*p))
+                {
+                    return false;
+                }
+                int e = 0;
+                for (; p < end && IsDigit(*p); ++p)
+                {
+                    e = std::min(e * 10 + (*p - '0'), 100000);
+                }
+                exponent += negative ? -e : e;
+            }
+            if (p != end)
+            {
+                return false;
+            }
+
+            if (digits <= 15 && exponent >= -22 && exponent <= 22)
+            {
+                value = exponent < 0 ? double(mantissa) / powers[-exponent] : double(mantissa) * powers[exponent];
+                return true;
+            }
+
+            // too many digits for the fast path.  strtod wants the locale's decimal point
+            char buffer[128];
+            std::size_t n = std::size_t(end - begin);
+            if (n >= sizeof(buffer))
+            {
+                return false;
+            }
+            std::memcpy(buffer, begin, n);
+            buffer[n] = '\0';
+            char *point = std::strchr(buffer, '.');
+            if (point)
+            {
+                *point = *std::localeconv()->decimal_point;
+            }
+            value = std::strtod(buffer, NULL);
+            return true;
+        }
+
+
+        char *FormatLuaNumber(double value, char *buffer)
+        {
+            char point = *std::localeconv()->decimal_point;
+            int n = 0;
+            for (int precision = 6; precision <= 9; ++precision)
+            {
+                n = std::snprintf(buffer, 32, "%.*g", precision, value);
+                char *p = std::strchr(buffer, point);
+                if (p)
+                {
+                    *p = '.';
+                }
+
+                double readBack;
+                const char *b = buffer + (*buffer == '-');
+                if (ParseLuaNumber(b, buffer + n, readBack) && float(*buffer == '-' ? -readBack : readBack) == float(value))
+                {
+                    break;
+                }
+            }
+            return buffer + n;
+        }
+
+
+        LuaTokenHistory::LuaTokenHistory()
+        {
+            for (LuaToken &t : tokens)
+            {
+                t.type = LuaToken::END;
+                t.begin = t.end = NULL;
+            }
+        }
+
+
+        void LuaTokenHistory::Push(const LuaToken &token)
+        {
+            for (int i = DEPTH - 1; i > 0; --i)
+            {
+                tokens[i] = tokens[i - 1];
+            }
+            tokens[0] = token;
+        }
+
+
+        const LuaToken *LuaTokenHistory::AssignedKey() const
+        {
+            if (!tokens[0].Is('='))
+            {
+                return NULL;
+            }
+
+            const LuaToken &k = tokens[1].Is(']') ? tokens[2] : tokens[1];
+            return k.type == LuaToken::NAME || k.type == LuaToken::STRING ? &k : NULL;
+        }
+
+
+        const char *LuaTokenHistory::AssignmentBegin() const
+        {
+            if (!AssignedKey())
+            {
+                return NULL;
+            }
+            return tokens[1].Is(']') ? tokens[3].begin : tokens[1].begin;
+        }
+
+
+        bool LuaTokenHistory::IsAssignmentTo(const char *key) const
+        {
+            const LuaToken *k = AssignedKey();
+            if (!k)
+            {
+                return false;
+            }
+
+            const char *b, *e;
+            k->Unquoted(b, e);
+            std::size_t n = std::strlen(key);
+            return std::size_t(e - b) == n && !std::memcmp(b, key, n);
+        }
+
+
+        bool ReadLuaNumberList(LuaLexer &lexer, char open, int count, char close, double *values, LuaToken &first, LuaToken &last)
+        {
+            LuaLexer lookahead = lexer;
+            if (open)
+            {
+                first = lookahead.NextSignificant();
+                if (!first.Is(open))
+                {
+                    return false;
+                }
+            }
+            for (int i = 0; i < count; ++i)
+            {
+                LuaToken t = lookahead.NextSignificant();
+                if (!open && i == 0)
+                {
+                    first = t;
+                }
+                bool negative = t.Is('-');
+                if (negative)
+                {
+                    t = lookahead.NextSignificant();
+                }
+                if (t.type != LuaToken::NUMBER || !ParseLuaNumber(t.begin, t.end, values[i]))
+                {
+                    return false;
+                }
+                values[i] = negative ? -values[i] : values[i];
+
+                t = lookahead.NextSignificant();
+                if (t.Is(',') && i + 1 == count)
+                {
+                    t = lookahead.NextSignificant();
+                }
+                if (i + 1 < count ? !t.Is(',') : !t.Is(close))
+                {
+                    return false;
+                }
+                last = t;
+            }
+            lexer = lookahead;
+            return true;
+        }
+
+
+        std::string FormatLuaNumberList(const double *values, int count)
+        {
+            std::string result;
+            char buffer[32];
+            for (int i = 0; i < count; ++i)
+            {
+                if (i > 0)
+                {
+                    result += ", ";
+                }
+                result.append(buffer, FormatLuaNumber(values[i], buffer));
+            }
+            return result;
+        }
+
+
+        void UpdateScenarioLua(const char *begin, const char *end, std::ostream &os, const Scmp &scmp)
+        {
+            const char *copied = begin;
+            LuaLexer lexer(begin, end);
+            LuaTokenHistory history;
+
+            for (LuaToken t = lexer.NextSignificant(); t.type != LuaToken::END; t = lexer.NextSignificant())
+            {
+                LuaToken first, last;
+                double v[2];
+                if (t.Is('{') && history.IsAssignmentTo("size") && ReadLuaNumberList(lexer, 0, 2, '}', v, first, last))
+                {
+                    v[0] = scmp.width;
+                    v[1] = scmp.height;
+                    os.write(copied, t.begin - copied);
+                    os << "{ " << FormatLuaNumberList(v, 2) << " }";
+                    copied = last.end;
+                    t = last;
+                }
+                history.Push(t);
+            }
+            os.write(copied, end - copied);
+        }
+
+
+        void RewriteLuaFile(const std::string &sourceFilename, const std::string &targetFilename,
+            const std::function<void(const char *begin, const char *end, std::ostream &os)> &rewrite)
+        {
+            std::string tempFilename = targetFilename + ".tmp";
+            {
+                MappedFile source(sourceFilename);
+                std::ofstream ofs(tempFilename.c_str(), std::ios::binary);
+                if (!ofs.good())
+                {
+                    throw std::runtime_error("unable to write " + tempFilename);
+                }
+                try
+                {
+                    rewrite(source.begin(), source.end(), ofs);
+                }
+                catch (...)
+                {
+                    ofs.close();
+                    std::remove(tempFilename.c_str());
+                    throw;
+                }
+                ofs.close();
+                if (ofs.fail())
+                {
+                    std::remove(tempFilename.c_str());
+                    throw std::runtime_error("unable to write " + tempFilename);
+                }
+            }
+
+            // the target is replaced in one step, so a failure leaves it as it was
+#ifdef _WIN32
+            // rename won't replace an existing file on windows
+            bool replaced = MoveFileExA(tempFilename.c_str(), targetFilename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            bool replaced = std::rename(tempFilename.c_str(), targetFilename.c_str()) == 0;
+#endif
+            if (!replaced)
+            {
+                std::remove(tempFilename.c_str());
+                throw std::runtime_error("unable to replace " + targetFilename);
+            }
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // A token is a range of the buffer being lexed, never a copy of it
+        struct LuaToken
+        {
+            enum Type
+            {
+                END,
+                NAME,       // identifiers and keywords
+                NUMBER,
+                STRING,     // including its quotes or long brackets
+                SYMBOL,     // operators and punctuation, one or more characters
+                COMMENT
+            };
+
+            bool Is(char symbol) const { return type == SYMBOL && end - begin == 1 && *begin == symbol; }
+            bool Is(Type t, const char *text) const;
+            // the text of a STRING without its quotes.  escapes are not processed
+            void Unquoted(const char *&b, const char *&e) const;
+
+            Type type;
+            const char *begin;
+            const char *end;
+        };
+
+
+        // Splits a lua source buffer into tokens without allocating.  Whitespace is skipped, comments are returned
+        // as tokens so that callers who copy the input through can see every byte.  Malformed input (an
+        // unterminated string, say) ends the token at the end of the buffer rather than throwing.
+        class LuaLexer
+        {
+        public:
+            LuaLexer(const char *begin, const char *end) : m_pos(begin), m_end(end) { }
+
+            LuaToken Next();
+            // next token that isn't a comment
+            LuaToken NextSignificant();
+
+        private:
+            const char *LongBracketEnd(const char *p) const;
+
+            const char *m_pos;
+            const char *m_end;
+        };
+
+
+        // Locale independent number conversion.  ParseLuaNumber returns false if the token isn't a decimal number.
+        // FormatLuaNumber writes the shortest %g form, of at least 6 significant digits, that reads back as the same
+        // float: the precision the game keeps.  buffer must hold at least 32 chars; returns the end of the text
+        bool ParseLuaNumber(const char *begin, const char *end, double &value);
+        char *FormatLuaNumber(double value, char *buffer);
+
+
+        // "a, b, c" as FormatLuaNumber writes them
+        std::string FormatLuaNumberList(const double *values, int count);
+
+
+        // The last few significant tokens read, most recent first
+        struct LuaTokenHistory
+        {
+            enum { DEPTH = 4 };
+
+            LuaTokenHistory();
+            void Push(const LuaToken &token);
+
+            // if the token about to be read is the value of an assignment, key = ... or ['key'] = ..., the key's token
+            const LuaToken *AssignedKey() const;
+            // where that assignment starts: the key, or the '[' before it
+            const char *AssignmentBegin() const;
+            bool IsAssignmentTo(const char *key) const;
+
+            LuaToken tokens[DEPTH];
+        };
+
+
+        // Reads "open n, n, ... n close" into values, allowing negative numbers and a trailing comma.  open may be 0 if
+        // it has already been read, in which case first is the first number.  lexer is only advanced on success
+        bool ReadLuaNumberList(LuaLexer &lexer, char open, int count, char close, double *values, LuaToken &first, LuaToken &last);
+
+
+        // Copy a _scenario.lua through to os, replacing size = { w, h } with the size of scmp
+        void UpdateScenarioLua(const char *begin, const char *end, std::ostream &os, const Scmp &scmp);
+
+        // Map sourceFilename and pass its bytes through rewrite into targetFilename.  Output goes to a temporary file that
+        // replaces the target once complete, so source and target may be the same file.  If rewrite throws, or the target
+        // can't be replaced, the temporary file is removed and the target left as it was
+        void RewriteLuaFile(const std::string &sourceFilename, const std::string &targetFilename,
+            const std::function<void(const char *begin, const char *end, std::ostream &os)> &rewrite);
+    }
+}
@@ -0,0 +1,117 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace nfa {
+    namespace scmp {
+
+#ifdef _WIN32
+
+        MappedFile::MappedFile(const std::string &filename) :
+            m_data(NULL),
+            m_size(0u),
+            m_file(INVALID_HANDLE_VALUE),
+            m_mapping(NULL)
+        {
+            m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                throw std::runtime_error("unable to open " + filename);
+            }
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size))
+            {
+                CloseHandle(m_file);
+                throw std::runtime_error("unable to get size of " + filename);
+            }
+            m_size = std::size_t(size.QuadPart);
+            if (m_size == 0u)
+            {
+                return;
+            }
+
+            m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            m_data = m_mapping ? (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+            if (!m_data)
+            {
+                if (m_mapping)
+                {
+                    CloseHandle(m_mapping);
+                }
+                CloseHandle(m_file);
+                throw std::runtime_error("unable to map " + filename);
+            }
+        }
+
+        MappedFile::~MappedFile()
+        {
+            if (m_data)
+            {
+                UnmapViewOfFile(m_data);
+            }
+            if (m_mapping)
+            {
+                CloseHandle(m_mapping);
+            }
+            CloseHandle(m_file);
+        }
+
+#else
+
+        MappedFile::MappedFile(const std::string &filename) :
+            m_data(NULL),
+            m_size(0u)
+        {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("unable to open " + filename);
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                close(fd);
+                throw std::runtime_error("unable to get size of " + filename);
+            }
+            m_size = std::size_t(st.st_size);
+            if (m_size == 0u)
+            {
+                close(fd);
+                return;
+            }
+
+            void *p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED)
+            {
+                throw std::runtime_error("unable to map " + filename);
+            }
+            madvise(p, m_size, MADV_SEQUENTIAL);
+            m_data = (const char*)p;
+        }
+
+        MappedFile::~MappedFile()
+        {
+            if (m_data)
+            {
+                munmap((void*)m_data, m_size);
+            }
+        }
+
+#endif
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace nfa {
+    namespace scmp {
+
+        // A whole file mapped read only into memory.  The mapping lives as long as the object.
+        // Throws std::runtime_error if the file can't be opened or mapped.  An empty file maps to data() == NULL.
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(const std::string &filename);
+            ~MappedFile();
+
+            const char *data() const { return m_data; }
+            std::size_t size() const { return m_size; }
+            const char *begin() const { return m_data; }
+            const char *end() const { return m_data + m_size; }
+
+        private:
+            MappedFile(const MappedFile &);
+            MappedFile &operator=(const MappedFile &);
+
+            const char *m_data;
+            std::size_t m_size;
+#ifdef _WIN32
+            void *m_file;
+            void *m_mapping;
+#endif
+        };
+    }
+}
@@ -0,0 +1,600 @@
+#include "markers.h"
+
+#include "io.h"
+#include "lua.h"
+#include "pathability.h"
+#include "scmp.h"
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <climits>
+#include <sys/stat.h>
+#endif
+
+
+static const std::uint32_t CACHE_MAGIC = 0x4b4d4353;    // "SCMK"
+static const std::uint32_t CACHE_VERSION = 1u;
+
+
+// p, moved back to the start of its line if only whitespace precedes it
+static const char *LineBegin(const char *fileBegin, const char *p)
+{
+    const char *q = p;
+    while (q > fileBegin && (q[-1] == ' ' || q[-1] == '\t'))
+    {
+        --q;
+    }
+    return q == fileBegin || q[-1] == '\n' ? q : p;
+}
+
+
+// p, moved forward past the end of its line if only whitespace follows it
+static const char *LineEnd(const char *p, const char *fileEnd)
+{
+    const char *q = p;
+    while (q < fileEnd && (*q == ' ' || *q == '\t' || *q == '\r'))
+    {
+        ++q;
+    }
+    if (q == fileEnd)
+    {
+        return q;
+    }
+    return *q == '\n' ? q + 1 : p;
+}
+
+
+namespace nfa {
+    namespace scmp {
+
+        std::uint64_t HashBytes(const char *begin, const char *end)
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (const char *p = begin; p < end; ++p)
+            {
+                hash = (hash ^ std::uint8_t(*p)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+
+        // filename made absolute, so every spelling of one file names the same cache.  As given if it can't be resolved
+        static std::string CanonicalFilename(const std::string &filename)
+        {
+#ifdef _WIN32
+            char path[MAX_PATH];
+            DWORD length = GetFullPathNameA(filename.c_str(), MAX_PATH, path, NULL);
+            if (length == 0 || length >= MAX_PATH)
+            {
+                return filename;
+            }
+            // windows paths are case insensitive
+            std::string canonical(path, length);
+            std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+            return canonical;
+#else
+            char path[PATH_MAX];
+            return realpath(filename.c_str(), path) ? std::string(path) : filename;
+#endif
+        }
+
+
+        // the user's cache directory for marker caches, created if need be.  Empty if there is none
+        static std::string MarkerCacheDirectory()
+        {
+#ifdef _WIN32
+            const char *root = std::getenv("LOCALAPPDATA");
+            if (!root || !*root)
+            {
+                return std::string();
+            }
+            std::string directory = std::string(root) + "\\scmp";
+            CreateDirectoryA(directory.c_str(), NULL);
+            directory += "\\markers";
+            CreateDirectoryA(directory.c_str(), NULL);
+            DWORD attributes = GetFileAttributesA(directory.c_str());
+            return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) ? directory : std::string();
+#else
+            std::string directory;
+            const char *root = std::getenv("XDG_CACHE_HOME");
+            if (root && *root == '/')
+            {
+                directory = root;
+            }
+            else if ((root = std::getenv("HOME")) && *root)
+            {
+                directory = std::string(root) + "/.cache";
+            }
+            else
+            {
+                return std::string();
+            }
+            mkdir(directory.c_str(), 0700);
+            directory += "/scmp";
+            mkdir(directory.c_str(), 0700);
+            directory += "/markers";
+            mkdir(directory.c_str(), 0700);
+            struct stat st;
+            return stat(directory.c_str(), &st) == 0 && S_ISDIR(st.st_mode) ? directory : std::string();
+#endif
+        }
+
+
+        std::string MarkerCacheFilename(const std::string &luaFilename)
+        {
+            std::string directory = MarkerCacheDirectory();
+            if (directory.empty())
+            {
+                return std::string();
+            }
+            std::string canonical = CanonicalFilename(luaFilename);
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.markers", (unsigned long long)HashBytes(canonical.data(), canonical.data() + canonical.size()));
+#ifdef _WIN32
+            return directory + "\\" + name;
+#else
+            return directory + "/" + name;
+#endif
+        }
+
+
+        static SaveLuaMarkers ParseMarkers(const char *begin, const char *end, std::uint64_t hash)
+        {
+            enum Container { NONE, MARKERS, AREAS };
+            struct Level
+            {
+                int marker;             // index of the marker this table is the entry of, or -1
+                Container container;    // whether this table's entries are markers
+            };
+
+            SaveLuaMarkers result;
+            result.fileSize = std::uint64_t(end - begin);
+            result.fileHash = hash;
+            if (result.fileSize > std::numeric_limits<std::uint32_t>::max())
+            {
+                throw std::runtime_error("lua file too large to index markers");
+            }
+
+            auto offset = [begin](const char *p) { return std::uint32_t(p - begin); };
+
+            std::vector<Level> stack;
+            LuaLexer lexer(begin, end);
+            LuaTokenHistory history;
+            for (LuaToken t = lexer.NextSignificant(); t.type != LuaToken::END; t = lexer.NextSignificant())
+            {
+                if (t.Is('{'))
+                {
+                    Level level = { -1, NONE };
+                    const LuaToken *key = history.AssignedKey();
+                    if (key && !stack.empty() && stack.back().container != NONE)
+                    {
+                        const char *nb, *ne;
+                        key->Unquoted(nb, ne);
+
+                        Marker m;
+                        m.kind = stack.back().container == MARKERS ? Marker::MARKER : Marker::AREA;
+                        m.name.assign(nb, ne);
+                        m.hasPosition = m.hasRectangle = false;
+                        std::fill(m.position, m.position + 3, 0.0);
+                        std::fill(m.rectangle, m.rectangle + 4, 0.0);
+                        m.entry.begin = offset(LineBegin(begin, history.AssignmentBegin()));
+                        m.nameSpan = LuaSpan(offset(nb), offset(ne));
+                        level.marker = int(result.markers.size());
+                        result.markers.push_back(m);
+                    }
+                    else if (key && history.IsAssignmentTo("Markers"))
+                    {
+                        level.container = MARKERS;
+                    }
+                    else if (key && history.IsAssignmentTo("Areas"))
+                    {
+                        level.container = AREAS;
+                    }
+                    stack.push_back(level);
+                }
+                else if (t.Is('}'))
+                {
+                    if (stack.empty())
+                    {
+                        continue;
+                    }
+
+                    Level level = stack.back();
+                    stack.pop_back();
+                    if (level.container == MARKERS)
+                    {
+                        result.markersInsert = offset(LineBegin(begin, t.begin));
+                    }
+                    else if (level.container == AREAS)
+                    {
+                        result.areasInsert = offset(LineBegin(begin, t.begin));
+                    }
+                    else if (level.marker >= 0)
+                    {
+                        // take the separator with the entry, so removing it leaves the table well formed
+                        LuaLexer lookahead = lexer;
+                        LuaToken separator = lookahead.NextSignificant();
+                        if (separator.Is(',') || separator.Is(';'))
+                        {
+                            lexer = lookahead;
+                            t = separator;
+                        }
+                        result.markers[level.marker].entry.end = offset(LineEnd(t.end, end));
+                    }
+                }
+                else if (!stack.empty() && stack.back().marker >= 0)
+                {
+                    Marker &m = result.markers[stack.back().marker];
+                    LuaToken first, last;
+                    if (t.Is(LuaToken::NAME, "VECTOR3") && history.IsAssignmentTo("position") &&
+                        ReadLuaNumberList(lexer, '(', 3, ')', m.position, first, last))
+                    {
+                        m.hasPosition = true;
+                        m.positionArgs = LuaSpan(offset(first.end), offset(last.begin));
+                        t = last;
+                    }
+                    else if (t.Is(LuaToken::NAME, "RECTANGLE") && history.IsAssignmentTo("rectangle") &&
+                        ReadLuaNumberList(lexer, '(', 4, ')', m.rectangle, first, last))
+                    {
+                        m.hasRectangle = true;
+                        m.rectangleArgs = LuaSpan(offset(first.end), offset(last.begin));
+                        t = last;
+                    }
+                    else if (t.Is(LuaToken::NAME, "STRING") && history.IsAssignmentTo("type"))
+                    {
+                        LuaLexer lookahead = lexer;
+                        LuaToken open = lookahead.NextSignificant();
+                        LuaToken value = lookahead.NextSignificant();
+                        LuaToken close = lookahead.NextSignificant();
+                        if (open.Is('(') && value.type == LuaToken::STRING && close.Is(')'))
+                        {
+                            const char *vb, *ve;
+                            value.Unquoted(vb, ve);
+                            m.type.assign(vb, ve);
+                            lexer = lookahead;
+                            t = close;
+                        }
+                    }
+                }
+                history.Push(t);
+            }
+            return result;
+        }
+
+
+        SaveLuaMarkers SaveLuaMarkers::Parse(const char *begin, const char *end)
+        {
+            return ParseMarkers(begin, end, HashBytes(begin, end));
+        }
+
+
+        SaveLuaMarkers SaveLuaMarkers::Load(const char *begin, const char *end, const std::string &cacheFilename)
+        {
+            std::uint64_t hash = HashBytes(begin, end);
+            if (cacheFilename.empty())
+            {
+                return ParseMarkers(begin, end, hash);
+            }
+            {
+                std::ifstream ifs(cacheFilename.c_str(), std::ios::binary);
+                SaveLuaMarkers cached;
+                if (ifs.good() && cached.ReadCache(ifs) && cached.fileSize == std::uint64_t(end - begin) && cached.fileHash == hash)
+                {
+                    return cached;
+                }
+            }
+
+            SaveLuaMarkers result = ParseMarkers(begin, end, hash);
+            std::ofstream ofs(cacheFilename.c_str(), std::ios::binary);
+            if (ofs.good())
+            {
+                result.WriteCache(ofs);
+            }
+            return result;
+        }
+
+
+        bool SaveLuaMarkers::ReadCache(std::istream &is)
+        {
+            std::uint32_t magic = 0u, version = 0u, count = 0u;
+            Read(is, magic);
+            Read(is, version);
+            if (!is.good() || magic != CACHE_MAGIC || version != CACHE_VERSION)
+            {
+                return false;
+            }
+
+            Read(is, fileSize);
+            Read(is, fileHash);
+            Read(is, markersInsert);
+            Read(is, areasInsert);
+            Read(is, count);
+            if (!is.good() || count > fileSize)
+            {
+                return false;
+            }
+
+            markers.resize(count);
+            for (Marker &m : markers)
+            {
+                std::uint8_t kind = 0u, hasPosition = 0u, hasRectangle = 0u;
+                Read(is, kind);
+                Read(is, m.name);
+                Read(is, m.type);
+                Read(is, hasPosition);
+                Read(is, m.position);
+                Read(is, hasRectangle);
+                Read(is, m.rectangle);
+                for (LuaSpan *span : { &m.entry, &m.nameSpan, &m.positionArgs, &m.rectangleArgs })
+                {
+                    Read(is, span->begin);
+                    Read(is, span->end);
+                    if (span->begin > span->end || span->end > fileSize)
+                    {
+                        return false;
+                    }
+                }
+                m.kind = Marker::Kind(kind);
+                m.hasPosition = hasPosition != 0u;
+                m.hasRectangle = hasRectangle != 0u;
+            }
+            return !is.fail();
+        }
+
+
+        void SaveLuaMarkers::WriteCache(std::ostream &os) const
+        {
+            Write(os, CACHE_MAGIC);
+            Write(os, CACHE_VERSION);
+            Write(os, fileSize);
+            Write(os, fileHash);
+            Write(os, markersInsert);
+            Write(os, areasInsert);
+            Write(os, std::uint32_t(markers.size()));
+            for (const Marker &m : markers)
+            {
+                Write(os, std::uint8_t(m.kind));
+                Write(os, m.name);
+                Write(os, m.type);
+                Write(os, std::uint8_t(m.hasPosition));
+                Write(os, m.position);
+                Write(os, std::uint8_t(m.hasRectangle));
+                Write(os, m.rectangle);
+                for (const LuaSpan *span : { &m.entry, &m.nameSpan, &m.positionArgs, &m.rectangleArgs })
+                {
+                    Write(os, span->begin);
+                    Write(os, span->end);
+                }
+            }
+        }
+
+
+        void ApplyLuaPatches(const char *begin, const char *end, std::vector<LuaPatch> patches, std::ostream &os)
+        {
+            std::stable_sort(patches.begin(), patches.end(), [](const LuaPatch &a, const LuaPatch &b)
+            {
+                return a.begin < b.begin;
+            });
+
+            std::uint32_t copied = 0u;
+            std::uint32_t size = std::uint32_t(end - begin);
+            for (const LuaPatch &patch : patches)
+            {
+                if (patch.begin < copied || patch.end < patch.begin || patch.end > size)
+                {
+                    throw std::runtime_error("overlapping or out of range lua patches");
+                }
+                os.write(begin + copied, patch.begin - copied);
+                os.write(patch.text.data(), patch.text.size());
+                copied = patch.end;
+            }
+            os.write(begin + copied, size - copied);
+        }
+
+
+        std::vector<LuaPatch> RescaleMarkerPatches(const SaveLuaMarkers &markers,
+            double xscale, double zscale, double xofs, double zofs, const Scmp &scmp)
+        {
+            std::vector<LuaPatch> patches;
+            for (const Marker &m : markers.markers)
+            {
+                if (m.hasPosition)
+                {
+                    double v[3];
+                    v[0] = m.position[0] * xscale + xofs;
+                    v[2] = m.position[2] * zscale + zofs;
+                    v[1] = scmp.heightScale * scmp.HeightMapAt(int(v[0]), int(v[2]));
+                    patches.push_back(LuaPatch(m.positionArgs.begin, m.positionArgs.end, " " + FormatLuaNumberList(v, 3) + " "));
+                }
+                if (m.hasRectangle)
+                {
+                    double v[4];
+                    v[0] = m.rectangle[0] * xscale + xofs;
+                    v[1] = m.rectangle[1] * zscale + zofs;
+                    v[2] = m.rectangle[2] * xscale + xofs;
+                    v[3] = m.rectangle[3] * zscale + zofs;
+                    patches.push_back(LuaPatch(m.rectangleArgs.begin, m.rectangleArgs.end, " " + FormatLuaNumberList(v, 4) + " "));
+                }
+            }
+            return patches;
+        }
+
+
+        // name with its trailing number, if any, bumped until it isn't in names.  "Mass 07" => "Mass 08", "Start" => "Start 2"
+        static std::string UniqueMarkerName(const std::string &name, const std::set<std::string> &names)
+        {
+            std::size_t digits = name.size();
+            while (digits > 0u && name[digits - 1u] >= '0' && name[digits - 1u] <= '9')
+            {
+                --digits;
+            }
+
+            std::string prefix = digits < name.size() ? name.substr(0u, digits) : name + " ";
+            std::size_t width = name.size() - digits;
+            long number = digits < name.size() ? std::strtol(name.c_str() + digits, NULL, 10) : 1;
+            std::string result = name;
+            while (names.count(result))
+            {
+                std::ostringstream ss;
+                ss << prefix;
+                ss.width(width);
+                ss.fill('0');
+                ss << ++number;
+                result = ss.str();
+            }
+            return result;
+        }
+
+
+        std::vector<LuaPatch> MergeMarkerPatches(
+            const char *sourceBegin, const SaveLuaMarkers &source,
+            const char *targetBegin, const SaveLuaMarkers &target,
+            double xscale, double zscale, double xofs, double zofs, double importWidth, double importHeight,
+            const Scmp &targetScmp)
+        {
+            if (target.markersInsert == 0u)
+            {
+                throw std::runtime_error("target _save.lua has no Markers table to merge into");
+            }
+
+            float x0 = float(std::max(xofs, 0.0));
+            float z0 = float(std::max(zofs, 0.0));
+            float x1 = float(std::min(xofs + importWidth, double(targetScmp.width)));
+            float z1 = float(std::min(zofs + importHeight, double(targetScmp.height)));
+
+            std::vector<float> px, pz;
+            std::vector<std::uint32_t> indexed;
+            for (std::uint32_t i = 0u; i < target.markers.size(); ++i)
+            {
+                const Marker &m = target.markers[i];
+                if (m.kind == Marker::MARKER && m.hasPosition)
+                {
+                    px.push_back(float(m.position[0]));
+                    pz.push_back(float(m.position[2]));
+                    indexed.push_back(i);
+                }
+            }
+            SpatialGrid grid;
+            grid.Build(px, pz);
+            std::vector<std::uint32_t> inside;
+            grid.QueryRectangle(x0, z0, x1, z1, inside);
+
+            std::vector<bool> removed(target.markers.size(), false);
+            std::vector<LuaPatch> patches;
+            for (std::uint32_t k : inside)
+            {
+                const Marker &m = target.markers[indexed[k]];
+                removed[indexed[k]] = true;
+                patches.push_back(LuaPatch(m.entry.begin, m.entry.end, std::string()));
+            }
+
+            std::set<std::string> names;
+            for (std::size_t i = 0u; i < target.markers.size(); ++i)
+            {
+                if (!removed[i])
+                {
+                    names.insert(target.markers[i].name);
+                }
+            }
+
+            // the last surviving entry before the insertion point needs a separator if it has none
+            const char *p = targetBegin + target.markersInsert;
+            while (p > targetBegin && (p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\r' || p[-1] == '\n'))
+            {
+                --p;
+            }
+            if (p > targetBegin && p[-1] != '{' && p[-1] != ',' && p[-1] != ';')
+            {
+                std::uint32_t at = std::uint32_t(p - targetBegin);
+                bool insideRemoved = false;
+                for (const LuaPatch &patch : patches)
+                {
+                    insideRemoved = insideRemoved || (at > patch.begin && at <= patch.end);
+                }
+                if (!insideRemoved)
+                {
+                    patches.push_back(LuaPatch(at, at, ","));
+                }
+            }
+
+            std::ostringstream inserted;
+            for (const Marker &m : source.markers)
+            {
+                if (m.kind != Marker::MARKER || !m.hasPosition)
+                {
+                    continue;
+                }
+
+                double v[3];
+                v[0] = m.position[0] * xscale + xofs;
+                v[2] = m.position[2] * zscale + zofs;
+                if (!(v[0] >= x0 && v[0] < x1 && v[2] >= z0 && v[2] < z1))
+                {
+                    continue;
+                }
+                v[1] = targetScmp.heightScale * targetScmp.HeightMapAt(int(v[0]), int(v[2]));
+
+                std::string name = UniqueMarkerName(m.name, names);
+                names.insert(name);
+
+                std::vector<LuaPatch> entryPatches;
+                entryPatches.push_back(LuaPatch(m.nameSpan.begin - m.entry.begin, m.nameSpan.end - m.entry.begin, name));
+                entryPatches.push_back(LuaPatch(m.positionArgs.begin - m.entry.begin, m.positionArgs.end - m.entry.begin,
+                    " " + FormatLuaNumberList(v, 3) + " "));
+                std::ostringstream entry;
+                ApplyLuaPatches(sourceBegin + m.entry.begin, sourceBegin + m.entry.end, entryPatches, entry);
+
+                std::string text = entry.str();
+                text.erase(text.find_last_not_of(" \t\r\n") + 1u);
+                if (!text.empty() && text.back() == '}')
+                {
+                    text += ',';
+                }
+                inserted << text << '\n';
+            }
+            patches.push_back(LuaPatch(target.markersInsert, target.markersInsert, inserted.str()));
+            return patches;
+        }
+
+
+        void RescaleSaveLua(const char *begin, const char *end, const SaveLuaMarkers &markers, std::ostream &os,
+            double xscale, double zscale, double xofs, double zofs, const Scmp &scmp)
+        {
+            if (markers.fileSize != std::uint64_t(end - begin))
+            {
+                throw std::runtime_error("markers were read from a different _save.lua");
+            }
+            ApplyLuaPatches(begin, end, RescaleMarkerPatches(markers, xscale, zscale, xofs, zofs, scmp), os);
+        }
+
+
+        std::vector<std::size_t> BlockedMarkers(const SaveLuaMarkers &markers, const PathabilityGrid &grid)
+        {
+            std::vector<std::size_t> blocked;
+            for (std::size_t n = 0u; n < markers.markers.size(); ++n)
+            {
+                const Marker &m = markers.markers[n];
+                if (m.hasPosition && grid.BlockedAt(m.position[0], m.position[2]))
+                {
+                    blocked.push_back(n);
+                }
+            }
+            return blocked;
+        }
+    }
+}
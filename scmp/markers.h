@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+        struct PathabilityGrid;
+
+        // A byte range [begin, end) of a lua file
+        struct LuaSpan
+        {
+            LuaSpan() : begin(0u), end(0u) { }
+            LuaSpan(std::uint32_t b, std::uint32_t e) : begin(b), end(e) { }
+            bool empty() const { return begin == end; }
+
+            std::uint32_t begin;
+            std::uint32_t end;
+        };
+
+
+        // One entry of the Markers or Areas table of a _save.lua
+        struct Marker
+        {
+            enum Kind
+            {
+                MARKER,     // Scenario.MasterChain._MASTERCHAIN_.Markers
+                AREA        // Scenario.Areas
+            };
+
+            Kind kind;
+            std::string name;
+            std::string type;           // ['type'] = STRING( ... ), if present
+            bool hasPosition;
+            double position[3];         // ['position'] = VECTOR3( x, y, z )
+            bool hasRectangle;
+            double rectangle[4];        // ['rectangle'] = RECTANGLE( x0, z0, x1, z1 )
+
+            LuaSpan entry;              // the whole entry, from the start of its first line to the end of the line holding its
+                                        // closing brace and separator.  removing it leaves a well formed table
+            LuaSpan nameSpan;           // the name, inside its quotes
+            LuaSpan positionArgs;       // inside the parentheses of VECTOR3( ... ); empty if !hasPosition
+            LuaSpan rectangleArgs;      // inside the parentheses of RECTANGLE( ... ); empty if !hasRectangle
+        };
+
+
+        // Every marker and area of a _save.lua, with the spans needed to patch them in place
+        struct SaveLuaMarkers
+        {
+            SaveLuaMarkers() : fileSize(0u), fileHash(0u), markersInsert(0u), areasInsert(0u) { }
+
+            static SaveLuaMarkers Parse(const char *begin, const char *end);
+
+            // Parse, or read the markers from cacheFilename if it was written for a file with the same size and hash.
+            // A stale or missing cache is rewritten; failing to write it is not an error.  An empty cacheFilename only parses
+            static SaveLuaMarkers Load(const char *begin, const char *end, const std::string &cacheFilename);
+
+            bool ReadCache(std::istream &is);
+            void WriteCache(std::ostream &os) const;
+
+            std::uint64_t fileSize;
+            std::uint64_t fileHash;
+            std::vector<Marker> markers;
+            std::uint32_t markersInsert;    // offset of the Markers table's closing brace, where new markers go.  0 if none
+            std::uint32_t areasInsert;      // likewise for Areas
+        };
+
+        // where SaveLuaMarkers::Load keeps the cache for a lua file: a file named for its canonical path, in the user's
+        // cache directory (%LOCALAPPDATA%\scmp\markers, or $XDG_CACHE_HOME/scmp/markers defaulting to ~/.cache), never
+        // beside the map.  Empty if there's no such directory, and then nothing is cached
+        std::string MarkerCacheFilename(const std::string &luaFilename);
+
+        // FNV-1a, 64 bit
+        std::uint64_t HashBytes(const char *begin, const char *end);
+
+
+        // Replace span [begin, end) of a lua file with text.  begin == end inserts
+        struct LuaPatch
+        {
+            LuaPatch(std::uint32_t b, std::uint32_t e, const std::string &t) : begin(b), end(e), text(t) { }
+
+            std::uint32_t begin;
+            std::uint32_t end;
+            std::string text;
+        };
+
+        // Copy [begin, end) to os with patches applied, streaming the unpatched ranges.  Insertions at the same offset
+        // keep their order.  Throws std::runtime_error if patches overlap or run past the end
+        void ApplyLuaPatches(const char *begin, const char *end, std::vector<LuaPatch> patches, std::ostream &os);
+
+
+        // Patches that rescale every marker position and area rectangle: x' = x*xscale + xofs, z' = z*zscale + zofs
+        // and y' the height of scmp at (x', z')
+        std::vector<LuaPatch> RescaleMarkerPatches(const SaveLuaMarkers &markers,
+            double xscale, double zscale, double xofs, double zofs, const Scmp &scmp);
+
+        // Patches that bring the markers of a source _save.lua into target, as Scmp::Import brings in its map: a source
+        // position (x, z) lands at (x*xscale + xofs, z*zscale + zofs), and the imported rectangle is importWidth by
+        // importHeight at (xofs, zofs), clipped to targetScmp.  Target markers inside that rectangle are removed, source
+        // markers landing outside it are dropped, heights snap to targetScmp, and source names that collide with a target
+        // name are renumbered.  Only Markers entries are merged; Areas describe the target's playable area and stay.
+        // Throws std::runtime_error if the target has no Markers table
+        std::vector<LuaPatch> MergeMarkerPatches(
+            const char *sourceBegin, const SaveLuaMarkers &source,
+            const char *targetBegin, const SaveLuaMarkers &target,
+            double xscale, double zscale, double xofs, double zofs, double importWidth, double importHeight,
+            const Scmp &targetScmp);
+
+        // Copy a _save.lua through to os with its markers rescaled as RescaleMarkerPatches
+        void RescaleSaveLua(const char *begin, const char *end, const SaveLuaMarkers &markers, std::ostream &os,
+            double xscale, double zscale, double xofs, double zofs, const Scmp &scmp);
+
+        // Indices into markers.markers of the markers positioned on a blocked cell of grid, eg start positions or mass
+        // points a Resize or a filter left on a cliff or under water
+        std::vector<std::size_t> BlockedMarkers(const SaveLuaMarkers &markers, const PathabilityGrid &grid);
+    }
+}
@@ -0,0 +1,108 @@
+#include "image.h"
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        // one normal per heightmap cell, taken at the cell centre by central differences of its four corners.
+        // that is the exact gradient of the bilinear surface the game renders
+        static NormalMap HeightMapNormals(const Scmp &scmp)
+        {
+            int W = scmp.width;
+            int H = scmp.height;
+            int stride = W + 1;
+            float scale = 0.5f * scmp.heightScale;
+            NormalMap nm(W, H);
+
+            ParallelForRows(H, [&](int row0, int row1)
+            {
+                for (int z = row0; z < row1; ++z)
+                {
+                    const std::int16_t *h0 = scmp.heightMapData.data() + std::size_t(stride) * z;
+                    const std::int16_t *h1 = h0 + stride;
+                    float *nx = nm.x.data() + std::size_t(W) * z;
+                    float *ny = nm.y.data() + std::size_t(W) * z;
+                    float *nz = nm.z.data() + std::size_t(W) * z;
+                    for (int x = 0; x < W; ++x)
+                    {
+                        float dhdx = scale * (float(h0[x + 1]) + float(h1[x + 1]) - float(h0[x]) - float(h1[x]));
+                        float dhdz = scale * (float(h1[x]) + float(h1[x + 1]) - float(h0[x]) - float(h0[x + 1]));
+                        float inv = 1.0f / std::sqrt(dhdx*dhdx + dhdz*dhdz + 1.0f);
+                        nx[x] = -dhdx * inv;
+                        ny[x] = -dhdz * inv;
+                        nz[x] = inv;
+                    }
+                }
+            });
+            return nm;
+        }
+
+
+        void Scmp::RegenerateNormalMap()
+        {
+            if (normalMapData.empty() || width <= 0 || height <= 0)
+            {
+                return;
+            }
+
+            EditScope edit(*this, "RegenerateNormalMap");
+            NormalMap cellNormals = HeightMapNormals(*this);
+
+            for (auto &data : normalMapData)
+            {
+                DropMipmaps(data);
+                dds::DdsFile dds(data.data(), data.size());
+                int W = dds.width();
+                int H = dds.height();
+
+                const NormalMap *nm = &cellNormals;
+                NormalMap resampled;
+                if (W != cellNormals.width || H != cellNormals.height)
+                {
+                    resampled = ResampleNormals(cellNormals, W, H, 1.0f, 1.0f);
+                    nm = &resampled;
+                }
+
+                std::size_t imageBytes;
+                std::uint8_t *image = (std::uint8_t*)dds.getMutable(imageBytes);
+
+                if (dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                {
+                    // bands of whole block rows, so each thread packs and encodes independently
+                    std::vector<std::uint8_t> rgba(4u * W * H);
+                    ParallelForRows((H + 3) / 4, [&](int blockRow0, int blockRow1)
+                    {
+                        int row0 = 4 * blockRow0;
+                        int row1 = std::min(4 * blockRow1, H);
+                        PackNormalRows(*nm, row0, row1, rgba.data());
+                        dds::encodeDxt5Region(rgba.data(), W, H, image, 0, row0, W, row1);
+                    }, 4);
+                }
+                else if (dds.glDataFormat() == GL_BGRA && dds.bytesPerPixel() == 4u)
+                {
+                    ParallelForRows(H, [&](int row0, int row1)
+                    {
+                        PackNormalRows(*nm, row0, row1, image);
+                        for (std::size_t i = std::size_t(W) * row0; i < std::size_t(W) * row1; ++i)
+                        {
+                            std::swap(image[4 * i + 0], image[4 * i + 2]);
+                        }
+                    });
+                }
+                else
+                {
+                    throw std::runtime_error("normalMapData: unsupported dds format, cannot regenerate");
+                }
+            }
+        }
+
+    }
+}
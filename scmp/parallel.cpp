@@ -0,0 +1,80 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        static std::atomic<unsigned> workerLimit(0u);
+
+        unsigned WorkerCount()
+        {
+            unsigned limit = workerLimit;
+            return limit > 0u ? limit : std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        void SetWorkerCount(unsigned workers)
+        {
+            workerLimit = workers;
+        }
+
+
+        void ParallelForRows(int rows, const std::function<void(int, int)> &f, int minRowsPerBand)
+        {
+            if (rows <= 0)
+            {
+                return;
+            }
+
+            int bands = std::min(int(WorkerCount()), std::max(1, rows / std::max(1, minRowsPerBand)));
+            if (bands <= 1)
+            {
+                f(0, rows);
+                return;
+            }
+
+            std::exception_ptr error;
+            std::mutex errorMutex;
+            auto runBand = [&](int band)
+            {
+                int row0 = int(std::int64_t(rows) * band / bands);
+                int row1 = int(std::int64_t(rows) * (band + 1) / bands);
+                try
+                {
+                    f(row0, row1);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (int band = 1; band < bands; ++band)
+            {
+                threads.push_back(std::thread(runBand, band));
+            }
+            runBand(0);
+            for (auto &t : threads)
+            {
+                t.join();
+            }
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+    }
+}
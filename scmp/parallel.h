@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+
+namespace nfa {
+    namespace scmp {
+
+        // Splits [0, rows) into contiguous bands, one per hardware thread, and calls f(row0, row1) for each band
+        // concurrently.  Bands are never smaller than minRowsPerBand, so small images stay on the calling thread.
+        // The first exception thrown by any band is rethrown once all bands have finished.
+        void ParallelForRows(int rows, const std::function<void(int row0, int row1)> &f, int minRowsPerBand = 16);
+
+        // Threads used by ParallelForRows and TaskGraph: the hardware thread count unless limited by SetWorkerCount.
+        // Batch tools that already run one map per thread set this to keep the total near the core count
+        unsigned WorkerCount();
+        void SetWorkerCount(unsigned workers);      // 0 restores the default
+    }
+}
@@ -0,0 +1,210 @@
+#include "pathability.h"
+#include "io.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <stdexcept>
+
+
+static const std::uint32_t GRID_MAGIC = 0x47504353;     // "SCPG"
+static const std::uint32_t GRID_VERSION = 1u;
+
+
+namespace nfa {
+    namespace scmp {
+
+        // The slope and depth tests are rewritten as integer comparisons with the raw heights, so the row loops stay in
+        // integers: a cell's slope is compared through the spread of its corners' raw heights, and its depth through
+        // their sum
+
+        static int ClampThreshold(double t)
+        {
+            // beyond any spread (65535) or sum (4 x 32768) of int16 heights, including the infinities
+            return int(std::max(-262144.0, std::min(262144.0, t)));
+        }
+
+        // T such that spread >= T exactly when the slope is above limit, or at least limit if !strict
+        static int SlopeThreshold(const Scmp &scmp, float limit, bool strict)
+        {
+            double raw = double(limit) / scmp.heightScale;
+            return ClampThreshold(strict ? std::floor(raw) + 1.0 : std::ceil(raw));
+        }
+
+        // T such that sum < T exactly when the depth is above limit, or at least limit if !strict.  depth = elevation -
+        // sum * heightScale / 4; without water every depth is -infinity
+        static int DepthThreshold(const Scmp &scmp, float limit, bool strict)
+        {
+            if (!scmp.waterShaderProperties || !scmp.waterShaderProperties->hasWater)
+            {
+                bool always = !strict && limit == -std::numeric_limits<float>::infinity();
+                return ClampThreshold(always ? HUGE_VAL : -HUGE_VAL);
+            }
+            double raw = 4.0 * (double(scmp.waterShaderProperties->elevation) - limit) / scmp.heightScale;
+            return ClampThreshold(strict ? std::ceil(raw) : std::floor(raw) + 1.0);
+        }
+
+
+        // the spread and sum of the raw corner heights of each cell of row z
+        static void AnalyseRow(const std::int16_t *heights, int W, int z, std::int32_t *spread, std::int32_t *sum)
+        {
+            const std::int16_t *r0 = heights + std::size_t(W + 1) * z;
+            const std::int16_t *r1 = r0 + (W + 1);
+            for (int x = 0; x < W; ++x)
+            {
+                std::int16_t a = r0[x], b = r0[x + 1], c = r1[x], d = r1[x + 1];
+                std::int16_t hi0 = a > b ? a : b, hi1 = c > d ? c : d;
+                std::int16_t lo0 = a < b ? a : b, lo1 = c < d ? c : d;
+                std::int16_t hi = hi0 > hi1 ? hi0 : hi1;
+                std::int16_t lo = lo0 < lo1 ? lo0 : lo1;
+                spread[x] = std::int32_t(hi) - std::int32_t(lo);
+                sum[x] = std::int32_t(a) + std::int32_t(b) + std::int32_t(c) + std::int32_t(d);
+            }
+        }
+
+
+        static void CheckHeights(const Scmp &scmp, const char *what)
+        {
+            if (scmp.width <= 0 || scmp.height <= 0 || scmp.heightMapData.size() != std::size_t(scmp.width + 1) * (scmp.height + 1))
+            {
+                throw std::runtime_error(std::string(what) + ": the heightmap isn't (width + 1) x (height + 1)");
+            }
+            if (!(scmp.heightScale > 0.0f))
+            {
+                throw std::runtime_error(std::string(what) + ": the map's heightScale isn't positive");
+            }
+        }
+
+
+        PathabilityGrid::PathabilityGrid(std::istream &is)
+        {
+            std::uint32_t magic = 0u, version = 0u;
+            Read(is, magic);
+            Read(is, version);
+            if (!is.good() || magic != GRID_MAGIC || version != GRID_VERSION)
+            {
+                throw std::runtime_error("PathabilityGrid: not a pathability grid, or of another version");
+            }
+            Read(is, width);
+            Read(is, height);
+            if (!is.good() || width < 0 || height < 0)
+            {
+                throw std::runtime_error("PathabilityGrid: bad size");
+            }
+            stride = (width + 63) / 64;
+            ReadBuffer(is, bits, std::size_t(stride) * height);
+        }
+
+
+        void PathabilityGrid::Save(std::ostream &os) const
+        {
+            Write(os, GRID_MAGIC);
+            Write(os, GRID_VERSION);
+            Write(os, width);
+            Write(os, height);
+            WriteBuffer(os, bits, bits.size());
+        }
+
+
+        bool PathabilityGrid::BlockedAt(double x, double z) const
+        {
+            double fx = std::floor(x), fz = std::floor(z);
+            return !(fx >= 0.0 && fz >= 0.0 && fx < width && fz < height) || Blocked(int(fx), int(fz));
+        }
+
+
+        std::size_t PathabilityGrid::BlockedCount() const
+        {
+            std::size_t count = 0u;
+            for (std::uint64_t word : bits)
+            {
+                count += std::bitset<64>(word).count();
+            }
+            return count;
+        }
+
+
+        PathabilityGrid ComputePathability(const Scmp &scmp, const PathabilityRules &rules)
+        {
+            CheckHeights(scmp, "ComputePathability");
+            int W = scmp.width, H = scmp.height;
+            int spreadAtLeast = SlopeThreshold(scmp, rules.maxSlope, true);
+            int sumBelow = DepthThreshold(scmp, rules.maxWaterDepth, true);
+
+            PathabilityGrid grid;
+            grid.width = W;
+            grid.height = H;
+            grid.stride = (W + 63) / 64;
+            grid.bits.assign(std::size_t(grid.stride) * H, 0u);
+
+            const std::int16_t *heights = scmp.heightMapData.Get().data();
+            ParallelForRows(H, [&](int row0, int row1)
+            {
+                std::vector<std::int32_t> spread(W), sum(W);
+                std::vector<std::uint8_t> blocked(std::size_t(grid.stride) * 64u, 0u);
+                for (int z = row0; z < row1; ++z)
+                {
+                    AnalyseRow(heights, W, z, spread.data(), sum.data());
+                    for (int x = 0; x < W; ++x)
+                    {
+                        blocked[x] = std::uint8_t((spread[x] >= spreadAtLeast) | (sum[x] < sumBelow));
+                    }
+                    std::uint64_t *words = grid.bits.data() + std::size_t(grid.stride) * z;
+                    for (int w = 0; w < grid.stride; ++w)
+                    {
+                        const std::uint8_t *flags = blocked.data() + std::size_t(w) * 64u;
+                        std::uint64_t word = 0u;
+                        for (unsigned k = 0u; k < 64u; ++k)
+                        {
+                            word |= std::uint64_t(flags[k]) << k;
+                        }
+                        words[w] = word;
+                    }
+                }
+            });
+            return grid;
+        }
+
+
+        void RewriteTerrainTypes(Scmp &scmp, const std::vector<TerrainTypeRule> &rules)
+        {
+            CheckHeights(scmp, "RewriteTerrainTypes");
+            int W = scmp.width, H = scmp.height;
+            std::vector<int> spreadAtLeast, sumBelow;
+            for (const TerrainTypeRule &rule : rules)
+            {
+                spreadAtLeast.push_back(SlopeThreshold(scmp, rule.minSlope, false));
+                sumBelow.push_back(DepthThreshold(scmp, rule.minWaterDepth, false));
+            }
+
+            EditScope edit(scmp, "RewriteTerrainTypes");
+            if (scmp.terrainTypeData.size() != std::size_t(W) * H)
+            {
+                scmp.terrainTypeData = std::vector<std::uint8_t>(std::size_t(W) * H, 0u);
+            }
+            std::uint8_t *types = scmp.terrainTypeData.Mutable().data();
+            const std::int16_t *heights = scmp.heightMapData.Get().data();
+            ParallelForRows(H, [&](int row0, int row1)
+            {
+                std::vector<std::int32_t> spread(W), sum(W);
+                for (int z = row0; z < row1; ++z)
+                {
+                    AnalyseRow(heights, W, z, spread.data(), sum.data());
+                    std::uint8_t *row = types + std::size_t(W) * z;
+                    // last rule first, so the first that matches is the one left
+                    for (std::size_t r = rules.size(); r-- > 0u; )
+                    {
+                        int ruleSpread = spreadAtLeast[r], ruleSum = sumBelow[r];
+                        std::uint8_t type = rules[r].type;
+                        for (int x = 0; x < W; ++x)
+                        {
+                            row[x] = spread[x] >= ruleSpread && sum[x] < ruleSum ? type : row[x];
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
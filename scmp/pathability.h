@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // A cell is the square between vertices x, x + 1 and z, z + 1 of the heightmap.  Its slope is the difference
+        // between the highest and lowest of its corners and its water depth how far their mean lies below the water
+        // surface, both in world units (heightScale * raw heights).  A map without water has no depth: every cell is
+        // above it, by an unlimited amount
+
+
+        // Classifies a cell as terrain type `type` if its slope is at least minSlope and its water depth at least
+        // minWaterDepth.  The defaults match any slope and any depth, eg TerrainTypeRule(t, 0.0f, 2.0f) matches water
+        // at least 2 deep
+        struct TerrainTypeRule
+        {
+            TerrainTypeRule(std::uint8_t t, float slope = 0.0f, float waterDepth = -std::numeric_limits<float>::infinity()) :
+                type(t), minSlope(slope), minWaterDepth(waterDepth) { }
+
+            std::uint8_t type;
+            float minSlope;
+            float minWaterDepth;
+        };
+
+
+        // What blocks land units: cells steeper than maxSlope or deeper under water than maxWaterDepth.  The defaults
+        // block any slope over 0.75 and anything under water
+        struct PathabilityRules
+        {
+            PathabilityRules() : maxSlope(0.75f), maxWaterDepth(0.0f) { }
+
+            float maxSlope;
+            float maxWaterDepth;
+        };
+
+
+        // One bit per cell, set where the cell is blocked: bit x % 64 of bits[z * stride + x / 64].  Rows start on a
+        // word so they can be scanned a word at a time.  Saved as a small header and the words, for tools that check
+        // markers against a map without loading it
+        struct PathabilityGrid
+        {
+            PathabilityGrid() : width(0), height(0), stride(0) { }
+            PathabilityGrid(std::istream &is);
+            void Save(std::ostream &os) const;
+
+            // cells off the grid are blocked
+            bool Blocked(int x, int z) const
+            {
+                return x < 0 || z < 0 || x >= width || z >= height ||
+                    (bits[std::size_t(z) * stride + unsigned(x) / 64u] >> (unsigned(x) % 64u) & 1u) != 0u;
+            }
+            // the cell holding world position (x, z)
+            bool BlockedAt(double x, double z) const;
+            std::size_t BlockedCount() const;
+
+            int width;
+            int height;
+            int stride;     // words per row
+            std::vector<std::uint64_t> bits;
+        };
+
+
+        // The blocked cells of the map, by rules.  One pass over the heights in row bands on every core
+        PathabilityGrid ComputePathability(const Scmp &scmp, const PathabilityRules &rules = PathabilityRules());
+
+        // Recompute terrainTypeData from the heights, eg after Resize or a filter changed their shape: each cell takes the
+        // type of the first rule it matches, and cells matching none keep theirs.  One edit of the map; terrainTypeData
+        // is created, zeroed, if it is missing
+        void RewriteTerrainTypes(Scmp &scmp, const std::vector<TerrainTypeRule> &rules);
+    }
+}
@@ -0,0 +1,338 @@
+#include "pipeline.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+namespace nfa {
+    namespace scmp {
+
+        typedef std::chrono::steady_clock Clock;
+
+        static double SecondsSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+
+        namespace {
+
+            // Indices handed from one stage to the next.  Push waits for room, Pop for an item; once closed and drained Pop
+            // returns false
+            class IndexQueue
+            {
+            public:
+                explicit IndexQueue(std::size_t capacity) : m_capacity(std::max<std::size_t>(1u, capacity)), m_closed(false) { }
+
+                void Push(std::size_t index)
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_changed.wait(lock, [&]() { return m_queue.size() < m_capacity; });
+                    m_queue.push_back(index);
+                    m_changed.notify_all();
+                }
+
+                bool Pop(std::size_t &index)
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_changed.wait(lock, [&]() { return m_closed || !m_queue.empty(); });
+                    if (m_queue.empty())
+                    {
+                        return false;
+                    }
+                    index = m_queue.front();
+                    m_queue.pop_front();
+                    m_changed.notify_all();
+                    return true;
+                }
+
+                void Close()
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_closed = true;
+                    m_changed.notify_all();
+                }
+
+            private:
+                std::mutex m_mutex;
+                std::condition_variable m_changed;
+                std::deque<std::size_t> m_queue;
+                std::size_t m_capacity;
+                bool m_closed;
+            };
+        }
+
+
+        Pipeline::Pipeline() :
+            m_memoryBudget(0u),
+            m_queueDepth(2u)
+        {
+            m_workers[READ] = 1u;
+            m_workers[COMPUTE] = 0u;
+            m_workers[WRITE] = 1u;
+        }
+
+
+        void Pipeline::SetRead(const std::function<std::size_t(std::size_t)> &read, unsigned workers)
+        {
+            m_read = read;
+            m_workers[READ] = workers;
+        }
+
+
+        void Pipeline::SetCompute(const std::function<void(std::size_t)> &compute, unsigned workers)
+        {
+            m_compute = compute;
+            m_workers[COMPUTE] = workers;
+        }
+
+
+        void Pipeline::SetWrite(const std::function<void(std::size_t)> &write, unsigned workers)
+        {
+            m_write = write;
+            m_workers[WRITE] = workers;
+        }
+
+
+        void Pipeline::SetFinished(const std::function<void(std::size_t, std::exception_ptr)> &finished)
+        {
+            m_finished = finished;
+        }
+
+
+        void Pipeline::SetMemoryBudget(std::uint64_t bytes)
+        {
+            m_memoryBudget = bytes;
+        }
+
+
+        void Pipeline::SetQueueDepth(std::size_t depth)
+        {
+            m_queueDepth = depth;
+        }
+
+
+        Pipeline::Stats Pipeline::Run(std::size_t count, const ProgressCallback &progress)
+        {
+            static const char *stageNames[STAGE_COUNT] = { "read", "compute", "write" };
+
+            Stats stats;
+            Clock::time_point start = Clock::now();
+
+            // bytes held by each item in flight, and the totals the memory budget is checked against
+            std::vector<std::uint64_t> itemBytes(count, 0u);
+            std::mutex memoryMutex;
+            std::condition_variable memoryChanged;
+            std::uint64_t bytesInFlight = 0u;
+            std::size_t itemsInFlight = 0u;
+
+            std::mutex finishedMutex;
+            std::size_t finishedCount = 0u;
+            std::atomic<bool> cancelled(false);
+            std::exception_ptr progressError;
+
+            std::mutex statsMutex;
+            std::atomic<std::size_t> nextRead(0u);
+            IndexQueue toCompute(m_queueDepth), toWrite(m_queueDepth);
+
+            auto finish = [&](std::size_t index, std::exception_ptr error)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(memoryMutex);
+                    bytesInFlight -= itemBytes[index];
+                    --itemsInFlight;
+                    memoryChanged.notify_all();
+                }
+
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                ++finishedCount;
+                try
+                {
+                    if (m_finished)
+                    {
+                        m_finished(index, error);
+                    }
+                    if (progress && !progress("item", float(finishedCount) / float(count)))
+                    {
+                        cancelled = true;
+                    }
+                }
+                catch (...)
+                {
+                    // a failing callback stops the batch like a cancel, but is what Run rethrows
+                    if (!progressError)
+                    {
+                        progressError = std::current_exception();
+                    }
+                    cancelled = true;
+                }
+                if (cancelled)
+                {
+                    memoryChanged.notify_all();
+                }
+            };
+
+            // one stage's worker: take items from input (or admit new ones, for READ), run f, hand them to output (or
+            // finish them, for WRITE)
+            auto runStage = [&](Stage stage, IndexQueue *input, IndexQueue *output)
+            {
+                StageStats local;
+                for (;;)
+                {
+                    Clock::time_point waitStart = Clock::now();
+                    std::size_t index = 0u;
+                    if (input)
+                    {
+                        if (!input->Pop(index))
+                        {
+                            local.starvedSeconds += SecondsSince(waitStart);
+                            break;
+                        }
+                    }
+                    else
+                    {
+                        std::unique_lock<std::mutex> lock(memoryMutex);
+                        memoryChanged.wait(lock, [&]()
+                        {
+                            return cancelled || nextRead >= count || itemsInFlight == 0u || m_memoryBudget == 0u ||
+                                bytesInFlight < m_memoryBudget;
+                        });
+                        index = nextRead++;
+                        if (cancelled || index >= count)
+                        {
+                            local.starvedSeconds += SecondsSince(waitStart);
+                            break;
+                        }
+                        ++itemsInFlight;
+                        stats.peakItems = std::max(stats.peakItems, itemsInFlight);
+                    }
+                    local.starvedSeconds += SecondsSince(waitStart);
+
+                    Clock::time_point busyStart = Clock::now();
+                    std::exception_ptr error;
+                    try
+                    {
+                        if (stage == READ)
+                        {
+                            std::size_t bytes = m_read ? m_read(index) : 0u;
+                            std::lock_guard<std::mutex> lock(memoryMutex);
+                            itemBytes[index] = bytes;
+                            bytesInFlight += bytes;
+                            stats.bytes += bytes;
+                            stats.peakBytes = std::max(stats.peakBytes, bytesInFlight);
+                        }
+                        else if (stage == COMPUTE && m_compute)
+                        {
+                            m_compute(index);
+                        }
+                        else if (stage == WRITE && m_write)
+                        {
+                            m_write(index);
+                        }
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                        ++local.failures;
+                    }
+                    local.busySeconds += SecondsSince(busyStart);
+                    ++local.items;
+
+                    if (error || !output)
+                    {
+                        finish(index, error);
+                    }
+                    else
+                    {
+                        Clock::time_point blockStart = Clock::now();
+                        output->Push(index);
+                        local.blockedSeconds += SecondsSince(blockStart);
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(statsMutex);
+                StageStats &s = stats.stages[stage];
+                s.items += local.items;
+                s.failures += local.failures;
+                s.busySeconds += local.busySeconds;
+                s.starvedSeconds += local.starvedSeconds;
+                s.blockedSeconds += local.blockedSeconds;
+            };
+
+            IndexQueue *inputs[STAGE_COUNT] = { NULL, &toCompute, &toWrite };
+            IndexQueue *outputs[STAGE_COUNT] = { &toCompute, &toWrite, NULL };
+            std::vector<std::thread> stageThreads[STAGE_COUNT];
+            for (int stage = READ; stage < STAGE_COUNT; ++stage)
+            {
+                unsigned workers = m_workers[stage] > 0u ? m_workers[stage] : WorkerCount();
+                workers = unsigned(std::max<std::size_t>(1u, std::min<std::size_t>(workers, count)));
+                stats.stages[stage].name = stageNames[stage];
+                stats.stages[stage].workers = workers;
+                for (unsigned w = 0u; w < workers; ++w)
+                {
+                    stageThreads[stage].push_back(std::thread(runStage, Stage(stage), inputs[stage], outputs[stage]));
+                }
+            }
+
+            // a stage's queue closes once every worker feeding it has finished, which lets the next stage drain and stop
+            for (int stage = READ; stage < STAGE_COUNT; ++stage)
+            {
+                for (auto &t : stageThreads[stage])
+                {
+                    t.join();
+                }
+                if (outputs[stage])
+                {
+                    outputs[stage]->Close();
+                }
+            }
+
+            stats.seconds = SecondsSince(start);
+            if (progressError)
+            {
+                std::rethrow_exception(progressError);
+            }
+            if (cancelled && finishedCount < count)
+            {
+                throw Cancelled("Pipeline cancelled");
+            }
+            return stats;
+        }
+
+
+        void ReportPipelineStats(const Pipeline::Stats &stats, std::ostream &os)
+        {
+            std::ios_base::fmtflags flags = os.flags();
+            std::streamsize precision = os.precision();
+
+            os << std::fixed << std::setprecision(2);
+            os << "pipeline: " << stats.stages[Pipeline::READ].items << " items in " << stats.seconds << "s, "
+                << stats.bytes / 1048576.0 << " MB read, peak " << stats.peakItems << " items / "
+                << stats.peakBytes / 1048576.0 << " MB in flight" << std::endl;
+            os << "  stage    workers  items  failed  items/s   busy%  starved%  blocked%" << std::endl;
+            for (const Pipeline::StageStats &s : stats.stages)
+            {
+                // percentages of the stage's total worker time
+                double total = std::max(1e-9, stats.seconds * s.workers);
+                os << "  " << std::left << std::setw(9) << s.name << std::right
+                    << std::setw(7) << s.workers
+                    << std::setw(7) << s.items
+                    << std::setw(8) << s.failures
+                    << std::setw(9) << s.items / std::max(1e-9, stats.seconds)
+                    << std::setw(8) << 100.0 * s.busySeconds / total
+                    << std::setw(10) << 100.0 * s.starvedSeconds / total
+                    << std::setw(10) << 100.0 * s.blockedSeconds / total << std::endl;
+            }
+
+            os.flags(flags);
+            os.precision(precision);
+        }
+
+    }
+}
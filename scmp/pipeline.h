@@ -0,0 +1,88 @@
+#pragma once
+
+#include "progress.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        // Runs a batch of items through three stages - read, compute, write - each on its own threads, so that while one
+        // map is being resized the next is being read and the previous written.  Stages hand items on through bounded
+        // queues, and reads wait while the items in flight hold more than the memory budget.
+        //
+        // Items are identified by their index in the batch; the stage functions keep whatever they produce per index.
+        // An item whose stage throws skips the remaining stages.
+        class Pipeline
+        {
+        public:
+            enum Stage { READ, COMPUTE, WRITE, STAGE_COUNT };
+
+            struct StageStats
+            {
+                StageStats() : workers(0u), items(0u), failures(0u), busySeconds(0.0), starvedSeconds(0.0), blockedSeconds(0.0) { }
+
+                std::string name;
+                unsigned workers;
+                std::size_t items;          // items that passed through, including failures
+                std::size_t failures;
+                double busySeconds;         // summed over the stage's workers
+                double starvedSeconds;      // waiting for input: an earlier stage, or the memory budget for READ
+                double blockedSeconds;      // waiting for room in the next stage's queue
+            };
+
+            struct Stats
+            {
+                Stats() : seconds(0.0), bytes(0u), peakBytes(0u), peakItems(0u) { }
+
+                double seconds;             // wall clock for the whole batch
+                std::uint64_t bytes;        // total reported by the read stage
+                std::uint64_t peakBytes;    // most held by items in flight at once
+                std::size_t peakItems;
+                StageStats stages[STAGE_COUNT];
+            };
+
+            Pipeline();
+
+            // read(index) returns the bytes the item will hold until it leaves the pipeline; they count against the
+            // memory budget.  workers == 0 means WorkerCount() (the default for COMPUTE; READ and WRITE default to 1)
+            void SetRead(const std::function<std::size_t(std::size_t index)> &read, unsigned workers = 1u);
+            void SetCompute(const std::function<void(std::size_t index)> &compute, unsigned workers = 0u);
+            void SetWrite(const std::function<void(std::size_t index)> &write, unsigned workers = 1u);
+
+            // Called once per item as it leaves the pipeline, with the exception that stopped it, if any.  From the worker
+            // threads, but never concurrently
+            void SetFinished(const std::function<void(std::size_t index, std::exception_ptr error)> &finished);
+
+            // Reads wait while the items in flight hold at least this many bytes.  One item is always admitted however
+            // large.  An item's bytes count from when its read returns, so each READ worker may overshoot the budget by
+            // the item it is reading.  0 (the default) means no limit
+            void SetMemoryBudget(std::uint64_t bytes);
+
+            // Items that may wait between two stages.  Default 2
+            void SetQueueDepth(std::size_t depth);
+
+            // Run items 0..count-1 through every stage.  progress (optional) is called as each item finishes; returning
+            // false stops further reads, lets the items in flight finish, then throws Cancelled
+            Stats Run(std::size_t count, const ProgressCallback &progress = ProgressCallback());
+
+        private:
+            std::function<std::size_t(std::size_t)> m_read;
+            std::function<void(std::size_t)> m_compute;
+            std::function<void(std::size_t)> m_write;
+            std::function<void(std::size_t, std::exception_ptr)> m_finished;
+            unsigned m_workers[STAGE_COUNT];
+            std::uint64_t m_memoryBudget;
+            std::size_t m_queueDepth;
+        };
+
+        // A table of per stage throughput, utilisation and waiting
+        void ReportPipelineStats(const Pipeline::Stats &stats, std::ostream &os);
+    }
+}
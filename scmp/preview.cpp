@@ -0,0 +1,214 @@
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        std::vector<float> DownsampleHeights(const Scmp &scmp, int PW, int PH)
+        {
+            int W0 = scmp.width + 1;
+            int H0 = scmp.height + 1;
+
+            std::vector<int> colBegin(PW + 1), rowBegin(PH + 1);
+            for (int i = 0; i <= PW; ++i)
+            {
+                colBegin[i] = std::min(W0, std::max(i * W0 / PW, i > 0 ? colBegin[i - 1] + 1 : 0));
+            }
+            for (int i = 0; i <= PH; ++i)
+            {
+                rowBegin[i] = std::min(H0, std::max(i * H0 / PH, i > 0 ? rowBegin[i - 1] + 1 : 0));
+            }
+
+            std::vector<float> heights(std::size_t(PW) * PH);
+            ParallelForRows(PH, [&](int row0, int row1)
+            {
+                std::vector<float> sum(PW);
+                for (int row = row0; row < row1; ++row)
+                {
+                    std::fill(sum.begin(), sum.end(), 0.0f);
+                    int r0 = std::min(rowBegin[row], H0 - 1);
+                    int r1 = std::max(rowBegin[row + 1], r0 + 1);
+                    for (int r = r0; r < r1; ++r)
+                    {
+                        const std::int16_t *src = scmp.heightMapData.data() + std::size_t(W0) * r;
+                        for (int col = 0; col < PW; ++col)
+                        {
+                            int c0 = std::min(colBegin[col], W0 - 1);
+                            int c1 = std::max(colBegin[col + 1], c0 + 1);
+                            float s = 0.0f;
+                            for (int c = c0; c < c1; ++c)
+                            {
+                                s += float(src[c]);
+                            }
+                            sum[col] += s / float(c1 - c0);
+                        }
+                    }
+
+                    float scale = scmp.heightScale / float(r1 - r0);
+                    float *out = heights.data() + std::size_t(PW) * row;
+                    for (int col = 0; col < PW; ++col)
+                    {
+                        out[col] = sum[col] * scale;
+                    }
+                }
+            });
+            return heights;
+        }
+
+
+        static void UnpackArgb(std::uint32_t argb, float *rgb)
+        {
+            rgb[0] = float((argb >> 16) & 0xff);
+            rgb[1] = float((argb >> 8) & 0xff);
+            rgb[2] = float(argb & 0xff);
+        }
+
+
+        void Scmp::RenderPreview()
+        {
+            if (previewImageData.empty())
+            {
+                return;
+            }
+
+            EditScope edit(*this, "RenderPreview");
+            DropMipmaps(previewImageData);
+            dds::DdsFile dds(previewImageData.data(), previewImageData.size());
+            int PW = dds.width();
+            int PH = dds.height();
+            bool dxt5 = dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            std::size_t bytesPerPixel = dxt5 ? 4u : dds.bytesPerPixel();
+            if (!dxt5 && dds.glDataFormat() != GL_BGRA && dds.glDataFormat() != GL_BGR)
+            {
+                throw std::runtime_error("previewImageData: unsupported dds format, cannot render preview");
+            }
+
+            std::vector<float> heights = DownsampleHeights(*this, PW, PH);
+            float minHeight = *std::min_element(heights.begin(), heights.end());
+            float maxHeight = *std::max_element(heights.begin(), heights.end());
+
+            bool water = waterShaderProperties && waterShaderProperties->hasWater;
+            float shoreElevation = water ? waterShaderProperties->elevation : minHeight;
+            float deepElevation = water ? std::min(waterShaderProperties->elevationAbyss, shoreElevation - 1.0f) : minHeight - 1.0f;
+            float landRange = std::max(maxHeight - shoreElevation, 1.0f);
+
+            float deepColour[3], shoreColour[3], landStartColour[3], landEndColour[3], contourColour[3];
+            UnpackArgb(minimapDeepWaterColor, deepColour);
+            UnpackArgb(minimapShoreColor, shoreColour);
+            UnpackArgb(minimapLandStartColor, landStartColour);
+            UnpackArgb(minimapLandEndColor, landEndColour);
+            UnpackArgb(minimapContourColor, contourColour);
+
+            // the light vector is sunDirection (see Scmp), normalised; a map without one is lit from straight above
+            float sun[3] = { sunDirection[0], sunDirection[1], sunDirection[2] };
+            float sunLength = std::sqrt(sun[0] * sun[0] + sun[1] * sun[1] + sun[2] * sun[2]);
+            if (sunLength <= 0.0f)
+            {
+                sun[0] = sun[2] = 0.0f;
+                sun[1] = sunLength = 1.0f;
+            }
+            for (float &s : sun)
+            {
+                s /= sunLength;
+            }
+
+            float cellWidth = float(width) / float(PW);
+            float cellHeight = float(height) / float(PH);
+            float contourInterval = float(minimapContourInterval);
+
+            std::vector<std::uint8_t> bgra(std::size_t(PW) * PH * 4u);
+            ParallelForRows(PH, [&](int row0, int row1)
+            {
+                std::vector<float> shade(PW), t(PW), r(PW), g(PW), b(PW);
+                for (int row = row0; row < row1; ++row)
+                {
+                    const float *h = heights.data() + std::size_t(PW) * row;
+                    const float *hUp = heights.data() + std::size_t(PW) * std::max(row - 1, 0);
+                    const float *hDown = heights.data() + std::size_t(PW) * std::min(row + 1, PH - 1);
+
+                    // lambert shading from central differences; borders use one sided differences
+                    for (int col = 0; col < PW; ++col)
+                    {
+                        int left = std::max(col - 1, 0), right = std::min(col + 1, PW - 1);
+                        float dhdx = (h[right] - h[left]) / (float(right - left) * cellWidth);
+                        float dhdz = (hDown[col] - hUp[col]) / (float(std::min(row + 1, PH - 1) - std::max(row - 1, 0)) * cellHeight);
+                        float nDotL = (-dhdx * sun[0] + sun[1] - dhdz * sun[2]) / std::sqrt(dhdx*dhdx + dhdz*dhdz + 1.0f);
+                        shade[col] = 0.5f + 0.5f * std::max(nDotL, 0.0f);
+                    }
+
+                    // colour ramps either side of the shoreline.  water is flat, so it isn't shaded
+                    for (int col = 0; col < PW; ++col)
+                    {
+                        bool underwater = h[col] < shoreElevation;
+                        float tt = underwater ?
+                            (shoreElevation - h[col]) / (shoreElevation - deepElevation) :
+                            (h[col] - shoreElevation) / landRange;
+                        tt = std::min(std::max(tt, 0.0f), 1.0f);
+                        const float *c0 = underwater ? shoreColour : landStartColour;
+                        const float *c1 = underwater ? deepColour : landEndColour;
+                        float s = underwater ? 1.0f : shade[col];
+                        r[col] = s * (c0[0] + tt * (c1[0] - c0[0]));
+                        g[col] = s * (c0[1] + tt * (c1[1] - c0[1]));
+                        b[col] = s * (c0[2] + tt * (c1[2] - c0[2]));
+                    }
+
+                    // contour lines on land, where a band boundary passes between this texel and its right or lower neighbour
+                    if (contourInterval > 0.0f)
+                    {
+                        for (int col = 0; col < PW; ++col)
+                        {
+                            int right = std::min(col + 1, PW - 1);
+                            float band = std::floor(h[col] / contourInterval);
+                            bool contour = h[col] >= shoreElevation &&
+                                (band != std::floor(h[right] / contourInterval) || band != std::floor(hDown[col] / contourInterval));
+                            if (contour)
+                            {
+                                r[col] = contourColour[0];
+                                g[col] = contourColour[1];
+                                b[col] = contourColour[2];
+                            }
+                        }
+                    }
+
+                    std::uint8_t *out = bgra.data() + std::size_t(PW) * row * 4u;
+                    for (int col = 0; col < PW; ++col)
+                    {
+                        out[4 * col + 0] = std::uint8_t(std::min(b[col] + 0.5f, 255.0f));
+                        out[4 * col + 1] = std::uint8_t(std::min(g[col] + 0.5f, 255.0f));
+                        out[4 * col + 2] = std::uint8_t(std::min(r[col] + 0.5f, 255.0f));
+                        out[4 * col + 3] = 255u;
+                    }
+                }
+            });
+
+            std::size_t imageBytes;
+            std::uint8_t *image = (std::uint8_t*)dds.getMutable(imageBytes);
+            std::size_t texels = std::size_t(PW) * PH;
+            if (dxt5)
+            {
+                for (std::size_t i = 0u; i < texels; ++i)
+                {
+                    std::swap(bgra[4 * i + 0], bgra[4 * i + 2]);
+                }
+                dds::encodeDxt5(bgra.data(), PW, PH, image);
+            }
+            else
+            {
+                for (std::size_t i = 0u; i < texels; ++i)
+                {
+                    std::copy(&bgra[4 * i], &bgra[4 * i] + bytesPerPixel, image + bytesPerPixel * i);
+                }
+            }
+        }
+
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+namespace nfa {
+    namespace scmp {
+
+        // Reports progress of a long running operation: the phase that just finished and the overall fraction done (0..1).
+        // Return false to cancel; the operation then throws Cancelled once the work already in flight has finished.
+        typedef std::function<bool(const std::string &phase, float fraction)> ProgressCallback;
+
+        class Cancelled : public std::runtime_error
+        {
+        public:
+            Cancelled(const std::string &what) : std::runtime_error(what) { }
+        };
+    }
+}
@@ -0,0 +1,191 @@
+#include "pyramid.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace nfa {
+    namespace scmp {
+
+        HeightPyramid::HeightPyramid(const Scmp &scmp, int minSize) :
+            m_width(scmp.width),
+            m_height(scmp.height),
+            m_heightScale(scmp.heightScale)
+        {
+            Level level0;
+            level0.width = m_width + 1;
+            level0.height = m_height + 1;
+            level0.data = scmp.heightMapData;
+            m_levels.push_back(level0);
+
+            while (std::max(m_levels.back().width, m_levels.back().height) - 1 > std::max(minSize, 1))
+            {
+                const Level &fine = m_levels.back();
+                const std::int16_t *src = fine.data.Get().data();
+                int W = fine.width, H = fine.height;
+                int W1 = (W - 1) / 2 + 1, H1 = (H - 1) / 2 + 1;
+
+                // rows first, at full height, then columns; each output sample is centred on an input sample
+                std::vector<std::int32_t> rows(std::size_t(W1) * H);
+                ParallelForRows(H, [&](int row0, int row1)
+                {
+                    for (int z = row0; z < row1; ++z)
+                    {
+                        const std::int16_t *in = src + std::size_t(W) * z;
+                        std::int32_t *out = rows.data() + std::size_t(W1) * z;
+                        for (int x = 0; x < W1; ++x)
+                        {
+                            int c = 2 * x;
+                            out[x] = in[std::max(c - 1, 0)] + 2 * in[c] + in[std::min(c + 1, W - 1)];
+                        }
+                    }
+                });
+
+                std::vector<std::int16_t> coarse(std::size_t(W1) * H1);
+                ParallelForRows(H1, [&](int row0, int row1)
+                {
+                    for (int z = row0; z < row1; ++z)
+                    {
+                        int r = 2 * z;
+                        const std::int32_t *above = rows.data() + std::size_t(W1) * std::max(r - 1, 0);
+                        const std::int32_t *centre = rows.data() + std::size_t(W1) * r;
+                        const std::int32_t *below = rows.data() + std::size_t(W1) * std::min(r + 1, H - 1);
+                        std::int16_t *out = coarse.data() + std::size_t(W1) * z;
+                        for (int x = 0; x < W1; ++x)
+                        {
+                            std::int32_t sum = above[x] + 2 * centre[x] + below[x];
+                            out[x] = std::int16_t(sum >= 0 ? (sum + 8) / 16 : -((8 - sum) / 16));
+                        }
+                    }
+                });
+
+                Level level;
+                level.width = W1;
+                level.height = H1;
+                level.data = std::move(coarse);
+                m_levels.push_back(level);
+            }
+        }
+
+
+        int HeightPyramid::LevelFor(float step) const
+        {
+            int level = 0;
+            while (level + 1 < LevelCount() && float(1 << (level + 1)) <= step)
+            {
+                ++level;
+            }
+            return level;
+        }
+
+
+        float HeightPyramid::Sample(int level, float x, float z) const
+        {
+            const Level &l = m_levels[level];
+            float scale = 1.0f / float(1 << level);
+            float u = std::min(std::max(x * scale, 0.0f), float(l.width - 1));
+            float v = std::min(std::max(z * scale, 0.0f), float(l.height - 1));
+            int x0 = std::min(int(u), std::max(l.width - 2, 0));
+            int z0 = std::min(int(v), std::max(l.height - 2, 0));
+            int x1 = std::min(x0 + 1, l.width - 1);
+            int z1 = std::min(z0 + 1, l.height - 1);
+            float fx = u - float(x0), fz = v - float(z0);
+
+            const std::int16_t *data = l.data.Get().data();
+            float h00 = data[std::size_t(l.width) * z0 + x0], h01 = data[std::size_t(l.width) * z0 + x1];
+            float h10 = data[std::size_t(l.width) * z1 + x0], h11 = data[std::size_t(l.width) * z1 + x1];
+            return (h00 + (h01 - h00) * fx) * (1.0f - fz) + (h10 + (h11 - h10) * fx) * fz;
+        }
+
+
+        void RenderPlacement(const HeightPyramid *target, const HeightPyramid *source, const Placement &placement,
+            int PW, int PH, std::uint32_t *argb)
+        {
+            if (PW <= 0 || PH <= 0 || (!target && !source))
+            {
+                return;
+            }
+
+            bool composite = target && source && placement.width > 0 && placement.height > 0;
+            if (!target)
+            {
+                target = source;
+            }
+
+            float W = float(target->Width()), H = float(target->Height());
+            float step = std::max(W / float(PW), H / float(PH));
+            int targetLevel = target->LevelFor(step);
+
+            float sourceScaleX = 1.0f, sourceScaleZ = 1.0f, gain = 1.0f;
+            int sourceLevel = 0;
+            if (composite)
+            {
+                sourceScaleX = float(source->Width()) / float(placement.width);
+                sourceScaleZ = float(source->Height()) / float(placement.height);
+                sourceLevel = source->LevelFor(step * std::max(sourceScaleX, sourceScaleZ));
+                // as Resize scales heights
+                gain = 1.0f / std::sqrt(sourceScaleX * sourceScaleZ);
+            }
+
+            // world heights, and which pixels the source covers
+            std::vector<float> heights(std::size_t(PW) * PH);
+            std::vector<std::uint8_t> fromSource(std::size_t(PW) * PH, 0u);
+            ParallelForRows(PH, [&](int row0, int row1)
+            {
+                for (int pz = row0; pz < row1; ++pz)
+                {
+                    float z = (float(pz) + 0.5f) * H / float(PH);
+                    for (int px = 0; px < PW; ++px)
+                    {
+                        float x = (float(px) + 0.5f) * W / float(PW);
+                        float h = target->Sample(targetLevel, x, z);
+                        float sx = x - float(placement.column0), sz = z - float(placement.row0);
+                        if (composite && sx >= 0.0f && sx < float(placement.width) && sz >= 0.0f && sz < float(placement.height))
+                        {
+                            float s = gain * source->Sample(sourceLevel, sx * sourceScaleX, sz * sourceScaleZ);
+                            h = placement.additive ? h + s : s;
+                            fromSource[std::size_t(PW) * pz + px] = 1u;
+                        }
+                        heights[std::size_t(PW) * pz + px] = h * target->HeightScale();
+                    }
+                }
+            }, 4);
+
+            auto minmax = std::minmax_element(heights.begin(), heights.end());
+            float minHeight = *minmax.first;
+            float range = std::max(*minmax.second - minHeight, 1e-3f);
+
+            // height as brightness, with a little hill shading lit from the north west
+            float lx = -0.5f, ly = 0.7071f, lz = -0.5f;
+            ParallelForRows(PH, [&](int row0, int row1)
+            {
+                for (int pz = row0; pz < row1; ++pz)
+                {
+                    const float *row = heights.data() + std::size_t(PW) * pz;
+                    const float *up = heights.data() + std::size_t(PW) * std::max(pz - 1, 0);
+                    const float *down = heights.data() + std::size_t(PW) * std::min(pz + 1, PH - 1);
+                    for (int px = 0; px < PW; ++px)
+                    {
+                        float dhdx = (row[std::min(px + 1, PW - 1)] - row[std::max(px - 1, 0)]) / (2.0f * step);
+                        float dhdz = (down[px] - up[px]) / (2.0f * step);
+                        float lambert = std::max(0.0f, (-dhdx * lx + ly - dhdz * lz) / std::sqrt(dhdx*dhdx + dhdz*dhdz + 1.0f));
+                        float v = 0.15f + 0.85f * (0.65f * (row[px] - minHeight) / range + 0.35f * lambert);
+                        v = std::min(std::max(v, 0.0f), 1.0f);
+
+                        float r = v, g = v, b = v;
+                        if (fromSource[std::size_t(PW) * pz + px])
+                        {
+                            g *= 0.85f;
+                            b *= 0.55f;
+                        }
+                        argb[std::size_t(PW) * pz + px] = 0xff000000u |
+                            (std::uint32_t(255.0f * r + 0.5f) << 16) | (std::uint32_t(255.0f * g + 0.5f) << 8) | std::uint32_t(255.0f * b + 0.5f);
+                    }
+                }
+            }, 4);
+        }
+
+    }
+}
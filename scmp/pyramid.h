@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cow.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // A map's heightmap at successively halved resolutions, so a thumbnail of any part of it reads a level with
+        // about one sample per pixel instead of the full heightmap.  Level 0 shares the map's own buffer; each coarser
+        // level is a [1 2 1] tent filtered copy of the one before, keeping every other sample, down to minSize cells.
+        // Values are raw heightmap units.  Read only once built, so it may be sampled from several threads
+        class HeightPyramid
+        {
+        public:
+            explicit HeightPyramid(const Scmp &scmp, int minSize = 16);
+
+            int Width() const { return m_width; }           // in map cells, as Scmp::width
+            int Height() const { return m_height; }
+            float HeightScale() const { return m_heightScale; }
+            int LevelCount() const { return int(m_levels.size()); }
+
+            // the coarsest level whose samples are no further apart than step map cells
+            int LevelFor(float step) const;
+
+            // bilinear height at map position (x, z), clamped to the map, from the given level
+            float Sample(int level, float x, float z) const;
+
+        private:
+            struct Level
+            {
+                int width;          // samples per row, ie (cells >> level) + 1
+                int height;
+                CowVector<std::int16_t> data;
+            };
+
+            int m_width;
+            int m_height;
+            float m_heightScale;
+            std::vector<Level> m_levels;
+        };
+
+
+        // Where Scmp::Import would put the source map, resized to width x height, in the target
+        struct Placement
+        {
+            Placement() : column0(0), row0(0), width(0), height(0), additive(false) { }
+
+            int column0;
+            int row0;
+            int width;
+            int height;
+            bool additive;
+        };
+
+
+        // Draws the target's heights, shaded, over the whole PW x PH image as 0xAARRGGBB pixels, with the source map
+        // composited where the placement puts it and tinted so it stands out.  The source is resized and, when additive,
+        // added as Resize and Import would.  target may be null to draw the source alone over the whole image
+        void RenderPlacement(const HeightPyramid *target, const HeightPyramid *source, const Placement &placement,
+            int PW, int PH, std::uint32_t *argb);
+    }
+}
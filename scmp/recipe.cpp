@@ -0,0 +1,634 @@
+#include "recipe.h"
+#include "image.h"
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+#include "taskgraph.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+namespace nfa {
+    namespace scmp {
+
+        namespace {
+
+            // a Gain (source == 0) or an Import of a sourceW x sourceH image at column0,row0
+            template<typename DataT>
+            struct RasterOp
+            {
+                float gain;
+                const DataT *source;
+                int sourceW;
+                int sourceH;
+                int column0;
+                int row0;
+                bool additive;
+            };
+
+
+            // One layer of a pass: an optional resample of the input, then each op in turn, pixel by pixel.  Sample gives a
+            // pixel as it is after the first opCount ops without computing any other; Run computes them all, a row at a time
+            template<typename DataT>
+            class RasterPass
+            {
+            public:
+                RasterPass(const DataT *input, int inputW, int inputH, int W, int H, bool resample, bool lerp) :
+                    m_input(input), m_inputW(inputW), m_inputH(inputH), m_W(W), m_H(H), m_resample(resample), m_lerp(lerp),
+                    m_wscale(float(W) / float(inputW)), m_hscale(float(H) / float(inputH))
+                {
+                    if (resample && lerp)
+                    {
+                        m_columnTaps = BuildTaps(W, m_wscale);
+                        m_rowTaps = BuildTaps(H, m_hscale);
+                    }
+                }
+
+                void Gain(float gain)
+                {
+                    RasterOp<DataT> op = { gain, 0, 0, 0, 0, 0, false };
+                    m_ops.push_back(op);
+                }
+
+                void Import(const DataT *source, int sourceW, int sourceH, int column0, int row0, bool additive)
+                {
+                    RasterOp<DataT> op = { 1.0f, source, sourceW, sourceH, column0, row0, additive };
+                    m_ops.push_back(op);
+                }
+
+                std::size_t OpCount() const { return m_ops.size(); }
+
+                DataT Sample(int x, int z, std::size_t opCount) const
+                {
+                    DataT value = m_resample ? Resample(x, z) : m_input[std::size_t(m_inputW) * z + x];
+                    ApplyOps(z, x, x + 1, &value, opCount);
+                    return value;
+                }
+
+                // output may be the input if there is no resample
+                void Run(DataT *output) const
+                {
+                    ParallelForRows(m_H, [&](int row0, int row1)
+                    {
+                        for (int z = row0; z < row1; ++z)
+                        {
+                            DataT *row = output + std::size_t(m_W) * z;
+                            if (m_resample)
+                            {
+                                for (int x = 0; x < m_W; ++x)
+                                {
+                                    row[x] = Resample(x, z);
+                                }
+                            }
+                            else if (m_input != output)
+                            {
+                                std::copy(m_input + std::size_t(m_W) * z, m_input + std::size_t(m_W) * (z + 1), row);
+                            }
+                            ApplyOps(z, 0, m_W, row, m_ops.size());
+                        }
+                    });
+                }
+
+            private:
+                // the four source columns (or rows) from first that ResizeSample weighs for each output one, and their
+                // squared distances
+                struct Taps
+                {
+                    int first;
+                    double distance2[4];
+                };
+
+                static std::vector<Taps> BuildTaps(int n, float scale)
+                {
+                    std::vector<Taps> taps(n);
+                    for (int i = 0; i < n; ++i)
+                    {
+                        float source(float(i) / scale);
+                        taps[i].first = int(source) - 1;
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            double d = source - double(taps[i].first + k);
+                            taps[i].distance2[k] = d*d;
+                        }
+                    }
+                    return taps;
+                }
+
+                // ResizeSample, with the distances looked up rather than computed per pixel
+                DataT Resample(int x, int z) const
+                {
+                    if (!m_lerp)
+                    {
+                        return ResizeSample(m_input, m_inputW, m_inputH, m_wscale, m_hscale, x, z, false);
+                    }
+
+                    const Taps &columns = m_columnTaps[x];
+                    const Taps &rows = m_rowTaps[z];
+                    double sum = 0.0, sumWeights = 0.0;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        int c = columns.first + i;
+                        if (c < 0 || c >= m_inputW)
+                        {
+                            continue;
+                        }
+                        for (int j = 0; j < 4; ++j)
+                        {
+                            int r = rows.first + j;
+                            if (r >= 0 && r < m_inputH)
+                            {
+                                double d = std::max(0.1, columns.distance2[i] + rows.distance2[j]);
+                                sum += double(m_input[std::size_t(m_inputW) * r + c]) / d;
+                                sumWeights += 1.0 / d;
+                            }
+                        }
+                    }
+                    return sumWeights > 0.0 ? DataT(sum / sumWeights) : DataT(0.0);
+                }
+
+                // row holds columns [x0,x1) of row z
+                void ApplyOps(int z, int x0, int x1, DataT *row, std::size_t opCount) const
+                {
+                    for (std::size_t i = 0u; i < opCount; ++i)
+                    {
+                        const RasterOp<DataT> &op = m_ops[i];
+                        if (!op.source)
+                        {
+                            for (int x = 0; x < x1 - x0; ++x)
+                            {
+                                row[x] *= op.gain;
+                            }
+                            continue;
+                        }
+
+                        int sourceRow = z - op.row0;
+                        int c0 = std::max(x0, op.column0);
+                        int c1 = std::min(x1, op.column0 + op.sourceW);
+                        if (sourceRow < 0 || sourceRow >= op.sourceH || c0 >= c1)
+                        {
+                            continue;
+                        }
+                        const DataT *src = op.source + std::size_t(op.sourceW) * sourceRow - op.column0;
+                        DataT *dst = row - x0;
+                        if (op.additive)
+                        {
+                            for (int c = c0; c < c1; ++c)
+                            {
+                                dst[c] += src[c];
+                            }
+                        }
+                        else
+                        {
+                            std::copy(src + c0, src + c1, dst + c0);
+                        }
+                    }
+                }
+
+                const DataT *m_input;
+                int m_inputW;
+                int m_inputH;
+                int m_W;
+                int m_H;
+                bool m_resample;
+                bool m_lerp;
+                float m_wscale;
+                float m_hscale;
+                std::vector<Taps> m_columnTaps;
+                std::vector<Taps> m_rowTaps;
+                std::vector< RasterOp<DataT> > m_ops;
+            };
+        }
+
+
+        Recipe &Recipe::Resize(int width, int height)
+        {
+            Step step(Step::RESIZE);
+            step.width = width;
+            step.height = height;
+            m_steps.push_back(step);
+            return *this;
+        }
+
+
+        Recipe &Recipe::Gain(float gain)
+        {
+            Step step(Step::GAIN);
+            step.gain = gain;
+            m_steps.push_back(step);
+            return *this;
+        }
+
+
+        Recipe &Recipe::Import(std::shared_ptr<const Scmp> source, int column0, int row0, bool additiveTerrain)
+        {
+            Step step(Step::IMPORT);
+            step.source = source;
+            step.column0 = column0;
+            step.row0 = row0;
+            step.additive = additiveTerrain;
+            m_steps.push_back(step);
+            return *this;
+        }
+
+
+        Recipe &Recipe::SnapItems()
+        {
+            m_steps.push_back(Step(Step::SNAP_ITEMS));
+            return *this;
+        }
+
+
+        Recipe &Recipe::RegenerateNormalMap()
+        {
+            m_steps.push_back(Step(Step::REGENERATE_NORMAL_MAP));
+            return *this;
+        }
+
+
+        Recipe &Recipe::RenderPreview()
+        {
+            m_steps.push_back(Step(Step::RENDER_PREVIEW));
+            return *this;
+        }
+
+
+        void Recipe::Apply(Scmp &scmp, const ProgressCallback &progress) const
+        {
+            EditScope edit(scmp, "Recipe");
+
+            std::size_t count = m_steps.size();
+            std::size_t lastNormals = count, lastPreview = count;
+            for (std::size_t i = 0u; i < count; ++i)
+            {
+                if (m_steps[i].kind == Step::REGENERATE_NORMAL_MAP)
+                {
+                    lastNormals = i;
+                }
+                else if (m_steps[i].kind == Step::RENDER_PREVIEW)
+                {
+                    lastPreview = i;
+                }
+            }
+
+            // split into passes.  the RegenerateNormalMap and RenderPreview that aren't overwritten are passes of their
+            // own; the others are left in the passes around them, where they do nothing
+            std::vector< std::pair<std::size_t, std::size_t> > passes;
+            for (std::size_t begin = 0u; begin < count; )
+            {
+                std::size_t end = begin + 1u;
+                if (begin != lastNormals && begin != lastPreview)
+                {
+                    while (end < count && m_steps[end].kind != Step::RESIZE && end != lastNormals && end != lastPreview)
+                    {
+                        ++end;
+                    }
+                }
+                passes.push_back(std::make_pair(begin, end));
+                begin = end;
+            }
+
+            for (std::size_t p = 0u; p < passes.size(); ++p)
+            {
+                ProgressCallback passProgress;
+                if (progress)
+                {
+                    passProgress = [&, p](const std::string &phase, float fraction)
+                    {
+                        return progress(phase, (float(p) + fraction) / float(passes.size()));
+                    };
+                }
+
+                std::size_t begin = passes[p].first;
+                if (begin == lastNormals || begin == lastPreview)
+                {
+                    const char *phase = begin == lastNormals ? "normalMapData" : "previewImageData";
+                    if (begin == lastNormals)
+                    {
+                        scmp.RegenerateNormalMap();
+                    }
+                    else
+                    {
+                        scmp.RenderPreview();
+                    }
+                    if (passProgress && !passProgress(phase, 1.0f))
+                    {
+                        throw Cancelled("Recipe cancelled");
+                    }
+                    continue;
+                }
+                ApplyPass(scmp, begin, passes[p].second, lastNormals != count && lastNormals > begin, passProgress);
+            }
+        }
+
+
+        void Recipe::ApplyPass(Scmp &scmp, std::size_t begin, std::size_t end, bool normalsOverwritten,
+            const ProgressCallback &progress) const
+        {
+            int W0 = scmp.width, H0 = scmp.height;
+            bool resize = m_steps[begin].kind == Step::RESIZE;
+            int W = resize ? m_steps[begin].width : W0;
+            int H = resize ? m_steps[begin].height : H0;
+            float scalex = float(W) / float(W0);
+            float scalez = float(H) / float(H0);
+            float scaley = std::sqrt(scalex*scalez);
+
+            std::vector<std::size_t> imports;
+            bool heightOps = resize;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                if (m_steps[i].kind == Step::IMPORT)
+                {
+                    imports.push_back(i);
+                }
+                heightOps = heightOps || m_steps[i].kind == Step::IMPORT || m_steps[i].kind == Step::GAIN;
+            }
+
+            // heights are written in place unless resized, so the items (which read them) go first
+            std::vector<std::int16_t> newHeights;
+            std::int16_t *heightOutput = 0;
+            if (resize)
+            {
+                newHeights.resize(std::size_t(W + 1) * (H + 1));
+                heightOutput = newHeights.data();
+            }
+            else if (heightOps)
+            {
+                heightOutput = scmp.heightMapData.data();
+            }
+            const std::int16_t *heightInput = heightOutput && !resize ? heightOutput : scmp.heightMapData.Get().data();
+            RasterPass<std::int16_t> heights(heightInput, W0 + 1, H0 + 1, W + 1, H + 1, resize, true);
+
+            // terrain types are fused when they are a byte per cell; otherwise resized like the masks and not imported
+            bool terrainFused = scmp.terrainTypeData.size() == std::size_t(W0) * H0 && W0 > 0 && H0 > 0;
+            std::vector<std::uint8_t> newTerrain;
+            std::uint8_t *terrainOutput = 0;
+            if (terrainFused && resize)
+            {
+                newTerrain.resize(std::size_t(W) * H);
+                terrainOutput = newTerrain.data();
+            }
+            else if (terrainFused && !imports.empty())
+            {
+                terrainOutput = scmp.terrainTypeData.data();
+            }
+            const std::uint8_t *terrainInput = terrainOutput && !resize ? terrainOutput : scmp.terrainTypeData.Get().data();
+            RasterPass<std::uint8_t> terrain(terrainInput, W0, H0, W, H, resize, false);
+
+            // the ops, and how many of them each step sees
+            std::vector<std::size_t> opCounts(end - begin);
+            if (resize)
+            {
+                heights.Gain(scaley);
+            }
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const Step &step = m_steps[i];
+                if (step.kind == Step::GAIN)
+                {
+                    heights.Gain(step.gain);
+                }
+                else if (step.kind == Step::IMPORT)
+                {
+                    const Scmp &other = *step.source;
+                    heights.Import(other.heightMapData.Get().data(), other.width + 1, other.height + 1, step.column0, step.row0, step.additive);
+                    if (terrainFused && other.terrainTypeData.size() == std::size_t(other.width) * other.height)
+                    {
+                        terrain.Import(other.terrainTypeData.Get().data(), other.width, other.height, step.column0, step.row0, false);
+                    }
+                }
+                opCounts[i - begin] = heights.OpCount();
+            }
+
+            TaskGraph tasks;
+
+            TaskGraph::TaskId itemsTask = tasks.Add("items", [&]()
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    const Step &step = m_steps[i];
+                    std::size_t opCount = opCounts[i - begin];
+                    auto heightAt = [&](float x, float z) -> float
+                    {
+                        int ix = int(x), iz = int(z);
+                        return ix >= 0 && ix <= W && iz >= 0 && iz <= H ? scmp.heightScale * heights.Sample(ix, iz, opCount) : 0.0f;
+                    };
+
+                    switch (step.kind)
+                    {
+                    case Step::RESIZE:
+                        scmp.waterShaderProperties->ScaleSize(scaley);
+                        for (auto wg : scmp.waveGenerators)
+                        {
+                            wg->ScaleSize(scalex, scaley, scalez);
+                        }
+                        for (auto s : scmp.strata)
+                        {
+                            s->ScaleSize(std::sqrt(scalex*scalez));
+                        }
+                        for (auto d : scmp.decals)
+                        {
+                            d->ScaleSize(scalex, scaley, scalez);
+                        }
+                        for (auto p : scmp.props)
+                        {
+                            p->ScaleSize(scalex, scaley, scalez);
+                        }
+                        scmp.InvalidateItemIndices();
+                        break;
+
+                    case Step::GAIN:
+                        scmp.waterShaderProperties->ScaleSize(step.gain);
+                        for (auto wg : scmp.waveGenerators)
+                        {
+                            wg->ScaleSize(1.0f, step.gain, 1.0f);
+                        }
+                        for (auto d : scmp.decals)
+                        {
+                            d->ScaleSize(1.0f, step.gain, 1.0f);
+                        }
+                        for (auto p : scmp.props)
+                        {
+                            p->ScaleSize(1.0f, step.gain, 1.0f);
+                        }
+                        scmp.InvalidateItemIndices();
+                        break;
+
+                    case Step::IMPORT:
+                    {
+                        const Scmp &other = *step.source;
+                        int columnEnd = step.column0 + other.width;
+                        int rowEnd = step.row0 + other.height;
+                        {
+                            // taken before Mutable() moves the generation on: a copy it makes holds the same items in order
+                            std::shared_ptr<const SpatialGrid> grid = scmp.ItemGrid(Scmp::LAYER_WAVE_GENERATORS);
+                            const auto &items = scmp.waveGenerators.Mutable();
+                            scmp.waveGenerators = ImportItemsInRectangle(
+                                items, *grid,
+                                other.waveGenerators.Get(), *other.ItemGrid(Scmp::LAYER_WAVE_GENERATORS),
+                                step.column0, step.row0, columnEnd, rowEnd, heightAt);
+                        }
+                        {
+                            std::shared_ptr<const SpatialGrid> grid = scmp.ItemGrid(Scmp::LAYER_DECALS);
+                            const auto &items = scmp.decals.Mutable();
+                            scmp.decals = ImportItemsInRectangle(
+                                items, *grid,
+                                other.decals.Get(), *other.ItemGrid(Scmp::LAYER_DECALS),
+                                step.column0, step.row0, columnEnd, rowEnd, heightAt);
+                        }
+                        {
+                            std::shared_ptr<const SpatialGrid> grid = scmp.ItemGrid(Scmp::LAYER_PROPS);
+                            const auto &items = scmp.props.Mutable();
+                            scmp.props = ImportItemsInRectangle(
+                                items, *grid,
+                                other.props.Get(), *other.ItemGrid(Scmp::LAYER_PROPS),
+                                step.column0, step.row0, columnEnd, rowEnd, heightAt);
+                        }
+                        scmp.InvalidateItemIndices();
+                        break;
+                    }
+
+                    case Step::SNAP_ITEMS:
+                        for (auto wg : scmp.waveGenerators)
+                        {
+                            wg->position[1] = heightAt(wg->position[0], wg->position[2]);
+                        }
+                        for (auto d : scmp.decals)
+                        {
+                            d->position[1] = heightAt(d->position[0], d->position[2]);
+                        }
+                        for (auto p : scmp.props)
+                        {
+                            p->position[1] = heightAt(p->position[0], p->position[2]);
+                        }
+                        break;
+
+                    default:
+                        break;
+                    }
+                }
+            });
+
+            if (heightOutput)
+            {
+                tasks.Add("heightMapData", [&]()
+                {
+                    heights.Run(heightOutput);
+                }, { itemsTask });
+            }
+
+            if (terrainOutput)
+            {
+                tasks.Add("terrainTypeData", [&]()
+                {
+                    terrain.Run(terrainOutput);
+                });
+            }
+
+            if (resize)
+            {
+                tasks.Add("masks", [&]()
+                {
+                    for (CowVector<std::uint8_t> *dataPtr : { &scmp.waterFoamMask, &scmp.waterFlatnessMask, &scmp.waterDepthBiasMask, &scmp.terrainTypeData })
+                    {
+                        if ((dataPtr == &scmp.terrainTypeData && terrainFused) || dataPtr->empty())
+                        {
+                            continue;
+                        }
+                        int sizeDivisor = W0*H0 / dataPtr->size();
+                        std::vector<std::uint8_t> newData(W*H / sizeDivisor);
+                        int widthDivisor = int(0.5 + std::sqrt(double(sizeDivisor)));
+                        ResizeImage<std::uint8_t>(
+                            dataPtr->Get().data(), newData.data(),
+                            W0 / widthDivisor, H0 / widthDivisor, W / widthDivisor, H / widthDivisor, false);
+                        *dataPtr = std::move(newData);
+                    }
+                });
+            }
+
+            // normal maps that a later RegenerateNormalMap overwrites only take their new size
+            for (std::size_t n = 0u; n < scmp.normalMapData.size() && (resize || (!imports.empty() && !normalsOverwritten)); ++n)
+            {
+                tasks.Add("normalMapData", [&, n]()
+                {
+                    CowVector<std::uint8_t> &nm = scmp.normalMapData[n];
+                    if (resize)
+                    {
+                        dds::DdsFile dds(nm.Get().data(), nm.size());
+                        int newW = std::max(4, 4 * int(0.5f + dds.width() * scalex / 4.0f));
+                        int newH = std::max(4, 4 * int(0.5f + dds.height() * scalez / 4.0f));
+                        if (normalsOverwritten && dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                        {
+                            nm = dds.createBlank(newW, newH);
+                        }
+                        else
+                        {
+                            ResizeNormalDds(nm.Mutable(), newW, newH, scaley / scalex, scaley / scalez);
+                        }
+                    }
+                    for (std::size_t i : imports)
+                    {
+                        const Scmp &other = *m_steps[i].source;
+                        if (normalsOverwritten || n >= other.normalMapData.size())
+                        {
+                            continue;
+                        }
+                        ImportNormalDds(
+                            other.normalMapData[n].data(), other.normalMapData[n].size(),
+                            nm.data(), nm.size(),
+                            other.width, other.height, W, H,
+                            m_steps[i].column0, m_steps[i].row0, "normalMapData");
+                    }
+                });
+            }
+
+            for (auto layers : {
+                std::make_pair(&scmp.strataLerpData, "strataLerpData"),
+                std::make_pair(&scmp.waterLerpData, "waterLerpData") })
+            {
+                for (std::size_t n = 0u; n < layers.first->size() && !imports.empty(); ++n)
+                {
+                    tasks.Add(layers.second, [&, layers, n]()
+                    {
+                        CowVector<std::uint8_t> &data = (*layers.first)[n];
+                        for (std::size_t i : imports)
+                        {
+                            const Scmp &other = *m_steps[i].source;
+                            const std::vector< CowVector<std::uint8_t> > &otherLayers =
+                                layers.first == &scmp.strataLerpData ? other.strataLerpData : other.waterLerpData;
+                            if (n >= otherLayers.size())
+                            {
+                                continue;
+                            }
+                            ImportDds(
+                                otherLayers[n].data(), otherLayers[n].size(),
+                                data.data(), data.size(),
+                                other.width, other.height, W, H,
+                                m_steps[i].column0, m_steps[i].row0, layers.second, false);
+                        }
+                    });
+                }
+            }
+
+            tasks.Run(progress);
+
+            if (resize)
+            {
+                scmp.heightMapData = std::move(newHeights);
+                if (terrainFused)
+                {
+                    scmp.terrainTypeData = std::move(newTerrain);
+                }
+                scmp.widthOther = scmp.widthOther * W / W0;
+                scmp.heightOther = scmp.heightOther * H / H0;
+                scmp.width = W;
+                scmp.height = H;
+            }
+        }
+
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "progress.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // A chain of edits recorded now and applied later in as few passes over the map as possible.  The steps give the
+        // map they would give applied one by one, but each run of per pixel steps - a Resize, then any Gains and Imports
+        // - is evaluated as one pass of row bands, with the heights and terrain types of every step computed from the
+        // previous ones in registers rather than in buffers of their own.  A pass ends at the next Resize, or where a
+        // RegenerateNormalMap or RenderPreview needs the heights as they are at that point.
+        //
+        // Work whose result is overwritten is skipped: normal maps are only resized and imported after the last
+        // RegenerateNormalMap (before it they only change size), and only the last RenderPreview is drawn.  Items are
+        // edited step by step, with heights sampled from the pass as it would be at their step
+        class Recipe
+        {
+        public:
+            // as Scmp::Resize
+            Recipe &Resize(int width, int height);
+            // multiply the heights, the heights of items and the water elevations by gain
+            Recipe &Gain(float gain);
+            // as Scmp::Import.  source is kept until the recipe is cleared or destroyed
+            Recipe &Import(std::shared_ptr<const Scmp> source, int column0, int row0, bool additiveTerrain);
+            // move wave generators, decals and props to the height of the terrain under them
+            Recipe &SnapItems();
+            Recipe &RegenerateNormalMap();
+            Recipe &RenderPreview();
+
+            bool Empty() const { return m_steps.empty(); }
+            void Clear() { m_steps.clear(); }
+
+            // Apply every step to scmp, as one edit.  progress (optional) is called after each layer of each pass;
+            // cancelling throws Cancelled and leaves the map part edited
+            void Apply(Scmp &scmp, const ProgressCallback &progress = ProgressCallback()) const;
+
+        private:
+            struct Step
+            {
+                enum Kind { RESIZE, GAIN, IMPORT, SNAP_ITEMS, REGENERATE_NORMAL_MAP, RENDER_PREVIEW };
+
+                Step(Kind k) : kind(k), width(0), height(0), gain(1.0f), column0(0), row0(0), additive(false) { }
+
+                Kind kind;
+                int width;
+                int height;
+                float gain;
+                std::shared_ptr<const Scmp> source;
+                int column0;
+                int row0;
+                bool additive;
+            };
+
+            void ApplyPass(Scmp &scmp, std::size_t begin, std::size_t end, bool normalsOverwritten,
+                const ProgressCallback &progress) const;
+
+            std::vector<Step> m_steps;
+        };
+    }
+}
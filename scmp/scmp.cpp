@@ -1,7 +1,11 @@
+#include "image.h"
 #include "io.h"
+#include "layers.h"
 #include "scmp.h"
+#include "taskgraph.h"
 
 #include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
 
 #include <algorithm>
 #include <iostream>
@@ -10,195 +14,6 @@
 #include <memory>
 
 
-template<typename DataT>
-static void ResizeImage(const DataT *im, DataT *om, int W0, int H0, int W, int H, bool lerp)
-{
-    float wscale = float(W) / float(W0);
-    float hscale = float(H) / float(H0);
-
-    for (int col = 0; col < W; ++col)
-    {
-        for (int row = 0; row < H; ++row)
-        {
-            if (lerp)
-            {
-                float sourceCol(float(col) / wscale);
-                float sourceRow(float(row) / hscale);
-                double sum = 0.0, sumWeights = 0.0;
-                for (int c = int(sourceCol) -1; c<int(sourceCol) + 3; ++c)
-                {
-                    for (int r = int(sourceRow) -1; r<int(sourceRow) + 3; ++r)
-                    {
-                        if (c >= 0 && c < W0 && r >= 0 && r < H0)
-                        {
-                            double d = std::pow(sourceCol - double(c), 2.0) + std::pow(sourceRow - double(r), 2.0);
-                            d = std::max(0.1, d);
-                            sum += double(im[W0*r + c]) / d;
-                            sumWeights += 1.0 / d;
-                        }
-                        om[W*row + col] = sumWeights > 0.0 ? DataT(sum / sumWeights) : DataT(0.0);
-                    }
-                }
-            }
-            else
-            {
-                int sourceCol(float(col) / wscale);
-                int sourceRow(float(row) / hscale);
-                om[W*row + col] = im[W0*sourceRow + sourceCol];
-            }
-        }
-    }
-}
-
-
-template<typename DataT>
-static void ImportImage(
-    const DataT *im1, int W1, int H1,
-    DataT *im2, int W2, int H2,
-    int W0, int H0, bool additive)
-{
-    for (int col = 0u; col < W1; ++col)
-    {
-        for (int row = 0u; row < H1; ++row)
-        {
-            int destCol = col + W0;
-            int destRow = row + H0;
-            if (destCol < 0 || destCol >= W2 || destRow < 0 || destRow >= H2)
-            {
-                continue;
-            }
-            if (additive)
-            {
-                im2[W2*destRow + destCol] += im1[W1*row + col];
-            }
-            else
-            {
-                im2[W2*destRow + destCol] = im1[W1*row + col];
-            }
-        }
-    }
-}
-
-
-static void ImportDds(
-    const std::uint8_t *_srcDdsData, std::size_t srcBytes,
-    std::uint8_t *_dstDdsData, std::size_t dstBytes,
-    int srcW, int srcH, int destW, int destH,
-    int column0, int row0, std::string debugName, bool lerp)
-{
-    dds::DdsFile srcDds(_srcDdsData, srcBytes);
-    dds::DdsFile dstDds(_dstDdsData, dstBytes);
-
-    if (srcDds.bytesPerPixel() != dstDds.bytesPerPixel() || srcDds.glDataFormat() != dstDds.glDataFormat() || srcDds.glDataType() != dstDds.glDataType())
-    {
-        throw std::runtime_error(debugName + ": dds data aren't in the same pixel format. cannot import");
-    }
-
-    // adjust column0,row0 to texture coordinates
-    column0 = 0.5 + float(column0) / float(destW) * dstDds.width();
-    row0 = 0.5 + float(row0) / float(destH) * dstDds.height();
-
-    // scale source texture to fit into dst texture coordinates assuming src texture maps to srcW/H world coordinates and dst texture maps to destW/H world coordinates
-    int srcWScaled = 0.5 + float(srcW) / float(destW) * float(dstDds.width());
-    int srcHScaled = 0.5 + float(srcH) / float(destH) * float(dstDds.height());
-    // actually just set up the buffer here, we'll do the resize in the coming switch statement
-    std::vector<std::uint8_t> srcScaled(srcWScaled*srcHScaled*srcDds.bytesPerPixel());
-
-    std::size_t imageBytes;
-    switch (srcDds.bytesPerPixel())
-    {
-    case 1:
-        ResizeImage<std::uint8_t>((const std::uint8_t*)srcDds.get(imageBytes), (std::uint8_t*)srcScaled.data(),
-            srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
-        ImportImage<std::uint8_t>(
-            (std::uint8_t*)srcScaled.data(), srcWScaled, srcHScaled,
-            (std::uint8_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
-            column0, row0, false);
-        break;
-
-    case 2:
-        ResizeImage<std::uint16_t>((const std::uint16_t*)srcDds.get(imageBytes), (std::uint16_t*)srcScaled.data(),
-            srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
-        ImportImage<std::uint16_t>(
-            (std::uint16_t*)srcScaled.data(), srcWScaled, srcHScaled,
-            (std::uint16_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
-            column0, row0, false);
-        break;
-
-    case 4:
-        ResizeImage<std::uint32_t>((const std::uint32_t*)srcDds.get(imageBytes), (std::uint32_t*)srcScaled.data(),
-            srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
-        ImportImage<std::uint32_t>(
-            (std::uint32_t*)srcScaled.data(), srcWScaled, srcHScaled,
-            (std::uint32_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
-            column0, row0, false);
-        break;
-
-    case 8:
-        ResizeImage<std::uint64_t>((const std::uint64_t*)srcDds.get(imageBytes), (std::uint64_t*)srcScaled.data(),
-            srcDds.width(), srcDds.height(), srcWScaled, srcHScaled, lerp);
-        ImportImage<std::uint64_t>(
-            (std::uint64_t*)srcScaled.data(), srcWScaled, srcHScaled,
-            (std::uint64_t*)dstDds.getMutable(imageBytes), dstDds.width(), dstDds.height(),
-            column0, row0, false);
-        break;
-
-    default:
-        throw std::runtime_error(debugName + ": dds data unexpected bytes per pixel");
-    }
-}
-
-
-template<typename DataT>
-static void GainImage(std::vector<DataT> &im, float gain)
-{
-    for (auto &pix : im)
-    {
-        pix *= gain;
-    }
-}
-
-
-template<typename T>
-static std::vector< std::shared_ptr<T> > ImportItemsInRectangle(
-    const std::vector<std::shared_ptr<T> > &items,
-    const std::vector<std::shared_ptr<T> > &otherItems,
-    int xlow, int zlow, int xhigh, int zhigh, nfa::scmp::Scmp *scmp)
-{
-    auto isInBounds = [xlow, zlow, xhigh, zhigh](float *pos)
-    {
-        return (pos[0] >= xlow && pos[0] < xhigh && pos[2] >= zlow && pos[2] < zhigh);
-    };
-
-    std::vector<std::shared_ptr<T> > newItems;
-    for (auto & itemPtr : items)
-    {
-        if (!isInBounds(itemPtr->position))
-        {
-            newItems.push_back(itemPtr);
-        }
-    }
-    for (auto _itemPtr : otherItems)
-    {
-        std::shared_ptr<T> itemPtr(new T(*_itemPtr));
-        itemPtr->position[0] += xlow;
-        itemPtr->position[2] += zlow;
-
-        if (isInBounds(itemPtr->position))
-        {
-            if (scmp)
-            {
-                float newHeight = scmp->heightScale * scmp->HeightMapAt(itemPtr->position[0], itemPtr->position[2]);
-                itemPtr->position[1] = newHeight;
-            }
-
-            newItems.push_back(itemPtr);
-        }
-    }
-    return newItems;
-}
-
-
 namespace nfa {
     namespace scmp {
 
@@ -229,7 +44,7 @@ namespace nfa {
             Read<std::string>(is, path);
         }
 
-        void WaveTexture::Save(std::ostream &os)
+        void WaveTexture::Save(std::ostream &os) const
         {
             Write(os, normalMovement);
             Write<std::string>(os, path);
@@ -283,7 +98,7 @@ namespace nfa {
             }
         }
 
-        void WaterShaderProperties::Save(std::ostream &os)
+        void WaterShaderProperties::Save(std::ostream &os) const
         {
             Write(os, hasWater);
             Write(os, elevation);
@@ -345,7 +160,7 @@ namespace nfa {
             Read(is, stripCount);
         }
 
-        void WaveGenerator::Save(std::ostream &os)
+        void WaveGenerator::Save(std::ostream &os) const
         {
             Write(os, textureName);
             Write(os, rampName);
@@ -380,7 +195,7 @@ namespace nfa {
             Read(is, normalsScale);
         }
 
-        void Stratum::Save(std::ostream &os)
+        void Stratum::Save(std::ostream &os) const
         {
             Write(os, albedoPath);
             Write(os, normalsPath);
@@ -401,7 +216,7 @@ namespace nfa {
             Read(is, albedoScale);
         }
 
-        void Stratum::SaveAlbedo(std::ostream &os)
+        void Stratum::SaveAlbedo(std::ostream &os) const
         {
             Write(os, albedoPath);
             Write(os, albedoScale);
@@ -414,7 +229,7 @@ namespace nfa {
             Read(is, normalsScale);
         }
 
-        void Stratum::SaveNormal(std::ostream &os)
+        void Stratum::SaveNormal(std::ostream &os) const
         {
             Write(os, normalsPath);
             Write(os, normalsScale);
@@ -445,7 +260,7 @@ namespace nfa {
             Read(is, ownerArmy);
         }
 
-        void Decal::Save(std::ostream &os)
+        void Decal::Save(std::ostream &os) const
         {
             std::uint32_t numberOfTextures = texPaths.size();
 
@@ -489,7 +304,7 @@ namespace nfa {
             ReadBuffer(is, data, groupCount);
         }
 
-        void DecalGroup::Save(std::ostream &os)
+        void DecalGroup::Save(std::ostream &os) const
         {
             std::uint32_t groupCount = data.size();
 
@@ -510,7 +325,7 @@ namespace nfa {
             Read(is, unknown);
         }
 
-        void Prop::Save(std::ostream &os)
+        void Prop::Save(std::ostream &os) const
         {
             Write(os, blueprintPath);
             Write(os, position);
@@ -564,7 +379,7 @@ namespace nfa {
             }
         }
 
-        void V59ObjectA::Save(std::ostream &os)
+        void V59ObjectA::Save(std::ostream &os) const
         {
             Write(os, p1_v3f);
             Write(os, p2_sf);
@@ -612,7 +427,7 @@ namespace nfa {
             }
         }
 
-        void V59ObjectB::Save(std::ostream &os)
+        void V59ObjectB::Save(std::ostream &os) const
         {
             Write(os, p1_str1);
             Write(os, p2_str2);
@@ -623,7 +438,7 @@ namespace nfa {
             }
         }
 
-        std::int16_t Scmp::HeightMapAt(int x, int z)
+        std::int16_t Scmp::HeightMapAt(int x, int z) const
         {
             if (x >= 0 && x <= width && z >= 0 && z <= height)
             {
@@ -635,6 +450,66 @@ namespace nfa {
             }
         }
 
+        std::shared_ptr<const SpatialGrid> Scmp::ItemGrid(ItemLayer layer) const
+        {
+            switch (layer)
+            {
+            case LAYER_WAVE_GENERATORS:
+                return waveGeneratorIndex.Get(waveGenerators);
+            case LAYER_DECALS:
+                return decalIndex.Get(decals);
+            default:
+                return propIndex.Get(props);
+            }
+        }
+
+        void Scmp::ItemsInRectangle(ItemLayer layer, float x0, float z0, float x1, float z1, std::vector<std::uint32_t> &indices) const
+        {
+            ItemGrid(layer)->QueryRectangle(x0, z0, x1, z1, indices);
+        }
+
+        void Scmp::ItemsInRadius(ItemLayer layer, float x, float z, float radius, std::vector<std::uint32_t> &indices) const
+        {
+            ItemGrid(layer)->QueryRadius(x, z, radius, indices);
+        }
+
+        void Scmp::InvalidateItemIndices()
+        {
+            waveGeneratorIndex.Invalidate();
+            decalIndex.Invalidate();
+            propIndex.Invalidate();
+        }
+
+
+        void Scmp::EnableJournal(bool enable, std::uint64_t memoryBudget)
+        {
+            journal.Enable(enable, memoryBudget);
+        }
+
+
+        void Scmp::BeginEdit(const std::string &name, const EditRegion &region)
+        {
+            journal.Begin(*this, name, region);
+        }
+
+
+        void Scmp::EndEdit()
+        {
+            journal.End(*this);
+        }
+
+
+        bool Scmp::Undo()
+        {
+            return journal.Undo(*this);
+        }
+
+
+        bool Scmp::Redo()
+        {
+            return journal.Redo(*this);
+        }
+
         Scmp::Scmp(std::istream &is)
         {
             // header
@@ -932,7 +807,7 @@ namespace nfa {
             }
         }
 
-        void Scmp::Save(std::ostream &os)
+        void Scmp::Save(std::ostream &os) const
         {
             // header
             Write(os, magicMap1A);
@@ -985,7 +860,8 @@ namespace nfa {
             }
             else
             {
-                std::string texturePath = environmentCubeMapTextures["<default>"];
+                auto it = environmentCubeMapTextures.find("<default>");
+                std::string texturePath = it != environmentCubeMapTextures.end() ? it->second : std::string();
                 Write(os, texturePath);
             }
 
@@ -1046,7 +922,10 @@ namespace nfa {
             }
             else
             {
-                strata.resize(10u);
+                if (strata.size() < 10u)
+                {
+                    throw std::runtime_error("strata: expected 10 layers");
+                }
                 for (int i = 0; i < 10; ++i)
                 {
                     strata[i]->SaveAlbedo(os);
@@ -1161,16 +1040,26 @@ namespace nfa {
         }
 
 
-        void Scmp::Resize(int newWidth, int newHeight)
+        void Scmp::Resize(int newWidth, int newHeight, const ProgressCallback &progress)
         {
+            EditScope edit(*this, "Resize");
             float scalex = float(newWidth) / float(width);
             float scalez = float(newHeight) / float(height);
             float scaley = std::sqrt(scalex*scalez);
 
+            auto report = [&](const char *phase, float fraction)
+            {
+                if (progress && !progress(phase, fraction))
+                {
+                    throw Cancelled("Resize cancelled");
+                }
+            };
+
             std::vector<std::int16_t> newHeightMapData((newWidth + 1)*(newHeight + 1));
-            ResizeImage<std::int16_t>(heightMapData.data(), newHeightMapData.data(), width + 1, height + 1, newWidth + 1, newHeight + 1, true);
+            ResizeImage<std::int16_t>(heightMapData.Get().data(), newHeightMapData.data(), width + 1, height + 1, newWidth + 1, newHeight + 1, true);
             GainImage<std::int16_t>(newHeightMapData, scaley);
-            heightMapData = newHeightMapData;
+            heightMapData = std::move(newHeightMapData);
+            report("heightMapData", 0.2f);
 
             waterShaderProperties->ScaleSize(scaley);
 
@@ -1187,7 +1076,17 @@ namespace nfa {
                 d->ScaleSize(scalex, scaley, scalez);
             }
 
-            // normalMapData, strataLerpData, waterLerpData ... all DDS format ...
+            // normal maps keep their texel density, and their slopes follow the non-uniform part of the scale
+            for (auto &nm : normalMapData)
+            {
+                dds::DdsFile dds(nm.Get().data(), nm.size());
+                int newW = std::max(4, 4 * int(0.5f + dds.width() * scalex / 4.0f));
+                int newH = std::max(4, 4 * int(0.5f + dds.height() * scalez / 4.0f));
+                ResizeNormalDds(nm.Mutable(), newW, newH, scaley / scalex, scaley / scalez);
+            }
+            report("normalMapData", 0.7f);
+
+            // strataLerpData, waterLerpData ... all DDS format ...
 
             // waterFoamMask, waterFlatnessMask, waterDepthBiasMask all 64k
 
@@ -1197,16 +1096,17 @@ namespace nfa {
             {
                 p->ScaleSize(scalex, scaley, scalez);
             }
+            InvalidateItemIndices();
 
-            for (std::vector<std::uint8_t> *dataPtr : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask, &terrainTypeData })
+            for (CowVector<std::uint8_t> *dataPtr : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask, &terrainTypeData })
             {
                 int sizeDivisor = width*height / dataPtr->size();
                 std::vector<std::uint8_t> newData(newWidth*newHeight / sizeDivisor);
                 int widthDivisor = int(0.5 + std::sqrt(double(sizeDivisor)));
                 ResizeImage<std::uint8_t>(
-                    dataPtr->data(), newData.data(), 
+                    dataPtr->Get().data(), newData.data(), 
                     width / widthDivisor, height / widthDivisor, newWidth / widthDivisor, newHeight / widthDivisor, false);
-                *dataPtr = newData;
+                *dataPtr = std::move(newData);
             }
 
             widthOther = widthOther * newWidth / width;
@@ -1214,56 +1114,129 @@ namespace nfa {
 
             width = newWidth;
             height = newHeight;
+            if (progress)
+            {
+                progress("terrainTypeData", 1.0f);
+            }
         }
 
 
-        void Scmp::Import(const Scmp &other, int column0, int row0, bool additiveTerrain)
+        void Scmp::Import(const Scmp &other, int column0, int row0, bool additiveTerrain, const ProgressCallback &progress)
         {
-            // previewImageData.  not important, user can update it with any map editor
+            EditScope edit(*this, "Import");
+
+            // previewImageData is left alone, RenderPreview() redraws it from the merged layers.
+            //
+            // every layer is imported by its own task: they touch disjoint buffers, so only the items (which are
+            // re-snapped to the new terrain) have to wait for the heightmap
+            //
+            // the kept items carry over into each new item vector, so they are made this map's own (Mutable) first
 
-            ImportImage(
-                other.heightMapData.data(), 1 + other.width, 1 + other.height,
-                this->heightMapData.data(), 1 + this->width, 1 + this->height,
-                column0, row0, additiveTerrain);
+            TaskGraph tasks;
 
-            ImportImage(
-                other.terrainTypeData.data(), other.width, other.height,
-                this->terrainTypeData.data(), this->width, this->height,
-                column0, row0, false);
+            TaskGraph::TaskId heightMapTask = tasks.Add("heightMapData", [&]()
+            {
+                ImportImage(
+                    other.heightMapData.data(), 1 + other.width, 1 + other.height,
+                    this->heightMapData.data(), 1 + this->width, 1 + this->height,
+                    column0, row0, additiveTerrain);
+            });
+
+            tasks.Add("terrainTypeData", [&]()
+            {
+                ImportImage(
+                    other.terrainTypeData.data(), other.width, other.height,
+                    this->terrainTypeData.data(), this->width, this->height,
+                    column0, row0, false);
+            });
 
             for (std::size_t n = 0u; n < normalMapData.size() && n < other.normalMapData.size(); ++n)
             {
-                ImportDds(
-                    (std::uint8_t*)other.normalMapData[n].data(), other.normalMapData[n].size(),
-                    (std::uint8_t*)normalMapData[n].data(), normalMapData[n].size(),
-                    other.width, other.height, width, height,
-                    column0, row0, "normalMapData", false);
+                tasks.Add("normalMapData", [&, n]()
+                {
+                    ImportNormalDds(
+                        (std::uint8_t*)other.normalMapData[n].data(), other.normalMapData[n].size(),
+                        (std::uint8_t*)normalMapData[n].data(), normalMapData[n].size(),
+                        other.width, other.height, width, height,
+                        column0, row0, "normalMapData");
+                });
             }
 
             for (std::size_t n = 0u; n < strataLerpData.size() && n < other.strataLerpData.size(); ++n)
             {
-                ImportDds(
-                    (std::uint8_t*)other.strataLerpData[n].data(), other.strataLerpData[n].size(),
-                    (std::uint8_t*)strataLerpData[n].data(), strataLerpData[n].size(),
-                    other.width, other.height, width, height,
-                    column0, row0, "strataLerpData", false);
+                tasks.Add("strataLerpData", [&, n]()
+                {
+                    ImportDds(
+                        (std::uint8_t*)other.strataLerpData[n].data(), other.strataLerpData[n].size(),
+                        (std::uint8_t*)strataLerpData[n].data(), strataLerpData[n].size(),
+                        other.width, other.height, width, height,
+                        column0, row0, "strataLerpData", false);
+                });
             }
 
             for (std::size_t n = 0u; n < waterLerpData.size() && n < other.waterLerpData.size(); ++n)
             {
-                ImportDds(
-                    (std::uint8_t*)other.waterLerpData[n].data(), other.waterLerpData[n].size(),
-                    (std::uint8_t*)waterLerpData[n].data(), waterLerpData[n].size(),
-                    other.width, other.height, width, height,
-                    column0, row0, "waterLerpData", false);
+                tasks.Add("waterLerpData", [&, n]()
+                {
+                    ImportDds(
+                        (std::uint8_t*)other.waterLerpData[n].data(), other.waterLerpData[n].size(),
+                        (std::uint8_t*)waterLerpData[n].data(), waterLerpData[n].size(),
+                        other.width, other.height, width, height,
+                        column0, row0, "waterLerpData", false);
+                });
             }
 
             int columnEnd = column0 + other.width;
             int rowEnd = row0 + other.height;
+            auto heightAt = [this](float x, float z) { return heightScale * HeightMapAt(int(x), int(z)); };
+
+            tasks.Add("waveGenerators", [&]()
+            {
+                // taken before Mutable() moves the generation on: a copy it makes holds the same items in order
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_WAVE_GENERATORS);
+                const auto &items = waveGenerators.Mutable();
+                waveGenerators = ImportItemsInRectangle(
+                    items, *grid,
+                    other.waveGenerators.Get(), *other.ItemGrid(LAYER_WAVE_GENERATORS),
+                    column0, row0, columnEnd, rowEnd, heightAt);
+            }, { heightMapTask });
+            tasks.Add("decals", [&]()
+            {
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_DECALS);
+                const auto &items = decals.Mutable();
+                decals = ImportItemsInRectangle(
+                    items, *grid,
+                    other.decals.Get(), *other.ItemGrid(LAYER_DECALS),
+                    column0, row0, columnEnd, rowEnd, heightAt);
+            }, { heightMapTask });
+            tasks.Add("props", [&]()
+            {
+                std::shared_ptr<const SpatialGrid> grid = ItemGrid(LAYER_PROPS);
+                const auto &items = props.Mutable();
+                props = ImportItemsInRectangle(
+                    items, *grid,
+                    other.props.Get(), *other.ItemGrid(LAYER_PROPS),
+                    column0, row0, columnEnd, rowEnd, heightAt);
+            }, { heightMapTask });
+
+            tasks.Run(progress);
+            InvalidateItemIndices();
+        }
 
-            waveGenerators = ImportItemsInRectangle(waveGenerators, other.waveGenerators, column0, row0, columnEnd, rowEnd, this);
-            decals = ImportItemsInRectangle(decals, other.decals, column0, row0, columnEnd, rowEnd, this);
-            props = ImportItemsInRectangle(props, other.props, column0, row0, columnEnd, rowEnd, this);
+
+        std::shared_ptr<Scmp> Scmp::Clone() const
+        {
+            std::shared_ptr<Scmp> clone = std::make_shared<Scmp>(*this);
+            if (waterShaderProperties)
+            {
+                clone->waterShaderProperties = std::make_shared<WaterShaderProperties>(*waterShaderProperties);
+                clone->waterShaderProperties->waveTextures = CowCopy(waterShaderProperties->waveTextures);
+            }
+            if (v59ObjectA)
+            {
+                clone->v59ObjectA = std::make_shared<V59ObjectA>(*v59ObjectA);
+            }
+            return clone;
         }
 
 
@@ -1308,9 +1281,18 @@ namespace nfa {
                 << " bytes=" << bytes
                 << " fourcc=\"" << std::string(data + 0x54, data + 0x58) << "\" / " 
                 << std::hex << *(std::uint32_t*)(data + 0x54) << std::dec;
+            try
+            {
+                dds::DdsTexture texture = dds::DdsTexture::parse(data, bytes);
+                os << " format=" << dds::formatName(texture.format) << " mips=" << texture.mipMapCount;
+            }
+            catch (const std::exception &e)
+            {
+                os << " (" << e.what() << ')';
+            }
         }
 
-        void Scmp::MapInfo(std::ostream &os)
+        void Scmp::MapInfo(std::ostream &os) const
         {
             os << "version: " << versionMajor << '.' << versionMinor << std::endl;
             os << "preview dds: "; DdsInfo(os, (const char*)previewImageData.data(), previewImageData.size()); os << std::endl;
@@ -1358,7 +1340,7 @@ namespace nfa {
                 os << "waterShaderProperties waveTexture normalRepeat: " << wt->normalRepeat << std::endl;
             }
             os << "number of waveGenerators: " << waveGenerators.size() << std::endl;
-            for (auto &wg : waveGenerators)
+            for (const auto &wg : waveGenerators)
             {
                 os << "--- waveGenerator textureName: " << wg->textureName << std::endl;
                 os << "waveGenerator rampName: " << wg->rampName << std::endl;
@@ -1386,7 +1368,7 @@ namespace nfa {
             os << "minimapLandEndColor: " << std::hex << minimapLandEndColor << std::endl;
             os << std::dec;
             os << "tileset: \"" << tileset << '"' << std::endl;
-            for (auto &stratum : strata)
+            for (const auto &stratum : strata)
             {
                 if (stratum)
                 {
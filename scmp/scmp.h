@@ -1,7 +1,13 @@
 #pragma once
 
+#include "cow.h"
+#include "image.h"
 #include "io.h"
+#include "journal.h"
+#include "progress.h"
+#include "spatial_index.h"
 
+#include <climits>
 #include <cstdint>
 #include <istream>
 #include <limits>
@@ -26,7 +32,7 @@ namespace nfa {
         struct WaveTexture
         {
             WaveTexture(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
 
             std::string path;
             float normalMovement[2];
@@ -37,7 +43,7 @@ namespace nfa {
         struct WaterShaderProperties
         {
             WaterShaderProperties(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
             void ScaleSize(float scaley);
 
             std::uint8_t hasWater;
@@ -66,7 +72,7 @@ namespace nfa {
         struct WaveGenerator
         {
             WaveGenerator(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
             void ScaleSize(float scalex, float scaley, float scalez);
 
             float position[3];
@@ -92,13 +98,13 @@ namespace nfa {
             Stratum() { }
             Stratum(std::istream &is);
 
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
             void ScaleSize(float scale);
 
             void LoadAlbedo(std::istream &is);
             void LoadNormal(std::istream &is);
-            void SaveAlbedo(std::ostream &os);
-            void SaveNormal(std::ostream &os);
+            void SaveAlbedo(std::ostream &os) const;
+            void SaveNormal(std::ostream &os) const;
 
             std::string albedoPath;
             std::string normalsPath;
@@ -124,7 +130,7 @@ namespace nfa {
             };
             Type GetType() const { return (Type)type; }
             Decal(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
             void ScaleSize(float scalex, float scaley, float scalez);
 
             UnknownFields<1> unknown;
@@ -142,7 +148,7 @@ namespace nfa {
         struct DecalGroup
         {
             DecalGroup(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
 
             std::int32_t id;
             std::string name;
@@ -153,7 +159,7 @@ namespace nfa {
         struct Prop
         {
             Prop(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
             void ScaleSize(float scalex, float scaley, float scalez);
 
             std::string blueprintPath;
@@ -168,7 +174,7 @@ namespace nfa {
         struct V59ObjectA
         {
             V59ObjectA(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
 
             float p1_v3f[3];     // read into LoadV59ObjectsA, Object* ((v2=a1)+32) { halfWidth, 0.0, halfHeight }
             float p2_sf;         // read into LoadV59ObjectsA, Object* ((v2=a1)+44) { eg -2.5, -100. }
@@ -198,7 +204,7 @@ namespace nfa {
         struct V59ObjectB
         {
             V59ObjectB(std::istream &is, std::uint32_t versionMinor);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
 
             std::string p1_str1;
             std::string p2_str2;
@@ -207,17 +213,99 @@ namespace nfa {
         };
 
 
+        // How far one layer of a map is from a symmetry: of the samples (pixels, bytes of dds pixels, dds blocks or items)
+        // compared with their mirror images, how many differ and by how much, in the layer's own units.  Compressed dds
+        // blocks differ by 1 or 0, and items by none: an item is asymmetric if no item of its kind is at its mirror image
+        struct LayerAsymmetry
+        {
+            LayerAsymmetry(const std::string &name) : layer(name), samples(0u), asymmetric(0u), meanDifference(0.0), maxDifference(0.0) { }
+
+            std::string layer;
+            std::size_t samples;
+            std::size_t asymmetric;
+            double meanDifference;
+            double maxDifference;
+        };
+
+
         struct Scmp
         {
             Scmp(std::istream &is);
-            void Save(std::ostream &os);
+            void Save(std::ostream &os) const;
+
+            // An independent copy that either map may be edited without affecting the other.  Costs a reference count
+            // per buffer and item vector: they are CowVectors, copied by whichever map writes to them first
+            std::shared_ptr<Scmp> Clone() const;
 
             void DumpTextures(const std::string &prefix) const;
             void DumpTexture(const std::string &filename, const std::vector<std::uint8_t> &data) const;
-            void MapInfo(std::ostream &);
-            void Resize(int width, int height);
-            void Import(const Scmp &other, int column0, int row0, bool additiveTerrain);
-            std::int16_t HeightMapAt(int x, int z);
+            void MapInfo(std::ostream &) const;
+            // progress (optional) is called after each layer; cancelling throws Cancelled and leaves the map part resized
+            void Resize(int width, int height, const ProgressCallback &progress = ProgressCallback());
+            void Import(const Scmp &other, int column0, int row0, bool additiveTerrain, const ProgressCallback &progress = ProgressCallback());
+            // Import other placed by transform, which takes its positions (in cells) to this map's: rotated, scaled and moved
+            // at once.  Each layer of this map under the placed source - heights, terrain types, water masks and dds
+            // textures - is resampled straight from the source's in one pass, bilinearly (terrain types take the nearest),
+            // with normals turned and their slopes changed by the transform.  Items are replaced as by Import, the source's
+            // carried over by TransformItem.  The layers and textures must be in the same formats as Import requires;
+            // throws std::runtime_error if they aren't or the transform is singular
+            void ImportAffine(const Scmp &other, const Affine &transform, bool additiveTerrain,
+                const ProgressCallback &progress = ProgressCallback());
+            void RegenerateNormalMap();     // recompute normalMapData from heightMapData, in each texture's existing format and size (mipmaps are dropped)
+            void RenderPreview();           // redraw previewImageData (shaded heights, minimap colours and contours) in its existing format and size (mipmaps are dropped)
+            // Redraw the water layers from the heights and the water elevations, each in its existing size (and for
+            // waterLerpData, format), eg after Resize or a change of elevation.  Depth runs 0 at the surface, 128 at
+            // elevationDeep and 255 at elevationAbyss: waterLerpData takes it in its green channel, where the water
+            // shader reads it, and waterDepthBiasMask as it is.  waterFoamMask is 255 at the shoreline fading to 0
+            // shoreWidth cells out into the water, and waterFlatnessMask its complement, so open water and land keep
+            // the 0 foam and 255 flatness maps ship with.  Land is depth 0.  The shoreline distance is an exact
+            // euclidean distance transform, linear in the texels.  waterLerpData's mipmaps are dropped
+            void RegenerateWaterMasks(float shoreWidth = 8.0f);
+            std::int16_t HeightMapAt(int x, int z) const;
+
+            // Cut out, extend, mirror or turn the whole map: heights, masks, terrain types, dds textures (mipmaps are
+            // dropped, as by Resize) and the positions and headings of items.  Crop keeps cells column0 <= x < column0 +
+            // width, row0 <= z < row0 + height; where that hangs off the map the layers repeat its edge, and items outside
+            // it are removed.  Crop and Pad redraw the preview; the others reorient it
+            void Crop(int column0, int row0, int width, int height);
+            void Pad(int left, int top, int right, int bottom);
+            enum Axis { AXIS_X, AXIS_Z };
+            void Flip(Axis axis);           // x -> width - x, or z -> height - z
+            void Rotate90();                // clockwise seen from above, x east and z south: the north edge becomes the east edge
+            void Rotate180();
+            void Rotate270();
+            void Transpose();               // x <-> z, mirroring across the diagonal from the north west corner
+            void Orient(Orientation orientation);
+
+            // Make the map symmetric, copying the first half (see SymmetryOverwrites), or the second, over the other:
+            // heights, masks, terrain types and dds textures (mipmaps are dropped) mirrored pixel for pixel, and the
+            // items of the overwritten half replaced by mirror images of the kept half's.  MeasureSymmetry reports how
+            // far each layer is from the symmetry, in one pass over it, cheap enough to run after every edit
+            void EnforceSymmetry(Symmetry symmetry, bool fromSecondHalf = false);
+            std::vector<LayerAsymmetry> MeasureSymmetry(Symmetry symmetry) const;
+
+            // Structural checks a map must pass to load in game and to Resize/Import safely.  Problems that would break
+            // the map are appended to errors; suspicious but loadable content (eg items off the map) to warnings
+            void Validate(std::vector<std::string> &errors, std::vector<std::string> &warnings) const;
+
+            // Indices, in ascending order, of the wave generators, decals or props positioned in x0 <= x < x1, z0 <= z < z1,
+            // or within radius of (x, z).  Backed by a spatial index per layer that rebuilds itself after the layer's vector
+            // is written (see ItemIndex).  ItemGrid's snapshot stays valid after later edits.  Call InvalidateItemIndices()
+            // after moving items through a const reference
+            enum ItemLayer { LAYER_WAVE_GENERATORS, LAYER_DECALS, LAYER_PROPS };
+            void ItemsInRectangle(ItemLayer layer, float x0, float z0, float x1, float z1, std::vector<std::uint32_t> &indices) const;
+            void ItemsInRadius(ItemLayer layer, float x, float z, float radius, std::vector<std::uint32_t> &indices) const;
+            std::shared_ptr<const SpatialGrid> ItemGrid(ItemLayer layer) const;
+            void InvalidateItemIndices();
+
+            // Undo/redo (see EditJournal), off by default.  Bracket edits made directly to the map's fields, eg moving
+            // props, with BeginEdit/EndEdit, giving the region of the heightmap and terrain types the edit may change if
+            // it is small; the map's own edits record themselves
+            void EnableJournal(bool enable = true, std::uint64_t memoryBudget = 256u << 20);
+            void BeginEdit(const std::string &name, const EditRegion &region = EditRegion());
+            void EndEdit();
+            bool Undo();
+            bool Redo();
 
             std::uint32_t magicMap1A;
             std::uint32_t magicBeeffeed;
@@ -225,13 +313,13 @@ namespace nfa {
             std::uint16_t wstring1;
             std::int32_t versionMajor;
             std::int32_t versionMinor;
-            std::vector<std::uint8_t> previewImageData;     // dds
+            CowVector<std::uint8_t> previewImageData;       // dds
 
             // height map
             std::int32_t width;
             std::int32_t height;
             float heightScale; // usually 1/128
-            std::vector<std::int16_t> heightMapData;        // raw
+            CowVector<std::int16_t> heightMapData;          // raw
             std::string unknownv54String;
 
             // texture definition
@@ -242,7 +330,7 @@ namespace nfa {
             std::map<std::string, std::string> environmentCubeMapTextures; // keyed by <faction> or <default>
 
             float lightingMultiplier;
-            float sunDirection[3];
+            float sunDirection[3];          // towards the sun from the ground, y up: the terrain shader lights by dot(normal, sunDirection)
             float sunAmbience[3];
             float sunColour[3];
             float shadowFillColour[3];
@@ -252,7 +340,7 @@ namespace nfa {
             float fogStart;
             float fogEnd;
             std::shared_ptr<WaterShaderProperties> waterShaderProperties;
-            std::vector<std::shared_ptr<WaveGenerator> > waveGenerators;
+            CowVector<std::shared_ptr<WaveGenerator> > waveGenerators;
 
             std::int32_t minimapContourInterval;
             std::uint32_t minimapDeepWaterColor;
@@ -264,29 +352,35 @@ namespace nfa {
 
             std::string tileset; // always "No Tileset"
             std::uint32_t stratumCount;  // number of actually populated strata
-            std::vector<std::shared_ptr<Stratum> > strata;  // always size 10, but depending on mapversion not all are populated
+            CowVector<std::shared_ptr<Stratum> > strata;    // always size 10, but depending on mapversion not all are populated
 
             UnknownFields<2> unknownPreDecals;
-            std::vector<std::shared_ptr<Decal> > decals;
-            std::vector<std::shared_ptr<DecalGroup> > decalGroups;
+            CowVector<std::shared_ptr<Decal> > decals;
+            CowVector<std::shared_ptr<DecalGroup> > decalGroups;
 
             // usually same as width/height, but sometimes half
             std::uint32_t widthOther;
             std::uint32_t heightOther;
 
-            std::vector< std::vector<uint8_t> > normalMapData;  // in the wild, only 1 of these
-            std::vector< std::vector<uint8_t> > strataLerpData; // may be 1 or 2, depending on version
-            std::vector< std::vector<uint8_t> > waterLerpData;  // in the wild, only 1 of these
+            std::vector< CowVector<uint8_t> > normalMapData;  // in the wild, only 1 of these
+            std::vector< CowVector<uint8_t> > strataLerpData; // may be 1 or 2, depending on version
+            std::vector< CowVector<uint8_t> > waterLerpData;  // in the wild, only 1 of these
 
-            std::vector<std::uint8_t> waterFoamMask;      // obviously not used.. each byte is 00
-            std::vector<std::uint8_t> waterFlatnessMask;  // obviously not used.. each byte is FF
-            std::vector<std::uint8_t> waterDepthBiasMask; // obviously not used.. each byte is 7f
-            std::vector<std::uint8_t> terrainTypeData;
+            CowVector<std::uint8_t> waterFoamMask;        // obviously not used.. each byte is 00
+            CowVector<std::uint8_t> waterFlatnessMask;    // obviously not used.. each byte is FF
+            CowVector<std::uint8_t> waterDepthBiasMask;   // obviously not used.. each byte is 7f
+            CowVector<std::uint8_t> terrainTypeData;
 
             std::shared_ptr<V59ObjectA> v59ObjectA;
-            std::vector< std::shared_ptr<V59ObjectB> > v59ObjectB;  // in the wild, always empty
+            CowVector< std::shared_ptr<V59ObjectB> > v59ObjectB;  // in the wild, always empty
+
+            CowVector<std::shared_ptr<Prop> > props;
+
+            ItemIndex waveGeneratorIndex;
+            ItemIndex decalIndex;
+            ItemIndex propIndex;
 
-            std::vector<std::shared_ptr<Prop> > props;
+            EditJournal journal;
         };
     }
 }
@@ -0,0 +1,216 @@
+#include "scmp_cache.h"
+#include "scmp.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
+#endif
+
+
+namespace nfa {
+    namespace scmp {
+
+        // the canonical path, size and modification time of filename.  false if it doesn't exist
+        static bool StatFile(const std::string &filename, std::string &canonical, std::uint64_t &size, std::int64_t &modified)
+        {
+#ifdef _WIN32
+            char path[MAX_PATH];
+            DWORD length = GetFullPathNameA(filename.c_str(), MAX_PATH, path, NULL);
+            if (length == 0 || length >= MAX_PATH)
+            {
+                return false;
+            }
+            WIN32_FILE_ATTRIBUTE_DATA data;
+            if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                return false;
+            }
+            // windows paths are case insensitive
+            canonical.assign(path, length);
+            std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+            size = (std::uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+            modified = std::int64_t((std::uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime);
+#else
+            char path[PATH_MAX];
+            struct stat st;
+            if (!realpath(filename.c_str(), path) || stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            {
+                return false;
+            }
+            canonical = path;
+            size = std::uint64_t(st.st_size);
+#ifdef __APPLE__
+            modified = std::int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+            modified = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+            return true;
+        }
+
+
+        ScmpCache::ScmpCache(std::uint64_t memoryBudget) :
+            m_memoryBudget(memoryBudget),
+            m_bytes(0u),
+            m_hits(0u),
+            m_misses(0u)
+        {
+        }
+
+
+        ScmpCache &ScmpCache::Instance()
+        {
+            static ScmpCache cache;
+            return cache;
+        }
+
+
+        std::shared_ptr<const Scmp> ScmpCache::Load(const std::string &filename)
+        {
+            std::string canonical;
+            std::uint64_t size;
+            std::int64_t modified;
+            if (!StatFile(filename, canonical, size, modified))
+            {
+                throw std::runtime_error("unable to open " + filename);
+            }
+
+            std::shared_future<std::shared_ptr<const Scmp> > future;
+            std::promise<std::shared_ptr<const Scmp> > promise;
+            bool parse = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_entries.find(canonical);
+                if (it != m_entries.end() && (it->second.fileSize != size || it->second.modified != modified))
+                {
+                    // changed on disk
+                    m_bytes -= it->second.fileSize;
+                    m_lru.erase(it->second.lru);
+                    m_entries.erase(it);
+                    it = m_entries.end();
+                }
+
+                if (it != m_entries.end())
+                {
+                    ++m_hits;
+                    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+                    future = it->second.scmp;
+                }
+                else
+                {
+                    ++m_misses;
+                    parse = true;
+                    future = promise.get_future().share();
+                    m_lru.push_front(canonical);
+                    Entry &entry = m_entries[canonical];
+                    entry.fileSize = size;
+                    entry.modified = modified;
+                    entry.scmp = future;
+                    entry.lru = m_lru.begin();
+                    m_bytes += size;
+                    Trim(canonical);
+                }
+            }
+
+            if (parse)
+            {
+                try
+                {
+                    std::ifstream ifs(canonical.c_str(), std::ios::binary);
+                    if (!ifs.good())
+                    {
+                        throw std::runtime_error("unable to open " + filename);
+                    }
+                    promise.set_value(std::shared_ptr<const Scmp>(std::make_shared<Scmp>(ifs)));
+                }
+                catch (...)
+                {
+                    // let whoever is waiting see the failure, but don't keep it
+                    promise.set_exception(std::current_exception());
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    auto it = m_entries.find(canonical);
+                    if (it != m_entries.end() && it->second.modified == modified && it->second.fileSize == size)
+                    {
+                        m_bytes -= it->second.fileSize;
+                        m_lru.erase(it->second.lru);
+                        m_entries.erase(it);
+                    }
+                }
+            }
+            return future.get();
+        }
+
+
+        void ScmpCache::SetMemoryBudget(std::uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_memoryBudget = bytes;
+            Trim(std::string());
+        }
+
+
+        void ScmpCache::Evict(const std::string &filename)
+        {
+            std::string canonical;
+            std::uint64_t size;
+            std::int64_t modified;
+            if (!StatFile(filename, canonical, size, modified))
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(canonical);
+            if (it != m_entries.end())
+            {
+                m_bytes -= it->second.fileSize;
+                m_lru.erase(it->second.lru);
+                m_entries.erase(it);
+            }
+        }
+
+
+        void ScmpCache::Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries.clear();
+            m_lru.clear();
+            m_bytes = 0u;
+        }
+
+
+        ScmpCache::Stats ScmpCache::GetStats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Stats stats;
+            stats.hits = m_hits;
+            stats.misses = m_misses;
+            stats.entries = m_entries.size();
+            stats.bytes = m_bytes;
+            return stats;
+        }
+
+
+        void ScmpCache::Trim(const std::string &keep)
+        {
+            while (m_bytes > m_memoryBudget && !m_lru.empty() && m_lru.back() != keep)
+            {
+                auto it = m_entries.find(m_lru.back());
+                m_bytes -= it->second.fileSize;
+                m_entries.erase(it);
+                m_lru.pop_back();
+            }
+        }
+
+    }
+}
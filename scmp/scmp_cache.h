@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace nfa {
+    namespace scmp {
+
+        struct Scmp;
+
+        // Parsed maps, keyed by canonical path and checked against the file's size and modification time on every Load,
+        // so a map is parsed once however often it is opened and reparsed as soon as it changes on disk.
+        //
+        // Maps are shared, so they are const: Clone() one before editing it.  Least recently used maps are dropped once
+        // the cached maps' files add up to more than the memory budget; anyone still holding one keeps it alive.
+        // Thread safe.  Several threads asking for the same uncached map wait for a single parse
+        class ScmpCache
+        {
+        public:
+            struct Stats
+            {
+                Stats() : hits(0u), misses(0u), entries(0u), bytes(0u) { }
+
+                std::uint64_t hits;
+                std::uint64_t misses;
+                std::size_t entries;
+                std::uint64_t bytes;
+            };
+
+            explicit ScmpCache(std::uint64_t memoryBudget = 1024u << 20);
+
+            // the cache shared by the whole process
+            static ScmpCache &Instance();
+
+            // Throws std::runtime_error if the file can't be opened or parsed; failures aren't cached
+            std::shared_ptr<const Scmp> Load(const std::string &filename);
+
+            void SetMemoryBudget(std::uint64_t bytes);
+            void Evict(const std::string &filename);
+            void Clear();
+            Stats GetStats() const;
+
+        private:
+            struct Entry
+            {
+                std::uint64_t fileSize;
+                std::int64_t modified;      // in the platform's file time units
+                std::shared_future<std::shared_ptr<const Scmp> > scmp;
+                std::list<std::string>::iterator lru;
+            };
+
+            void Trim(const std::string &keep);     // with m_mutex held
+
+            mutable std::mutex m_mutex;
+            std::map<std::string, Entry> m_entries;
+            std::list<std::string> m_lru;       // most recently used first
+            std::uint64_t m_memoryBudget;
+            std::uint64_t m_bytes;
+            std::uint64_t m_hits;
+            std::uint64_t m_misses;
+        };
+    }
+}
@@ -0,0 +1,168 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+static const int MAX_CELLS_PER_SIDE = 1024;
+static const float POINTS_PER_CELL = 4.0f;
+
+
+namespace nfa {
+    namespace scmp {
+
+        SpatialGrid::SpatialGrid() :
+            m_x0(0.0f),
+            m_z0(0.0f),
+            m_cellSize(1.0f),
+            m_columns(0),
+            m_rows(0)
+        {
+        }
+
+
+        void SpatialGrid::Clear()
+        {
+            m_columns = m_rows = 0;
+            m_cellStart.clear();
+            m_indices.clear();
+            m_x.clear();
+            m_z.clear();
+        }
+
+
+        int SpatialGrid::Column(float x) const
+        {
+            float c = (x - m_x0) / m_cellSize;
+            // written so that NaN lands in cell 0
+            return c >= 0.0f ? int(std::min(c, float(m_columns - 1))) : 0;
+        }
+
+
+        int SpatialGrid::Row(float z) const
+        {
+            float r = (z - m_z0) / m_cellSize;
+            return r >= 0.0f ? int(std::min(r, float(m_rows - 1))) : 0;
+        }
+
+
+        void SpatialGrid::Build(const std::vector<float> &x, const std::vector<float> &z, float cellSize)
+        {
+            Clear();
+            m_x = x;
+            m_z = z;
+            std::size_t n = std::min(m_x.size(), m_z.size());
+            m_x.resize(n);
+            m_z.resize(n);
+            if (n == 0u)
+            {
+                return;
+            }
+
+            float x0 = 0.0f, z0 = 0.0f, x1 = 0.0f, z1 = 0.0f;
+            bool any = false;
+            for (std::size_t i = 0u; i < n; ++i)
+            {
+                if (std::isfinite(m_x[i]) && std::isfinite(m_z[i]))
+                {
+                    x0 = any ? std::min(x0, m_x[i]) : m_x[i];
+                    x1 = any ? std::max(x1, m_x[i]) : m_x[i];
+                    z0 = any ? std::min(z0, m_z[i]) : m_z[i];
+                    z1 = any ? std::max(z1, m_z[i]) : m_z[i];
+                    any = true;
+                }
+            }
+
+            float extent = std::max(std::max(x1 - x0, z1 - z0), 1.0f);
+            if (cellSize <= 0.0f)
+            {
+                cellSize = std::sqrt((x1 - x0 + 1.0f) * (z1 - z0 + 1.0f) * POINTS_PER_CELL / float(n));
+            }
+            m_cellSize = std::max(cellSize, extent / float(MAX_CELLS_PER_SIDE));
+            m_x0 = x0;
+            m_z0 = z0;
+            m_columns = std::max(1, std::min(MAX_CELLS_PER_SIDE, int((x1 - x0) / m_cellSize) + 1));
+            m_rows = std::max(1, std::min(MAX_CELLS_PER_SIDE, int((z1 - z0) / m_cellSize) + 1));
+
+            // counting sort of the points into their cells
+            std::vector<std::uint32_t> cellOf(n);
+            m_cellStart.assign(std::size_t(m_columns) * m_rows + 1u, 0u);
+            for (std::size_t i = 0u; i < n; ++i)
+            {
+                cellOf[i] = std::uint32_t(Row(m_z[i]) * m_columns + Column(m_x[i]));
+                ++m_cellStart[cellOf[i] + 1u];
+            }
+            for (std::size_t c = 1u; c < m_cellStart.size(); ++c)
+            {
+                m_cellStart[c] += m_cellStart[c - 1u];
+            }
+
+            m_indices.resize(n);
+            std::vector<std::uint32_t> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+            for (std::size_t i = 0u; i < n; ++i)
+            {
+                m_indices[fill[cellOf[i]]++] = std::uint32_t(i);
+            }
+        }
+
+
+        void SpatialGrid::QueryRectangle(float x0, float z0, float x1, float z1, std::vector<std::uint32_t> &result) const
+        {
+            if (m_x.empty() || !(x0 < x1) || !(z0 < z1))
+            {
+                return;
+            }
+
+            std::size_t first = result.size();
+            int c0 = Column(x0), c1 = Column(x1);
+            int r0 = Row(z0), r1 = Row(z1);
+            for (int r = r0; r <= r1; ++r)
+            {
+                for (int c = c0; c <= c1; ++c)
+                {
+                    std::size_t cell = std::size_t(r) * m_columns + c;
+                    for (std::uint32_t k = m_cellStart[cell]; k < m_cellStart[cell + 1u]; ++k)
+                    {
+                        std::uint32_t i = m_indices[k];
+                        if (m_x[i] >= x0 && m_x[i] < x1 && m_z[i] >= z0 && m_z[i] < z1)
+                        {
+                            result.push_back(i);
+                        }
+                    }
+                }
+            }
+            std::sort(result.begin() + first, result.end());
+        }
+
+
+        void SpatialGrid::QueryRadius(float x, float z, float radius, std::vector<std::uint32_t> &result) const
+        {
+            if (m_x.empty() || !(radius >= 0.0f))
+            {
+                return;
+            }
+
+            std::size_t first = result.size();
+            float radius2 = radius * radius;
+            int c0 = Column(x - radius), c1 = Column(x + radius);
+            int r0 = Row(z - radius), r1 = Row(z + radius);
+            for (int r = r0; r <= r1; ++r)
+            {
+                for (int c = c0; c <= c1; ++c)
+                {
+                    std::size_t cell = std::size_t(r) * m_columns + c;
+                    for (std::uint32_t k = m_cellStart[cell]; k < m_cellStart[cell + 1u]; ++k)
+                    {
+                        std::uint32_t i = m_indices[k];
+                        float dx = m_x[i] - x, dz = m_z[i] - z;
+                        if (dx * dx + dz * dz <= radius2)
+                        {
+                            result.push_back(i);
+                        }
+                    }
+                }
+            }
+            std::sort(result.begin() + first, result.end());
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "cow.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        // Points in the XZ plane bucketed into a uniform grid of square cells.  Buckets are packed into one index
+        // array, so a build is two linear passes and a query touches only the cells overlapping it.
+        class SpatialGrid
+        {
+        public:
+            SpatialGrid();
+
+            // cellSize <= 0 picks one giving a few points per cell
+            void Build(const std::vector<float> &x, const std::vector<float> &z, float cellSize = 0.0f);
+            void Clear();
+            std::size_t size() const { return m_x.size(); }
+
+            // Indices of the points with x0 <= x < x1 and z0 <= z < z1, in ascending order, appended to result
+            void QueryRectangle(float x0, float z0, float x1, float z1, std::vector<std::uint32_t> &result) const;
+            // Indices of the points no further than radius from (x, z), in ascending order, appended to result
+            void QueryRadius(float x, float z, float radius, std::vector<std::uint32_t> &result) const;
+
+        private:
+            int Column(float x) const;
+            int Row(float z) const;
+
+            float m_x0;
+            float m_z0;
+            float m_cellSize;
+            int m_columns;
+            int m_rows;
+            std::vector<std::uint32_t> m_cellStart;     // m_columns*m_rows + 1 offsets into m_indices
+            std::vector<std::uint32_t> m_indices;
+            std::vector<float> m_x;
+            std::vector<float> m_z;
+        };
+
+
+        // A SpatialGrid over the XZ positions of one of Scmp's item vectors, built on first use and rebuilt on the first
+        // use after the vector changes.  Changes are noticed by the vector's Generation(), which any non-const access
+        // bumps; items moved through a const reference must be declared with Invalidate().  Get may be called from
+        // several threads: each build is a new grid, so a snapshot stays valid, if stale, while others rebuild.  Copies
+        // start out unbuilt
+        class ItemIndex
+        {
+        public:
+            ItemIndex() : m_generation(0u) { }
+            ItemIndex(const ItemIndex &) : m_generation(0u) { }
+            ItemIndex &operator=(const ItemIndex &) { Invalidate(); return *this; }
+
+            void Invalidate()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_grid.reset();
+            }
+
+            template<typename T>
+            std::shared_ptr<const SpatialGrid> Get(const CowVector<std::shared_ptr<T> > &items) const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_grid || m_generation != items.Generation())
+                {
+                    std::vector<float> x(items.size()), z(items.size());
+                    for (std::size_t i = 0u; i < items.size(); ++i)
+                    {
+                        x[i] = items[i]->position[0];
+                        z[i] = items[i]->position[2];
+                    }
+                    std::shared_ptr<SpatialGrid> grid = std::make_shared<SpatialGrid>();
+                    grid->Build(x, z);
+                    m_grid = grid;
+                    m_generation = items.Generation();
+                }
+                return m_grid;
+            }
+
+        private:
+            mutable std::mutex m_mutex;
+            mutable std::shared_ptr<const SpatialGrid> m_grid;
+            mutable std::uint64_t m_generation;
+        };
+    }
+}
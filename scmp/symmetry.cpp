@@ -0,0 +1,291 @@
+#include "image.h"
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+#include "taskgraph.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        template<typename T>
+        static void SymmetrizeGrid(CowVector<T> &data, int W, int H, Symmetry s, bool fromSecondHalf)
+        {
+            if (data.size() != std::size_t(W) * H || data.empty())
+            {
+                return;
+            }
+            std::vector<T> symmetric(data.size());
+            const T *source = data.Get().data();
+            ParallelForRows(H, [&](int row0, int row1)
+            {
+                OrientImage(source, symmetric.data(), W, H, SymmetryOrientation(s), row0, row1);
+                SymmetrizeImage(source, symmetric.data(), W, H, s, fromSecondHalf, row0, row1);
+            });
+            data = std::move(symmetric);
+        }
+
+
+        template<typename T>
+        static void MeasureGrid(const CowVector<T> &data, int W, int H, Symmetry s, LayerAsymmetry &asymmetry)
+        {
+            if (data.size() != std::size_t(W) * H || data.empty())
+            {
+                return;
+            }
+            bool swaps = OrientSwapsAxes(SymmetryOrientation(s));
+            std::vector<T> mirrored(swaps ? data.size() : 0u);
+            const T *source = data.Get().data();
+            std::int64_t sum = 0;
+            int largest = 0;
+            std::size_t differing = 0u;
+            std::mutex lock;
+            ParallelForRows(H, [&](int row0, int row1)
+            {
+                std::vector<T> row(swaps ? 0u : std::size_t(W));
+                std::int64_t bandSum = 0;
+                int bandLargest = 0;
+                std::size_t bandDiffering = 0u;
+                AccumulateAsymmetry<T>(source, swaps ? mirrored.data() : row.data(), W, H, s, row0, row1, bandSum, bandLargest, bandDiffering);
+                std::lock_guard<std::mutex> guard(lock);
+                sum += bandSum;
+                largest = std::max(largest, bandLargest);
+                differing += bandDiffering;
+            });
+
+            asymmetry.samples = data.size();
+            asymmetry.asymmetric = differing;
+            asymmetry.meanDifference = double(sum) / double(data.size());
+            asymmetry.maxDifference = double(largest);
+        }
+
+
+        // the items of the kept half, then mirror images of those not on the mirror line
+        template<typename T>
+        static void SymmetrizeItems(CowVector< std::shared_ptr<T> > &items, int W, int H, Symmetry s, bool fromSecondHalf)
+        {
+            if (items.empty())
+            {
+                return;
+            }
+            Orientation o = SymmetryOrientation(s);
+            std::vector< std::shared_ptr<T> > kept, mirrored;
+            for (const std::shared_ptr<T> &item : items.Get())
+            {
+                float x = item->position[0], z = item->position[2];
+                OrientPoint(o, float(W), float(H), x, z);
+                if (SymmetryOverwrites(s, fromSecondHalf, item->position[0], item->position[2], x, z))
+                {
+                    continue;
+                }
+                kept.push_back(item);
+                if (x != item->position[0] || z != item->position[2])
+                {
+                    std::shared_ptr<T> mirror(new T(*item));
+                    OrientItem(*mirror, o, W, H);
+                    mirrored.push_back(mirror);
+                }
+            }
+            kept.insert(kept.end(), mirrored.begin(), mirrored.end());
+            items = std::move(kept);
+        }
+
+
+        static bool SameKind(const WaveGenerator &a, const WaveGenerator &b)
+        {
+            return a.textureName == b.textureName && a.rampName == b.rampName;
+        }
+
+        static bool SameKind(const Decal &a, const Decal &b)
+        {
+            return a.type == b.type && a.texPaths == b.texPaths;
+        }
+
+        static bool SameKind(const Prop &a, const Prop &b)
+        {
+            return a.blueprintPath == b.blueprintPath;
+        }
+
+
+        // items with no item of the same kind within a small distance of their mirror image, found by the layer's index
+        template<typename T>
+        static void MeasureItems(const Scmp &scmp, Scmp::ItemLayer layer, const CowVector< std::shared_ptr<T> > &items,
+            Symmetry s, LayerAsymmetry &asymmetry)
+        {
+            const float TOLERANCE = 1.0f / 16.0f;
+            Orientation o = SymmetryOrientation(s);
+            std::vector<std::uint32_t> near;
+            for (const std::shared_ptr<T> &item : items.Get())
+            {
+                float x = item->position[0], z = item->position[2];
+                OrientPoint(o, float(scmp.width), float(scmp.height), x, z);
+                near.clear();
+                scmp.ItemsInRadius(layer, x, z, TOLERANCE, near);
+                bool matched = std::any_of(near.begin(), near.end(), [&](std::uint32_t i)
+                {
+                    return SameKind(*items.Get()[i], *item);
+                });
+                asymmetry.asymmetric += matched ? 0u : 1u;
+            }
+            asymmetry.samples = items.size();
+        }
+
+
+        static void CheckSymmetry(const Scmp &scmp, Symmetry s, const char *what)
+        {
+            if (OrientSwapsAxes(SymmetryOrientation(s)) && scmp.width != scmp.height)
+            {
+                throw std::runtime_error(std::string(what) + ": diagonal symmetry needs a square map");
+            }
+        }
+
+
+        void Scmp::EnforceSymmetry(Symmetry s, bool fromSecondHalf)
+        {
+            CheckSymmetry(*this, s, "EnforceSymmetry");
+            EditScope edit(*this, "EnforceSymmetry");
+            int W = width, H = height;
+
+            TaskGraph tasks;
+            tasks.Add("heightMapData", [&]()
+            {
+                SymmetrizeGrid(heightMapData, W + 1, H + 1, s, fromSecondHalf);
+            });
+            tasks.Add("terrainTypeData", [&]()
+            {
+                SymmetrizeGrid(terrainTypeData, W, H, s, fromSecondHalf);
+            });
+            tasks.Add("masks", [&]()
+            {
+                for (CowVector<std::uint8_t> *mask : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask })
+                {
+                    int divisor;
+                    if (MaskDivisor(mask->size(), W, H, divisor))
+                    {
+                        SymmetrizeGrid(*mask, W / divisor, H / divisor, s, fromSecondHalf);
+                    }
+                }
+            });
+
+            auto symmetrizeDds = [s, fromSecondHalf](CowVector<std::uint8_t> &data, bool normals)
+            {
+                if (!data.empty())
+                {
+                    data = SymmetrizeDds(data.Get(), s, fromSecondHalf, normals);
+                }
+            };
+            tasks.Add("previewImageData", [&]()
+            {
+                symmetrizeDds(previewImageData, false);
+            });
+            for (auto layers : { &normalMapData, &strataLerpData, &waterLerpData })
+            {
+                for (std::size_t n = 0u; n < layers->size(); ++n)
+                {
+                    tasks.Add(layers == &normalMapData ? "normalMapData" : layers == &strataLerpData ? "strataLerpData" : "waterLerpData",
+                        [&, layers, n]()
+                    {
+                        symmetrizeDds((*layers)[n], layers == &normalMapData);
+                    });
+                }
+            }
+
+            tasks.Add("items", [&]()
+            {
+                SymmetrizeItems(waveGenerators, W, H, s, fromSecondHalf);
+                SymmetrizeItems(decals, W, H, s, fromSecondHalf);
+                SymmetrizeItems(props, W, H, s, fromSecondHalf);
+            });
+
+            tasks.Run();
+        }
+
+
+        std::vector<LayerAsymmetry> Scmp::MeasureSymmetry(Symmetry s) const
+        {
+            CheckSymmetry(*this, s, "MeasureSymmetry");
+            int W = width, H = height;
+
+            std::vector<LayerAsymmetry> report;
+            report.emplace_back("heightMapData");
+            report.emplace_back("terrainTypeData");
+            report.emplace_back("waterFoamMask");
+            report.emplace_back("waterFlatnessMask");
+            report.emplace_back("waterDepthBiasMask");
+            report.emplace_back("previewImageData");
+            for (auto layers : { std::make_pair(&normalMapData, "normalMapData"), std::make_pair(&strataLerpData, "strataLerpData"),
+                std::make_pair(&waterLerpData, "waterLerpData") })
+            {
+                for (std::size_t n = 0u; n < layers.first->size(); ++n)
+                {
+                    report.emplace_back(std::string(layers.second) + "[" + std::to_string(n) + "]");
+                }
+            }
+            report.emplace_back("waveGenerators");
+            report.emplace_back("decals");
+            report.emplace_back("props");
+
+            // each task fills in its own entries
+            TaskGraph tasks;
+            tasks.Add("previewImageData", [&]()
+            {
+                if (!previewImageData.empty())
+                {
+                    MeasureDdsAsymmetry(previewImageData.Get(), s, report[5], false);
+                }
+            });
+            tasks.Add("heightMapData", [&]()
+            {
+                MeasureGrid(heightMapData, W + 1, H + 1, s, report[0]);
+            });
+            tasks.Add("terrainTypeData", [&]()
+            {
+                MeasureGrid(terrainTypeData, W, H, s, report[1]);
+            });
+            tasks.Add("masks", [&]()
+            {
+                std::size_t entry = 2u;
+                for (const CowVector<std::uint8_t> *mask : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask })
+                {
+                    int divisor;
+                    if (MaskDivisor(mask->size(), W, H, divisor))
+                    {
+                        MeasureGrid(*mask, W / divisor, H / divisor, s, report[entry]);
+                    }
+                    ++entry;
+                }
+            });
+
+            std::size_t entry = 6u;
+            for (auto layers : { &normalMapData, &strataLerpData, &waterLerpData })
+            {
+                for (const CowVector<std::uint8_t> &data : *layers)
+                {
+                    tasks.Add(report[entry].layer, [&, layers, entry]()
+                    {
+                        if (!data.empty())
+                        {
+                            MeasureDdsAsymmetry(data.Get(), s, report[entry], layers == &normalMapData);
+                        }
+                    });
+                    ++entry;
+                }
+            }
+
+            tasks.Add("items", [&, entry]()
+            {
+                MeasureItems(*this, LAYER_WAVE_GENERATORS, waveGenerators, s, report[entry]);
+                MeasureItems(*this, LAYER_DECALS, decals, s, report[entry + 1]);
+                MeasureItems(*this, LAYER_PROPS, props, s, report[entry + 2]);
+            });
+
+            tasks.Run();
+            return report;
+        }
+
+    }
+}
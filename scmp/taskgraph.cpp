@@ -0,0 +1,139 @@
+#include "taskgraph.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace nfa {
+    namespace scmp {
+
+        TaskGraph::TaskId TaskGraph::Add(const std::string &name, const std::function<void()> &f, const std::vector<TaskId> &dependsOn)
+        {
+            TaskId id = m_tasks.size();
+            Task task;
+            task.name = name;
+            task.f = f;
+            task.unfinishedDependencies = dependsOn.size();
+            m_tasks.push_back(task);
+
+            for (TaskId dependency : dependsOn)
+            {
+                if (dependency >= id)
+                {
+                    throw std::runtime_error("TaskGraph: task " + name + " depends on a task that hasn't been added yet");
+                }
+                m_tasks[dependency].dependents.push_back(id);
+            }
+            return id;
+        }
+
+
+        void TaskGraph::Run(const ProgressCallback &progress, unsigned workers)
+        {
+            if (workers == 0u)
+            {
+                workers = WorkerCount();
+            }
+            workers = std::max(1u, std::min(workers, unsigned(m_tasks.size())));
+
+            std::mutex mutex;
+            std::condition_variable readyChanged;
+            std::deque<TaskId> ready;
+            std::vector<std::size_t> waitingOn(m_tasks.size());
+            std::size_t finished = 0u, running = 0u;
+            bool stopping = false;
+            std::exception_ptr error;
+
+            for (TaskId id = 0u; id < m_tasks.size(); ++id)
+            {
+                waitingOn[id] = m_tasks[id].unfinishedDependencies;
+                if (waitingOn[id] == 0u)
+                {
+                    ready.push_back(id);
+                }
+            }
+
+            auto worker = [&]()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    readyChanged.wait(lock, [&]() { return stopping || !ready.empty() || running == 0u; });
+                    if (stopping || ready.empty())
+                    {
+                        // nothing more will become ready: either stopped, or every task is done
+                        readyChanged.notify_all();
+                        return;
+                    }
+
+                    TaskId id = ready.front();
+                    ready.pop_front();
+                    ++running;
+
+                    lock.unlock();
+                    std::exception_ptr taskError;
+                    try
+                    {
+                        m_tasks[id].f();
+                    }
+                    catch (...)
+                    {
+                        taskError = std::current_exception();
+                    }
+                    lock.lock();
+
+                    --running;
+                    ++finished;
+                    if (taskError)
+                    {
+                        if (!error)
+                        {
+                            error = taskError;
+                        }
+                        stopping = true;
+                    }
+                    else
+                    {
+                        for (TaskId dependent : m_tasks[id].dependents)
+                        {
+                            if (--waitingOn[dependent] == 0u)
+                            {
+                                ready.push_back(dependent);
+                            }
+                        }
+                        if (progress && !stopping && !progress(m_tasks[id].name, float(finished) / float(m_tasks.size())))
+                        {
+                            if (!error)
+                            {
+                                error = std::make_exception_ptr(Cancelled("cancelled after " + m_tasks[id].name));
+                            }
+                            stopping = true;
+                        }
+                    }
+                    readyChanged.notify_all();
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 1u; i < workers; ++i)
+            {
+                threads.push_back(std::thread(worker));
+            }
+            worker();
+            for (auto &t : threads)
+            {
+                t.join();
+            }
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "progress.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+
+        // A small dependency graph of tasks, run on a pool of worker threads.
+        // A task starts as soon as all the tasks it depends on have finished.
+        class TaskGraph
+        {
+        public:
+            typedef std::size_t TaskId;
+
+            TaskId Add(const std::string &name, const std::function<void()> &f, const std::vector<TaskId> &dependsOn = std::vector<TaskId>());
+
+            // Runs every task and returns when all have finished.  progress (optional) is called after each task, from the
+            // worker threads but never concurrently.  If a task throws, or progress returns false, no further tasks are
+            // started and the exception (or Cancelled) is rethrown on the calling thread.
+            void Run(const ProgressCallback &progress = ProgressCallback(), unsigned workers = 0u);
+
+        private:
+            struct Task
+            {
+                std::string name;
+                std::function<void()> f;
+                std::vector<TaskId> dependents;
+                std::size_t unfinishedDependencies;
+            };
+
+            std::vector<Task> m_tasks;
+        };
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A minimal self registering test runner.  TEST(name) defines a test case; CHECK and CHECK_EQUAL throw TestFailure, which
+// fails the case and moves on to the next one
+namespace nfa {
+    namespace scmp {
+        namespace test {
+
+            class TestFailure : public std::runtime_error
+            {
+            public:
+                TestFailure(const std::string &what) : std::runtime_error(what) { }
+            };
+
+            struct TestCase
+            {
+                const char *name;
+                void (*run)();
+            };
+
+            std::vector<TestCase> &TestCases();
+
+            struct Register
+            {
+                Register(const char *name, void (*run)()) { TestCases().push_back(TestCase{ name, run }); }
+            };
+
+            template<typename A, typename B>
+            void CheckEqual(const A &a, const B &b, const char *as, const char *bs, const char *file, int line)
+            {
+                if (!(a == b))
+                {
+                    std::ostringstream ss;
+                    ss << file << ':' << line << ": " << as << " == " << bs << " failed: " << a << " != " << b;
+                    throw TestFailure(ss.str());
+                }
+            }
+        }
+    }
+}
+
+#define TEST(name) \
+    static void Test_##name(); \
+    static nfa::scmp::test::Register register_##name(#name, &Test_##name); \
+    static void Test_##name()
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::ostringstream ss_; \
+            ss_ << __FILE__ << ':' << __LINE__ << ": " << #condition << " failed"; \
+            throw nfa::scmp::test::TestFailure(ss_.str()); \
+        } \
+    } while (false)
+
+#define CHECK_EQUAL(a, b) nfa::scmp::test::CheckEqual((a), (b), #a, #b, __FILE__, __LINE__)
+
+#define CHECK_THROWS(statement, exception) \
+    do \
+    { \
+        bool thrown_ = false; \
+        try \
+        { \
+            statement; \
+        } \
+        catch (const exception &) \
+        { \
+            thrown_ = true; \
+        } \
+        if (!thrown_) \
+        { \
+            std::ostringstream ss_; \
+            ss_ << __FILE__ << ':' << __LINE__ << ": " << #statement << " didn't throw " << #exception; \
+            throw nfa::scmp::test::TestFailure(ss_.str()); \
+        } \
+    } while (false)
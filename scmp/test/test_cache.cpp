@@ -0,0 +1,105 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/scmp_cache.h"
+
+#include <cstdio>
+#include <fstream>
+
+#ifndef _WIN32
+#include <utime.h>
+#endif
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static std::uint64_t WriteMap(const char *filename, unsigned seed)
+{
+    std::string bytes = MakeTestMapBytes(32, 32, seed);
+    std::ofstream(filename, std::ios::binary) << bytes;
+    return bytes.size();
+}
+
+
+TEST(CacheHitsUntilTheFileChanges)
+{
+    WriteMap("cache_a.scmap", 1u);
+    ScmpCache cache;
+    std::shared_ptr<const Scmp> first = cache.Load("cache_a.scmap");
+    CHECK(cache.Load("cache_a.scmap") == first);
+    CHECK(cache.Load("./cache_a.scmap") == first);
+    ScmpCache::Stats stats = cache.GetStats();
+    CHECK_EQUAL(stats.hits, 2u);
+    CHECK_EQUAL(stats.misses, 1u);
+    CHECK_EQUAL(stats.entries, 1u);
+    CheckSameMap(*first, *MakeTestMap(32, 32, 1u));
+
+    // a different map
+    WriteMap("cache_a.scmap", 2u);
+    std::shared_ptr<const Scmp> second = cache.Load("cache_a.scmap");
+    CHECK(second != first);
+    CheckSameMap(*second, *MakeTestMap(32, 32, 2u));
+    CHECK_EQUAL(cache.GetStats().misses, 2u);
+
+#ifndef _WIN32
+    // the same bytes, touched
+    WriteMap("cache_a.scmap", 2u);
+    utimbuf times = { 1000000000, 1000000000 };
+    CHECK_EQUAL(utime("cache_a.scmap", &times), 0);
+    CHECK(cache.Load("cache_a.scmap") != second);
+    CHECK_EQUAL(cache.GetStats().misses, 3u);
+    CHECK_EQUAL(cache.GetStats().entries, 1u);
+#endif
+
+    cache.Evict("cache_a.scmap");
+    CHECK_EQUAL(cache.GetStats().entries, 0u);
+    std::remove("cache_a.scmap");
+}
+
+
+TEST(CacheDropsTheLeastRecentlyUsed)
+{
+    std::uint64_t size = WriteMap("cache_a.scmap", 1u);
+    WriteMap("cache_b.scmap", 1u);
+    WriteMap("cache_c.scmap", 1u);
+
+    // room for two
+    ScmpCache cache(2u * size);
+    std::shared_ptr<const Scmp> a = cache.Load("cache_a.scmap");
+    cache.Load("cache_b.scmap");
+    CHECK(cache.Load("cache_a.scmap") == a);
+    cache.Load("cache_c.scmap");
+    ScmpCache::Stats stats = cache.GetStats();
+    CHECK_EQUAL(stats.entries, 2u);
+    CHECK_EQUAL(stats.bytes, 2u * size);
+
+    // b went; a, used more recently, stayed
+    CHECK(cache.Load("cache_a.scmap") == a);
+    CHECK_EQUAL(cache.GetStats().misses, 3u);
+    cache.Load("cache_b.scmap");
+    CHECK_EQUAL(cache.GetStats().misses, 4u);
+
+    // a map over budget on its own is still returned, and the rest go
+    cache.SetMemoryBudget(size / 2u);
+    CHECK_EQUAL(cache.GetStats().entries, 0u);
+    CHECK(cache.Load("cache_c.scmap") != nullptr);
+    CHECK_EQUAL(cache.GetStats().entries, 1u);
+
+    std::remove("cache_a.scmap");
+    std::remove("cache_b.scmap");
+    std::remove("cache_c.scmap");
+}
+
+
+TEST(CacheDoesNotKeepFailures)
+{
+    ScmpCache cache;
+    CHECK_THROWS(cache.Load("cache_missing.scmap"), std::runtime_error);
+
+    std::ofstream("cache_bad.scmap", std::ios::binary) << "not a map";
+    CHECK_THROWS(cache.Load("cache_bad.scmap"), std::runtime_error);
+    CHECK_EQUAL(cache.GetStats().entries, 0u);
+    CHECK_EQUAL(cache.GetStats().bytes, 0u);
+    std::remove("cache_bad.scmap");
+}
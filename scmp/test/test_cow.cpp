@@ -0,0 +1,88 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include <type_traits>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(CloneSharesUntilWritten)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(32, 32);
+    std::shared_ptr<Scmp> clone = original->Clone();
+    CHECK(original->heightMapData.Get().data() == clone->heightMapData.Get().data());
+    CHECK(original->props.IsShared());
+
+    clone->heightMapData[0] = 1234;
+    CHECK(original->heightMapData.Get().data() != clone->heightMapData.Get().data());
+    CHECK(original->heightMapData.Get()[0] != 1234);
+}
+
+
+TEST(CloneIsolatesItems)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(32, 32);
+    float x = original->props.Get()[0]->position[0];
+    std::shared_ptr<Scmp> clone = original->Clone();
+
+    clone->props[0]->position[0] = x + 5.0f;
+    clone->decals.Mutable().pop_back();
+    CHECK_EQUAL(original->props.Get()[0]->position[0], x);
+    CHECK_EQUAL(original->decals.size(), std::size_t(20u));
+    CHECK_EQUAL(clone->props.Get()[0]->position[0], x + 5.0f);
+}
+
+
+TEST(ConstMapsGiveConstItems)
+{
+    std::shared_ptr<const Scmp> scmp = MakeTestMap(32, 32);
+    static_assert(std::is_same<decltype(scmp->props[0]), std::shared_ptr<const Prop> >::value,
+        "a const map's items are const");
+    static_assert(std::is_same<decltype(*scmp->decals.begin()), std::shared_ptr<const Decal> >::value,
+        "a const map's items are const");
+    std::size_t count = 0u;
+    for (const auto &prop : scmp->props)
+    {
+        CHECK(prop == scmp->props.Get()[count++]);
+    }
+    CHECK_EQUAL(count, std::size_t(100u));
+    CHECK_EQUAL(scmp->heightMapData[3], scmp->heightMapData.Get()[3]);
+}
+
+
+TEST(CloneIsolatesEdits)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> expected = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> clone = original->Clone();
+    clone->Resize(32, 32);
+    clone->RegenerateNormalMap();
+    clone->EnforceSymmetry(SYMMETRY_ROTATE_180);
+    CheckSameMap(*expected, *original);
+}
+
+
+TEST(ItemGridFollowsEdits)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    std::vector<std::uint32_t> near;
+    scmp->ItemsInRectangle(Scmp::LAYER_PROPS, 0.0f, 0.0f, 0.5f, 0.5f, near);
+    CHECK(near.empty());
+    std::shared_ptr<const SpatialGrid> before = scmp->ItemGrid(Scmp::LAYER_PROPS);
+
+    // moved in place: the same buffer, of the same size
+    const void *buffer = scmp->props.Get().data();
+    scmp->props[7]->position[0] = 0.25f;
+    scmp->props[7]->position[2] = 0.25f;
+    CHECK(scmp->props.Get().data() == buffer);
+    scmp->ItemsInRectangle(Scmp::LAYER_PROPS, 0.0f, 0.0f, 0.5f, 0.5f, near);
+    CHECK_EQUAL(near.size(), std::size_t(1u));
+    CHECK_EQUAL(near[0], std::uint32_t(7u));
+
+    // the earlier snapshot is untouched by the rebuild
+    near.clear();
+    before->QueryRectangle(0.0f, 0.0f, 0.5f, 0.5f, near);
+    CHECK(near.empty());
+    CHECK_EQUAL(before->size(), std::size_t(100u));
+}
@@ -0,0 +1,187 @@
+#include "test.h"
+
+#include "nfa_gl/DdsFile.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace dds;
+
+
+// offsets into a dds file, from the "DDS " magic
+enum
+{
+    HEADER_FLAGS = 8,
+    HEADER_HEIGHT = 12,
+    HEADER_WIDTH = 16,
+    HEADER_MIPMAPCOUNT = 28,
+    FORMAT_FLAGS = 80,
+    FORMAT_FOURCC = 84,
+    FORMAT_BITCOUNT = 88,
+    FORMAT_RMASK = 92,
+    FORMAT_GMASK = 96,
+    FORMAT_AMASK = 104,
+    DX10_FORMAT = 128,
+    DX10_DIMENSION = 132,
+    DX10_ARRAYSIZE = 140
+};
+
+static const std::uint32_t DDPF_ALPHA = 0x2u, DDPF_FOURCC = 0x4u, DDPF_RGB = 0x40u;
+
+
+static void Put(std::vector<std::uint8_t> &data, std::size_t offset, std::uint32_t value)
+{
+    std::memcpy(data.data() + offset, &value, 4u);
+}
+
+
+// a header for a width x height texture with mipMapCount levels; the format is left to the caller.  pixelBytes of
+// zeroes follow it
+static std::vector<std::uint8_t> Header(std::uint32_t width, std::uint32_t height, std::uint32_t mipMapCount,
+    std::size_t pixelBytes, bool dx10 = false)
+{
+    std::vector<std::uint8_t> data(128u + (dx10 ? 20u : 0u) + pixelBytes, 0u);
+    std::memcpy(data.data(), "DDS ", 4u);
+    Put(data, 4u, 124u);
+    Put(data, HEADER_FLAGS, 0x1007u | (mipMapCount > 1u ? 0x20000u : 0u));
+    Put(data, HEADER_HEIGHT, height);
+    Put(data, HEADER_WIDTH, width);
+    Put(data, HEADER_MIPMAPCOUNT, mipMapCount);
+    Put(data, 76u, 32u);
+    if (dx10)
+    {
+        Put(data, FORMAT_FLAGS, DDPF_FOURCC);
+        std::memcpy(data.data() + FORMAT_FOURCC, "DX10", 4u);
+        Put(data, DX10_DIMENSION, 3u);
+        Put(data, DX10_ARRAYSIZE, 1u);
+    }
+    return data;
+}
+
+
+TEST(ParseDxt5WithMipmaps)
+{
+    // 16x8, 8x4, 4x2, 2x1 and 1x1: 8 + 2 + 1 + 1 + 1 blocks
+    std::vector<std::uint8_t> data = Header(16u, 8u, 5u, 13u * 16u);
+    Put(data, FORMAT_FLAGS, DDPF_FOURCC);
+    std::memcpy(data.data() + FORMAT_FOURCC, "DXT5", 4u);
+
+    DdsTexture texture = DdsTexture::parse(data.data(), data.size());
+    CHECK_EQUAL(int(texture.format), int(FORMAT_DXT5));
+    CHECK(texture.isCompressed());
+    CHECK_EQUAL(texture.headerBytes, 128u);
+    CHECK_EQUAL(texture.mipMapCount, 5u);
+    const std::uint32_t offsets[] = { 128u, 256u, 288u, 304u, 320u };
+    for (unsigned level = 0u; level < 5u; ++level)
+    {
+        CHECK_EQUAL(texture.mipOffset[level], offsets[level]);
+    }
+    CHECK_EQUAL(texture.mipWidth(3u), 2u);
+    CHECK_EQUAL(texture.mipHeight(4u), 1u);
+    CHECK_EQUAL(texture.totalBytes(), data.size());
+
+    // one byte short of the last level
+    CHECK_THROWS(DdsTexture::parse(data.data(), data.size() - 1u), std::runtime_error);
+}
+
+
+TEST(ParseClampsTheMipMapCount)
+{
+    // 4x4 has three levels, whatever the header says
+    std::vector<std::uint8_t> data = Header(4u, 4u, 12u, 3u * 16u);
+    Put(data, FORMAT_FLAGS, DDPF_FOURCC);
+    std::memcpy(data.data() + FORMAT_FOURCC, "DXT5", 4u);
+    CHECK_EQUAL(DdsTexture::parse(data.data(), data.size()).mipMapCount, 3u);
+
+    Put(data, HEADER_MIPMAPCOUNT, 0u);
+    CHECK_EQUAL(DdsTexture::parse(data.data(), data.size()).mipMapCount, 1u);
+}
+
+
+TEST(ParseDx10Headers)
+{
+    const std::uint32_t dxgi[] = { 77u, 61u, 49u, 87u };
+    const Format formats[] = { FORMAT_DXT5, FORMAT_R8, FORMAT_RG8, FORMAT_BGRA8 };
+    const std::size_t bytes[] = { 4u * 16u, 64u, 128u, 256u };
+    for (std::size_t i = 0u; i < 4u; ++i)
+    {
+        std::vector<std::uint8_t> data = Header(8u, 8u, 1u, bytes[i], true);
+        Put(data, DX10_FORMAT, dxgi[i]);
+        DdsTexture texture = DdsTexture::parse(data.data(), data.size());
+        CHECK_EQUAL(int(texture.format), int(formats[i]));
+        CHECK_EQUAL(texture.headerBytes, 148u);
+        CHECK_EQUAL(texture.mipOffset[0], 148u);
+        CHECK_EQUAL(texture.totalBytes(), data.size());
+    }
+
+    std::vector<std::uint8_t> array = Header(8u, 8u, 1u, 64u, true);
+    Put(array, DX10_FORMAT, 61u);
+    Put(array, DX10_ARRAYSIZE, 2u);
+    CHECK_THROWS(DdsTexture::parse(array.data(), array.size()), std::runtime_error);
+
+    std::vector<std::uint8_t> unknown = Header(8u, 8u, 1u, 64u, true);
+    Put(unknown, DX10_FORMAT, 2u);
+    CHECK_THROWS(DdsTexture::parse(unknown.data(), unknown.size()), std::runtime_error);
+}
+
+
+TEST(ParseMaskFormats)
+{
+    std::vector<std::uint8_t> r8 = Header(6u, 3u, 1u, 18u);
+    Put(r8, FORMAT_FLAGS, DDPF_RGB);
+    Put(r8, FORMAT_BITCOUNT, 8u);
+    Put(r8, FORMAT_RMASK, 0xffu);
+    DdsTexture texture = DdsTexture::parse(r8.data(), r8.size());
+    CHECK_EQUAL(int(texture.format), int(FORMAT_R8));
+    CHECK_EQUAL(texture.glDataFormat, GLenum(GL_RED));
+    CHECK(!texture.isCompressed());
+    CHECK_EQUAL(texture.mipBytes(0u), 18u);
+
+    std::vector<std::uint8_t> rg8 = Header(6u, 3u, 1u, 36u);
+    Put(rg8, FORMAT_FLAGS, DDPF_RGB);
+    Put(rg8, FORMAT_BITCOUNT, 16u);
+    Put(rg8, FORMAT_RMASK, 0xffu);
+    Put(rg8, FORMAT_GMASK, 0xff00u);
+    texture = DdsTexture::parse(rg8.data(), rg8.size());
+    CHECK_EQUAL(int(texture.format), int(FORMAT_RG8));
+    CHECK_EQUAL(texture.glDataFormat, GLenum(GL_RG));
+    CHECK_EQUAL(texture.mipBytes(0u), 36u);
+
+    std::vector<std::uint8_t> a8 = Header(6u, 3u, 1u, 18u);
+    Put(a8, FORMAT_FLAGS, DDPF_ALPHA);
+    Put(a8, FORMAT_BITCOUNT, 8u);
+    Put(a8, FORMAT_AMASK, 0xffu);
+    CHECK_EQUAL(int(DdsTexture::parse(a8.data(), a8.size()).format), int(FORMAT_A8));
+
+    // R5G6B5 isn't supported
+    std::vector<std::uint8_t> r5g6b5 = Header(6u, 3u, 1u, 36u);
+    Put(r5g6b5, FORMAT_FLAGS, DDPF_RGB);
+    Put(r5g6b5, FORMAT_BITCOUNT, 16u);
+    Put(r5g6b5, FORMAT_RMASK, 0xf800u);
+    CHECK_THROWS(DdsTexture::parse(r5g6b5.data(), r5g6b5.size()), std::runtime_error);
+}
+
+
+TEST(ParseRejectsBadHeaders)
+{
+    std::vector<std::uint8_t> data = Header(4u, 4u, 1u, 16u);
+    Put(data, FORMAT_FLAGS, DDPF_FOURCC);
+    std::memcpy(data.data() + FORMAT_FOURCC, "DXT5", 4u);
+    CHECK_THROWS(DdsTexture::parse(data.data(), 100u), std::runtime_error);
+
+    std::vector<std::uint8_t> magic = data;
+    magic[0] = 'X';
+    CHECK_THROWS(DdsTexture::parse(magic.data(), magic.size()), std::runtime_error);
+
+    std::vector<std::uint8_t> empty = data;
+    Put(empty, HEADER_WIDTH, 0u);
+    CHECK_THROWS(DdsTexture::parse(empty.data(), empty.size()), std::runtime_error);
+
+    // the descriptor holds no pointer: it addresses a copy of the bytes as well as the original
+    DdsTexture texture = DdsTexture::parse(data.data(), data.size());
+    std::vector<std::uint8_t> copy = data;
+    DdsFile file(copy.data(), copy.size());
+    std::size_t bytes;
+    CHECK(file.get(bytes) == (const char *)copy.data() + texture.mipOffset[0]);
+    CHECK_EQUAL(bytes, 16u);
+}
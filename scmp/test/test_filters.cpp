@@ -0,0 +1,214 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/filters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static double Roughness(const Scmp &scmp)
+{
+    double sum = 0.0;
+    for (int z = 1; z < scmp.height; ++z)
+    {
+        for (int x = 1; x < scmp.width; ++x)
+        {
+            sum += std::abs(scmp.HeightMapAt(x, z) - scmp.HeightMapAt(x - 1, z)) +
+                std::abs(scmp.HeightMapAt(x, z) - scmp.HeightMapAt(x, z - 1));
+        }
+    }
+    return sum;
+}
+
+
+static double Volume(const Scmp &scmp)
+{
+    double sum = 0.0;
+    for (std::int16_t h : scmp.heightMapData.Get())
+    {
+        sum += h;
+    }
+    return sum;
+}
+
+
+// heights that differ from expected's outside column0 <= x < column0 + width, row0 <= z < row0 + height
+static int ChangedOutside(const Scmp &expected, const Scmp &scmp, int column0, int row0, int width, int height)
+{
+    int changed = 0;
+    for (int z = 0; z <= scmp.height; ++z)
+    {
+        for (int x = 0; x <= scmp.width; ++x)
+        {
+            bool inside = x >= column0 && x < column0 + width && z >= row0 && z < row0 + height;
+            changed += !inside && expected.HeightMapAt(x, z) != scmp.HeightMapAt(x, z);
+        }
+    }
+    return changed;
+}
+
+
+TEST(BlurSmoothsAndSharpenRoughens)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> blurred = original->Clone();
+    GaussianBlurHeights(*blurred, 2.0f);
+    CHECK(Roughness(*blurred) < 0.8 * Roughness(*original));
+    CHECK(std::abs(Volume(*blurred) - Volume(*original)) < 0.01 * std::abs(Volume(*original)));
+
+    std::shared_ptr<Scmp> sharpened = original->Clone();
+    UnsharpMaskHeights(*sharpened, 2.0f, 1.0f);
+    CHECK(Roughness(*sharpened) > Roughness(*original));
+
+    std::shared_ptr<Scmp> unchanged = original->Clone();
+    UnsharpMaskHeights(*unchanged, 2.0f, 0.0f);
+    CheckSameMap(*original, *unchanged);
+}
+
+
+TEST(FiltersKeepFlatMaps)
+{
+    std::shared_ptr<Scmp> flat = MakeTestMap(32, 32);
+    std::vector<std::int16_t> &heights = flat->heightMapData.Mutable();
+    std::fill(heights.begin(), heights.end(), std::int16_t(2000));
+
+    std::shared_ptr<Scmp> scmp = flat->Clone();
+    GaussianBlurHeights(*scmp, 3.0f);
+    UnsharpMaskHeights(*scmp, 1.5f, 2.0f);
+    MedianFilterHeights(*scmp, 2);
+    ThermalErosionHeights(*scmp, 0.1f, 5);
+    CheckSameMap(*flat, *scmp);
+}
+
+
+TEST(MedianRemovesSpikes)
+{
+    std::shared_ptr<Scmp> flat = MakeTestMap(32, 32);
+    std::vector<std::int16_t> &heights = flat->heightMapData.Mutable();
+    std::fill(heights.begin(), heights.end(), std::int16_t(2000));
+    std::shared_ptr<Scmp> scmp = flat->Clone();
+    scmp->heightMapData.Mutable()[33 * 10 + 10] = 9000;
+    scmp->heightMapData.Mutable()[33 * 20 + 5] = 100;
+
+    MedianFilterHeights(*scmp, 1);
+    CheckSameMap(*flat, *scmp);
+}
+
+
+TEST(FiltersStayInTheirArea)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    HeightmapArea area(8, 16, 24, 20);
+
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    GaussianBlurHeights(*scmp, 2.0f, area);
+    CHECK_EQUAL(ChangedOutside(*original, *scmp, 8, 16, 24, 20), 0);
+    CHECK(Roughness(*scmp) < Roughness(*original));
+
+    // inside, the area filters as the whole map does
+    std::shared_ptr<Scmp> whole = original->Clone();
+    GaussianBlurHeights(*whole, 2.0f);
+    for (int z = 16; z < 36; ++z)
+    {
+        for (int x = 8; x < 32; ++x)
+        {
+            CHECK_EQUAL(scmp->HeightMapAt(x, z), whole->HeightMapAt(x, z));
+        }
+    }
+
+    // a zero mask keeps every height
+    area.mask.assign(24u * 20u, 0u);
+    std::shared_ptr<Scmp> masked = original->Clone();
+    MedianFilterHeights(*masked, 2, area);
+    CheckSameMap(*original, *masked);
+
+    std::shared_ptr<Scmp> eroded = original->Clone();
+    ThermalErosionHeights(*eroded, 0.05f, 10, 0.5f, HeightmapArea(8, 16, 24, 20));
+    CHECK_EQUAL(ChangedOutside(*original, *eroded, 8, 16, 24, 20), 0);
+}
+
+
+TEST(ThermalErosionKeepsTheVolume)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    ThermalErosionHeights(*scmp, 0.02f, 20);
+    CHECK(Roughness(*scmp) < Roughness(*original));
+    // heights are rounded once per vertex
+    CHECK(std::abs(Volume(*scmp) - Volume(*original)) <= 0.5 * 65.0 * 65.0);
+}
+
+
+TEST(FilterIsOneEdit)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    scmp->EnableJournal();
+    std::shared_ptr<Scmp> original = scmp->Clone();
+    GaussianBlurHeights(*scmp, 1.0f);
+    std::shared_ptr<Scmp> blurred = scmp->Clone();
+    CHECK(scmp->Undo());
+    CheckSameMap(*original, *scmp);
+    CHECK(!scmp->Undo());
+    CHECK(scmp->Redo());
+    CheckSameMap(*blurred, *scmp);
+}
+
+
+TEST(HydraulicErosionIsRepeatable)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    HydraulicErosion settings;
+    settings.droplets = 4000u;
+    settings.seed = 7u;
+
+    std::shared_ptr<Scmp> a = original->Clone(), b = original->Clone(), c = original->Clone();
+    HydraulicErosionHeights(*a, settings);
+    HydraulicErosionHeights(*b, settings);
+    CheckSameMap(*a, *b);
+    CHECK(a->heightMapData.Get() != original->heightMapData.Get());
+
+    settings.seed = 8u;
+    HydraulicErosionHeights(*c, settings);
+    CHECK(c->heightMapData.Get() != a->heightMapData.Get());
+}
+
+
+TEST(HydraulicErosionStaysInItsArea)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    HydraulicErosion settings;
+    settings.droplets = 2000u;
+    settings.iterations = 2;
+
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    HydraulicErosionHeights(*scmp, settings, HeightmapArea(16, 8, 32, 40));
+    CHECK_EQUAL(ChangedOutside(*original, *scmp, 16, 8, 32, 40), 0);
+    CHECK(scmp->heightMapData.Get() != original->heightMapData.Get());
+}
+
+
+TEST(HydraulicErosionCancels)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    HydraulicErosion settings;
+    settings.droplets = 1000u;
+    settings.iterations = 3;
+
+    int calls = 0;
+    CHECK_THROWS(HydraulicErosionHeights(*scmp, settings, HeightmapArea(),
+        [&](const std::string &, float fraction)
+        {
+            CHECK(fraction > 0.0f && fraction <= 1.0f);
+            return ++calls < 2;
+        }), Cancelled);
+    CHECK_EQUAL(calls, 2);
+
+    calls = 0;
+    HydraulicErosionHeights(*scmp, settings, HeightmapArea(), [&](const std::string &, float) { ++calls; return true; });
+    CHECK_EQUAL(calls, 3 * 4);
+}
@@ -0,0 +1,71 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/import_session.h"
+#include "scmp/recipe.h"
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(ImportSessionMatchesFreshImport)
+{
+    std::shared_ptr<Scmp> base = MakeTestMap(128, 128);
+    std::shared_ptr<Scmp> source = MakeTestMap(32, 32, 2u);
+    ImportSession session(*base, *source, false);
+
+    const int placements[][2] = { { 8, 8 }, { 24, 40 }, { 100, 100 }, { 0, 0 }, { 96, 0 } };
+    for (auto &at : placements)
+    {
+        session.Place(at[0], at[1]);
+        std::shared_ptr<Scmp> expected = base->Clone();
+        expected->Import(*source, at[0], at[1], false);
+        CheckSameMap(*expected, session.Result());
+    }
+    // the base's items around the placement are shared, not copied
+    std::size_t kept = 0u;
+    while (base->props.Get()[kept]->position[0] >= 96.0f && base->props.Get()[kept]->position[2] < 32.0f)
+    {
+        ++kept;
+    }
+    CHECK(session.Result().props.Get()[0] == base->props.Get()[kept]);
+    // the base is untouched
+    CheckSameMap(*MakeTestMap(128, 128), *base);
+}
+
+
+TEST(RecipeMatchesSequentialEdits)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    std::shared_ptr<const Scmp> source = MakeTestMap(32, 32, 2u);
+
+    std::shared_ptr<Scmp> sequential = original->Clone();
+    sequential->Resize(128, 128);
+    sequential->Import(*source, 16, 24, false);
+    sequential->Import(*source, 40, 8, true);
+    sequential->RegenerateNormalMap();
+    sequential->RenderPreview();
+
+    std::shared_ptr<Scmp> recipe = original->Clone();
+    Recipe().Resize(128, 128).Import(source, 16, 24, false).Import(source, 40, 8, true).RegenerateNormalMap().RenderPreview().Apply(*recipe);
+
+    CheckSameMap(*sequential, *recipe, false);
+    CHECK(TopLevel(sequential->normalMapData[0].Get()) == TopLevel(recipe->normalMapData[0].Get()));
+}
+
+
+TEST(ImportAffineTranslationMatchesImport)
+{
+    std::shared_ptr<Scmp> base = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> source = MakeTestMap(32, 32, 2u);
+    base->RegenerateNormalMap();
+    source->RegenerateNormalMap();
+
+    std::shared_ptr<Scmp> expected = base->Clone();
+    expected->Import(*source, 8, 24, false);
+    std::shared_ptr<Scmp> affine = base->Clone();
+    affine->ImportAffine(*source, Affine::Translation(8.0f, 24.0f), false);
+    CheckSameMap(*expected, *affine);
+
+    CHECK_THROWS(affine->ImportAffine(*source, Affine::Scale(0.0f, 1.0f), false), std::runtime_error);
+}
@@ -0,0 +1,100 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/filters.h"
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(UndoRedoEdits)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> source = MakeTestMap(32, 32, 2u);
+    scmp->EnableJournal();
+    std::shared_ptr<Scmp> original = scmp->Clone();
+
+    scmp->Import(*source, 8, 16, false);
+    std::shared_ptr<Scmp> imported = scmp->Clone();
+    scmp->Resize(128, 96);
+    std::shared_ptr<Scmp> resized = scmp->Clone();
+    scmp->RegenerateNormalMap();
+    std::shared_ptr<Scmp> regenerated = scmp->Clone();
+
+    CHECK(scmp->Undo());
+    CheckSameMap(*resized, *scmp);
+    CHECK(scmp->Undo());
+    CheckSameMap(*imported, *scmp);
+    CHECK(scmp->Undo());
+    CheckSameMap(*original, *scmp);
+    CHECK(!scmp->Undo());
+
+    CHECK(scmp->Redo());
+    CHECK(scmp->Redo());
+    CHECK(scmp->Redo());
+    CHECK(!scmp->Redo());
+    CheckSameMap(*regenerated, *scmp);
+}
+
+
+TEST(UndoDirectEdit)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    scmp->EnableJournal();
+    std::shared_ptr<Scmp> original = scmp->Clone();
+
+    scmp->BeginEdit("move props");
+    for (auto &prop : scmp->props)
+    {
+        prop->position[0] = 1.0f;
+    }
+    scmp->heightMapData[100] = 0;
+    scmp->EndEdit();
+
+    CHECK(scmp->Undo());
+    CheckSameMap(*original, *scmp);
+    CHECK(scmp->Redo());
+    CHECK_EQUAL(scmp->props[0]->position[0], 1.0f);
+    CHECK_EQUAL(scmp->heightMapData.Get()[100], 0);
+}
+
+
+TEST(NewEditDropsRedo)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    scmp->EnableJournal();
+    scmp->RegenerateNormalMap();
+    CHECK(scmp->Undo());
+    scmp->RenderPreview();
+    CHECK(!scmp->Redo());
+}
+
+
+TEST(UndoEditOfARegion)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    scmp->EnableJournal();
+    std::shared_ptr<Scmp> original = scmp->Clone();
+
+    GaussianBlurHeights(*scmp, 1.0f, HeightmapArea(10, 20, 16, 8));
+    std::shared_ptr<Scmp> blurred = scmp->Clone();
+    scmp->BeginEdit("paint", EditRegion(30, 30, 4, 4));
+    scmp->heightMapData[65u * 31u + 32u] = 77;
+    scmp->terrainTypeData[64u * 33u + 30u] = 9;
+    scmp->EndEdit();
+    std::shared_ptr<Scmp> painted = scmp->Clone();
+
+    CHECK(scmp->Undo());
+    CheckSameMap(*blurred, *scmp);
+    CHECK(scmp->Undo());
+    CheckSameMap(*original, *scmp);
+    CHECK(scmp->Redo());
+    CHECK(scmp->Redo());
+    CheckSameMap(*painted, *scmp);
+
+    // resizing what the region covers can't be undone from the region alone
+    scmp->BeginEdit("resize", EditRegion(0, 0, 4, 4));
+    scmp->heightMapData.resize(10u);
+    scmp->EndEdit();
+    CHECK(!scmp->Undo());
+}
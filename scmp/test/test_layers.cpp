@@ -0,0 +1,107 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "nfa_gl/DdsFile.h"
+
+#include <cstring>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+// the texture with two mip levels of 0x5a bytes after its top level
+static void AddMipmaps(CowVector<std::uint8_t> &ddsData)
+{
+    dds::DdsTexture texture = dds::DdsTexture::parse(ddsData.Get().data(), ddsData.size());
+    std::vector<std::uint8_t> &data = ddsData.Mutable();
+    std::uint32_t flags, count = 3u;
+    std::memcpy(&flags, data.data() + 8, 4u);
+    flags |= 0x20000u;
+    std::memcpy(data.data() + 8, &flags, 4u);
+    std::memcpy(data.data() + 28, &count, 4u);
+    data.insert(data.end(), texture.mipBytes(1u) + texture.mipBytes(2u), std::uint8_t(0x5a));
+}
+
+
+static unsigned MipMapCount(const CowVector<std::uint8_t> &ddsData)
+{
+    return dds::DdsTexture::parse(ddsData.Get().data(), ddsData.size()).mipMapCount;
+}
+
+
+TEST(RegeneratedNormalsDropTheirMipmaps)
+{
+    std::shared_ptr<Scmp> expected = MakeTestMap(32, 32);
+    std::shared_ptr<Scmp> scmp = expected->Clone();
+    AddMipmaps(scmp->normalMapData[0]);
+    CHECK_EQUAL(MipMapCount(scmp->normalMapData[0]), 3u);
+
+    expected->RegenerateNormalMap();
+    scmp->RegenerateNormalMap();
+    CHECK_EQUAL(MipMapCount(scmp->normalMapData[0]), 1u);
+    CheckSameMap(*expected, *scmp);
+}
+
+
+TEST(RenderedPreviewDropsItsMipmaps)
+{
+    std::shared_ptr<Scmp> expected = MakeTestMap(32, 32);
+    std::shared_ptr<Scmp> scmp = expected->Clone();
+    AddMipmaps(scmp->previewImageData);
+
+    expected->RenderPreview();
+    scmp->RenderPreview();
+    CHECK_EQUAL(MipMapCount(scmp->previewImageData), 1u);
+    CHECK(TopLevel(expected->previewImageData.Get()) == TopLevel(scmp->previewImageData.Get()));
+}
+
+
+TEST(RegeneratedWaterLerpDropsItsMipmaps)
+{
+    std::shared_ptr<Scmp> expected = MakeTestMap(32, 32);
+    std::shared_ptr<Scmp> scmp = expected->Clone();
+    AddMipmaps(scmp->waterLerpData[0]);
+
+    expected->RegenerateWaterMasks();
+    scmp->RegenerateWaterMasks();
+    CHECK_EQUAL(MipMapCount(scmp->waterLerpData[0]), 1u);
+    CheckSameMap(*expected, *scmp);
+}
+
+
+TEST(UnsupportedWaterLerpChangesNothing)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    // a second lerp texture, retagged DXT1
+    std::vector<std::uint8_t> dxt1 = scmp->waterLerpData[0].Get();
+    std::uint32_t flags = 0x4u;
+    std::memcpy(dxt1.data() + 80, &flags, 4u);
+    std::memcpy(dxt1.data() + 84, "DXT1", 4u);
+    scmp->waterLerpData.push_back(dxt1);
+    AddMipmaps(scmp->waterLerpData[0]);
+    std::shared_ptr<Scmp> original = scmp->Clone();
+
+    CHECK_THROWS(scmp->RegenerateWaterMasks(), std::runtime_error);
+    CHECK(scmp->waterFoamMask.Get() == original->waterFoamMask.Get());
+    CHECK(scmp->waterDepthBiasMask.Get() == original->waterDepthBiasMask.Get());
+    CHECK(scmp->waterLerpData[0].Get() == original->waterLerpData[0].Get());
+}
+
+
+TEST(PreviewIsLitAlongSunDirection)
+{
+    std::shared_ptr<Scmp> above = MakeTestMap(32, 32);
+    above->sunDirection[0] = 0.6f;
+    above->sunDirection[1] = 0.8f;
+    above->sunDirection[2] = 0.0f;
+    std::shared_ptr<Scmp> below = above->Clone();
+    for (float &s : below->sunDirection)
+    {
+        s = -s;
+    }
+
+    // the opposite vector is a sun below the horizon, not the same light
+    above->RenderPreview();
+    below->RenderPreview();
+    CHECK(TopLevel(above->previewImageData.Get()) != TopLevel(below->previewImageData.Get()));
+}
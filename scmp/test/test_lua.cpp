@@ -0,0 +1,166 @@
+#include "test.h"
+
+#include "scmp/lua.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace nfa::scmp;
+
+
+static std::string Text(const LuaToken &token)
+{
+    return std::string(token.begin, token.end);
+}
+
+
+static std::string ReadFile(const char *filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+
+TEST(LexerSplitsTokens)
+{
+    std::string lua = "size = { 1024, -2.5e+3 } -- trailing\nname = 'a\\'b' .. [==[long]]==]";
+    LuaLexer lexer(lua.data(), lua.data() + lua.size());
+
+    const LuaToken::Type types[] = {
+        LuaToken::NAME, LuaToken::SYMBOL, LuaToken::SYMBOL, LuaToken::NUMBER, LuaToken::SYMBOL, LuaToken::SYMBOL,
+        LuaToken::NUMBER, LuaToken::SYMBOL, LuaToken::COMMENT, LuaToken::NAME, LuaToken::SYMBOL, LuaToken::STRING,
+        LuaToken::SYMBOL, LuaToken::STRING, LuaToken::END };
+    const char *texts[] = {
+        "size", "=", "{", "1024", ",", "-", "2.5e+3", "}", "-- trailing", "name", "=", "'a\\'b'", "..",
+        "[==[long]]==]", "" };
+    for (std::size_t i = 0u; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        LuaToken token = lexer.Next();
+        CHECK_EQUAL(int(token.type), int(types[i]));
+        CHECK_EQUAL(Text(token), texts[i]);
+    }
+}
+
+
+TEST(LexerSkipsComments)
+{
+    std::string lua = "--[[ a\nlong comment ]] x --\ny";
+    LuaLexer lexer(lua.data(), lua.data() + lua.size());
+    CHECK(lexer.NextSignificant().Is(LuaToken::NAME, "x"));
+    CHECK(lexer.NextSignificant().Is(LuaToken::NAME, "y"));
+    CHECK_EQUAL(int(lexer.NextSignificant().type), int(LuaToken::END));
+}
+
+
+TEST(LexerEndsUnterminatedStrings)
+{
+    std::string lua = "x = [[never closed";
+    LuaLexer lexer(lua.data(), lua.data() + lua.size());
+    lexer.Next();
+    lexer.Next();
+    LuaToken token = lexer.Next();
+    CHECK_EQUAL(int(token.type), int(LuaToken::STRING));
+    CHECK(token.end == lua.data() + lua.size());
+    CHECK_EQUAL(int(lexer.Next().type), int(LuaToken::END));
+}
+
+
+TEST(UnquotedStripsQuotesAndBrackets)
+{
+    std::string lua = "'single' \"double\" [=[long]=]";
+    LuaLexer lexer(lua.data(), lua.data() + lua.size());
+    const char *expected[] = { "single", "double", "long" };
+    for (const char *e : expected)
+    {
+        const char *b, *end;
+        lexer.Next().Unquoted(b, end);
+        CHECK_EQUAL(std::string(b, end), e);
+    }
+}
+
+
+TEST(ParseLuaNumber)
+{
+    const char *texts[] = { "0", "512", "2.5", ".25", "1e3", "1.5E-2", "123456789012345678901", "0.30000000000000004" };
+    const double values[] = { 0.0, 512.0, 2.5, 0.25, 1000.0, 0.015, 123456789012345678901.0, 0.30000000000000004 };
+    for (std::size_t i = 0u; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        double value = -1.0;
+        CHECK(ParseLuaNumber(texts[i], texts[i] + std::strlen(texts[i]), value));
+        CHECK_EQUAL(value, values[i]);
+    }
+
+    const char *bad[] = { "", ".", "1e", "1e+", "12x", "0x10" };
+    for (const char *text : bad)
+    {
+        double value;
+        CHECK(!ParseLuaNumber(text, text + std::strlen(text), value));
+    }
+}
+
+
+TEST(FormatLuaNumberRoundTrips)
+{
+    const double values[] = { 0.0, 1.0, -1.0, 0.1, 256.5, -17.25, 1024.0 / 3.0, 123456.789, 1e-7, 3.4e38 };
+    for (double value : values)
+    {
+        char buffer[32];
+        char *end = FormatLuaNumber(value, buffer);
+        std::string text(buffer, end);
+        CHECK(text.find(',') == std::string::npos);
+
+        double readBack;
+        const char *b = buffer + (*buffer == '-');
+        CHECK(ParseLuaNumber(b, end, readBack));
+        CHECK_EQUAL(float(*buffer == '-' ? -readBack : readBack), float(value));
+    }
+
+    // at least 6 significant digits, and no more than a float needs
+    char buffer[32];
+    CHECK_EQUAL(std::string(buffer, FormatLuaNumber(0.1, buffer)), "0.1");
+    CHECK_EQUAL(std::string(buffer, FormatLuaNumber(512.0, buffer)), "512");
+    CHECK_EQUAL(FormatLuaNumberList(std::vector<double>{ 1.0, -2.5 }.data(), 2), "1, -2.5");
+}
+
+
+TEST(RewriteLuaFileReplacesTheTarget)
+{
+    std::ofstream("rewrite_source.lua", std::ios::binary) << "a = 1";
+    std::ofstream("rewrite_target.lua", std::ios::binary) << "old";
+    RewriteLuaFile("rewrite_source.lua", "rewrite_target.lua", [](const char *b, const char *e, std::ostream &os)
+    {
+        os.write(b, e - b);
+        os << "\nb = 2";
+    });
+    CHECK_EQUAL(ReadFile("rewrite_target.lua"), "a = 1\nb = 2");
+    CHECK(!std::ifstream("rewrite_target.lua.tmp").good());
+
+    // in place
+    RewriteLuaFile("rewrite_target.lua", "rewrite_target.lua", [](const char *b, const char *e, std::ostream &os)
+    {
+        os.write(b, 5);
+    });
+    CHECK_EQUAL(ReadFile("rewrite_target.lua"), "a = 1");
+    std::remove("rewrite_source.lua");
+    std::remove("rewrite_target.lua");
+}
+
+
+TEST(FailedRewriteLeavesTheTarget)
+{
+    std::ofstream("rewrite_source.lua", std::ios::binary) << "a = 1";
+    std::ofstream("rewrite_target.lua", std::ios::binary) << "old";
+    CHECK_THROWS(RewriteLuaFile("rewrite_source.lua", "rewrite_target.lua",
+        [](const char *, const char *, std::ostream &os)
+        {
+            os << "partial";
+            throw std::runtime_error("rewrite failed");
+        }), std::runtime_error);
+    CHECK_EQUAL(ReadFile("rewrite_target.lua"), "old");
+    CHECK(!std::ifstream("rewrite_target.lua.tmp").good());
+    std::remove("rewrite_source.lua");
+    std::remove("rewrite_target.lua");
+}
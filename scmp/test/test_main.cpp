@@ -0,0 +1,53 @@
+#include "test.h"
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+namespace nfa {
+    namespace scmp {
+        namespace test {
+
+            std::vector<TestCase> &TestCases()
+            {
+                static std::vector<TestCase> cases;
+                return cases;
+            }
+        }
+    }
+}
+
+
+// runs every test case, or those whose names are given
+int main(int argc, char *argv[])
+{
+    using namespace nfa::scmp::test;
+
+    int run = 0, failed = 0;
+    for (const TestCase &testCase : TestCases())
+    {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            selected = selected || std::strcmp(argv[i], testCase.name) == 0;
+        }
+        if (!selected)
+        {
+            continue;
+        }
+
+        ++run;
+        try
+        {
+            testCase.run();
+            std::cout << "ok      " << testCase.name << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            ++failed;
+            std::cout << "FAILED  " << testCase.name << ": " << e.what() << std::endl;
+        }
+    }
+    std::cout << run << " tests, " << failed << " failed" << std::endl;
+    return failed > 0 || run == 0 ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+#include "test_maps.h"
+#include "test.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+namespace nfa {
+    namespace scmp {
+        namespace test {
+
+            namespace {
+
+                class Writer
+                {
+                public:
+                    void U8(std::uint8_t v) { m_bytes.push_back(char(v)); }
+                    void U16(std::uint16_t v) { Raw(&v, sizeof(v)); }
+                    void U32(std::uint32_t v) { Raw(&v, sizeof(v)); }
+                    void I32(std::int32_t v) { Raw(&v, sizeof(v)); }
+                    void F(float v) { Raw(&v, sizeof(v)); }
+                    void F(std::initializer_list<float> vs) { for (float v : vs) F(v); }
+                    void S(const std::string &s) { m_bytes.append(s.c_str(), s.size() + 1u); }
+                    void Raw(const void *p, std::size_t n) { m_bytes.append((const char*)p, n); }
+                    void Blob(const std::string &b) { U32(std::uint32_t(b.size())); m_bytes += b; }
+
+                    const std::string &Bytes() const { return m_bytes; }
+
+                private:
+                    std::string m_bytes;
+                };
+
+
+                // a dds texture without mipmaps: BGRA of random bytes, or DXT5 blocks all of one pale normal
+                std::string Dds(int w, int h, bool dxt5, std::mt19937 &random)
+                {
+                    Writer dds;
+                    dds.Raw("DDS ", 4u);
+                    dds.U32(124u);
+                    dds.U32(0x1u | 0x2u | 0x4u | 0x1000u);
+                    dds.U32(std::uint32_t(h));
+                    dds.U32(std::uint32_t(w));
+                    for (int i = 0; i < 3 + 11; ++i)
+                    {
+                        dds.U32(0u);
+                    }
+                    dds.U32(32u);
+                    dds.U32(dxt5 ? 0x4u : 0x41u);
+                    dds.Raw(dxt5 ? "DXT5" : "\0\0\0\0", 4u);
+                    dds.U32(dxt5 ? 0u : 32u);
+                    dds.U32(dxt5 ? 0u : 0xff0000u);
+                    dds.U32(dxt5 ? 0u : 0xff00u);
+                    dds.U32(dxt5 ? 0u : 0xffu);
+                    dds.U32(dxt5 ? 0u : 0xff000000u);
+                    dds.U32(0x1000u);
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        dds.U32(0u);
+                    }
+
+                    if (dxt5)
+                    {
+                        const std::uint8_t block[16] = { 200, 50, 0, 0, 0, 0, 0, 0, 0xe0, 0x07, 0, 0, 0, 0, 0, 0 };
+                        for (int i = 0; i < (w / 4) * (h / 4); ++i)
+                        {
+                            dds.Raw(block, sizeof(block));
+                        }
+                    }
+                    else
+                    {
+                        for (int i = 0; i < 4 * w * h; ++i)
+                        {
+                            dds.U8(std::uint8_t(random()));
+                        }
+                    }
+                    return dds.Bytes();
+                }
+            }
+
+
+            std::string MakeTestMapBytes(int W, int H, unsigned seed)
+            {
+                std::mt19937 random(seed);
+                std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+                Writer b;
+
+                b.U32(0x1a70614du);
+                b.I32(2);
+                b.U32(0xbeeffeedu);
+                b.U32(2u);
+                b.F({ float(W), float(H) });
+                b.U16(0u);
+                b.U32(0u);
+                b.Blob(Dds(64, 64, false, random));
+                b.I32(56);
+                b.I32(W);
+                b.I32(H);
+                b.F(1.0f / 128.0f);
+                for (int z = 0; z <= H; ++z)
+                {
+                    float cz = std::cos(float(z) * 6.28f / float(H) * 3.0f);
+                    for (int x = 0; x <= W; ++x)
+                    {
+                        b.U16(std::uint16_t(std::int16_t(2000.0f + 1500.0f * std::sin(float(x) * 6.28f / float(W) * 2.0f) * cz)));
+                    }
+                }
+                b.S("");
+
+                b.S("TTerrain");
+                b.S("");
+                b.S("");
+                b.U32(1u);
+                b.S("<default>");
+                b.S("/textures/env/cube.dds");
+                b.F({ 1.5f, 0.5f, 0.7f, 0.5f, 0.1f, 0.1f, 0.1f, 1.0f, 1.0f, 1.0f, 0.2f, 0.2f, 0.2f, 0.0f, 0.0f, 0.0f, 0.0f, 0.08f,
+                    1.0f, 1.0f, 1.0f, 0.0f, 1000.0f });
+
+                // water
+                b.U8(1u);
+                b.F({ 17.5f, 15.0f, 2.5f, 0.0f, 0.7f, 1.5f, 0.06f, 0.1f, 0.7f, 0.1f, 1.5f, 0.5f, 1.5f, 50.0f, 10.0f,
+                    0.1f, -0.95f, 0.4f, 1.1f, 0.7f, 0.5f, 5.0f, 0.1f });
+                b.S("/textures/engine/waterCubemap.dds");
+                b.S("/textures/engine/waterramp.dds");
+                b.F({ 0.0009f, 0.009f, 0.05f, 0.5f });
+                for (int i = 0; i < 4; ++i)
+                {
+                    b.F({ 0.5f, -0.9f });
+                    b.S("/textures/engine/waves.dds");
+                }
+
+                b.U32(3u);
+                for (int i = 0; i < 3; ++i)
+                {
+                    b.S("/env/common/splats/wave.dds");
+                    b.S("/env/common/splats/ramp.dds");
+                    b.F({ unit(random) * W, 17.5f, unit(random) * H, 0.3f, 0.0f, 0.0f, 0.0f });
+                    for (int j = 0; j < 10; ++j)
+                    {
+                        b.F(1.0f);
+                    }
+                }
+
+                b.U32(24u);
+                b.U32(0xff0e3effu);
+                b.U32(0xff215cffu);
+                b.U32(0xff4785ffu);
+                b.U32(0xff4c9d32u);
+                b.U32(0xffffffffu);
+                for (int i = 0; i < 10; ++i)
+                {
+                    b.S("/env/albedo" + std::to_string(i) + ".dds");
+                    b.F(4.0f);
+                }
+                for (int i = 0; i < 9; ++i)
+                {
+                    b.S("/env/normal" + std::to_string(i) + ".dds");
+                    b.F(4.0f);
+                }
+                b.U32(0u);
+                b.U32(0u);
+
+                b.U32(20u);
+                for (int i = 0; i < 20; ++i)
+                {
+                    b.U32(0u);
+                    b.I32(1);
+                    b.U32(1u);
+                    b.Blob("/env/decals/d.dds");
+                    b.F({ 10.0f, 10.0f, 10.0f, unit(random) * W, 20.0f, unit(random) * H, 0.0f, unit(random) * 6.28f, 0.0f,
+                        1000.0f, 0.0f });
+                    b.I32(-1);
+                }
+                b.U32(0u);
+
+                b.U32(std::uint32_t(W));
+                b.U32(std::uint32_t(H));
+                b.U32(1u);
+                b.Blob(Dds(W, H, true, random));
+                for (int i = 0; i < 2; ++i)
+                {
+                    b.Blob(Dds(W / 2, H / 2, false, random));
+                }
+                b.U32(1u);
+                b.Blob(Dds(W / 2, H / 2, false, random));
+                b.Raw(std::string(std::size_t(W * H / 4), '\x00').data(), std::size_t(W * H / 4));
+                b.Raw(std::string(std::size_t(W * H / 4), '\xff').data(), std::size_t(W * H / 4));
+                b.Raw(std::string(std::size_t(W * H / 4), '\x7f').data(), std::size_t(W * H / 4));
+                for (int i = 0; i < W * H; ++i)
+                {
+                    b.U8(std::uint8_t(1u + (random() & 3u)));
+                }
+
+                b.U32(100u);
+                for (int i = 0; i < 100; ++i)
+                {
+                    b.S(i % 3 ? "/env/props/tree.bp" : "/env/props/rock.bp");
+                    b.F({ unit(random) * W, 20.0f, unit(random) * H, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f });
+                    b.U32(0u);
+                    b.U32(0u);
+                    b.U32(0u);
+                }
+                return b.Bytes();
+            }
+
+
+            std::shared_ptr<Scmp> MakeTestMap(int width, int height, unsigned seed)
+            {
+                std::istringstream is(MakeTestMapBytes(width, height, seed));
+                return std::make_shared<Scmp>(is);
+            }
+
+
+            std::vector<std::uint8_t> TopLevel(const std::vector<std::uint8_t> &ddsData)
+            {
+                std::vector<std::uint8_t> copy(ddsData);
+                dds::DdsFile dds(copy.data(), copy.size());
+                std::size_t bytes;
+                const std::uint8_t *image = (const std::uint8_t*)dds.get(bytes);
+                return std::vector<std::uint8_t>(image, image + bytes);
+            }
+
+
+            std::vector<std::uint8_t> DecodedTopLevel(const std::vector<std::uint8_t> &ddsData)
+            {
+                std::vector<std::uint8_t> copy(ddsData);
+                dds::DdsFile dds(copy.data(), copy.size());
+                std::size_t bytes;
+                const std::uint8_t *image = (const std::uint8_t*)dds.get(bytes);
+                std::vector<std::uint8_t> rgba(4u * dds.width() * dds.height());
+                dds::decodeDxt5(image, dds.width(), dds.height(), rgba.data());
+                return rgba;
+            }
+
+
+            double MeanNormalDifference(const std::vector<std::uint8_t> &a, const std::vector<std::uint8_t> &b)
+            {
+                std::vector<std::uint8_t> ta = DecodedTopLevel(a), tb = DecodedTopLevel(b);
+                if (ta.size() != tb.size() || ta.empty())
+                {
+                    throw TestFailure("normal maps of different sizes");
+                }
+                double sum = 0.0;
+                for (std::size_t i = 0u; i < ta.size(); i += 4u)
+                {
+                    sum += std::abs(int(ta[i + 1u]) - int(tb[i + 1u])) + std::abs(int(ta[i + 3u]) - int(tb[i + 3u]));
+                }
+                return sum / double(ta.size() / 2u);
+            }
+
+
+            namespace {
+
+                void Fail(const std::string &what)
+                {
+                    throw TestFailure("maps differ: " + what);
+                }
+
+                template<typename T>
+                void CheckSameItems(const CowVector< std::shared_ptr<T> > &a, const CowVector< std::shared_ptr<T> > &b,
+                    const char *layer, float tolerance)
+                {
+                    if (a.size() != b.size())
+                    {
+                        Fail(std::string(layer) + " count " + std::to_string(a.size()) + " != " + std::to_string(b.size()));
+                    }
+                    for (std::size_t i = 0u; i < a.size(); ++i)
+                    {
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            if (std::fabs(a[i]->position[k] - b[i]->position[k]) > tolerance)
+                            {
+                                Fail(std::string(layer) + "[" + std::to_string(i) + "] position");
+                            }
+                        }
+                    }
+                }
+            }
+
+
+            void CheckSameMap(const Scmp &a, const Scmp &b, bool textures, float tolerance)
+            {
+                if (a.width != b.width || a.height != b.height)
+                {
+                    Fail("size");
+                }
+                if (a.heightMapData.Get() != b.heightMapData.Get())
+                {
+                    Fail("heightMapData");
+                }
+                if (a.terrainTypeData.Get() != b.terrainTypeData.Get())
+                {
+                    Fail("terrainTypeData");
+                }
+                if (a.waterFoamMask.Get() != b.waterFoamMask.Get() || a.waterFlatnessMask.Get() != b.waterFlatnessMask.Get() ||
+                    a.waterDepthBiasMask.Get() != b.waterDepthBiasMask.Get())
+                {
+                    Fail("water masks");
+                }
+                if (textures)
+                {
+                    for (auto layers : { std::make_pair(&a.normalMapData, &b.normalMapData), std::make_pair(&a.strataLerpData, &b.strataLerpData),
+                        std::make_pair(&a.waterLerpData, &b.waterLerpData) })
+                    {
+                        if (layers.first->size() != layers.second->size())
+                        {
+                            Fail("texture count");
+                        }
+                        for (std::size_t n = 0u; n < layers.first->size(); ++n)
+                        {
+                            if (TopLevel((*layers.first)[n].Get()) != TopLevel((*layers.second)[n].Get()))
+                            {
+                                Fail(layers.first == &a.normalMapData ? "normalMapData" : layers.first == &a.strataLerpData ? "strataLerpData" : "waterLerpData");
+                            }
+                        }
+                    }
+                }
+                CheckSameItems(a.waveGenerators, b.waveGenerators, "waveGenerators", tolerance);
+                CheckSameItems(a.decals, b.decals, "decals", tolerance);
+                CheckSameItems(a.props, b.props, "props", tolerance);
+            }
+        }
+    }
+}
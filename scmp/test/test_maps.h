@@ -0,0 +1,37 @@
+#pragma once
+
+#include "scmp/scmp.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nfa {
+    namespace scmp {
+        namespace test {
+
+            // A small v56 map built in memory and parsed as a .scmap would be: rolling heights, water at 17.5 (deep 15,
+            // abyss 2.5), a DXT5 normal map at full size, BGRA strata and water lerp textures and the water masks at half
+            // size, and wave generators, decals and props (of two blueprints) scattered by seed.  width and height must
+            // be multiples of 8
+            std::shared_ptr<Scmp> MakeTestMap(int width, int height, unsigned seed = 1u);
+
+            // The same map's .scmap bytes
+            std::string MakeTestMapBytes(int width, int height, unsigned seed = 1u);
+
+            // The top level image of a dds texture, as stored (still block compressed if it is)
+            std::vector<std::uint8_t> TopLevel(const std::vector<std::uint8_t> &ddsData);
+
+            // The top level image of a DXT5 texture, decoded to rgba
+            std::vector<std::uint8_t> DecodedTopLevel(const std::vector<std::uint8_t> &ddsData);
+
+            // The mean difference between the packed normals (x in alpha, y in green) of two DXT5 normal maps of one size
+            double MeanNormalDifference(const std::vector<std::uint8_t> &a, const std::vector<std::uint8_t> &b);
+
+            // Throws TestFailure naming the first layer or item where a and b differ: sizes, heights, terrain types,
+            // masks, the top levels of the dds textures (unless textures is false) and item positions within tolerance
+            void CheckSameMap(const Scmp &a, const Scmp &b, bool textures = true, float tolerance = 1e-3f);
+        }
+    }
+}
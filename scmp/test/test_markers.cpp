@@ -0,0 +1,218 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/markers.h"
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static const char *SAVE_LUA =
+    "Scenario = {\n"
+    "    MasterChain = {\n"
+    "        ['_MASTERCHAIN_'] = {\n"
+    "            Markers = {\n"
+    "                ['ARMY_1'] = {\n"
+    "                    ['type'] = STRING( 'Blank Marker' ),\n"
+    "                    ['position'] = VECTOR3( 10, 0, 20 ),\n"
+    "                },\n"
+    "                ['Mass 01'] = {\n"
+    "                    ['type'] = STRING( 'Mass' ),\n"
+    "                    ['position'] = VECTOR3( 40.5, 1, 50 ),\n"
+    "                },\n"
+    "            },\n"
+    "        },\n"
+    "    },\n"
+    "    Areas = {\n"
+    "        ['AREA_1'] = {\n"
+    "            ['rectangle'] = RECTANGLE( 0, 0, 64, 32 ),\n"
+    "        },\n"
+    "    },\n"
+    "}\n";
+
+
+static std::string Span(const std::string &lua, const LuaSpan &span)
+{
+    return lua.substr(span.begin, span.end - span.begin);
+}
+
+
+static std::string Patched(const std::string &lua, const std::vector<LuaPatch> &patches)
+{
+    std::ostringstream ss;
+    ApplyLuaPatches(lua.data(), lua.data() + lua.size(), patches, ss);
+    return ss.str();
+}
+
+
+TEST(ParseFindsMarkersAndAreas)
+{
+    std::string lua = SAVE_LUA;
+    SaveLuaMarkers parsed = SaveLuaMarkers::Parse(lua.data(), lua.data() + lua.size());
+    CHECK_EQUAL(parsed.fileSize, lua.size());
+    CHECK_EQUAL(parsed.markers.size(), 3u);
+
+    const Marker &army = parsed.markers[0];
+    CHECK_EQUAL(int(army.kind), int(Marker::MARKER));
+    CHECK_EQUAL(army.name, "ARMY_1");
+    CHECK_EQUAL(army.type, "Blank Marker");
+    CHECK(army.hasPosition && !army.hasRectangle);
+    CHECK_EQUAL(army.position[0], 10.0);
+    CHECK_EQUAL(army.position[2], 20.0);
+    CHECK_EQUAL(Span(lua, army.nameSpan), "ARMY_1");
+    CHECK_EQUAL(Span(lua, army.positionArgs), " 10, 0, 20 ");
+
+    const Marker &mass = parsed.markers[1];
+    CHECK_EQUAL(mass.name, "Mass 01");
+    CHECK_EQUAL(mass.position[0], 40.5);
+
+    const Marker &area = parsed.markers[2];
+    CHECK_EQUAL(int(area.kind), int(Marker::AREA));
+    CHECK(area.hasRectangle && !area.hasPosition);
+    CHECK_EQUAL(area.rectangle[2], 64.0);
+    CHECK_EQUAL(Span(lua, area.rectangleArgs), " 0, 0, 64, 32 ");
+
+    // removing an entry leaves the table well formed
+    std::string removed = Patched(lua, { LuaPatch(army.entry.begin, army.entry.end, std::string()) });
+    SaveLuaMarkers reparsed = SaveLuaMarkers::Parse(removed.data(), removed.data() + removed.size());
+    CHECK_EQUAL(reparsed.markers.size(), 2u);
+    CHECK_EQUAL(reparsed.markers[0].name, "Mass 01");
+    CHECK_EQUAL(reparsed.markersInsert, parsed.markersInsert - (army.entry.end - army.entry.begin));
+}
+
+
+TEST(MarkerCacheRoundTrips)
+{
+    std::string lua = SAVE_LUA;
+    SaveLuaMarkers parsed = SaveLuaMarkers::Parse(lua.data(), lua.data() + lua.size());
+    std::stringstream ss;
+    parsed.WriteCache(ss);
+
+    SaveLuaMarkers cached;
+    CHECK(cached.ReadCache(ss));
+    CHECK_EQUAL(cached.fileHash, parsed.fileHash);
+    CHECK_EQUAL(cached.markersInsert, parsed.markersInsert);
+    CHECK_EQUAL(cached.areasInsert, parsed.areasInsert);
+    CHECK_EQUAL(cached.markers.size(), parsed.markers.size());
+    for (std::size_t i = 0u; i < parsed.markers.size(); ++i)
+    {
+        CHECK_EQUAL(cached.markers[i].name, parsed.markers[i].name);
+        CHECK_EQUAL(cached.markers[i].type, parsed.markers[i].type);
+        CHECK_EQUAL(cached.markers[i].entry.begin, parsed.markers[i].entry.begin);
+        CHECK_EQUAL(cached.markers[i].positionArgs.end, parsed.markers[i].positionArgs.end);
+        CHECK_EQUAL(cached.markers[i].rectangle[3], parsed.markers[i].rectangle[3]);
+    }
+
+    std::stringstream garbage("not a cache");
+    CHECK(!SaveLuaMarkers().ReadCache(garbage));
+}
+
+
+TEST(ApplyLuaPatches)
+{
+    std::string lua = "0123456789";
+    CHECK_EQUAL(Patched(lua, { LuaPatch(7u, 9u, "x"), LuaPatch(2u, 2u, "a"), LuaPatch(2u, 2u, "b") }), "01ab23456x9");
+    CHECK_EQUAL(Patched(lua, { LuaPatch(0u, 10u, "") }), "");
+    CHECK_THROWS(Patched(lua, { LuaPatch(2u, 5u, ""), LuaPatch(4u, 6u, "") }), std::runtime_error);
+    CHECK_THROWS(Patched(lua, { LuaPatch(8u, 11u, "") }), std::runtime_error);
+}
+
+
+TEST(RescaledMarkersSitOnTheMap)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    std::string lua = SAVE_LUA;
+    SaveLuaMarkers parsed = SaveLuaMarkers::Parse(lua.data(), lua.data() + lua.size());
+    std::ostringstream ss;
+    RescaleSaveLua(lua.data(), lua.data() + lua.size(), parsed, ss, 0.5, 2.0, 4.0, 0.0, *scmp);
+
+    std::string rescaled = ss.str();
+    SaveLuaMarkers result = SaveLuaMarkers::Parse(rescaled.data(), rescaled.data() + rescaled.size());
+    CHECK_EQUAL(result.markers.size(), 3u);
+    CHECK_EQUAL(result.markers[0].position[0], 9.0);
+    CHECK_EQUAL(result.markers[0].position[2], 40.0);
+    CHECK_EQUAL(float(result.markers[0].position[1]), float(scmp->heightScale * scmp->HeightMapAt(9, 40)));
+    CHECK_EQUAL(result.markers[2].rectangle[2], 36.0);
+    CHECK_EQUAL(result.markers[2].rectangle[3], 64.0);
+
+    std::string truncated = lua.substr(0u, lua.size() - 1u);
+    CHECK_THROWS(RescaleSaveLua(truncated.data(), truncated.data() + truncated.size(), parsed, ss, 1.0, 1.0, 0.0, 0.0, *scmp),
+        std::runtime_error);
+}
+
+
+#ifndef _WIN32
+TEST(MarkerCacheLivesInTheUserCache)
+{
+    // a cache directory and a lua file, both under the working directory
+    char path[PATH_MAX];
+    CHECK(getcwd(path, sizeof(path)) != NULL);
+    std::string directory = std::string(path) + "/marker_cache/scmp/markers/";
+    setenv("XDG_CACHE_HOME", (std::string(path) + "/marker_cache").c_str(), 1);
+    std::string lua = "Scenario = { }";
+    std::ofstream("markers_save.lua") << lua;
+
+    std::string cacheFilename = MarkerCacheFilename("markers_save.lua");
+    CHECK_EQUAL(cacheFilename.substr(0u, directory.size()), directory);
+    CHECK_EQUAL(MarkerCacheFilename("./markers_save.lua"), cacheFilename);
+    CHECK(MarkerCacheFilename("other_save.lua") != cacheFilename);
+
+    SaveLuaMarkers::Load(lua.data(), lua.data() + lua.size(), cacheFilename);
+    CHECK(std::ifstream(cacheFilename.c_str()).good());
+    CHECK(!std::ifstream("markers_save.lua.markers").good());
+    unsetenv("XDG_CACHE_HOME");
+}
+#endif
+
+
+TEST(MergedMarkersReplaceTheImportedRectangle)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    std::string source = SAVE_LUA;
+    std::string target =
+        "Scenario = {\n"
+        "    MasterChain = {\n"
+        "        ['_MASTERCHAIN_'] = {\n"
+        "            Markers = {\n"
+        "                ['ARMY_1'] = {\n"
+        "                    ['position'] = VECTOR3( 5, 0, 5 ),\n"
+        "                },\n"
+        "                ['Mass 01'] = {\n"
+        "                    ['position'] = VECTOR3( 30, 0, 30 ),\n"
+        "                }\n"
+        "            },\n"
+        "        },\n"
+        "    },\n"
+        "}\n";
+    SaveLuaMarkers sourceMarkers = SaveLuaMarkers::Parse(source.data(), source.data() + source.size());
+    SaveLuaMarkers targetMarkers = SaveLuaMarkers::Parse(target.data(), target.data() + target.size());
+
+    // a 32x32 import at (16, 16): the target's Mass 01 is inside it and goes, the source's ARMY_1 lands at (26, 36)
+    // and collides with the target's, the source's Mass 01 lands outside it
+    std::string merged = Patched(target, MergeMarkerPatches(source.data(), sourceMarkers, target.data(), targetMarkers,
+        1.0, 1.0, 16.0, 16.0, 32.0, 32.0, *scmp));
+    SaveLuaMarkers result = SaveLuaMarkers::Parse(merged.data(), merged.data() + merged.size());
+    CHECK_EQUAL(result.markers.size(), 2u);
+    CHECK_EQUAL(result.markers[0].name, "ARMY_1");
+    CHECK_EQUAL(result.markers[0].position[0], 5.0);
+    CHECK_EQUAL(result.markers[1].name, "ARMY_2");
+    CHECK_EQUAL(result.markers[1].type, "Blank Marker");
+    CHECK_EQUAL(result.markers[1].position[0], 26.0);
+    CHECK_EQUAL(result.markers[1].position[2], 36.0);
+    CHECK_EQUAL(float(result.markers[1].position[1]), float(scmp->heightScale * scmp->HeightMapAt(26, 36)));
+
+    // a target without a Markers table can't take any
+    std::string noMarkers = "Scenario = { Areas = { } }";
+    SaveLuaMarkers none = SaveLuaMarkers::Parse(noMarkers.data(), noMarkers.data() + noMarkers.size());
+    CHECK_THROWS(MergeMarkerPatches(source.data(), sourceMarkers, noMarkers.data(), none,
+        1.0, 1.0, 0.0, 0.0, 64.0, 64.0, *scmp), std::runtime_error);
+}
@@ -0,0 +1,213 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "nfa_gl/DxtCodec.h"
+#include "scmp/image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+// rgba with a green ramp down the rows, an alpha ramp along them and red and blue as PackNormals writes them
+static std::vector<std::uint8_t> NormalRamp(unsigned width, unsigned height)
+{
+    std::vector<std::uint8_t> rgba(width * height * 4u);
+    for (unsigned y = 0u; y < height; ++y)
+    {
+        for (unsigned x = 0u; x < width; ++x)
+        {
+            std::uint8_t *p = &rgba[(y * width + x) * 4u];
+            p[0] = 255u;
+            p[1] = std::uint8_t(60u + 120u * y / height);
+            p[2] = 0u;
+            p[3] = std::uint8_t(90u + 70u * x / width);
+        }
+    }
+    return rgba;
+}
+
+
+static int MaxDifference(const std::vector<std::uint8_t> &a, const std::vector<std::uint8_t> &b, int channel)
+{
+    int result = 0;
+    for (std::size_t i = std::size_t(channel); i < a.size(); i += 4u)
+    {
+        result = std::max(result, std::abs(int(a[i]) - int(b[i])));
+    }
+    return result;
+}
+
+
+static NormalMap TiltedNormals(int width, int height)
+{
+    NormalMap nm(width, height);
+    for (int z = 0; z < height; ++z)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            float nx = 0.6f * std::sin(0.7f * float(x)), ny = 0.5f * std::cos(0.3f * float(z));
+            float n = std::sqrt(nx * nx + ny * ny + 1.0f);
+            nm.x[z * width + x] = nx / n;
+            nm.y[z * width + x] = ny / n;
+            nm.z[z * width + x] = 1.0f / n;
+        }
+    }
+    return nm;
+}
+
+
+TEST(Dxt5RoundTripsWithinTheRampStep)
+{
+    // 10 x 6: the last blocks are partial
+    const unsigned W = 10u, H = 6u;
+    std::vector<std::uint8_t> rgba = NormalRamp(W, H);
+    std::vector<std::uint8_t> blocks(dds::dxt5ImageBytes(W, H));
+    CHECK_EQUAL(blocks.size(), 3u * 2u * dds::DXT5_BLOCK_BYTES);
+    dds::encodeDxt5(rgba.data(), W, H, blocks.data());
+
+    std::vector<std::uint8_t> decoded(rgba.size());
+    dds::decodeDxt5(blocks.data(), W, H, decoded.data());
+    // alpha has 8 levels between 8 bit endpoints, green 4 between 6 bit ones
+    CHECK(MaxDifference(rgba, decoded, 3) <= 3);
+    CHECK(MaxDifference(rgba, decoded, 1) <= 8);
+    CHECK(MaxDifference(rgba, decoded, 0) <= 4);
+    CHECK(MaxDifference(rgba, decoded, 2) <= 4);
+}
+
+
+TEST(Dxt5KeepsFlatBlocks)
+{
+    std::vector<std::uint8_t> rgba(16u * 4u);
+    for (std::size_t i = 0u; i < 16u; ++i)
+    {
+        rgba[i * 4u + 0u] = 255u;
+        rgba[i * 4u + 1u] = 128u;
+        rgba[i * 4u + 2u] = 0u;
+        rgba[i * 4u + 3u] = 128u;
+    }
+    std::uint8_t block[16];
+    dds::encodeDxt5Block(rgba.data(), block);
+    std::vector<std::uint8_t> decoded(rgba.size());
+    dds::decodeDxt5Block(block, decoded.data());
+    CHECK_EQUAL(MaxDifference(rgba, decoded, 3), 0);
+    CHECK(MaxDifference(rgba, decoded, 1) <= 2);
+}
+
+
+TEST(Dxt5RegionReencodesOnlyItsBlocks)
+{
+    const unsigned W = 16u, H = 8u;
+    std::vector<std::uint8_t> rgba = NormalRamp(W, H);
+    std::vector<std::uint8_t> blocks(dds::dxt5ImageBytes(W, H));
+    dds::encodeDxt5(rgba.data(), W, H, blocks.data());
+    std::vector<std::uint8_t> before = blocks;
+
+    for (std::uint8_t &b : rgba)
+    {
+        b = std::uint8_t(255u - b);
+    }
+    // texels 5..6 x 1..2 lie in the second block of the first row
+    dds::encodeDxt5Region(rgba.data(), W, H, blocks.data(), 5u, 1u, 7u, 3u);
+    for (std::size_t block = 0u; block < blocks.size() / dds::DXT5_BLOCK_BYTES; ++block)
+    {
+        bool same = std::equal(blocks.begin() + block * 16u, blocks.begin() + block * 16u + 16u, before.begin() + block * 16u);
+        CHECK_EQUAL(same, block != 1u);
+    }
+}
+
+
+TEST(PackedNormalsRoundTrip)
+{
+    NormalMap nm = TiltedNormals(12, 8);
+    std::vector<std::uint8_t> rgba(12u * 8u * 4u);
+    PackNormals(nm, rgba.data());
+    NormalMap unpacked(12, 8);
+    UnpackNormals(rgba.data(), unpacked);
+    for (std::size_t i = 0u; i < nm.x.size(); ++i)
+    {
+        CHECK(std::abs(unpacked.x[i] - nm.x[i]) < 1.0f / 127.0f);
+        CHECK(std::abs(unpacked.y[i] - nm.y[i]) < 1.0f / 127.0f);
+        CHECK(std::abs(unpacked.z[i] - nm.z[i]) < 2.0f / 127.0f);
+        CHECK_EQUAL(int(rgba[i * 4u]), 255);
+        CHECK_EQUAL(int(rgba[i * 4u + 2u]), 0);
+    }
+}
+
+
+TEST(ResampledNormalsAreUnitVectors)
+{
+    NormalMap nm = TiltedNormals(32, 24);
+    const int sizes[][2] = { { 32, 24 }, { 64, 48 }, { 8, 6 }, { 13, 40 } };
+    for (const auto &size : sizes)
+    {
+        NormalMap resampled = ResampleNormals(nm, size[0], size[1], 1.5f, 0.5f);
+        CHECK_EQUAL(resampled.width, size[0]);
+        CHECK_EQUAL(int(resampled.x.size()), size[0] * size[1]);
+        for (std::size_t i = 0u; i < resampled.x.size(); ++i)
+        {
+            float length = std::sqrt(resampled.x[i] * resampled.x[i] + resampled.y[i] * resampled.y[i] +
+                resampled.z[i] * resampled.z[i]);
+            CHECK(std::abs(length - 1.0f) < 1e-4f);
+            CHECK(resampled.z[i] > 0.0f);
+        }
+    }
+}
+
+
+TEST(ResampledNormalsKeepTheirDirection)
+{
+    // unchanged at the same size and gain, and a uniform tilt stays uniform however it is resized
+    NormalMap nm = TiltedNormals(16, 16);
+    NormalMap same = ResampleNormals(nm, 16, 16, 1.0f, 1.0f);
+    for (std::size_t i = 0u; i < nm.x.size(); ++i)
+    {
+        CHECK(std::abs(same.x[i] - nm.x[i]) < 1e-4f);
+        CHECK(std::abs(same.y[i] - nm.y[i]) < 1e-4f);
+    }
+
+    NormalMap tilted(16, 16);
+    std::fill(tilted.x.begin(), tilted.x.end(), 0.6f);
+    std::fill(tilted.y.begin(), tilted.y.end(), 0.0f);
+    std::fill(tilted.z.begin(), tilted.z.end(), 0.8f);
+    NormalMap resized = ResampleNormals(tilted, 5, 40, 2.0f, 1.0f);
+    // the slope x/z doubles
+    float n = std::sqrt(1.2f * 1.2f + 0.8f * 0.8f);
+    for (std::size_t i = 0u; i < resized.x.size(); ++i)
+    {
+        CHECK(std::abs(resized.x[i] - 1.2f / n) < 1e-4f);
+        CHECK(std::abs(resized.y[i]) < 1e-4f);
+    }
+}
+
+
+TEST(RegeneratedNormalsFollowTheSlope)
+{
+    // a plane rising 100 units a cell along x: every normal leans back along -x by the same amount
+    std::shared_ptr<Scmp> scmp = MakeTestMap(16, 16);
+    for (int z = 0; z <= scmp->height; ++z)
+    {
+        for (int x = 0; x <= scmp->width; ++x)
+        {
+            scmp->heightMapData[z * (scmp->width + 1) + x] = std::int16_t(1000 + 100 * x);
+        }
+    }
+    scmp->RegenerateNormalMap();
+
+    std::vector<std::uint8_t> blocks = TopLevel(scmp->normalMapData[0].Get());
+    std::vector<std::uint8_t> rgba(16u * 16u * 4u);
+    dds::decodeDxt5(blocks.data(), 16u, 16u, rgba.data());
+    NormalMap nm(16, 16);
+    UnpackNormals(rgba.data(), nm);
+
+    float slope = 100.0f * scmp->heightScale;
+    float n = std::sqrt(slope * slope + 1.0f);
+    for (std::size_t i = 0u; i < nm.x.size(); ++i)
+    {
+        CHECK(std::abs(nm.x[i] + slope / n) < 0.03f);
+        CHECK(std::abs(nm.y[i]) < 0.03f);
+    }
+}
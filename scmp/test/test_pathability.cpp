@@ -0,0 +1,148 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/markers.h"
+#include "scmp/pathability.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+// the slope and water depth of cell x, z as pathability.h defines them, worked out in doubles
+static void Cell(const Scmp &scmp, int x, int z, double &slope, double &depth)
+{
+    int corners[4] = { scmp.HeightMapAt(x, z), scmp.HeightMapAt(x + 1, z), scmp.HeightMapAt(x, z + 1), scmp.HeightMapAt(x + 1, z + 1) };
+    slope = (*std::max_element(corners, corners + 4) - *std::min_element(corners, corners + 4)) * double(scmp.heightScale);
+    double mean = (corners[0] + corners[1] + corners[2] + corners[3]) * double(scmp.heightScale) / 4.0;
+    bool water = scmp.waterShaderProperties && scmp.waterShaderProperties->hasWater;
+    depth = water ? scmp.waterShaderProperties->elevation - mean : -std::numeric_limits<double>::infinity();
+}
+
+
+static void CheckPathability(const Scmp &scmp, const PathabilityRules &rules, std::size_t &blocked)
+{
+    PathabilityGrid grid = ComputePathability(scmp, rules);
+    CHECK_EQUAL(grid.width, scmp.width);
+    CHECK_EQUAL(grid.height, scmp.height);
+    blocked = 0u;
+    for (int z = 0; z < scmp.height; ++z)
+    {
+        for (int x = 0; x < scmp.width; ++x)
+        {
+            double slope, depth;
+            Cell(scmp, x, z, slope, depth);
+            bool expected = slope > rules.maxSlope || depth > rules.maxWaterDepth;
+            CHECK_EQUAL(grid.Blocked(x, z), expected);
+            blocked += expected;
+        }
+    }
+    CHECK_EQUAL(grid.BlockedCount(), blocked);
+}
+
+
+TEST(PathabilityFollowsTheRules)
+{
+    // wider than a word, and not a whole number of them
+    std::shared_ptr<Scmp> scmp = MakeTestMap(96, 40);
+    std::size_t cells = 96u * 40u, blocked;
+
+    PathabilityRules rules;
+    CheckPathability(*scmp, rules, blocked);
+    CHECK(blocked > 0u && blocked < cells);
+
+    // limits on a whole number of raw height steps: exactly on one isn't over it
+    rules.maxSlope = 64.0f * scmp->heightScale;
+    rules.maxWaterDepth = 5.0f;
+    CheckPathability(*scmp, rules, blocked);
+    CHECK(blocked > 0u && blocked < cells);
+
+    rules.maxSlope = std::numeric_limits<float>::infinity();
+    rules.maxWaterDepth = std::numeric_limits<float>::infinity();
+    CheckPathability(*scmp, rules, blocked);
+    CHECK_EQUAL(blocked, 0u);
+
+    rules.maxSlope = -1.0f;
+    CheckPathability(*scmp, rules, blocked);
+    CHECK_EQUAL(blocked, cells);
+
+    // without water nothing is too deep
+    scmp->waterShaderProperties->hasWater = 0u;
+    rules = PathabilityRules();
+    rules.maxSlope = std::numeric_limits<float>::infinity();
+    rules.maxWaterDepth = -1000.0f;
+    CheckPathability(*scmp, rules, blocked);
+    CHECK_EQUAL(blocked, 0u);
+}
+
+
+TEST(PathabilityGridRoundTrips)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(72, 16);
+    PathabilityGrid grid = ComputePathability(*scmp);
+    std::stringstream ss;
+    grid.Save(ss);
+    PathabilityGrid loaded(ss);
+    CHECK_EQUAL(loaded.width, 72);
+    CHECK_EQUAL(loaded.height, 16);
+    CHECK_EQUAL(loaded.stride, 2);
+    CHECK(loaded.bits == grid.bits);
+
+    // cells off the grid are blocked, world positions floor to their cell
+    CHECK(loaded.Blocked(-1, 0) && loaded.Blocked(0, 16) && loaded.BlockedAt(72.0, 3.0) && loaded.BlockedAt(-0.5, 3.0));
+    CHECK_EQUAL(loaded.BlockedAt(5.9, 7.2), loaded.Blocked(5, 7));
+
+    std::stringstream garbage("not a grid");
+    CHECK_THROWS(PathabilityGrid bad(garbage), std::runtime_error);
+}
+
+
+TEST(TerrainTypesTakeTheFirstMatchingRule)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 48);
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    std::vector<TerrainTypeRule> rules;
+    rules.push_back(TerrainTypeRule(9u, 0.0f, 2.0f));
+    rules.push_back(TerrainTypeRule(5u, 1.0f));
+    RewriteTerrainTypes(*scmp, rules);
+
+    int counts[3] = { 0, 0, 0 };
+    for (int z = 0; z < 48; ++z)
+    {
+        for (int x = 0; x < 64; ++x)
+        {
+            double slope, depth;
+            Cell(*scmp, x, z, slope, depth);
+            std::size_t i = std::size_t(z) * 64u + x;
+            std::uint8_t expected = depth >= 2.0 ? 9u : slope >= 1.0 ? 5u : original->terrainTypeData.Get()[i];
+            CHECK_EQUAL(int(scmp->terrainTypeData.Get()[i]), int(expected));
+            ++counts[expected == 9u ? 0 : expected == 5u ? 1 : 2];
+        }
+    }
+    CHECK(counts[0] > 0 && counts[1] > 0 && counts[2] > 0);
+}
+
+
+TEST(BlockedMarkersAreOnBlockedCells)
+{
+    PathabilityGrid grid;
+    grid.width = grid.height = 64;
+    grid.stride = 1;
+    grid.bits.assign(64u, 0u);
+    grid.bits[20] = 1u << 10;
+
+    std::string lua =
+        "Scenario = { MasterChain = { ['_MASTERCHAIN_'] = { Markers = {\n"
+        "    ['free'] = { ['position'] = VECTOR3( 11.5, 0, 20.5 ) },\n"
+        "    ['blocked'] = { ['position'] = VECTOR3( 10.5, 0, 20.5 ) },\n"
+        "    ['off the map'] = { ['position'] = VECTOR3( 70, 0, 20 ) },\n"
+        "} } } }\n";
+    SaveLuaMarkers markers = SaveLuaMarkers::Parse(lua.data(), lua.data() + lua.size());
+    std::vector<std::size_t> blocked = BlockedMarkers(markers, grid);
+    CHECK_EQUAL(blocked.size(), 2u);
+    CHECK_EQUAL(markers.markers[blocked[0]].name, "blocked");
+    CHECK_EQUAL(markers.markers[blocked[1]].name, "off the map");
+}
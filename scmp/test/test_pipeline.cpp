@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include "scmp/pipeline.h"
+
+#include <atomic>
+
+using namespace nfa::scmp;
+
+
+TEST(PipelineRunsEveryStage)
+{
+    const std::size_t count = 20u;
+    std::vector<int> stages(count, 0);
+    std::size_t finished = 0u;
+    Pipeline pipeline;
+    pipeline.SetRead([&](std::size_t i) { stages[i] |= 1; return std::size_t(10u); }, 2u);
+    pipeline.SetCompute([&](std::size_t i) { stages[i] |= 2; }, 2u);
+    pipeline.SetWrite([&](std::size_t i) { stages[i] |= 4; if (i == 3u) throw std::runtime_error("write"); }, 2u);
+    std::vector<bool> failed(count, false);
+    pipeline.SetFinished([&](std::size_t i, std::exception_ptr error) { ++finished; failed[i] = bool(error); });
+
+    Pipeline::Stats stats = pipeline.Run(count);
+    CHECK_EQUAL(finished, count);
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+        CHECK_EQUAL(stages[i], 7);
+        CHECK_EQUAL(failed[i], i == 3u);
+    }
+    CHECK_EQUAL(stats.bytes, std::uint64_t(10u * count));
+    CHECK_EQUAL(stats.stages[Pipeline::WRITE].failures, std::size_t(1u));
+}
+
+
+TEST(PipelineKeepsToTheMemoryBudget)
+{
+    Pipeline pipeline;
+    pipeline.SetRead([&](std::size_t) { return std::size_t(60u); }, 1u);
+    pipeline.SetCompute([&](std::size_t) { }, 2u);
+    pipeline.SetWrite([&](std::size_t) { }, 1u);
+    pipeline.SetMemoryBudget(100u);
+
+    Pipeline::Stats stats = pipeline.Run(30u);
+    // a read waits while 100 bytes or more are held, so items of 60 are at most two at once.  (Each further reader
+    // could admit one more, whose bytes aren't known until it is read)
+    CHECK(stats.peakBytes <= 120u);
+    CHECK(stats.peakItems <= 2u);
+    CHECK_EQUAL(stats.stages[Pipeline::WRITE].items, std::size_t(30u));
+}
+
+
+TEST(PipelineCancels)
+{
+    std::atomic<std::size_t> reads(0u);
+    std::size_t finished = 0u;
+    Pipeline pipeline;
+    pipeline.SetRead([&](std::size_t) { ++reads; return std::size_t(1u); });
+    pipeline.SetCompute([&](std::size_t) { }, 1u);
+    pipeline.SetWrite([&](std::size_t) { });
+    pipeline.SetFinished([&](std::size_t, std::exception_ptr) { ++finished; });
+
+    CHECK_THROWS(pipeline.Run(1000u, [&](const std::string &, float) { return finished < 3u; }), Cancelled);
+    // the items in flight finish, but no more are read
+    CHECK(reads.load() < 1000u);
+    CHECK_EQUAL(finished, reads.load());
+}
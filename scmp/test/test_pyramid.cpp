@@ -0,0 +1,114 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(PyramidHalvesDownToMinSize)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 32);
+    HeightPyramid pyramid(*scmp, 16);
+    // 64 x 32 cells, 32 x 16, then 16 x 8
+    CHECK_EQUAL(pyramid.LevelCount(), 3);
+    CHECK_EQUAL(pyramid.Width(), 64);
+    CHECK_EQUAL(pyramid.Height(), 32);
+    CHECK_EQUAL(pyramid.HeightScale(), scmp->heightScale);
+
+    CHECK_EQUAL(pyramid.LevelFor(0.5f), 0);
+    CHECK_EQUAL(pyramid.LevelFor(1.9f), 0);
+    CHECK_EQUAL(pyramid.LevelFor(2.0f), 1);
+    CHECK_EQUAL(pyramid.LevelFor(5.0f), 2);
+    CHECK_EQUAL(pyramid.LevelFor(100.0f), 2);
+    CHECK_EQUAL(HeightPyramid(*scmp, 1).LevelCount(), 7);
+}
+
+
+TEST(PyramidSamplesAreTentFiltered)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    HeightPyramid pyramid(*scmp);
+
+    // level 0 is the heightmap, bilinear between its samples
+    for (int z = 0; z <= 64; z += 7)
+    {
+        for (int x = 0; x <= 64; x += 5)
+        {
+            CHECK_EQUAL(pyramid.Sample(0, float(x), float(z)), float(scmp->HeightMapAt(x, z)));
+        }
+    }
+    float mid = 0.5f * (float(scmp->HeightMapAt(10, 20)) + float(scmp->HeightMapAt(11, 20)));
+    CHECK(std::abs(pyramid.Sample(0, 10.5f, 20.0f) - mid) < 1e-3f);
+
+    // a level 1 sample is the [1 2 1] x [1 2 1] mean around the level 0 sample under it
+    for (int z = 2; z < 62; z += 6)
+    {
+        for (int x = 2; x < 62; x += 4)
+        {
+            float sum = 0.0f;
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    sum += float((2 - std::abs(dx)) * (2 - std::abs(dz)) * scmp->HeightMapAt(x + dx, z + dz));
+                }
+            }
+            CHECK(std::abs(pyramid.Sample(1, float(x), float(z)) - sum / 16.0f) <= 0.5f);
+        }
+    }
+
+    // and positions off the map clamp to its edge
+    CHECK_EQUAL(pyramid.Sample(2, -10.0f, 200.0f), pyramid.Sample(2, 0.0f, 64.0f));
+}
+
+
+TEST(FlatMapsStayFlat)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    std::vector<std::int16_t> &heights = scmp->heightMapData.Mutable();
+    std::fill(heights.begin(), heights.end(), std::int16_t(1000));
+    HeightPyramid pyramid(*scmp, 2);
+    for (int level = 0; level < pyramid.LevelCount(); ++level)
+    {
+        CHECK_EQUAL(pyramid.Sample(level, 13.3f, 7.9f), 1000.0f);
+    }
+}
+
+
+TEST(RenderPlacementTintsTheSource)
+{
+    std::shared_ptr<Scmp> target = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> source = MakeTestMap(32, 32, 2u);
+    HeightPyramid targetPyramid(*target), sourcePyramid(*source);
+
+    Placement placement;
+    placement.column0 = 16;
+    placement.row0 = 32;
+    placement.width = 32;
+    placement.height = 16;
+    std::vector<std::uint32_t> argb(32u * 32u);
+    RenderPlacement(&targetPyramid, &sourcePyramid, placement, 32, 32, argb.data());
+    for (int pz = 0; pz < 32; ++pz)
+    {
+        for (int px = 0; px < 32; ++px)
+        {
+            // pixels are two cells wide
+            bool inside = px >= 8 && px < 24 && pz >= 16 && pz < 24;
+            std::uint32_t p = argb[pz * 32 + px];
+            std::uint32_t r = (p >> 16) & 0xffu, g = (p >> 8) & 0xffu, b = p & 0xffu;
+            CHECK_EQUAL(p >> 24, 0xffu);
+            CHECK_EQUAL(inside, b < r);
+            CHECK(inside || (r == g && g == b));
+        }
+    }
+
+    // the source alone fills the image
+    std::fill(argb.begin(), argb.end(), 0u);
+    RenderPlacement(nullptr, &sourcePyramid, placement, 32, 32, argb.data());
+    CHECK(std::find(argb.begin(), argb.end(), 0u) == argb.end());
+}
@@ -0,0 +1,36 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include <string>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(ResizeReportsEachPhase)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    std::vector<std::string> phases;
+    float last = 0.0f;
+    scmp->Resize(64, 48, [&](const std::string &phase, float fraction)
+    {
+        CHECK(fraction > last && fraction <= 1.0f);
+        last = fraction;
+        phases.push_back(phase);
+        return true;
+    });
+    CHECK_EQUAL(phases.size(), 3u);
+    CHECK_EQUAL(last, 1.0f);
+    CHECK_EQUAL(scmp->width, 64);
+    CHECK_EQUAL(scmp->height, 48);
+}
+
+
+TEST(ResizeCancels)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    int calls = 0;
+    CHECK_THROWS(scmp->Resize(64, 64, [&](const std::string &, float) { ++calls; return false; }), Cancelled);
+    CHECK_EQUAL(calls, 1);
+    CHECK_EQUAL(scmp->width, 32);
+}
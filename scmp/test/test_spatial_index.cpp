@@ -0,0 +1,76 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/spatial_index.h"
+
+#include <random>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(GridQueriesMatchAScan)
+{
+    std::mt19937 random(3u);
+    std::uniform_real_distribution<float> position(-20.0f, 300.0f);
+    std::vector<float> x(2000u), z(2000u);
+    for (std::size_t i = 0u; i < x.size(); ++i)
+    {
+        x[i] = position(random);
+        z[i] = position(random);
+    }
+    // and some on top of each other
+    x[10] = x[11] = 5.0f;
+    z[10] = z[11] = 5.0f;
+
+    for (float cellSize : { 0.0f, 1.0f, 37.5f, 1000.0f })
+    {
+        SpatialGrid grid;
+        grid.Build(x, z, cellSize);
+        CHECK_EQUAL(grid.size(), x.size());
+        for (int query = 0; query < 50; ++query)
+        {
+            float qx = position(random), qz = position(random), size = 0.5f * float(query);
+            std::vector<std::uint32_t> inRectangle, inRadius, expectedRectangle, expectedRadius;
+            grid.QueryRectangle(qx, qz, qx + size, qz + 0.5f * size, inRectangle);
+            grid.QueryRadius(qx, qz, size, inRadius);
+            for (std::uint32_t i = 0u; i < x.size(); ++i)
+            {
+                if (x[i] >= qx && x[i] < qx + size && z[i] >= qz && z[i] < qz + 0.5f * size)
+                {
+                    expectedRectangle.push_back(i);
+                }
+                if ((x[i] - qx) * (x[i] - qx) + (z[i] - qz) * (z[i] - qz) <= size * size)
+                {
+                    expectedRadius.push_back(i);
+                }
+            }
+            CHECK(inRectangle == expectedRectangle);
+            CHECK(inRadius == expectedRadius);
+        }
+    }
+
+    SpatialGrid empty;
+    empty.Build(std::vector<float>(), std::vector<float>());
+    std::vector<std::uint32_t> none;
+    empty.QueryRadius(0.0f, 0.0f, 100.0f, none);
+    CHECK(none.empty());
+}
+
+
+TEST(MapItemQueries)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    std::vector<std::uint32_t> found, expected;
+    scmp->ItemsInRectangle(Scmp::LAYER_DECALS, 10.0f, 20.0f, 40.0f, 50.0f, found);
+    for (std::uint32_t i = 0u; i < scmp->decals.size(); ++i)
+    {
+        const float *p = scmp->decals.Get()[i]->position;
+        if (p[0] >= 10.0f && p[0] < 40.0f && p[2] >= 20.0f && p[2] < 50.0f)
+        {
+            expected.push_back(i);
+        }
+    }
+    CHECK(!expected.empty());
+    CHECK(found == expected);
+}
@@ -0,0 +1,102 @@
+#include "test.h"
+#include "test_maps.h"
+
+#include "scmp/layers.h"
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static std::size_t Asymmetric(const Scmp &scmp, Symmetry s, const std::string &layer)
+{
+    for (const LayerAsymmetry &asymmetry : scmp.MeasureSymmetry(s))
+    {
+        if (asymmetry.layer == layer)
+        {
+            return asymmetry.asymmetric;
+        }
+    }
+    throw TestFailure("no layer " + layer);
+}
+
+
+TEST(EnforcedSymmetryMeasuresSymmetric)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    for (int s = SYMMETRY_HORIZONTAL; s <= SYMMETRY_ROTATE_180; ++s)
+    {
+        std::shared_ptr<Scmp> scmp = original->Clone();
+        CHECK(Asymmetric(*scmp, Symmetry(s), "heightMapData") > 0u);
+        scmp->EnforceSymmetry(Symmetry(s));
+        for (const LayerAsymmetry &asymmetry : scmp->MeasureSymmetry(Symmetry(s)))
+        {
+            CHECK_EQUAL(asymmetry.layer + " " + std::to_string(asymmetry.asymmetric), asymmetry.layer + " 0");
+        }
+    }
+}
+
+
+TEST(MovedItemsMeasureAsymmetric)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+    scmp->EnforceSymmetry(SYMMETRY_HORIZONTAL);
+    CHECK_EQUAL(Asymmetric(*scmp, SYMMETRY_HORIZONTAL, "props"), std::size_t(0u));
+
+    // five props moved to one spot lose their mirror images, and so do the props they mirrored
+    std::vector<std::size_t> moved;
+    for (std::size_t i = 0u; i < scmp->props.size() && moved.size() < 5u; ++i)
+    {
+        if (scmp->props.Get()[i]->position[0] > 8.0f && scmp->props.Get()[i]->position[0] < 56.0f)
+        {
+            moved.push_back(i);
+        }
+    }
+    for (std::size_t i : moved)
+    {
+        scmp->props[i]->position[0] = 1.0f;
+        scmp->props[i]->position[2] = 1.0f;
+    }
+    scmp->InvalidateItemIndices();
+    CHECK_EQUAL(Asymmetric(*scmp, SYMMETRY_HORIZONTAL, "props"), std::size_t(10u));
+}
+
+
+TEST(EnforcedSymmetryTurnsTheNormals)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    for (int s = SYMMETRY_HORIZONTAL; s <= SYMMETRY_ROTATE_180; ++s)
+    {
+        std::shared_ptr<Scmp> mirrored = original->Clone();
+        mirrored->RegenerateNormalMap();
+        mirrored->EnforceSymmetry(Symmetry(s));
+        std::shared_ptr<Scmp> regenerated = original->Clone();
+        regenerated->EnforceSymmetry(Symmetry(s));
+        regenerated->RegenerateNormalMap();
+        CHECK(MeanNormalDifference(mirrored->normalMapData[0].Get(), regenerated->normalMapData[0].Get()) < 8.0);
+        CHECK_EQUAL(Asymmetric(*mirrored, Symmetry(s), "normalMapData[0]"), std::size_t(0u));
+    }
+}
+
+
+TEST(NormalsMeasureAsMirroredVectors)
+{
+    for (int s = SYMMETRY_HORIZONTAL; s <= SYMMETRY_ROTATE_180; ++s)
+    {
+        // the normals of symmetric heights are symmetric, but their texels aren't the same bytes mirrored
+        std::shared_ptr<Scmp> scmp = MakeTestMap(64, 64);
+        scmp->EnforceSymmetry(Symmetry(s));
+        scmp->RegenerateNormalMap();
+        CHECK_EQUAL(Asymmetric(*scmp, Symmetry(s), "normalMapData[0]"), std::size_t(0u));
+
+        LayerAsymmetry moved("moved");
+        MeasureDdsAsymmetry(SymmetrizeDds(scmp->normalMapData[0].Get(), Symmetry(s), false, false), Symmetry(s), moved, true);
+        CHECK(moved.asymmetric > 1000u);
+    }
+}
+
+
+TEST(DiagonalSymmetryNeedsASquareMap)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(64, 32);
+    CHECK_THROWS(scmp->EnforceSymmetry(SYMMETRY_DIAGONAL), std::runtime_error);
+}
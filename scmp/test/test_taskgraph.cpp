@@ -0,0 +1,80 @@
+#include "test.h"
+
+#include "scmp/taskgraph.h"
+
+#include <atomic>
+#include <mutex>
+
+using namespace nfa::scmp;
+
+
+TEST(TasksRunAfterTheirDependencies)
+{
+    // a diamond, a chain and some independent tasks
+    TaskGraph graph;
+    std::mutex mutex;
+    std::vector<TaskGraph::TaskId> order;
+    auto task = [&](TaskGraph::TaskId id)
+    {
+        return [&, id]()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(id);
+        };
+    };
+    TaskGraph::TaskId a = graph.Add("a", task(0u));
+    TaskGraph::TaskId b = graph.Add("b", task(1u), { a });
+    TaskGraph::TaskId c = graph.Add("c", task(2u), { a });
+    TaskGraph::TaskId d = graph.Add("d", task(3u), { b, c });
+    TaskGraph::TaskId e = graph.Add("e", task(4u), { d });
+    for (TaskGraph::TaskId i = 5u; i < 20u; ++i)
+    {
+        CHECK_EQUAL(graph.Add("independent", task(i)), i);
+    }
+
+    int calls = 0;
+    float last = 0.0f;
+    graph.Run([&](const std::string &, float fraction)
+    {
+        ++calls;
+        CHECK(fraction > last && fraction <= 1.0f);
+        last = fraction;
+        return true;
+    }, 4u);
+    CHECK_EQUAL(calls, 20);
+    CHECK_EQUAL(last, 1.0f);
+
+    CHECK_EQUAL(order.size(), 20u);
+    std::vector<std::size_t> position(20u);
+    for (std::size_t i = 0u; i < order.size(); ++i)
+    {
+        position[order[i]] = i;
+    }
+    CHECK(position[a] < position[b] && position[a] < position[c]);
+    CHECK(position[b] < position[d] && position[c] < position[d] && position[d] < position[e]);
+}
+
+
+TEST(FailedTaskStopsTheGraph)
+{
+    TaskGraph graph;
+    std::atomic<int> ran(0);
+    TaskGraph::TaskId first = graph.Add("fails", [&]() { ++ran; throw std::runtime_error("failed"); });
+    graph.Add("after", [&]() { ++ran; }, { first });
+    CHECK_THROWS(graph.Run(), std::runtime_error);
+    CHECK_EQUAL(ran.load(), 1);
+}
+
+
+TEST(CancelledGraphThrows)
+{
+    TaskGraph graph;
+    std::atomic<int> ran(0);
+    TaskGraph::TaskId previous = graph.Add("0", [&]() { ++ran; });
+    for (int i = 1; i < 5; ++i)
+    {
+        previous = graph.Add("chained", [&]() { ++ran; }, { previous });
+    }
+    CHECK_THROWS(graph.Run([](const std::string &, float) { return false; }), Cancelled);
+    CHECK_EQUAL(ran.load(), 1);
+}
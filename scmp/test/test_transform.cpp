@@ -0,0 +1,79 @@
+#include "test.h"
+#include "test_maps.h"
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static Orientation Inverse(Orientation o)
+{
+    return o == ORIENT_ROTATE_90 ? ORIENT_ROTATE_270 : o == ORIENT_ROTATE_270 ? ORIENT_ROTATE_90 : o;
+}
+
+
+// a and b the same, but for the normal maps: those are re-encoded each time the map turns, so they only come back
+// as close as encoding allows
+static void CheckSameTurnedMap(const Scmp &a, const Scmp &b)
+{
+    CheckSameMap(a, b, false);
+    CHECK(TopLevel(a.strataLerpData[0].Get()) == TopLevel(b.strataLerpData[0].Get()));
+    CHECK(TopLevel(a.waterLerpData[0].Get()) == TopLevel(b.waterLerpData[0].Get()));
+    CHECK(MeanNormalDifference(a.normalMapData[0].Get(), b.normalMapData[0].Get()) < 1.0);
+}
+
+
+TEST(OrientRoundTrips)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 32);
+    for (int o = ORIENT_FLIP_X; o <= ORIENT_ANTI_TRANSPOSE; ++o)
+    {
+        std::shared_ptr<Scmp> scmp = original->Clone();
+        scmp->Orient(Orientation(o));
+        CHECK_EQUAL(scmp->width, OrientSwapsAxes(Orientation(o)) ? 32 : 64);
+        scmp->Orient(Inverse(Orientation(o)));
+        CheckSameTurnedMap(*original, *scmp);
+    }
+}
+
+
+TEST(FourQuarterTurnsAreIdentity)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(32, 48);
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    for (int i = 0; i < 4; ++i)
+    {
+        scmp->Rotate90();
+    }
+    CheckSameTurnedMap(*original, *scmp);
+}
+
+
+TEST(OrientTurnsTheNormals)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 32);
+    for (int o = ORIENT_FLIP_X; o <= ORIENT_ANTI_TRANSPOSE; ++o)
+    {
+        std::shared_ptr<Scmp> turned = original->Clone();
+        turned->RegenerateNormalMap();
+        turned->Orient(Orientation(o));
+        std::shared_ptr<Scmp> regenerated = original->Clone();
+        regenerated->Orient(Orientation(o));
+        regenerated->RegenerateNormalMap();
+        // as close as encoding allows (about 5 when the axes swap, green having less precision than alpha).  Moving the
+        // texels without turning them is off by 40 or more
+        double difference = MeanNormalDifference(turned->normalMapData[0].Get(), regenerated->normalMapData[0].Get());
+        CHECK(difference < 8.0);
+    }
+}
+
+
+TEST(CropThenPadRestoresTheInside)
+{
+    std::shared_ptr<Scmp> original = MakeTestMap(64, 64);
+    std::shared_ptr<Scmp> scmp = original->Clone();
+    scmp->Pad(8, 16, 24, 0);
+    CHECK_EQUAL(scmp->width, 96);
+    CHECK_EQUAL(scmp->height, 80);
+    scmp->Crop(8, 16, 64, 64);
+    CheckSameMap(*original, *scmp);
+}
@@ -0,0 +1,21 @@
+#include "test.h"
+#include "test_maps.h"
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+TEST(ValidateFindsBrokenLayers)
+{
+    std::shared_ptr<Scmp> scmp = MakeTestMap(32, 32);
+    std::vector<std::string> errors, warnings;
+    scmp->Validate(errors, warnings);
+    CHECK(errors.empty());
+    CHECK(warnings.empty());
+
+    scmp->heightMapData.Mutable().pop_back();
+    scmp->heightScale = 0.0f;
+    scmp->normalMapData[0].resize(64u);
+    scmp->Validate(errors, warnings);
+    CHECK_EQUAL(errors.size(), 3u);
+}
@@ -0,0 +1,273 @@
+#include "image.h"
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+#include "taskgraph.h"
+
+#include "nfa_gl/DdsFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        template<typename T>
+        static void OrientGrid(CowVector<T> &data, int W, int H, Orientation o)
+        {
+            if (data.size() != std::size_t(W) * H || data.empty())
+            {
+                return;
+            }
+            std::vector<T> oriented(data.size());
+            const T *source = data.Get().data();
+            ParallelForRows(OrientSwapsAxes(o) ? W : H, [&](int row0, int row1)
+            {
+                OrientImage(source, oriented.data(), W, H, o, row0, row1);
+            });
+            data = std::move(oriented);
+        }
+
+
+        template<typename T>
+        static void CropGrid(CowVector<T> &data, int W, int H, int x0, int z0, int newW, int newH)
+        {
+            if (data.size() != std::size_t(W) * H || data.empty())
+            {
+                return;
+            }
+            std::vector<T> cropped(std::size_t(newW) * newH);
+            const T *source = data.Get().data();
+            ParallelForRows(newH, [&](int row0, int row1)
+            {
+                CropImage(source, W, H, cropped.data(), x0, z0, newW, row0, row1);
+            });
+            data = std::move(cropped);
+        }
+
+
+        // a map distance in cells as texels of a texture textureSize wide on a mapSize wide map
+        static int CellsToTexels(int cells, unsigned textureSize, int mapSize)
+        {
+            return int(std::floor(0.5 + double(cells) * double(textureSize) / double(mapSize)));
+        }
+
+
+        template<typename T>
+        static void CropItems(CowVector< std::shared_ptr<T> > &items, float x0, float z0, float W, float H)
+        {
+            if (items.empty())
+            {
+                return;
+            }
+            std::vector< std::shared_ptr<T> > &v = items.Mutable();
+            for (auto &item : v)
+            {
+                item->position[0] -= x0;
+                item->position[2] -= z0;
+            }
+            v.erase(std::remove_if(v.begin(), v.end(), [W, H](const std::shared_ptr<T> &item)
+            {
+                return !(item->position[0] >= 0.0f && item->position[0] <= W && item->position[2] >= 0.0f && item->position[2] <= H);
+            }), v.end());
+        }
+
+
+        void Scmp::Orient(Orientation o)
+        {
+            if (o == ORIENT_IDENTITY)
+            {
+                return;
+            }
+
+            EditScope edit(*this, "Orient");
+            int W = width, H = height;
+
+            TaskGraph tasks;
+            tasks.Add("heightMapData", [&]()
+            {
+                OrientGrid(heightMapData, W + 1, H + 1, o);
+            });
+            tasks.Add("terrainTypeData", [&]()
+            {
+                OrientGrid(terrainTypeData, W, H, o);
+            });
+            tasks.Add("masks", [&]()
+            {
+                for (CowVector<std::uint8_t> *mask : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask })
+                {
+                    int divisor;
+                    if (MaskDivisor(mask->size(), W, H, divisor))
+                    {
+                        OrientGrid(*mask, W / divisor, H / divisor, o);
+                    }
+                }
+            });
+
+            auto orientDds = [o](CowVector<std::uint8_t> &data, bool normals)
+            {
+                if (!data.empty())
+                {
+                    data = OrientDds(data.Get(), o, normals);
+                }
+            };
+            tasks.Add("previewImageData", [&]()
+            {
+                orientDds(previewImageData, false);
+            });
+            for (auto layers : { &normalMapData, &strataLerpData, &waterLerpData })
+            {
+                for (std::size_t n = 0u; n < layers->size(); ++n)
+                {
+                    tasks.Add(layers == &normalMapData ? "normalMapData" : layers == &strataLerpData ? "strataLerpData" : "waterLerpData",
+                        [&, layers, n]()
+                    {
+                        orientDds((*layers)[n], layers == &normalMapData);
+                    });
+                }
+            }
+
+            tasks.Add("items", [&]()
+            {
+                for (auto wg : waveGenerators)
+                {
+                    OrientItem(*wg, o, W, H);
+                }
+                for (auto d : decals)
+                {
+                    OrientItem(*d, o, W, H);
+                }
+                for (auto p : props)
+                {
+                    OrientItem(*p, o, W, H);
+                }
+                InvalidateItemIndices();
+            });
+
+            tasks.Run();
+
+            if (OrientSwapsAxes(o))
+            {
+                std::swap(width, height);
+                std::swap(widthOther, heightOther);
+            }
+        }
+
+
+        void Scmp::Crop(int column0, int row0, int newWidth, int newHeight)
+        {
+            if (newWidth <= 0 || newHeight <= 0)
+            {
+                throw std::runtime_error("Crop: the area kept is empty");
+            }
+            // the masks are stored at half resolution, with no room for an odd row or column
+            if (newWidth % 2 != 0 || newHeight % 2 != 0)
+            {
+                throw std::runtime_error("Crop: width and height must be even");
+            }
+
+            EditScope edit(*this, "Crop");
+            int W = width, H = height;
+
+            TaskGraph tasks;
+            tasks.Add("heightMapData", [&]()
+            {
+                CropGrid(heightMapData, W + 1, H + 1, column0, row0, newWidth + 1, newHeight + 1);
+            });
+            tasks.Add("terrainTypeData", [&]()
+            {
+                CropGrid(terrainTypeData, W, H, column0, row0, newWidth, newHeight);
+            });
+            tasks.Add("masks", [&]()
+            {
+                for (CowVector<std::uint8_t> *mask : { &waterFoamMask, &waterFlatnessMask, &waterDepthBiasMask })
+                {
+                    int divisor;
+                    if (MaskDivisor(mask->size(), W, H, divisor))
+                    {
+                        int x0 = int(std::floor(double(column0) / divisor)), z0 = int(std::floor(double(row0) / divisor));
+                        CropGrid(*mask, W / divisor, H / divisor, x0, z0, std::max(1, newWidth / divisor), std::max(1, newHeight / divisor));
+                    }
+                }
+            });
+
+            for (auto layers : { &normalMapData, &strataLerpData, &waterLerpData })
+            {
+                for (std::size_t n = 0u; n < layers->size(); ++n)
+                {
+                    tasks.Add(layers == &normalMapData ? "normalMapData" : layers == &strataLerpData ? "strataLerpData" : "waterLerpData",
+                        [&, layers, n]()
+                    {
+                        CowVector<std::uint8_t> &data = (*layers)[n];
+                        if (data.empty())
+                        {
+                            return;
+                        }
+                        dds::DdsFile dds(data.Get().data(), data.size());
+                        int x0 = CellsToTexels(column0, dds.width(), W), z0 = CellsToTexels(row0, dds.height(), H);
+                        int texelsWide = std::max(1, CellsToTexels(newWidth, dds.width(), W));
+                        int texelsHigh = std::max(1, CellsToTexels(newHeight, dds.height(), H));
+                        data = CropDds(data.Get(), x0, z0, texelsWide, texelsHigh);
+                    });
+                }
+            }
+
+            tasks.Add("items", [&]()
+            {
+                CropItems(waveGenerators, float(column0), float(row0), float(newWidth), float(newHeight));
+                CropItems(decals, float(column0), float(row0), float(newWidth), float(newHeight));
+                CropItems(props, float(column0), float(row0), float(newWidth), float(newHeight));
+                InvalidateItemIndices();
+            });
+
+            tasks.Run();
+
+            widthOther = widthOther * newWidth / W;
+            heightOther = heightOther * newHeight / H;
+            width = newWidth;
+            height = newHeight;
+
+            // the preview shows the whole map, so it is drawn again rather than cut
+            RenderPreview();
+        }
+
+
+        void Scmp::Pad(int left, int top, int right, int bottom)
+        {
+            Crop(-left, -top, width + left + right, height + top + bottom);
+        }
+
+
+        void Scmp::Flip(Axis axis)
+        {
+            Orient(axis == AXIS_X ? ORIENT_FLIP_X : ORIENT_FLIP_Z);
+        }
+
+
+        void Scmp::Rotate90()
+        {
+            Orient(ORIENT_ROTATE_90);
+        }
+
+
+        void Scmp::Rotate180()
+        {
+            Orient(ORIENT_ROTATE_180);
+        }
+
+
+        void Scmp::Rotate270()
+        {
+            Orient(ORIENT_ROTATE_270);
+        }
+
+
+        void Scmp::Transpose()
+        {
+            Orient(ORIENT_TRANSPOSE);
+        }
+
+    }
+}
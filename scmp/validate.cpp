@@ -0,0 +1,125 @@
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+
+#include <cmath>
+#include <sstream>
+
+
+namespace nfa {
+    namespace scmp {
+
+        static void ValidateDds(const std::string &name, const std::vector<std::uint8_t> &data, bool dxt5Only,
+            std::vector<std::string> &errors)
+        {
+            try
+            {
+                dds::DdsTexture texture = dds::DdsTexture::parse(data.data(), data.size());
+                if (dxt5Only && texture.format != dds::FORMAT_DXT5)
+                {
+                    errors.push_back(name + " is " + dds::formatName(texture.format) + ", expected DXT5");
+                }
+            }
+            catch (const std::exception &e)
+            {
+                errors.push_back(name + ": " + e.what());
+            }
+        }
+
+
+        template<typename T>
+        static void ValidateItems(const char *name, const std::vector<std::shared_ptr<T> > &items, int width, int height,
+            std::vector<std::string> &warnings)
+        {
+            std::size_t invalid = 0u, outside = 0u;
+            for (const auto &item : items)
+            {
+                const float *p = item->position;
+                if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2]))
+                {
+                    ++invalid;
+                }
+                else if (p[0] < 0.0f || p[0] > float(width) || p[2] < 0.0f || p[2] > float(height))
+                {
+                    ++outside;
+                }
+            }
+            if (invalid > 0u)
+            {
+                std::ostringstream ss;
+                ss << invalid << ' ' << name << " have non-finite positions";
+                warnings.push_back(ss.str());
+            }
+            if (outside > 0u)
+            {
+                std::ostringstream ss;
+                ss << outside << ' ' << name << " are outside the map";
+                warnings.push_back(ss.str());
+            }
+        }
+
+
+        void Scmp::Validate(std::vector<std::string> &errors, std::vector<std::string> &warnings) const
+        {
+            std::size_t cells = std::size_t(std::max(width, 0)) * std::size_t(std::max(height, 0));
+            if (width <= 0 || height <= 0)
+            {
+                errors.push_back("map size is not positive");
+            }
+            else if ((width & (width - 1)) || (height & (height - 1)))
+            {
+                warnings.push_back("map size is not a power of two");
+            }
+
+            if (heightMapData.size() != std::size_t(width + 1) * std::size_t(height + 1))
+            {
+                errors.push_back("heightMapData is not (width+1) x (height+1)");
+            }
+            if (!std::isfinite(heightScale) || heightScale <= 0.0f)
+            {
+                errors.push_back("heightScale is not positive");
+            }
+
+            ValidateDds("previewImageData", previewImageData, false, errors);
+            for (const auto &nm : normalMapData)
+            {
+                ValidateDds("normalMapData", nm, true, errors);
+            }
+            for (const auto &lerp : strataLerpData)
+            {
+                ValidateDds("strataLerpData", lerp, false, errors);
+            }
+            for (const auto &lerp : waterLerpData)
+            {
+                ValidateDds("waterLerpData", lerp, false, errors);
+            }
+
+            // Resize assumes every mask covers the map at a whole, square, divisor of its resolution
+            const std::pair<const char*, const CowVector<std::uint8_t>*> masks[] = {
+                std::make_pair("waterFoamMask", &waterFoamMask),
+                std::make_pair("waterFlatnessMask", &waterFlatnessMask),
+                std::make_pair("waterDepthBiasMask", &waterDepthBiasMask),
+                std::make_pair("terrainTypeData", &terrainTypeData) };
+            for (const auto &mask : masks)
+            {
+                std::size_t size = mask.second->size();
+                std::size_t divisor = size > 0u ? cells / size : 0u;
+                std::size_t side = std::size_t(std::sqrt(double(divisor)) + 0.5);
+                if (cells > 0u && (size == 0u || divisor * size != cells || side * side != divisor))
+                {
+                    errors.push_back(std::string(mask.first) + " does not cover the map at a square divisor of its size");
+                }
+            }
+
+            if (!waterShaderProperties)
+            {
+                errors.push_back("waterShaderProperties missing");
+            }
+
+            ValidateItems("wave generators", waveGenerators.Get(), width, height, warnings);
+            ValidateItems("decals", decals.Get(), width, height, warnings);
+            ValidateItems("props", props.Get(), width, height, warnings);
+        }
+
+    }
+}
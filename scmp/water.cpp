@@ -0,0 +1,262 @@
+#include "layers.h"
+#include "parallel.h"
+#include "scmp.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "nfa_gl/DxtCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+
+namespace nfa {
+    namespace scmp {
+
+        // the squared distance of a texel with no land in reach: far beyond any map, yet finite so differences of it
+        // stay numbers
+        static const float FAR_AWAY = 1e20f;
+
+
+        // Felzenszwalb and Huttenlocher's distance transform of n samples: d[q] = min over p of (q - p)^2 + f[p], from the
+        // lower envelope of the parabolas rooted at each f[p], in one pass each way.  v and z are scratch of n and n + 1
+        static void SquaredDistance(const float *f, int n, float *d, int *v, float *z)
+        {
+            int k = 0;
+            v[0] = 0;
+            z[0] = -FAR_AWAY;
+            z[1] = FAR_AWAY;
+            for (int q = 1; q < n; ++q)
+            {
+                // where the parabola of q crosses the envelope's last; z[0] is below any crossing, so k stops at 0
+                auto crossing = [&](int p)
+                {
+                    return ((f[q] + float(q) * float(q)) - (f[p] + float(p) * float(p))) / float(2 * (q - p));
+                };
+                float s = crossing(v[k]);
+                while (s <= z[k])
+                {
+                    --k;
+                    s = crossing(v[k]);
+                }
+                ++k;
+                v[k] = q;
+                z[k] = s;
+                z[k + 1] = FAR_AWAY;
+            }
+
+            k = 0;
+            for (int q = 0; q < n; ++q)
+            {
+                while (z[k + 1] < float(q))
+                {
+                    ++k;
+                }
+                float dq = float(q - v[k]);
+                d[q] = dq * dq + f[v[k]];
+            }
+        }
+
+
+        namespace {
+
+            // the depth ramp and shore foam of a layer TW x TH texels
+            struct WaterField
+            {
+                std::vector<std::uint8_t> depth;
+                std::vector<std::uint8_t> foam;
+            };
+        }
+
+
+        static WaterField DrawWaterField(const Scmp &scmp, int TW, int TH, float shoreWidth)
+        {
+            WaterField field;
+            field.depth.assign(std::size_t(TW) * TH, 0u);
+            field.foam.assign(std::size_t(TW) * TH, 0u);
+            if (!scmp.waterShaderProperties || !scmp.waterShaderProperties->hasWater)
+            {
+                return field;
+            }
+
+            const WaterShaderProperties &water = *scmp.waterShaderProperties;
+            float surface = water.elevation;
+            float shallowRange = std::max(water.elevation - water.elevationDeep, 1e-6f);
+            float deepRange = std::max(water.elevationDeep - water.elevationAbyss, 1e-6f);
+            float texelCells = float(scmp.width) / float(TW);
+            float foamScale = texelCells / std::max(shoreWidth, 1e-6f);
+            std::vector<float> heights = DownsampleHeights(scmp, TW, TH);
+
+            // distance in texels from each texel to the nearest land texel of its column, by a sweep down and one back
+            // up, each along whole rows of a band of columns.  The rows then take the squared distance to the nearest
+            // land anywhere from the lower envelope of their columns' distances
+            float noLand = std::sqrt(FAR_AWAY);
+            std::vector<float> column(std::size_t(TW) * TH);
+            ParallelForRows(TW, [&](int column0, int column1)
+            {
+                for (int x = column0; x < column1; ++x)
+                {
+                    column[x] = heights[x] < surface ? noLand : 0.0f;
+                }
+                for (int row = 1; row < TH; ++row)
+                {
+                    const float *h = heights.data() + std::size_t(TW) * row;
+                    const float *above = column.data() + std::size_t(TW) * (row - 1);
+                    float *g = column.data() + std::size_t(TW) * row;
+                    for (int x = column0; x < column1; ++x)
+                    {
+                        // noLand + 1 rounds back to noLand
+                        g[x] = h[x] < surface ? above[x] + 1.0f : 0.0f;
+                    }
+                }
+                for (int row = TH - 2; row >= 0; --row)
+                {
+                    const float *below = column.data() + std::size_t(TW) * (row + 1);
+                    float *g = column.data() + std::size_t(TW) * row;
+                    for (int x = column0; x < column1; ++x)
+                    {
+                        float up = below[x] + 1.0f;
+                        g[x] = up < g[x] ? up : g[x];
+                    }
+                }
+            }, 16);
+
+            ParallelForRows(TH, [&](int row0, int row1)
+            {
+                std::vector<float> f(TW), d(TW), z(TW + 1);
+                std::vector<int> v(TW);
+                for (int row = row0; row < row1; ++row)
+                {
+                    std::size_t offset = std::size_t(TW) * row;
+                    const float *g = column.data() + offset;
+                    for (int x = 0; x < TW; ++x)
+                    {
+                        f[x] = g[x] * g[x];
+                    }
+                    SquaredDistance(f.data(), TW, d.data(), v.data(), z.data());
+                    const float *h = heights.data() + offset;
+                    std::uint8_t *depth = field.depth.data() + offset;
+                    std::uint8_t *foam = field.foam.data() + offset;
+                    for (int x = 0; x < TW; ++x)
+                    {
+                        // the shoreline lies half way between the centres of a land and a water texel
+                        float shore = 1.0f - (std::sqrt(d[x]) - 0.5f) * foamScale;
+                        shore = shore < 1.0f ? shore : 1.0f;
+                        shore = shore > 0.0f && d[x] > 0.0f ? shore : 0.0f;
+                        foam[x] = std::uint8_t(int(shore * 255.0f + 0.5f));
+
+                        float below = surface - h[x];
+                        float ramp = below < shallowRange ? 0.5f * below / shallowRange : 0.5f + 0.5f * (below - shallowRange) / deepRange;
+                        ramp = ramp > 0.0f ? ramp : 0.0f;
+                        ramp = ramp < 1.0f ? ramp : 1.0f;
+                        depth[x] = std::uint8_t(int(ramp * 255.0f + 0.5f));
+                    }
+                }
+            });
+            return field;
+        }
+
+
+        // DXT5, or BGRA or BGR pixels
+        static bool WaterLerpFormatSupported(const dds::DdsFile &dds)
+        {
+            return dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+                ((dds.glDataFormat() == GL_BGRA || dds.glDataFormat() == GL_BGR) && dds.bytesPerPixel() >= 3u);
+        }
+
+
+        void Scmp::RegenerateWaterMasks(float shoreWidth)
+        {
+            if (width <= 0 || height <= 0 || heightMapData.size() != std::size_t(width + 1) * (height + 1))
+            {
+                return;
+            }
+
+            // every texture is checked before anything changes, so an unsupported one leaves the map as it was
+            for (const auto &data : waterLerpData)
+            {
+                if (!data.empty() && !WaterLerpFormatSupported(dds::DdsFile(data.Get().data(), data.size())))
+                {
+                    throw std::runtime_error("waterLerpData: unsupported dds format, cannot regenerate");
+                }
+            }
+
+            EditScope edit(*this, "RegenerateWaterMasks");
+            // the masks and the lerp texture are usually all half the map's size, so draw each size once
+            std::map<std::pair<int, int>, WaterField> fields;
+            auto field = [&](int TW, int TH) -> const WaterField &
+            {
+                auto found = fields.find(std::make_pair(TW, TH));
+                if (found == fields.end())
+                {
+                    found = fields.insert(std::make_pair(std::make_pair(TW, TH), DrawWaterField(*this, TW, TH, shoreWidth))).first;
+                }
+                return found->second;
+            };
+
+            int divisor;
+            if (MaskDivisor(waterFoamMask.size(), width, height, divisor))
+            {
+                waterFoamMask = field(width / divisor, height / divisor).foam;
+            }
+            if (MaskDivisor(waterFlatnessMask.size(), width, height, divisor))
+            {
+                std::vector<std::uint8_t> flatness = field(width / divisor, height / divisor).foam;
+                for (std::uint8_t &f : flatness)
+                {
+                    f = std::uint8_t(255u - f);
+                }
+                waterFlatnessMask = std::move(flatness);
+            }
+            if (MaskDivisor(waterDepthBiasMask.size(), width, height, divisor))
+            {
+                waterDepthBiasMask = field(width / divisor, height / divisor).depth;
+            }
+
+            for (auto &data : waterLerpData)
+            {
+                if (data.empty())
+                {
+                    continue;
+                }
+                DropMipmaps(data);
+                dds::DdsFile dds(data.data(), data.size());
+                int TW = dds.width();
+                int TH = dds.height();
+                const std::vector<std::uint8_t> &depth = field(TW, TH).depth;
+
+                std::size_t imageBytes;
+                std::uint8_t *image = (std::uint8_t*)dds.getMutable(imageBytes);
+                if (dds.glDataFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                {
+                    // bands of whole block rows, each decoded, given its new green and encoded again
+                    std::vector<std::uint8_t> rgba(4u * TW * TH);
+                    dds::decodeDxt5(image, TW, TH, rgba.data());
+                    ParallelForRows((TH + 3) / 4, [&](int blockRow0, int blockRow1)
+                    {
+                        int row0 = 4 * blockRow0;
+                        int row1 = std::min(4 * blockRow1, TH);
+                        for (std::size_t i = std::size_t(TW) * row0; i < std::size_t(TW) * row1; ++i)
+                        {
+                            rgba[4u * i + 1u] = depth[i];
+                        }
+                        dds::encodeDxt5Region(rgba.data(), TW, TH, image, 0, row0, TW, row1);
+                    }, 4);
+                }
+                else
+                {
+                    std::size_t bytesPerPixel = dds.bytesPerPixel();
+                    ParallelForRows(TH, [&](int row0, int row1)
+                    {
+                        for (std::size_t i = std::size_t(TW) * row0; i < std::size_t(TW) * row1; ++i)
+                        {
+                            image[bytesPerPixel * i + 1u] = depth[i];
+                        }
+                    });
+                }
+            }
+        }
+
+    }
+}
@@ -0,0 +1,451 @@
+#include "commands.h"
+#include "files.h"
+
+#include "nfa_gl/DdsFile.h"
+#include "scmp/filters.h"
+#include "scmp/io.h"
+#include "scmp/lua.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+
+std::string JsonString(const std::string &s)
+{
+    std::string result = "\"";
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20u)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+                result += escaped;
+            }
+            else
+            {
+                result += c;
+            }
+        }
+    }
+    return result + "\"";
+}
+
+
+// JSON has no NaN or infinity
+static std::string JsonNumber(double value)
+{
+    if (!std::isfinite(value))
+    {
+        return "null";
+    }
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+
+static std::string JsonArray(const std::vector<std::string> &strings)
+{
+    std::string result = "[";
+    for (std::size_t i = 0u; i < strings.size(); ++i)
+    {
+        result += (i ? "," : "") + JsonString(strings[i]);
+    }
+    return result + "]";
+}
+
+
+std::string Result::ToJson() const
+{
+    std::ostringstream ss;
+    ss << "{\"file\":" << JsonString(file) << ",\"command\":" << JsonString(command)
+        << ",\"ok\":" << (ok ? "true" : "false") << ",\"seconds\":" << JsonNumber(seconds);
+    if (!error.empty())
+    {
+        ss << ",\"error\":" << JsonString(error);
+    }
+    if (!output.empty())
+    {
+        ss << ",\"output\":" << JsonString(output);
+    }
+    if (!errors.empty() || command == "validate")
+    {
+        ss << ",\"errors\":" << JsonArray(errors);
+    }
+    if (!warnings.empty() || command == "validate")
+    {
+        ss << ",\"warnings\":" << JsonArray(warnings);
+    }
+    if (!info.empty())
+    {
+        ss << ",\"info\":" << info;
+    }
+    ss << '}';
+    return ss.str();
+}
+
+
+static std::shared_ptr<nfa::scmp::Scmp> LoadScmp(const std::string &filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs.good())
+    {
+        throw std::runtime_error("unable to open " + filename);
+    }
+    return std::make_shared<nfa::scmp::Scmp>(ifs);
+}
+
+
+// write to a temporary beside filename, so an interrupted batch never leaves a truncated map behind
+static void SaveScmp(nfa::scmp::Scmp &scmp, const std::string &filename)
+{
+    std::string temp = filename + ".tmp";
+    {
+        std::ofstream ofs(temp.c_str(), std::ios::binary);
+        scmp.Save(ofs);
+        if (!ofs.good())
+        {
+            ofs.close();
+            std::remove(temp.c_str());
+            throw std::runtime_error("unable to write " + filename);
+        }
+    }
+    ReplaceFile(temp, filename);
+}
+
+
+static std::string DdsDescription(const std::vector<std::uint8_t> &data)
+{
+    try
+    {
+        dds::DdsTexture texture = dds::DdsTexture::parse(data.data(), data.size());
+        std::ostringstream ss;
+        ss << dds::formatName(texture.format) << ' ' << texture.width << 'x' << texture.height;
+        return ss.str();
+    }
+    catch (const std::exception &e)
+    {
+        return e.what();
+    }
+}
+
+
+Batch::Batch(const Options &options, const std::vector<std::string> &filenames) :
+    m_options(options),
+    m_writes(false),
+    m_outputIsDirectory(false),
+    m_xscale(1.0),
+    m_zscale(1.0)
+{
+    const std::string &command = options.command;
+    if (command != "info" && command != "validate" && command != "convert" && command != "rescale" && command != "import")
+    {
+        throw std::runtime_error("unknown command " + command);
+    }
+
+    m_writes = command == "convert" || command == "rescale" || command == "import";
+    if (m_writes)
+    {
+        if (options.output.empty())
+        {
+            throw std::runtime_error(command + " needs an output: -o directory, or -o file.scmap for a single map");
+        }
+        m_outputIsDirectory = IsDirectory(options.output);
+        if (!m_outputIsDirectory && filenames.size() > 1u)
+        {
+            throw std::runtime_error("-o " + options.output + " is not a directory, but there are several maps");
+        }
+
+        // maps of the same name from different directories would overwrite each other's output, and race on its .tmp.
+        // Names are compared ignoring case, as they are on Windows
+        std::map<std::string, std::string> written;
+        for (const std::string &filename : filenames)
+        {
+            std::string output = OutputFilename(filename);
+            std::transform(output.begin(), output.end(), output.begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+            auto inserted = written.insert(std::make_pair(output, filename));
+            if (!inserted.second)
+            {
+                throw std::runtime_error(inserted.first->second + " and " + filename + " would both be written to " +
+                    OutputFilename(filename));
+            }
+        }
+    }
+
+    if (command == "rescale" && (options.width <= 0 || options.height <= 0))
+    {
+        throw std::runtime_error("rescale needs --size N or --size WxH");
+    }
+
+    if (command == "import")
+    {
+        if (options.source.empty())
+        {
+            throw std::runtime_error("import needs --source map.scmap");
+        }
+
+        // the source is resized once here and shared, read only, by every worker
+        m_source = LoadScmp(options.source);
+        int width = options.width > 0 ? options.width : m_source->width;
+        int height = options.height > 0 ? options.height : m_source->height;
+        m_xscale = double(width) / double(m_source->width);
+        m_zscale = double(height) / double(m_source->height);
+        if (width != m_source->width || height != m_source->height)
+        {
+            m_source->Resize(width, height);
+        }
+
+        std::string saveLua = MapLuaFilenames(options.source).save;
+        if (FileExists(saveLua))
+        {
+            m_sourceSaveLua.reset(new nfa::scmp::MappedFile(saveLua));
+            m_sourceMarkers = nfa::scmp::SaveLuaMarkers::Load(
+                m_sourceSaveLua->begin(), m_sourceSaveLua->end(), nfa::scmp::MarkerCacheFilename(saveLua));
+        }
+    }
+}
+
+
+std::size_t Batch::Read(Job &job) const
+{
+    job.start = std::chrono::steady_clock::now();
+
+    std::ifstream ifs(job.filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!ifs.good())
+    {
+        throw std::runtime_error("unable to open " + job.filename);
+    }
+    job.bytes.resize(std::size_t(ifs.tellg()));
+    ifs.seekg(0);
+    if (!job.bytes.empty() && !ifs.read(&job.bytes[0], job.bytes.size()))
+    {
+        throw std::runtime_error("unable to read " + job.filename);
+    }
+    return job.bytes.size();
+}
+
+
+void Batch::Compute(Job &job) const
+{
+    {
+        nfa::scmp::MemoryStreamBuf buffer(job.bytes.data(), job.bytes.data() + job.bytes.size());
+        std::istream is(&buffer);
+        job.scmp = std::make_shared<nfa::scmp::Scmp>(is);
+    }
+    std::vector<char>().swap(job.bytes);
+
+    nfa::scmp::Scmp &scmp = *job.scmp;
+    if (m_options.command == "info")
+    {
+        Info(scmp, job.result);
+    }
+    else if (m_options.command == "validate")
+    {
+        scmp.Validate(job.result.errors, job.result.warnings);
+    }
+    else if (m_options.command == "convert")
+    {
+        Convert(scmp);
+    }
+    else if (m_options.command == "rescale")
+    {
+        Rescale(job);
+    }
+    else if (m_options.command == "import")
+    {
+        Import(scmp);
+    }
+
+    if (!m_writes)
+    {
+        job.scmp.reset();
+    }
+}
+
+
+void Batch::Write(Job &job) const
+{
+    if (!m_writes)
+    {
+        return;
+    }
+
+    job.result.output = OutputFilename(job.filename);
+    SaveScmp(*job.scmp, job.result.output);
+    if (m_options.command == "rescale")
+    {
+        WriteRescaledLua(job);
+    }
+    else if (m_options.command == "import")
+    {
+        WriteImportedLua(job);
+    }
+    job.scmp.reset();
+}
+
+
+void Batch::Info(const nfa::scmp::Scmp &scmp, Result &result) const
+{
+    auto minmax = std::minmax_element(scmp.heightMapData.begin(), scmp.heightMapData.end());
+    bool hasHeights = !scmp.heightMapData.empty();
+
+    std::ostringstream ss;
+    ss << "{\"version\":" << JsonString(std::to_string(scmp.versionMajor) + "." + std::to_string(scmp.versionMinor))
+        << ",\"width\":" << scmp.width
+        << ",\"height\":" << scmp.height
+        << ",\"heightScale\":" << JsonNumber(scmp.heightScale)
+        << ",\"minHeight\":" << (hasHeights ? JsonNumber(*minmax.first * scmp.heightScale) : "null")
+        << ",\"maxHeight\":" << (hasHeights ? JsonNumber(*minmax.second * scmp.heightScale) : "null")
+        << ",\"preview\":" << JsonString(DdsDescription(scmp.previewImageData))
+        << ",\"normalMaps\":" << scmp.normalMapData.size();
+    if (!scmp.normalMapData.empty())
+    {
+        ss << ",\"normalMap\":" << JsonString(DdsDescription(scmp.normalMapData.front()));
+    }
+    if (scmp.waterShaderProperties)
+    {
+        ss << ",\"hasWater\":" << (scmp.waterShaderProperties->hasWater ? "true" : "false")
+            << ",\"waterElevation\":" << JsonNumber(scmp.waterShaderProperties->elevation);
+    }
+    ss << ",\"terrainShader\":" << JsonString(scmp.terrainShader)
+        << ",\"waveGenerators\":" << scmp.waveGenerators.size()
+        << ",\"decals\":" << scmp.decals.size()
+        << ",\"props\":" << scmp.props.size()
+        << '}';
+    result.info = ss.str();
+}
+
+
+void Batch::Convert(nfa::scmp::Scmp &scmp) const
+{
+    if (m_options.normals)
+    {
+        scmp.RegenerateNormalMap();
+    }
+    if (m_options.water)
+    {
+        scmp.RegenerateWaterMasks();
+    }
+    if (m_options.preview)
+    {
+        scmp.RenderPreview();
+    }
+}
+
+
+void Batch::Rescale(Job &job) const
+{
+    job.xscale = double(m_options.width) / double(job.scmp->width);
+    job.zscale = double(m_options.height) / double(job.scmp->height);
+    job.scmp->Resize(m_options.width, m_options.height);
+    if (m_options.smooth > 0.0f)
+    {
+        nfa::scmp::GaussianBlurHeights(*job.scmp, m_options.smooth);
+    }
+    if (m_options.water)
+    {
+        job.scmp->RegenerateWaterMasks();
+    }
+    job.scmp->RenderPreview();
+}
+
+
+void Batch::Import(nfa::scmp::Scmp &scmp) const
+{
+    scmp.Import(*m_source, m_options.atX, m_options.atZ, m_options.additive);
+    scmp.RenderPreview();
+}
+
+
+void Batch::WriteRescaledLua(Job &job) const
+{
+    const nfa::scmp::Scmp &scmp = *job.scmp;
+    MapLuaFilenames source(job.filename), target(job.result.output);
+    if (FileExists(source.save))
+    {
+        std::string cacheFilename = nfa::scmp::MarkerCacheFilename(source.save);
+        nfa::scmp::RewriteLuaFile(source.save, target.save,
+            [&](const char *begin, const char *end, std::ostream &os)
+        {
+            nfa::scmp::SaveLuaMarkers markers = nfa::scmp::SaveLuaMarkers::Load(begin, end, cacheFilename);
+            nfa::scmp::RescaleSaveLua(begin, end, markers, os, job.xscale, job.zscale, 0.0, 0.0, scmp);
+        });
+    }
+    else
+    {
+        job.result.warnings.push_back("no " + source.save + ", markers not rescaled");
+    }
+
+    if (FileExists(source.scenario))
+    {
+        nfa::scmp::RewriteLuaFile(source.scenario, target.scenario,
+            [&](const char *begin, const char *end, std::ostream &os)
+        {
+            nfa::scmp::UpdateScenarioLua(begin, end, os, scmp);
+        });
+    }
+    if (source.script != target.script && FileExists(source.script))
+    {
+        CopyFileTo(source.script, target.script);
+    }
+}
+
+
+void Batch::WriteImportedLua(Job &job) const
+{
+    // the map's size is unchanged, so only _save.lua needs more than a copy
+    const nfa::scmp::Scmp &scmp = *job.scmp;
+    MapLuaFilenames source(job.filename), target(job.result.output);
+    if (FileExists(source.save))
+    {
+        if (m_sourceSaveLua)
+        {
+            std::string cacheFilename = nfa::scmp::MarkerCacheFilename(source.save);
+            nfa::scmp::RewriteLuaFile(source.save, target.save,
+                [&](const char *begin, const char *end, std::ostream &os)
+            {
+                nfa::scmp::SaveLuaMarkers markers = nfa::scmp::SaveLuaMarkers::Load(begin, end, cacheFilename);
+                nfa::scmp::ApplyLuaPatches(begin, end, nfa::scmp::MergeMarkerPatches(
+                    m_sourceSaveLua->begin(), m_sourceMarkers, begin, markers,
+                    m_xscale, m_zscale, m_options.atX, m_options.atZ, m_source->width, m_source->height, scmp), os);
+            });
+        }
+        else
+        {
+            job.result.warnings.push_back("no _save.lua beside " + m_options.source + ", markers not imported");
+            if (source.save != target.save)
+            {
+                CopyFileTo(source.save, target.save);
+            }
+        }
+    }
+    if (source.scenario != target.scenario && FileExists(source.scenario))
+    {
+        CopyFileTo(source.scenario, target.scenario);
+    }
+    if (source.script != target.script && FileExists(source.script))
+    {
+        CopyFileTo(source.script, target.script);
+    }
+}
+
+
+std::string Batch::OutputFilename(const std::string &filename) const
+{
+    return m_outputIsDirectory ? JoinPath(m_options.output, FileName(filename)) : m_options.output;
+}
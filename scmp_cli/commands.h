@@ -0,0 +1,108 @@
+#pragma once
+
+#include "scmp/markers.h"
+#include "scmp/mapped_file.h"
+#include "scmp/scmp.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Options
+{
+    Options() : jobs(1u), readers(1u), writers(1u), memoryBudget(0u), width(0), height(0), atX(0), atZ(0),
+        additive(false), normals(false), preview(false), water(false), smooth(0.0f) { }
+
+    std::string command;            // info, validate, convert, rescale or import
+    std::vector<std::string> inputs;
+    std::string output;             // -o: a directory, or a file name when there is one input
+    unsigned jobs;                  // -j: maps computed at once
+    unsigned readers;               // --readers: maps read at once
+    unsigned writers;               // --writers: maps written at once
+    std::uint64_t memoryBudget;     // --memory: bytes of maps in flight before reads wait.  0 for no limit
+    int width;                      // --size: rescale to / resize the import source to
+    int height;
+    std::string source;             // --source: the map imported into each input
+    int atX;                        // --at: where the source lands, in heightmap cells
+    int atZ;
+    bool additive;                  // --additive: add the source's heights to the input's
+    bool normals;                   // --normals: regenerate normal maps on convert
+    bool preview;                   // --preview: redraw the preview image on convert
+    bool water;                     // --water: redraw the water masks from the heights on convert or rescale
+    float smooth;                   // --smooth: gaussian blur the rescaled heights by this sigma, in cells.  0 for none
+};
+
+
+// The outcome of one command on one map, written as a line of JSON
+struct Result
+{
+    Result() : ok(false), seconds(0.0) { }
+
+    std::string ToJson() const;
+
+    std::string file;
+    std::string command;
+    bool ok;
+    double seconds;
+    std::string error;              // why the command failed, if it did
+    std::string output;             // the .scmap written, if any
+    std::vector<std::string> errors;
+    std::vector<std::string> warnings;
+    std::string info;               // a JSON object, for info
+};
+
+
+// One map on its way through the batch
+struct Job
+{
+    Job() : xscale(1.0), zscale(1.0) { }
+
+    std::string filename;
+    std::chrono::steady_clock::time_point start;
+    std::vector<char> bytes;                        // the .scmap as read, until parsed
+    std::shared_ptr<nfa::scmp::Scmp> scmp;          // parsed and processed, until written
+    double xscale;                                  // rescale: the change in size, for the lua files
+    double zscale;
+    Result result;
+};
+
+
+// One command applied to many maps, in three steps that a Pipeline overlaps: Read loads a file's bytes, Compute parses
+// and processes them, and Write saves the map and its lua files.  Construction checks the options against the maps to
+// be processed (filenames) and loads anything shared by every map (the import source); the steps are then safe to call
+// from several threads at once
+class Batch
+{
+public:
+    Batch(const Options &options, const std::vector<std::string> &filenames);
+
+    std::size_t Read(Job &job) const;       // returns the bytes read
+    void Compute(Job &job) const;
+    void Write(Job &job) const;
+
+    // where the map read from filename is written
+    std::string OutputFilename(const std::string &filename) const;
+
+private:
+    void Info(const nfa::scmp::Scmp &scmp, Result &result) const;
+    void Convert(nfa::scmp::Scmp &scmp) const;
+    void Rescale(Job &job) const;
+    void Import(nfa::scmp::Scmp &scmp) const;
+    void WriteRescaledLua(Job &job) const;
+    void WriteImportedLua(Job &job) const;
+
+    Options m_options;
+    bool m_writes;
+    bool m_outputIsDirectory;
+
+    // import only
+    std::shared_ptr<nfa::scmp::Scmp> m_source;
+    double m_xscale;
+    double m_zscale;
+    std::unique_ptr<nfa::scmp::MappedFile> m_sourceSaveLua;
+    nfa::scmp::SaveLuaMarkers m_sourceMarkers;
+};
+
+
+std::string JsonString(const std::string &s);
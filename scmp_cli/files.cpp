@@ -0,0 +1,251 @@
+#include "files.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+
+static bool IsSeparator(char c)
+{
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+
+static std::size_t LastSeparator(const std::string &path)
+{
+    for (std::size_t i = path.size(); i > 0u; --i)
+    {
+        if (IsSeparator(path[i - 1u]))
+        {
+            return i - 1u;
+        }
+    }
+    return std::string::npos;
+}
+
+
+// names of the entries of directory, without "." and "..".  empty if it can't be read
+static std::vector<std::string> ListDirectory(const std::string &directory)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(JoinPath(directory, "*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return names;
+    }
+    do
+    {
+        names.push_back(data.cFileName);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return names;
+    }
+    while (dirent *entry = readdir(dir))
+    {
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+    names.erase(std::remove_if(names.begin(), names.end(), [](const std::string &name)
+    {
+        return name == "." || name == "..";
+    }), names.end());
+    return names;
+}
+
+
+static void FindMaps(const std::string &directory, std::vector<std::string> &result)
+{
+    for (const std::string &name : ListDirectory(directory))
+    {
+        std::string path = JoinPath(directory, name);
+        if (IsDirectory(path))
+        {
+            FindMaps(path, result);
+        }
+        else if (WildcardMatch("*.scmap", name.c_str()))
+        {
+            result.push_back(path);
+        }
+    }
+}
+
+
+std::vector<std::string> ExpandInputs(const std::vector<std::string> &inputs)
+{
+    std::vector<std::string> result;
+    for (const std::string &input : inputs)
+    {
+        std::string pattern = FileName(input);
+        if (IsDirectory(input))
+        {
+            FindMaps(input, result);
+        }
+        else if (pattern.find_first_of("*?") != std::string::npos)
+        {
+            std::string directory = DirectoryName(input);
+            for (const std::string &name : ListDirectory(directory))
+            {
+                std::string path = JoinPath(directory, name);
+                if (WildcardMatch(pattern.c_str(), name.c_str()) && !IsDirectory(path))
+                {
+                    result.push_back(path);
+                }
+            }
+        }
+        else
+        {
+            result.push_back(input);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+
+bool WildcardMatch(const char *pattern, const char *name)
+{
+    // greedy with a single backtrack point: the last * seen absorbs one more character on each mismatch
+    const char *star = NULL, *resume = NULL;
+    while (*name)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            resume = name;
+        }
+        else if (*pattern == '?' || std::tolower((unsigned char)*pattern) == std::tolower((unsigned char)*name))
+        {
+            ++pattern;
+            ++name;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            name = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        ++pattern;
+    }
+    return *pattern == 0;
+}
+
+
+bool IsDirectory(const std::string &path)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+
+bool FileExists(const std::string &path)
+{
+    return std::ifstream(path.c_str(), std::ios::binary).good() && !IsDirectory(path);
+}
+
+
+std::string JoinPath(const std::string &directory, const std::string &name)
+{
+    if (directory.empty() || directory == ".")
+    {
+        return name;
+    }
+    return IsSeparator(directory.back()) ? directory + name : directory + "/" + name;
+}
+
+
+std::string FileName(const std::string &path)
+{
+    std::size_t sep = LastSeparator(path);
+    return sep == std::string::npos ? path : path.substr(sep + 1u);
+}
+
+
+std::string DirectoryName(const std::string &path)
+{
+    std::size_t sep = LastSeparator(path);
+    if (sep == std::string::npos)
+    {
+        return ".";
+    }
+    return sep == 0u ? path.substr(0u, 1u) : path.substr(0u, sep);
+}
+
+
+MapLuaFilenames::MapLuaFilenames(const std::string &scmapFilename)
+{
+    std::string name = FileName(scmapFilename);
+    std::string base = JoinPath(DirectoryName(scmapFilename), name.substr(0u, name.find('.')));
+    save = base + "_save.lua";
+    scenario = base + "_scenario.lua";
+    script = base + "_script.lua";
+}
+
+
+void CopyFileTo(const std::string &source, const std::string &target)
+{
+    std::ifstream is(source.c_str(), std::ios::binary);
+    if (!is.good())
+    {
+        throw std::runtime_error("unable to open " + source);
+    }
+
+    std::string temp = target + ".tmp";
+    {
+        std::ofstream os(temp.c_str(), std::ios::binary);
+        os << is.rdbuf();
+        if (!os.good())
+        {
+            os.close();
+            std::remove(temp.c_str());
+            throw std::runtime_error("unable to write " + target);
+        }
+    }
+    ReplaceFile(temp, target);
+}
+
+
+void ReplaceFile(const std::string &temp, const std::string &target)
+{
+    // rename won't replace an existing file on windows
+    std::remove(target.c_str());
+    if (std::rename(temp.c_str(), target.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw std::runtime_error("unable to replace " + target);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Filesystem helpers for scmp_cli.  Paths are narrow strings throughout, as in the scmp library
+
+// Expand the command line inputs to a sorted list of .scmap files.  A directory contributes every .scmap beneath it; a
+// path whose last component holds * or ? contributes the matching files of its directory; anything else is taken as is
+std::vector<std::string> ExpandInputs(const std::vector<std::string> &inputs);
+
+// * matches any run of characters, ? any one character.  Case-insensitive, as the game's file names are
+bool WildcardMatch(const char *pattern, const char *name);
+
+bool IsDirectory(const std::string &path);
+bool FileExists(const std::string &path);
+std::string JoinPath(const std::string &directory, const std::string &name);
+std::string FileName(const std::string &path);              // last component
+std::string DirectoryName(const std::string &path);         // everything before the last component, or "."
+
+// The lua files that accompany a map: <dir>/<name>_save.lua etc, where <name> is the map's file name up to its first '.'
+struct MapLuaFilenames
+{
+    explicit MapLuaFilenames(const std::string &scmapFilename);
+
+    std::string save;
+    std::string scenario;
+    std::string script;
+};
+
+// Copy source to target, replacing target.  Throws std::runtime_error on failure
+void CopyFileTo(const std::string &source, const std::string &target);
+
+// Rename temp over target, replacing target.  Throws std::runtime_error on failure
+void ReplaceFile(const std::string &temp, const std::string &target);
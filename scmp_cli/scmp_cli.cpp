@@ -0,0 +1,240 @@
+#include "commands.h"
+#include "files.h"
+
+#include "scmp/parallel.h"
+#include "scmp/pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+
+static const char *usage =
+    "usage: scmp_cli <command> [options] <map.scmap | directory | pattern>...\n"
+    "\n"
+    "commands:\n"
+    "  info                             print the size, formats and item counts of each map\n"
+    "  validate                         check each map's structure; fails on errors, reports warnings\n"
+    "  convert  -o OUT [--normals] [--preview] [--water]\n"
+    "                                   re-save each map, regenerating its normal map, preview and/or water masks\n"
+    "  rescale  -o OUT --size N|WxH [--smooth SIGMA] [--water]\n"
+    "                                   resize each map, rescaling its _save.lua and _scenario.lua, blur the\n"
+    "                                   stair steps out of its heights by SIGMA cells and redraw its water masks\n"
+    "  import   -o OUT --source MAP --at X,Z [--size WxH] [--additive]\n"
+    "                                   import MAP, resized to WxH, into each map at X,Z, merging markers\n"
+    "\n"
+    "options:\n"
+    "  -j N          process N maps at once (default 1).  each map's own work is spread over the remaining cores\n"
+    "  --readers N   read N maps at once (default 1)\n"
+    "  --writers N   write N maps at once (default 1)\n"
+    "  --memory MB   hold back reads while the maps in flight take more than MB of file data (default no limit)\n"
+    "  -o OUT        an existing directory, or a file name when there is a single map\n"
+    "\n"
+    "a directory stands for every .scmap beneath it; a pattern may use * and ? in its last component.\n"
+    "reading, processing and writing overlap; per stage statistics are written to stderr at the end.\n"
+    "one JSON object is written to stdout per map.  exit status is 0 if every map succeeded, 1 if any failed, 2 on bad usage\n";
+
+
+static int ParseInt(const std::string &s, const std::string &option)
+{
+    std::istringstream ss(s);
+    int value;
+    if (!(ss >> value) || !ss.eof())
+    {
+        throw std::runtime_error(option + " expects a number, not " + s);
+    }
+    return value;
+}
+
+
+static float ParseFloat(const std::string &s, const std::string &option)
+{
+    std::istringstream ss(s);
+    float value;
+    if (!(ss >> value) || !ss.eof())
+    {
+        throw std::runtime_error(option + " expects a number, not " + s);
+    }
+    return value;
+}
+
+
+// "a<sep>b" => a, b.  "a" => a, a if sep is 'x', else an error
+static void ParsePair(const std::string &s, char sep, const std::string &option, int &a, int &b)
+{
+    std::size_t pos = s.find(sep);
+    if (pos == std::string::npos && sep == 'x')
+    {
+        a = b = ParseInt(s, option);
+        return;
+    }
+    if (pos == std::string::npos)
+    {
+        throw std::runtime_error(option + " expects two numbers separated by " + std::string(1, sep) + ", not " + s);
+    }
+    a = ParseInt(s.substr(0u, pos), option);
+    b = ParseInt(s.substr(pos + 1u), option);
+}
+
+
+static Options ParseOptions(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::runtime_error("no command");
+    }
+
+    Options options;
+    options.command = argv[1];
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error(arg + " expects a value");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-j")
+        {
+            options.jobs = unsigned(std::max(1, ParseInt(value(), arg)));
+        }
+        else if (arg == "--readers")
+        {
+            options.readers = unsigned(std::max(1, ParseInt(value(), arg)));
+        }
+        else if (arg == "--writers")
+        {
+            options.writers = unsigned(std::max(1, ParseInt(value(), arg)));
+        }
+        else if (arg == "--memory")
+        {
+            options.memoryBudget = std::uint64_t(std::max(0, ParseInt(value(), arg))) << 20;
+        }
+        else if (arg == "-o")
+        {
+            options.output = value();
+        }
+        else if (arg == "--size")
+        {
+            ParsePair(value(), 'x', arg, options.width, options.height);
+        }
+        else if (arg == "--smooth")
+        {
+            options.smooth = std::max(0.0f, ParseFloat(value(), arg));
+        }
+        else if (arg == "--source")
+        {
+            options.source = value();
+        }
+        else if (arg == "--at")
+        {
+            ParsePair(value(), ',', arg, options.atX, options.atZ);
+        }
+        else if (arg == "--additive")
+        {
+            options.additive = true;
+        }
+        else if (arg == "--normals")
+        {
+            options.normals = true;
+        }
+        else if (arg == "--preview")
+        {
+            options.preview = true;
+        }
+        else if (arg == "--water")
+        {
+            options.water = true;
+        }
+        else if (arg.size() > 1u && arg[0] == '-')
+        {
+            throw std::runtime_error("unknown option " + arg);
+        }
+        else
+        {
+            options.inputs.push_back(arg);
+        }
+    }
+    return options;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::vector<std::string> filenames;
+    std::unique_ptr<Batch> batch;
+    try
+    {
+        options = ParseOptions(argc, argv);
+        filenames = ExpandInputs(options.inputs);
+        if (filenames.empty())
+        {
+            throw std::runtime_error("no maps given");
+        }
+        batch.reset(new Batch(options, filenames));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "scmp_cli: " << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    // maps in parallel, and each map's row bands over what is left of the cores
+    unsigned jobs = std::min<unsigned>(options.jobs, unsigned(filenames.size()));
+    nfa::scmp::SetWorkerCount(std::max(1u, nfa::scmp::WorkerCount() / jobs));
+
+    std::vector<Job> batchJobs(filenames.size());
+    for (std::size_t i = 0u; i < filenames.size(); ++i)
+    {
+        batchJobs[i].filename = filenames[i];
+        batchJobs[i].result.file = filenames[i];
+        batchJobs[i].result.command = options.command;
+    }
+
+    std::size_t failed = 0u;
+    nfa::scmp::Pipeline pipeline;
+    pipeline.SetRead([&](std::size_t i) { return batch->Read(batchJobs[i]); }, options.readers);
+    pipeline.SetCompute([&](std::size_t i) { batch->Compute(batchJobs[i]); }, jobs);
+    pipeline.SetWrite([&](std::size_t i) { batch->Write(batchJobs[i]); }, options.writers);
+    pipeline.SetMemoryBudget(options.memoryBudget);
+    pipeline.SetFinished([&](std::size_t i, std::exception_ptr error)
+    {
+        Job &job = batchJobs[i];
+        std::vector<char>().swap(job.bytes);
+        job.scmp.reset();
+        if (error)
+        {
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const std::exception &e)
+            {
+                job.result.error = e.what();
+            }
+            catch (...)
+            {
+                job.result.error = "unknown error";
+            }
+        }
+        job.result.ok = !error && job.result.errors.empty();
+        job.result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.start).count();
+        if (!job.result.ok)
+        {
+            ++failed;
+        }
+        std::cout << job.result.ToJson() << std::endl;
+    });
+
+    nfa::scmp::Pipeline::Stats stats = pipeline.Run(batchJobs.size());
+    std::cerr << filenames.size() << " maps, " << failed << " failed" << std::endl;
+    nfa::scmp::ReportPipelineStats(stats, std::cerr);
+    return failed > 0u ? 1 : 0;
+}
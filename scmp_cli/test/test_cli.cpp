@@ -0,0 +1,104 @@
+#include "scmp/test/test.h"
+#include "scmp/test/test_maps.h"
+
+#include "../commands.h"
+#include "../files.h"
+
+#include <fstream>
+
+using namespace nfa::scmp;
+using namespace nfa::scmp::test;
+
+
+static Options ConvertOptions(const std::string &output)
+{
+    Options options;
+    options.command = "convert";
+    options.output = output;
+    return options;
+}
+
+
+static std::vector<std::string> Inputs(std::size_t count)
+{
+    std::vector<std::string> inputs;
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+        inputs.push_back("maps/" + std::to_string(i) + ".scmap");
+    }
+    return inputs;
+}
+
+
+TEST(OutputNamedInDirectory)
+{
+    Batch batch(ConvertOptions("out"), Inputs(2u));
+    CHECK_EQUAL(batch.OutputFilename("maps/a.scmap"), std::string("out/a.scmap"));
+    CHECK_EQUAL(batch.OutputFilename("b.scmap"), std::string("out/b.scmap"));
+}
+
+
+TEST(OutputNamedAsFile)
+{
+    Batch batch(ConvertOptions("out/renamed.scmap"), Inputs(1u));
+    CHECK_EQUAL(batch.OutputFilename("maps/a.scmap"), std::string("out/renamed.scmap"));
+    CHECK_THROWS(Batch(ConvertOptions("out/renamed.scmap"), Inputs(2u)), std::runtime_error);
+    CHECK_THROWS(Batch(ConvertOptions(""), Inputs(1u)), std::runtime_error);
+}
+
+
+TEST(DuplicateOutputsAreRefused)
+{
+    std::vector<std::string> inputs;
+    inputs.push_back("maps/a/setons.scmap");
+    inputs.push_back("maps/b/Setons.SCMAP");
+    CHECK_THROWS(Batch(ConvertOptions("out"), inputs), std::runtime_error);
+    inputs.pop_back();
+    inputs.push_back("maps/b/other.scmap");
+    Batch batch(ConvertOptions("out"), inputs);
+    // info and validate write nothing, so any names will do
+    Options options = ConvertOptions("");
+    options.command = "validate";
+    inputs.push_back("maps/c/setons.scmap");
+    Batch validate(options, inputs);
+}
+
+
+TEST(LuaFilesFollowTheMap)
+{
+    MapLuaFilenames lua("maps/dir/name.v0002.scmap");
+    CHECK_EQUAL(lua.save, std::string("maps/dir/name_save.lua"));
+    CHECK_EQUAL(lua.scenario, std::string("maps/dir/name_scenario.lua"));
+    CHECK_EQUAL(lua.script, std::string("maps/dir/name_script.lua"));
+}
+
+
+TEST(WildcardsMatchCaseInsensitively)
+{
+    CHECK(WildcardMatch("*.scmap", "Setons.SCMAP"));
+    CHECK(WildcardMatch("a?c*", "abcdef"));
+    CHECK(!WildcardMatch("*.scmap", "setons.scmap.tmp"));
+}
+
+
+TEST(ConvertWritesTheMap)
+{
+    {
+        std::ofstream os("in.scmap", std::ios::binary);
+        os << MakeTestMapBytes(32, 32);
+    }
+    Options options = ConvertOptions("out");
+    options.normals = true;
+    Batch batch(options, std::vector<std::string>(1u, "in.scmap"));
+    Job job;
+    job.filename = "in.scmap";
+    batch.Read(job);
+    batch.Compute(job);
+    batch.Write(job);
+    CHECK_EQUAL(job.result.output, std::string("out/in.scmap"));
+
+    std::ifstream is("out/in.scmap", std::ios::binary);
+    Scmp written(is);
+    CHECK_EQUAL(written.width, 32);
+    CHECK_EQUAL(written.props.size(), std::size_t(100u));
+}
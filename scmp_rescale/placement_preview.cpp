@@ -0,0 +1,93 @@
+#include "placement_preview.h"
+
+#include <qpainter.h>
+
+#include <algorithm>
+
+
+PlacementPreview::PlacementPreview(QWidget *parent) :
+    QWidget(parent),
+    m_dirty(true)
+{
+}
+
+
+void PlacementPreview::setMaps(std::shared_ptr<const nfa::scmp::HeightPyramid> target, std::shared_ptr<const nfa::scmp::HeightPyramid> source)
+{
+    if (target != m_target || source != m_source)
+    {
+        m_target = target;
+        m_source = source;
+        m_dirty = true;
+        update();
+    }
+}
+
+
+void PlacementPreview::setPlacement(const nfa::scmp::Placement &placement)
+{
+    if (placement.column0 != m_placement.column0 || placement.row0 != m_placement.row0 ||
+        placement.width != m_placement.width || placement.height != m_placement.height ||
+        placement.additive != m_placement.additive)
+    {
+        m_placement = placement;
+        m_dirty = true;
+        update();
+    }
+}
+
+
+QRect PlacementPreview::imageRect() const
+{
+    const nfa::scmp::HeightPyramid *map = m_target ? m_target.get() : m_source.get();
+    if (!map || map->Width() <= 0 || map->Height() <= 0)
+    {
+        return QRect();
+    }
+
+    double scale = std::min(double(width()) / double(map->Width()), double(height()) / double(map->Height()));
+    int w = std::max(1, int(scale * map->Width()));
+    int h = std::max(1, int(scale * map->Height()));
+    return QRect((width() - w) / 2, (height() - h) / 2, w, h);
+}
+
+
+void PlacementPreview::resizeEvent(QResizeEvent *event)
+{
+    m_dirty = true;
+    QWidget::resizeEvent(event);
+}
+
+
+void PlacementPreview::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().color(QPalette::Dark));
+
+    QRect r = imageRect();
+    if (r.isEmpty())
+    {
+        painter.drawText(rect(), Qt::AlignCenter, "no map");
+        return;
+    }
+
+    if (m_dirty || m_image.size() != r.size())
+    {
+        m_image = QImage(r.size(), QImage::Format_RGB32);
+        nfa::scmp::RenderPlacement(m_target.get(), m_source.get(), m_placement,
+            m_image.width(), m_image.height(), (std::uint32_t*)m_image.bits());
+        m_dirty = false;
+    }
+    painter.drawImage(r.topLeft(), m_image);
+
+    // outline the imported area, even where it hangs off the target
+    if (m_target && m_source && m_placement.width > 0 && m_placement.height > 0)
+    {
+        double sx = double(r.width()) / double(m_target->Width());
+        double sz = double(r.height()) / double(m_target->Height());
+        QRectF area(r.left() + sx * m_placement.column0, r.top() + sz * m_placement.row0,
+            sx * m_placement.width, sz * m_placement.height);
+        painter.setPen(QPen(Qt::yellow, 1.0));
+        painter.drawRect(area);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "scmp/pyramid.h"
+
+#include <qimage.h>
+#include <qwidget.h>
+
+#include <memory>
+
+
+// Thumbnail of the target map with the source drawn where the import would put it.  Draws from the maps' height
+// pyramids, so moving the placement re-renders only a widget sized image
+class PlacementPreview : public QWidget
+{
+public:
+    PlacementPreview(QWidget *parent = 0);
+
+    // either may be null: without a target the source is drawn alone
+    void setMaps(std::shared_ptr<const nfa::scmp::HeightPyramid> target, std::shared_ptr<const nfa::scmp::HeightPyramid> source);
+    void setPlacement(const nfa::scmp::Placement &placement);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    QRect imageRect() const;        // the map's extent within the widget, keeping its aspect ratio
+
+    std::shared_ptr<const nfa::scmp::HeightPyramid> m_target;
+    std::shared_ptr<const nfa::scmp::HeightPyramid> m_source;
+    nfa::scmp::Placement m_placement;
+    QImage m_image;
+    bool m_dirty;
+};
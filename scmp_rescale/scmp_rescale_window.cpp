@@ -1,17 +1,23 @@
 #include "scmp_rescale_window.h"
 
+#include "scmp/lua.h"
+#include "scmp/mapped_file.h"
+#include "scmp/markers.h"
+#include "scmp/pyramid.h"
 #include "scmp/scmp.h"
+#include "scmp/scmp_cache.h"
 
+#include <qevent.h>
 #include <qfiledialog.h>
 #include <qfileinfo.h>
 #include <qmessagebox.h>
 #include <qstandardpaths.h>
+#include <qtconcurrentrun.h>
 
 #include <algorithm>
 #include <fstream>
 #include <functional>
 #include <iostream>
-#include <regex>
 #include <sstream>
 
 
@@ -59,26 +65,6 @@ std::map<QString, QString>  GetMapLuaFileNames(const QString &scmapFilename)
 }
 
 
-void ModifyLines(std::istream &is, std::ostream &os,
-    std::function< void(std::ostream &, std::string &, const std::vector<std::string> &) > f)
-{
-    std::string line;
-    std::regex r("([a-zA-Z]+|[+-]?([0-9]*[.])?[0-9]+)");
-
-    while (!is.eof())
-    {
-        std::getline(is, line);
-
-        std::vector<std::string> keywords;
-        for (auto it = std::sregex_iterator(line.begin(), line.end(), r); it != std::sregex_iterator(); ++it)
-        {
-            keywords.push_back(it->str());
-        }
-        f(os, line, keywords);
-    }
-}
-
-
 void RescaleMapSaveFile(
     QString sourceFilename, QString targetFilename,
     double xscale, double zscale, double xofs, double zofs, nfa::scmp::Scmp *scmp)
@@ -88,39 +74,44 @@ void RescaleMapSaveFile(
         return;
     }
 
-    std::ostringstream oss;
+    BackupFile(targetFilename);
+    std::string cacheFilename = nfa::scmp::MarkerCacheFilename(sourceFilename.toLatin1().data());
+    nfa::scmp::RewriteLuaFile(sourceFilename.toLatin1().data(), targetFilename.toLatin1().data(),
+        [xscale, zscale, xofs, zofs, scmp, cacheFilename](const char *begin, const char *end, std::ostream &os)
     {
-        std::ifstream ifs(sourceFilename.toLatin1().data());
+        nfa::scmp::SaveLuaMarkers markers = nfa::scmp::SaveLuaMarkers::Load(begin, end, cacheFilename);
+        nfa::scmp::RescaleSaveLua(begin, end, markers, os, xscale, zscale, xofs, zofs, *scmp);
+    });
+}
 
-        ModifyLines(ifs, oss, [xscale, zscale, xofs, zofs, scmp](std::ostream &s, std::string &line, const std::vector<std::string> &kws)
-        {
-            if (kws.size() == 6 && kws[0] == "position" && kws[1] == "VECTOR" && kws[2] == "3")
-            {
-                double x = std::atof(kws[3].c_str()) * xscale + xofs;
-                double z = std::atof(kws[5].c_str()) * zscale + zofs;
-                double y = scmp->heightScale * scmp->HeightMapAt(x, z);
-                s << "['position'] = VECTOR3( " << x << ", " << y << ", " << z << " ),\n";
-            }
-            else if (kws.size() == 6 && kws[0] == "rectangle" && kws[1] == "RECTANGLE")
-            {
-                double xmin = std::atof(kws[2].c_str()) * xscale + xofs;
-                double zmin = std::atof(kws[3].c_str()) * zscale + zofs;
-                double xmax = std::atof(kws[4].c_str()) * xscale + xofs;
-                double zmax = std::atof(kws[5].c_str()) * zscale + zofs;
-                s << "['rectangle'] = RECTANGLE( " << xmin << ", " << zmin << ", " << xmax << ", " << zmax << " ),\n";
-            }
-            else
-            {
-                s << line << '\n';
-            }
-        });
+
+
+// bring the markers of sourceFilename into targetFilename, as Scmp::Import brought in the map.  false if either is missing
+bool MergeMapSaveFile(
+    QString sourceFilename, QString targetFilename,
+    double xscale, double zscale, double xofs, double zofs, double importWidth, double importHeight, nfa::scmp::Scmp *scmp)
+{
+    if (!QFileInfo(sourceFilename).exists() || !QFileInfo(targetFilename).exists())
+    {
+        return false;
     }
 
     BackupFile(targetFilename);
-    std::ofstream ofs(targetFilename.toLatin1().data());
-    ofs << oss.str();
-}
+    nfa::scmp::MappedFile source(sourceFilename.toLatin1().data());
+    nfa::scmp::SaveLuaMarkers sourceMarkers = nfa::scmp::SaveLuaMarkers::Load(
+        source.begin(), source.end(), nfa::scmp::MarkerCacheFilename(sourceFilename.toLatin1().data()));
+    std::string cacheFilename = nfa::scmp::MarkerCacheFilename(targetFilename.toLatin1().data());
 
+    nfa::scmp::RewriteLuaFile(targetFilename.toLatin1().data(), targetFilename.toLatin1().data(),
+        [&](const char *begin, const char *end, std::ostream &os)
+    {
+        nfa::scmp::SaveLuaMarkers targetMarkers = nfa::scmp::SaveLuaMarkers::Load(begin, end, cacheFilename);
+        nfa::scmp::ApplyLuaPatches(begin, end, nfa::scmp::MergeMarkerPatches(
+            source.begin(), sourceMarkers, begin, targetMarkers,
+            xscale, zscale, xofs, zofs, importWidth, importHeight, *scmp), os);
+    });
+    return true;
+}
 
 
 void UpdateMapScenarioFile(QString sourceFilename, QString targetFilename, nfa::scmp::Scmp *scmp)
@@ -130,26 +121,44 @@ void UpdateMapScenarioFile(QString sourceFilename, QString targetFilename, nfa::
         return;
     }
 
-    std::ostringstream oss;
+    BackupFile(targetFilename);
+    nfa::scmp::RewriteLuaFile(sourceFilename.toLatin1().data(), targetFilename.toLatin1().data(),
+        [scmp](const char *begin, const char *end, std::ostream &os)
     {
-        std::ifstream ifs(sourceFilename.toLatin1().data());
+        nfa::scmp::UpdateScenarioLua(begin, end, os, *scmp);
+    });
+}
 
-        ModifyLines(ifs, oss, [scmp](std::ostream &s, std::string &line, const std::vector<std::string> &kws)
-        {
-            if (kws.size() == 3 && kws[0] == "size")
-            {
-                s << "size = { " << scmp->width << ", " << scmp->height << " },\n";
-            }
-            else
-            {
-                s << line << '\n';
-            }
-        });
+
+// runs on a worker thread, so problems are returned rather than shown.  maps come from the process wide cache, so
+// loading one again is free until it changes on disk.  the preview's height pyramid is built here too, so moving the
+// placement never has to touch the full heightmap
+LoadedScmp LoadScmpFile(const QString &fn)
+{
+    LoadedScmp loaded;
+    loaded.filename = fn;
+
+    std::ifstream ifs((const char*)fn.toLatin1().data(), std::ios::binary);
+    if (!ifs.good())
+    {
+        return loaded;
     }
 
-    BackupFile(targetFilename);
-    std::ofstream ofs(targetFilename.toLatin1().data());
-    ofs << oss.str();
+    ifs.close();
+
+    try
+    {
+        loaded.scmp = nfa::scmp::ScmpCache::Instance().Load(fn.toLatin1().data());
+        loaded.pyramid = std::make_shared<nfa::scmp::HeightPyramid>(*loaded.scmp);
+        std::ostringstream ss;
+        loaded.scmp->MapInfo(ss);
+        std::cout << ss.str();
+    }
+    catch (std::exception &e)
+    {
+        loaded.error = "Unable to parse " + fn + ":" + e.what();
+    }
+    return loaded;
 }
 
 
@@ -174,6 +183,19 @@ ScmpRescaleWindow::ScmpRescaleWindow(QWidget *parent):
         ui.sourceNewHeightComboBox->setCurrentIndex(3);
     }
 
+    m_cancelRequested = false;
+    for (QTimer *timer : { &m_sourceLoadTimer, &m_targetLoadTimer })
+    {
+        timer->setSingleShot(true);
+        timer->setInterval(400);
+    }
+    connect(&m_sourceLoadTimer, SIGNAL(timeout()), this, SLOT(startSourceLoad()));
+    connect(&m_targetLoadTimer, SIGNAL(timeout()), this, SLOT(startTargetLoad()));
+    connect(&m_sourceLoadWatcher, SIGNAL(finished()), this, SLOT(sourceLoadFinished()));
+    connect(&m_targetLoadWatcher, SIGNAL(finished()), this, SLOT(targetLoadFinished()));
+    connect(&m_jobWatcher, SIGNAL(finished()), this, SLOT(jobFinished()));
+    setBusy(false);
+
     updateSourceMapInfo();
     updateTargetMapInfo();
     updateSaveOptions();
@@ -255,15 +277,28 @@ void ScmpRescaleWindow::updatePositionSliders()
         ui.sourceVerticalBottomPositionSlider->setMaximum(m_targetScmp->height);
         ui.sourceVerticalBottomPositionSlider->setValue(ui.sourceVerticalPositionSpinBox->value() + getNewSourceHeight());
     }
+    updatePreview();
 }
 
 
-void ScmpRescaleWindow::on_goButton_clicked()
+void ScmpRescaleWindow::updatePreview()
 {
-    // user might have been fiddling with files in between selecting them and pressing go
-    m_sourceScmp = tryLoadScmp(getSourceFilename());
-    m_targetScmp = tryLoadScmp(getTargetFilename());
+    nfa::scmp::Placement placement;
+    if (isMergeModeSelected())
+    {
+        placement.column0 = getHorzPosition();
+        placement.row0 = getVertPosition();
+        placement.width = getNewSourceWidth();
+        placement.height = getNewSourceHeight();
+        placement.additive = isAdditiveMerge();
+    }
+    ui.placementPreview->setMaps(isMergeModeSelected() ? m_targetPyramid : nullptr, m_sourcePyramid);
+    ui.placementPreview->setPlacement(placement);
+}
 
+
+void ScmpRescaleWindow::on_goButton_clicked()
+{
     QFileInfo checkFile(getTargetFilename());
     if (checkFile.exists() && checkFile.isFile())
     {
@@ -276,49 +311,136 @@ void ScmpRescaleWindow::on_goButton_clicked()
         BackupFile(getTargetFilename());
     }
 
+    RescaleJob job;
+    job.sourceFilename = getSourceFilename();
+    job.targetFilename = getTargetFilename();
+    job.mergeMode = isMergeModeSelected();
+    job.additiveMerge = isAdditiveMerge();
+    job.newSourceWidth = getNewSourceWidth();
+    job.newSourceHeight = getNewSourceHeight();
+    job.horzPosition = getHorzPosition();
+    job.vertPosition = getVertPosition();
+
+    m_cancelRequested = false;
+    setBusy(true);
+    m_jobWatcher.setFuture(QtConcurrent::run(this, &ScmpRescaleWindow::runJob, job));
+}
+
+
+RescaleJobResult ScmpRescaleWindow::runJob(const RescaleJob &job)
+{
+    // each step fills its own stretch of the progress bar, from begin to end
+    auto step = [this](const QString &phase, float begin, float end) -> nfa::scmp::ProgressCallback
+    {
+        return [this, phase, begin, end](const std::string &, float fraction)
+        {
+            QMetaObject::invokeMethod(this, "setProgress", Qt::QueuedConnection,
+                Q_ARG(QString, phase), Q_ARG(int, int(100.0f * (begin + fraction * (end - begin)))));
+            return !m_cancelRequested;
+        };
+    };
+    auto startStep = [&](const QString &phase, float begin)
+    {
+        if (!step(phase, begin, begin)("", 0.0f))
+        {
+            throw nfa::scmp::Cancelled(phase.toStdString());
+        }
+    };
+    // once the .scmap is being written, the lua files must follow it
+    auto startSaving = [&]()
+    {
+        startStep("saving", 0.9f);
+        QMetaObject::invokeMethod(ui.cancelButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
+    };
+
+    RescaleJobResult result;
     try
     {
-        if (isMergeModeSelected() && m_sourceScmp && m_targetScmp)
+        // user might have been fiddling with files in between selecting them and pressing go.  both load at once
+        startStep("loading", 0.0f);
+        QFuture<LoadedScmp> targetLoad = QtConcurrent::run(LoadScmpFile, job.targetFilename);
+        LoadedScmp source = LoadScmpFile(job.sourceFilename);
+        LoadedScmp target = targetLoad.result();
+        for (const LoadedScmp *loaded : { &source, &target })
+        {
+            if (!loaded->error.isEmpty())
+            {
+                throw std::runtime_error(loaded->error.toStdString());
+            }
+        }
+        if (!source.scmp)
         {
-            double xscale = double(getNewSourceWidth()) / double(m_sourceScmp->width);
-            double zscale = double(getNewSourceHeight()) / double(m_sourceScmp->height);
-            double xofs = double(getHorzPosition());
-            double zofs = double(getVertPosition());
-            m_sourceScmp->Resize(getNewSourceWidth(), getNewSourceHeight());
-            m_targetScmp->Import(*m_sourceScmp, getHorzPosition(), getVertPosition(), isAdditiveMerge());
-            std::ofstream ofs(getTargetFilename().toLatin1().data(), std::ios::binary);
-            m_targetScmp->Save(ofs);
-
-            if (getSourceFilename() == getTargetFilename())
+            throw std::runtime_error("Unable to open " + job.sourceFilename.toStdString());
+        }
+
+        if (job.mergeMode)
+        {
+            if (!target.scmp)
+            {
+                throw std::runtime_error("Unable to open " + job.targetFilename.toStdString());
+            }
+
+            // the loaded maps are shared with the cache
+            std::shared_ptr<nfa::scmp::Scmp> sourceScmp = source.scmp->Clone();
+            std::shared_ptr<nfa::scmp::Scmp> targetScmp = target.scmp->Clone();
+
+            double xscale = double(job.newSourceWidth) / double(sourceScmp->width);
+            double zscale = double(job.newSourceHeight) / double(sourceScmp->height);
+            double xofs = double(job.horzPosition);
+            double zofs = double(job.vertPosition);
+            sourceScmp->Resize(job.newSourceWidth, job.newSourceHeight, step("resizing", 0.1f, 0.5f));
+            targetScmp->Import(*sourceScmp, job.horzPosition, job.vertPosition, job.additiveMerge, step("importing", 0.5f, 0.8f));
+            startStep("rendering preview", 0.8f);
+            targetScmp->RenderPreview();
+
+            startSaving();
+            std::ofstream ofs(job.targetFilename.toLatin1().data(), std::ios::binary);
+            targetScmp->Save(ofs);
+            ofs.close();
+
+            auto sourceFilenames = GetMapLuaFileNames(job.sourceFilename);
+            auto targetFilenames = GetMapLuaFileNames(job.targetFilename);
+            result.title = "Rescale/import";
+            if (job.sourceFilename == job.targetFilename)
+            {
+                RescaleMapSaveFile(targetFilenames["save"], targetFilenames["save"], xscale, zscale, xofs, zofs, targetScmp.get());
+                result.message = "Finished rescaling and importing .scmap and _save.lua";
+            }
+            else if (MergeMapSaveFile(sourceFilenames["save"], targetFilenames["save"], xscale, zscale, xofs, zofs,
+                job.newSourceWidth, job.newSourceHeight, targetScmp.get()))
             {
-                auto targetFilenames = GetMapLuaFileNames(getTargetFilename());
-                RescaleMapSaveFile(targetFilenames["save"], targetFilenames["save"], xscale, zscale, xofs, zofs, m_targetScmp.get());
-                QMessageBox::information(this,
-                    "Rescale/import", "Finished rescaling and importing .scmap and _save.lua", QMessageBox::Ok);
+                result.message = "Finished rescaling and importing .scmap and _save.lua markers.\n"
+                    "Markers inside the imported area were replaced by those of the imported map.\n"
+                    "Check army start positions against the armies in _scenario.lua";
             }
             else
             {
-                QMessageBox::information(this,
-                    "Rescale/import", "Finished rescaling and importing .scmap.\n"
-                    "This tool only edits the .scmap file.  Your next step is:\n"
+                result.message = "Finished rescaling and importing .scmap.\n"
+                    "No _save.lua was found beside both maps, so markers were not imported.  Your next step is:\n"
                     "- use a map editor to place markers from the imported map\n"
-                    "  (eg mexes and starting positions)", QMessageBox::Ok);
+                    "  (eg mexes and starting positions)";
             }
         }
-        else if (!isMergeModeSelected() && m_sourceScmp)
+        else
         {
-            int newWidthHeight = std::max(getNewSourceWidth(), getNewSourceHeight());
-            double xscale = double(newWidthHeight) / double(m_sourceScmp->width);
-            double zscale = double(newWidthHeight) / double(m_sourceScmp->height);
-
-            m_sourceScmp->Resize(newWidthHeight, newWidthHeight);
-            std::ofstream ofs(getTargetFilename().toLatin1().data(), std::ios::binary);
-            m_sourceScmp->Save(ofs);
-
-            auto sourceFilenames = GetMapLuaFileNames(getSourceFilename());
-            auto targetFilenames = GetMapLuaFileNames(getTargetFilename());
-            RescaleMapSaveFile(sourceFilenames["save"], targetFilenames["save"], xscale, zscale, 0.0, 0.0, m_sourceScmp.get());
-            UpdateMapScenarioFile(sourceFilenames["scenario"], targetFilenames["scenario"], m_sourceScmp.get());
+            std::shared_ptr<nfa::scmp::Scmp> sourceScmp = source.scmp->Clone();
+            int newWidthHeight = std::max(job.newSourceWidth, job.newSourceHeight);
+            double xscale = double(newWidthHeight) / double(sourceScmp->width);
+            double zscale = double(newWidthHeight) / double(sourceScmp->height);
+
+            sourceScmp->Resize(newWidthHeight, newWidthHeight, step("resizing", 0.1f, 0.8f));
+            startStep("rendering preview", 0.8f);
+            sourceScmp->RenderPreview();
+
+            startSaving();
+            std::ofstream ofs(job.targetFilename.toLatin1().data(), std::ios::binary);
+            sourceScmp->Save(ofs);
+            ofs.close();
+
+            auto sourceFilenames = GetMapLuaFileNames(job.sourceFilename);
+            auto targetFilenames = GetMapLuaFileNames(job.targetFilename);
+            RescaleMapSaveFile(sourceFilenames["save"], targetFilenames["save"], xscale, zscale, 0.0, 0.0, sourceScmp.get());
+            UpdateMapScenarioFile(sourceFilenames["scenario"], targetFilenames["scenario"], sourceScmp.get());
             if (sourceFilenames["script"] != targetFilenames["script"] && QFileInfo(sourceFilenames["script"]).exists())
             {
                 BackupFile(targetFilenames["script"]);
@@ -326,21 +448,81 @@ void ScmpRescaleWindow::on_goButton_clicked()
                 QFile::copy(sourceFilenames["script"], targetFilenames["script"]);
             }
 
-            QMessageBox::information(this, "Rescale", 
-                "Finished rescaling .scmap, _save.lua and _scenario.lua files:\n", QMessageBox::Ok);
+            result.title = "Rescale";
+            result.message = "Finished rescaling .scmap, _save.lua and _scenario.lua files:\n";
         }
-
+    }
+    catch (const nfa::scmp::Cancelled &)
+    {
+        result.title = "Cancelled";
+        result.message = "Cancelled.  No files were written";
     }
     catch (const std::exception & e)
     {
-        QMessageBox::information(this, "Error", e.what(), QMessageBox::Ok);
+        result.title = "Error";
+        result.message = e.what();
     }
+    return result;
+}
 
-    m_sourceScmp = tryLoadScmp(getSourceFilename());
-    updateSourceMapInfo();
 
-    m_targetScmp = tryLoadScmp(getTargetFilename());
-    updateTargetMapInfo();
+void ScmpRescaleWindow::jobFinished()
+{
+    RescaleJobResult result = m_jobWatcher.result();
+    setBusy(false);
+    QMessageBox::information(this, result.title, result.message, QMessageBox::Ok);
+
+    // pick up what was written
+    startSourceLoad();
+    startTargetLoad();
+}
+
+
+void ScmpRescaleWindow::on_cancelButton_clicked()
+{
+    m_cancelRequested = true;
+    ui.cancelButton->setEnabled(false);
+    ui.progressBar->setFormat("cancelling...");
+}
+
+
+void ScmpRescaleWindow::setProgress(const QString &phase, int percent)
+{
+    if (!m_cancelRequested)
+    {
+        ui.progressBar->setFormat(phase + " %p%");
+    }
+    ui.progressBar->setValue(percent);
+}
+
+
+void ScmpRescaleWindow::setBusy(bool busy)
+{
+    ui.sourceMapGroupBox->setEnabled(!busy);
+    ui.sourceResizeGroupBox->setEnabled(!busy);
+    ui.targetMapGroupBox->setEnabled(!busy);
+    ui.saveOptionsGroupBox->setEnabled(!busy);
+    ui.progressBar->setVisible(busy);
+    ui.progressBar->setValue(0);
+    ui.cancelButton->setVisible(busy);
+    ui.cancelButton->setEnabled(busy);
+    if (busy)
+    {
+        ui.goButton->setEnabled(false);
+    }
+    else
+    {
+        updateSaveOptions();
+    }
+}
+
+
+void ScmpRescaleWindow::closeEvent(QCloseEvent *event)
+{
+    // the job refers to this window, so let it stop first
+    m_cancelRequested = true;
+    m_jobWatcher.waitForFinished();
+    event->accept();
 }
 
 
@@ -362,9 +544,28 @@ void ScmpRescaleWindow::on_sourceNewHeightComboBox_currentIndexChanged(int)
 }
 
 
+void ScmpRescaleWindow::on_sourceNewWidthSpinBox_valueChanged(int)
+{
+    updatePositionSliders();
+}
+
+
+void ScmpRescaleWindow::on_sourceNewHeightSpinBox_valueChanged(int)
+{
+    updatePositionSliders();
+}
+
+
 void ScmpRescaleWindow::on_mergeModeRadioButton_toggled(bool checked)
 {
     updateSaveOptions();
+    updatePositionSliders();
+}
+
+
+void ScmpRescaleWindow::on_additiveMergeCheckBox_toggled(bool)
+{
+    updatePreview();
 }
 
 
@@ -413,35 +614,39 @@ void ScmpRescaleWindow::on_sourceMapButton_clicked()
 }
 
 
-std::shared_ptr<nfa::scmp::Scmp>  ScmpRescaleWindow::tryLoadScmp(const QString &fn)
+void ScmpRescaleWindow::on_sourceMapLineEdit_textChanged(const QString &)
 {
-    std::shared_ptr<nfa::scmp::Scmp> scmp;
+    m_sourceScmp.reset();
+    m_sourcePyramid.reset();
+    updateSourceMapInfo();
+    updatePreview();
+    updateSaveOptions();
+    m_sourceLoadTimer.start();
+}
 
-    std::ifstream ifs((const char*)fn.toLatin1().data(), std::ios::binary);
-    if (!ifs.good())
-    {
-        return scmp;
-    }
 
-    try
+void ScmpRescaleWindow::startSourceLoad()
+{
+    m_sourceLoadTimer.stop();
+    m_sourceLoadWatcher.setFuture(QtConcurrent::run(LoadScmpFile, getSourceFilename()));
+}
+
+
+void ScmpRescaleWindow::sourceLoadFinished()
+{
+    LoadedScmp loaded = m_sourceLoadWatcher.result();
+    if (loaded.filename != getSourceFilename())
     {
-        scmp.reset(new nfa::scmp::Scmp(ifs));
-        scmp->MapInfo(std::cout);
+        return;     // the text changed while loading; the timer will load the new file
     }
-    catch (std::exception &e)
+    if (!loaded.error.isEmpty())
     {
-        std::ostringstream ss;
-        ss << "Unable to parse " << fn.toStdString() << ":" << e.what();
         QMessageBox messagebox;
-        messagebox.critical(0, "Error", QString::fromStdString(ss.str()));
+        messagebox.critical(0, "Error", loaded.error);
     }
-    return scmp;
-}
-
 
-void ScmpRescaleWindow::on_sourceMapLineEdit_textChanged(const QString &fn)
-{
-    m_sourceScmp = tryLoadScmp(fn);
+    m_sourceScmp = loaded.scmp;
+    m_sourcePyramid = loaded.pyramid;
     updateSourceMapInfo();
     updatePositionSliders();
     updateSaveOptions();
@@ -460,20 +665,50 @@ void ScmpRescaleWindow::on_targetMapButton_clicked()
 }
 
 
-void ScmpRescaleWindow::on_targetMapLineEdit_textChanged(const QString &fn)
+void ScmpRescaleWindow::on_targetMapLineEdit_textChanged(const QString &)
 {
-    m_targetScmp = tryLoadScmp(fn);
+    m_targetScmp.reset();
+    m_targetPyramid.reset();
+    updateTargetMapInfo();
+    updatePreview();
+    updateSaveOptions();
+    m_targetLoadTimer.start();
+}
+
+
+void ScmpRescaleWindow::startTargetLoad()
+{
+    m_targetLoadTimer.stop();
+    m_targetLoadWatcher.setFuture(QtConcurrent::run(LoadScmpFile, getTargetFilename()));
+}
+
+
+void ScmpRescaleWindow::targetLoadFinished()
+{
+    LoadedScmp loaded = m_targetLoadWatcher.result();
+    if (loaded.filename != getTargetFilename())
+    {
+        return;
+    }
+    if (!loaded.error.isEmpty())
+    {
+        QMessageBox messagebox;
+        messagebox.critical(0, "Error", loaded.error);
+    }
+
+    m_targetScmp = loaded.scmp;
+    m_targetPyramid = loaded.pyramid;
     updateTargetMapInfo();
     updatePositionSliders();
     updateSaveOptions();
 }
 
-std::shared_ptr<nfa::scmp::Scmp> ScmpRescaleWindow::getSourceScmp()
+std::shared_ptr<const nfa::scmp::Scmp> ScmpRescaleWindow::getSourceScmp()
 {
     return m_sourceScmp;
 }
 
-std::shared_ptr<nfa::scmp::Scmp> ScmpRescaleWindow::getTargetScmp()
+std::shared_ptr<const nfa::scmp::Scmp> ScmpRescaleWindow::getTargetScmp()
 {
     return m_targetScmp;
 }
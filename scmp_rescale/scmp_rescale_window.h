@@ -1,5 +1,9 @@
 #include "ui_scmp_rescale_window.h"
 
+#include <qfuturewatcher.h>
+#include <qtimer.h>
+
+#include <atomic>
 #include <memory>
 
 namespace nfa
@@ -7,9 +11,43 @@ namespace nfa
     namespace scmp
     {
         struct Scmp;
+        class HeightPyramid;
     }
 }
 
+
+// A map loaded on a worker thread, or why it couldn't be
+struct LoadedScmp
+{
+    QString filename;
+    std::shared_ptr<const nfa::scmp::Scmp> scmp;
+    std::shared_ptr<const nfa::scmp::HeightPyramid> pyramid;    // for the placement preview
+    QString error;      // empty if the file was missing or loaded fine
+};
+
+
+// Everything a rescale/import needs from the window, copied before the work leaves the UI thread
+struct RescaleJob
+{
+    QString sourceFilename;
+    QString targetFilename;
+    bool mergeMode;
+    bool additiveMerge;
+    int newSourceWidth;
+    int newSourceHeight;
+    int horzPosition;
+    int vertPosition;
+};
+
+
+// What to tell the user once a RescaleJob is over
+struct RescaleJobResult
+{
+    QString title;
+    QString message;
+};
+
+
 class ScmpRescaleWindow : public QMainWindow
 {
     Q_OBJECT
@@ -17,8 +55,8 @@ class ScmpRescaleWindow : public QMainWindow
 public:
     ScmpRescaleWindow(QWidget *parent = 0);
 
-    std::shared_ptr<nfa::scmp::Scmp> getSourceScmp();
-    std::shared_ptr<nfa::scmp::Scmp> getTargetScmp();
+    std::shared_ptr<const nfa::scmp::Scmp> getSourceScmp();
+    std::shared_ptr<const nfa::scmp::Scmp> getTargetScmp();
     QString getSourceFilename();
     QString getTargetFilename();
     int getNewSourceWidth();
@@ -35,7 +73,10 @@ public:
     void on_targetMapLineEdit_textChanged(const QString &);
     void on_sourceNewWidthComboBox_currentIndexChanged(int);
     void on_sourceNewHeightComboBox_currentIndexChanged(int);
+    void on_sourceNewWidthSpinBox_valueChanged(int);
+    void on_sourceNewHeightSpinBox_valueChanged(int);
     void on_mergeModeRadioButton_toggled(bool);
+    void on_additiveMergeCheckBox_toggled(bool);
     void on_sourceHorizontalPositionSpinBox_valueChanged(int);
     void on_sourceHorizontalLeftPositionSlider_valueChanged(int);
     void on_sourceHorizontalRightPositionSlider_valueChanged(int);
@@ -43,17 +84,40 @@ public:
     void on_sourceVerticalTopPositionSlider_valueChanged(int);
     void on_sourceVerticalBottomPositionSlider_valueChanged(int);
     void on_goButton_clicked();
+    void on_cancelButton_clicked();
     void on_exitButton_clicked();
 
+    void startSourceLoad();
+    void startTargetLoad();
+    void sourceLoadFinished();
+    void targetLoadFinished();
+    void jobFinished();
+    void setProgress(const QString &phase, int percent);
+
+protected:
+    void closeEvent(QCloseEvent *event) override;
+
 private:
     void updateSourceMapInfo();
     void updateTargetMapInfo();
     void updateSaveOptions();
     void updatePositionSliders();
-    std::shared_ptr<nfa::scmp::Scmp> tryLoadScmp(const QString &fn);
+    void updatePreview();
+    void setBusy(bool busy);
+    RescaleJobResult runJob(const RescaleJob &job);     // on a worker thread
 
     Ui::ScmpRescaleWindow ui;
 
-    std::shared_ptr<nfa::scmp::Scmp> m_sourceScmp;
-    std::shared_ptr<nfa::scmp::Scmp> m_targetScmp;
+    std::shared_ptr<const nfa::scmp::Scmp> m_sourceScmp;
+    std::shared_ptr<const nfa::scmp::Scmp> m_targetScmp;
+    std::shared_ptr<const nfa::scmp::HeightPyramid> m_sourcePyramid;
+    std::shared_ptr<const nfa::scmp::HeightPyramid> m_targetPyramid;
+
+    // typing a filename restarts its timer, so a map is only loaded once the user pauses
+    QTimer m_sourceLoadTimer;
+    QTimer m_targetLoadTimer;
+    QFutureWatcher<LoadedScmp> m_sourceLoadWatcher;
+    QFutureWatcher<LoadedScmp> m_targetLoadWatcher;
+    QFutureWatcher<RescaleJobResult> m_jobWatcher;
+    std::atomic<bool> m_cancelRequested;
 };